@@ -0,0 +1,166 @@
+// Throughput of the ColorSpace batch conversions against calling the scalar versions per
+// pixel, in Mpx/s, plus the largest difference between the two.
+//   colorspace-bench [pixels] [rounds]
+// Numbers depend on whether the build targets SSE2, the batch paths fall back to the
+// scalar loop otherwise.
+#include <QVector>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "ColorSpace.h"
+
+namespace {
+
+volatile quint32 sink = 0; // keeps the results alive
+
+struct Inputs {
+    QVector<float> h, s, v, a, rgba, linear;
+    QVector<quint8> srgb8;
+};
+
+Inputs makeInputs(int n) {
+    Inputs in;
+    in.h.resize(n);
+    in.s.resize(n);
+    in.v.resize(n);
+    in.a.resize(n);
+    in.rgba.resize(4 * n);
+    in.linear.resize(n);
+    in.srgb8.resize(n);
+    quint32 state = 0x2545F491u; // xorshift32, same inputs every run
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state & 0xFFFFFF) / float(0xFFFFFF);
+    };
+    for (int i = 0; i < n; ++i) {
+        in.h[i] = next() * 360.0f;
+        in.s[i] = next();
+        in.v[i] = next();
+        in.a[i] = next();
+        for (int c = 0; c < 4; ++c) in.rgba[4 * i + c] = next();
+        in.linear[i] = next();
+        in.srgb8[i] = static_cast<quint8>(next() * 255.0f);
+    }
+    return in;
+}
+
+// Best of rounds, in Mpx/s
+template <typename Run>
+double throughput(int n, int rounds, Run&& run) {
+    double best = 0.0;
+    for (int r = 0; r < rounds; ++r) {
+        QElapsedTimer timer;
+        timer.start();
+        run();
+        const double seconds = timer.nsecsElapsed() / 1.0e9;
+        if (seconds > 0.0) best = std::max(best, n / seconds / 1.0e6);
+    }
+    return best;
+}
+
+int maxChannelDifference(const QVector<quint32>& x, const QVector<quint32>& y) {
+    int worst = 0;
+    for (int i = 0; i < x.size(); ++i) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            worst = std::max(worst, std::abs(int((x[i] >> shift) & 0xff) - int((y[i] >> shift) & 0xff)));
+        }
+    }
+    return worst;
+}
+
+void report(const char* what, double batch, double scalar, const char* difference) {
+    std::printf("%-28s batch %8.1f Mpx/s  scalar %8.1f Mpx/s  x%5.2f  %s\n", what, batch, scalar,
+                scalar > 0.0 ? batch / scalar : 0.0, difference);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const int n = argc > 1 ? std::max(16, std::atoi(argv[1])) : 1 << 20;
+    const int rounds = argc > 2 ? std::max(1, std::atoi(argv[2])) : 10;
+    const Inputs in = makeInputs(n);
+    char difference[64];
+
+    {
+        QVector<quint32> batch(n), scalar(n);
+        const double b = throughput(n, rounds, [&]() {
+            ColorSpace::hsvToPremultipliedRGBA8(in.h.data(), in.s.data(), in.v.data(), in.a.data(), batch.data(), n);
+        });
+        const double s = throughput(n, rounds, [&]() {
+            for (int i = 0; i < n; ++i) {
+                const float a = std::clamp(in.a[i], 0.0f, 1.0f);
+                const RGBf rgb = ColorSpace::hsvToRgb(in.h[i], in.s[i], in.v[i]);
+                scalar[i] = ColorSpace::packRGBA8({ rgb.r * a, rgb.g * a, rgb.b * a }, a);
+            }
+        });
+        sink = sink + batch[n / 2] + scalar[n / 2];
+        std::snprintf(difference, sizeof(difference), "max diff %d/255", maxChannelDifference(batch, scalar));
+        report("HSV -> premultiplied RGBA8", b, s, difference);
+    }
+    {
+        QVector<float> r(n), g(n), bl(n), r2(n), g2(n), b2(n);
+        const double b = throughput(n, rounds, [&]() {
+            ColorSpace::hsvToRgb(in.h.data(), in.s.data(), in.v.data(), r.data(), g.data(), bl.data(), n);
+        });
+        const double s = throughput(n, rounds, [&]() {
+            for (int i = 0; i < n; ++i) {
+                const RGBf rgb = ColorSpace::hsvToRgb(in.h[i], in.s[i], in.v[i]);
+                r2[i] = rgb.r;
+                g2[i] = rgb.g;
+                b2[i] = rgb.b;
+            }
+        });
+        float worst = 0.0f;
+        for (int i = 0; i < n; ++i) {
+            worst = std::max({ worst, std::abs(r[i] - r2[i]), std::abs(g[i] - g2[i]), std::abs(bl[i] - b2[i]) });
+        }
+        sink = sink + quint32(r[n / 2] * 255.0f);
+        std::snprintf(difference, sizeof(difference), "max diff %.2g", worst);
+        report("HSV -> RGB floats", b, s, difference);
+    }
+    {
+        QVector<quint32> batch(n), scalar(n);
+        const double b = throughput(n, rounds, [&]() { ColorSpace::packRGBA8(in.rgba.data(), batch.data(), n); });
+        const double s = throughput(n, rounds, [&]() {
+            for (int i = 0; i < n; ++i) {
+                const float* p = in.rgba.data() + 4 * i;
+                scalar[i] = ColorSpace::packRGBA8({ p[0], p[1], p[2] }, p[3]);
+            }
+        });
+        sink = sink + batch[n / 2] + scalar[n / 2];
+        std::snprintf(difference, sizeof(difference), "max diff %d/255", maxChannelDifference(batch, scalar));
+        report("RGBA floats -> RGBA8", b, s, difference);
+    }
+    {
+        QVector<float> batch(n), scalar(n);
+        const double b = throughput(n, rounds, [&]() { ColorSpace::srgb8ToLinear(in.srgb8.data(), batch.data(), n); });
+        const double s = throughput(n, rounds, [&]() {
+            for (int i = 0; i < n; ++i) scalar[i] = ColorSpace::srgbToLinear(in.srgb8[i] / 255.0f);
+        });
+        float worst = 0.0f;
+        for (int i = 0; i < n; ++i) worst = std::max(worst, std::abs(batch[i] - scalar[i]));
+        sink = sink + quint32(batch[n / 2] * 255.0f);
+        std::snprintf(difference, sizeof(difference), "max diff %.2g", worst);
+        report("sRGB8 -> linear (table)", b, s, difference);
+    }
+    {
+        QVector<quint8> batch(n), scalar(n);
+        const double b = throughput(n, rounds, [&]() { ColorSpace::linearToSrgb8(in.linear.data(), batch.data(), n); });
+        const double s = throughput(n, rounds, [&]() {
+            for (int i = 0; i < n; ++i) {
+                scalar[i] = static_cast<quint8>(qRound(ColorSpace::linearToSrgb(std::clamp(in.linear[i], 0.0f, 1.0f)) * 255.0f));
+            }
+        });
+        int worst = 0;
+        for (int i = 0; i < n; ++i) worst = std::max(worst, std::abs(int(batch[i]) - int(scalar[i])));
+        sink = sink + batch[n / 2];
+        std::snprintf(difference, sizeof(difference), "max diff %d/255", worst);
+        report("linear -> sRGB8 (table)", b, s, difference);
+    }
+
+    std::printf("%d px, best of %d rounds\n", n, rounds);
+    return 0;
+}
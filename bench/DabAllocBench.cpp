@@ -0,0 +1,185 @@
+// Heap allocations on the dab paths, the way they were and with the reused buffers:
+// live meshes on the tessellation worker, the live stroke's per-frame draw lists in
+// CanvasRenderer and committed strokes appended to the document's dabs.
+//   dab-alloc-bench [points] [points per mesh] [strokes]
+// Counting wraps malloc, which QVector allocates through, so it needs glibc. Elsewhere
+// only the times are printed.
+#include <QVector>
+#include <QElapsedTimer>
+#include <QtMath>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include "core/BrushEngine.h"
+#include "data/Symmetry.h"
+
+#if defined(__GLIBC__)
+#define LANCER_COUNT_ALLOCATIONS 1
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+}
+
+namespace {
+std::atomic<quint64> allocations{ 0 };
+}
+
+extern "C" {
+void* malloc(size_t size) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+void* realloc(void* p, size_t size) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+}
+
+quint64 allocationCount() { return allocations.load(std::memory_order_relaxed); }
+#else
+quint64 allocationCount() { return 0; }
+#endif
+
+namespace {
+
+QVector<StrokePoint> makeStroke(int count) {
+    QVector<StrokePoint> stroke;
+    stroke.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        StrokePoint p;
+        p.pos = QPointF(200.0 + i * 1.5 + qSin(i * 0.05) * 40.0, 300.0 + qCos(i * 0.03) * 120.0);
+        p.pressure = 0.6f;
+        p.thickness = 6.0f;
+        p.r = 0.1f;
+        p.g = 0.2f;
+        p.b = 0.3f;
+        stroke.append(p);
+    }
+    return stroke;
+}
+
+struct Run {
+    quint64 allocations = 0;
+    double ms = 0.0;
+    int steps = 0;
+};
+
+void report(const char* what, const Run& before, const Run& after) {
+    std::printf("%-34s", what);
+#ifdef LANCER_COUNT_ALLOCATIONS
+    std::printf("  allocations/step %7.2f -> %7.2f", double(before.allocations) / before.steps,
+                double(after.allocations) / after.steps);
+#endif
+    std::printf("  ms %8.2f -> %8.2f  (%d steps)\n", before.ms, after.ms, after.steps);
+}
+
+// Counts only what happens inside step, the setup around it is left out
+template <typename Step>
+void measure(Run& run, Step&& step) {
+    QElapsedTimer timer;
+    timer.start();
+    const quint64 start = allocationCount();
+    step();
+    run.allocations += allocationCount() - start;
+    run.ms += timer.nsecsElapsed() / 1.0e6;
+    run.steps++;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const int points = argc > 1 ? std::max(2, std::atoi(argv[1])) : 2000;
+    const int perMesh = argc > 2 ? std::max(1, std::atoi(argv[2])) : 4;
+    const int strokes = argc > 3 ? std::max(1, std::atoi(argv[3])) : 200;
+
+    BrushEngine engine;
+    const BrushSettings& brush = BrushEngine::preset(1); // pencil, textured
+    const QVector<StrokePoint> stroke = makeStroke(points);
+    QVector<StrokePoint> prefix;
+    prefix.reserve(points);
+
+    // Live meshes: every few points the worker regenerates the whole stroke's dabs and hands
+    // them to the GUI thread, which keeps the newest
+    Run freshMeshes, reusedMeshes;
+    {
+        QVector<Dab> held;
+        prefix.clear();
+        for (int i = 0; i < points; ++i) {
+            prefix.append(stroke[i]);
+            if (prefix.size() < 2 || i % perMesh != 0) continue;
+            measure(freshMeshes, [&]() {
+                QVector<Dab> result = engine.generateDabs(prefix, brush);
+                held = std::move(result);
+            });
+        }
+    }
+    {
+        QVector<Dab> held;
+        QVector<Dab> buffer;
+        prefix.clear();
+        for (int i = 0; i < points; ++i) {
+            prefix.append(stroke[i]);
+            if (prefix.size() < 2 || i % perMesh != 0) continue;
+            measure(reusedMeshes, [&]() {
+                buffer.clear();
+                engine.appendDabs(prefix, brush, buffer);
+                QVector<Dab> result = buffer;
+                held = std::move(result);
+            });
+        }
+    }
+    report("live mesh dabs", freshMeshes, reusedMeshes);
+
+    // Frames: the live stroke goes to the renderer as a one stroke list
+    Run freshFrames, reusedFrames;
+    const Symmetry symmetry;
+    volatile int sink = 0;
+    for (int frame = 0; frame < 1000; ++frame) {
+        measure(freshFrames, [&]() {
+            QVector<int> oneCount = { frame };
+            const QVector<Symmetry> symmetries = { symmetry };
+            sink = sink + oneCount.size() + symmetries.size();
+        });
+    }
+    QVector<int> liveCount = { 0 };
+    QVector<Symmetry> liveSymmetries = { Symmetry() };
+    for (int frame = 0; frame < 1000; ++frame) {
+        measure(reusedFrames, [&]() {
+            liveCount[0] = frame;
+            liveSymmetries[0] = symmetry;
+            sink = sink + liveCount.size() + liveSymmetries.size();
+        });
+    }
+    report("live stroke draw lists per frame", freshFrames, reusedFrames);
+
+    // Commits and rebuilds: every stroke's dabs appended to the document's buffer
+    const QVector<StrokePoint> shortStroke = makeStroke(std::min(points, 300));
+    Run freshCommits, reusedCommits;
+    {
+        QVector<Dab> all;
+        for (int i = 0; i < strokes; ++i) {
+            measure(freshCommits, [&]() {
+                QVector<Dab> strokeDabs = engine.generateDabs(shortStroke, brush);
+                all += strokeDabs;
+            });
+        }
+    }
+    {
+        QVector<Dab> all;
+        for (int i = 0; i < strokes; ++i) {
+            measure(reusedCommits, [&]() { engine.appendDabs(shortStroke, brush, all); });
+        }
+    }
+    report("committed strokes", freshCommits, reusedCommits);
+
+#ifndef LANCER_COUNT_ALLOCATIONS
+    std::printf("(allocation counts need glibc)\n");
+#endif
+    return 0;
+}
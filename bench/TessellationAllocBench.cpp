@@ -0,0 +1,233 @@
+// Heap allocations on the tessellation paths, the way they were and with the reused buffers:
+// live meshes on the tessellation worker, the sample batches the GUI thread sends it and
+// committed strokes and fills tessellated into the document's vertex mirror.
+//   tessellation-alloc-bench [points] [points per mesh] [strokes]
+// Counting wraps malloc, which QVector allocates through, so it needs glibc. Elsewhere
+// only the times are printed.
+#include <QVector>
+#include <QElapsedTimer>
+#include <QtMath>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include "core/StrokeProcessor.h"
+
+#if defined(__GLIBC__)
+#define LANCER_COUNT_ALLOCATIONS 1
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+}
+
+namespace {
+std::atomic<quint64> allocations{ 0 };
+}
+
+extern "C" {
+void* malloc(size_t size) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+void* calloc(size_t count, size_t size) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+void* realloc(void* p, size_t size) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, size);
+}
+}
+
+quint64 allocationCount() { return allocations.load(std::memory_order_relaxed); }
+#else
+quint64 allocationCount() { return 0; }
+#endif
+
+namespace {
+
+QVector<StrokePoint> makeStroke(int count) {
+    QVector<StrokePoint> stroke;
+    stroke.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        StrokePoint p;
+        p.pos = QPointF(200.0 + i * 1.5 + qSin(i * 0.05) * 40.0, 300.0 + qCos(i * 0.03) * 120.0);
+        p.pressure = 0.6f;
+        p.thickness = 6.0f;
+        p.r = 0.1f;
+        p.g = 0.2f;
+        p.b = 0.3f;
+        stroke.append(p);
+    }
+    return stroke;
+}
+
+// A fill's quads the way FloodFill::toStroke gives them, rows of 4 corner points
+QVector<StrokePoint> makeFill(int quads) {
+    QVector<StrokePoint> fill;
+    fill.reserve(quads * 4);
+    for (int i = 0; i < quads; ++i) {
+        StrokePoint p;
+        p.r = 0.8f;
+        const qreal top = i * 2.0, left = 50.0 + (i % 7) * 3.0, right = 400.0 - (i % 5) * 4.0;
+        for (const QPointF& corner : { QPointF(left, top), QPointF(right, top), QPointF(right, top + 2.0), QPointF(left, top + 2.0) }) {
+            p.pos = corner;
+            fill.append(p);
+        }
+    }
+    return fill;
+}
+
+struct Run {
+    quint64 allocations = 0;
+    double ms = 0.0;
+    int steps = 0;
+};
+
+void report(const char* what, const Run& before, const Run& after) {
+    std::printf("%-34s", what);
+#ifdef LANCER_COUNT_ALLOCATIONS
+    std::printf("  allocations/step %7.2f -> %7.2f", double(before.allocations) / before.steps,
+                double(after.allocations) / after.steps);
+#endif
+    std::printf("  ms %8.2f -> %8.2f  (%d steps)\n", before.ms, after.ms, after.steps);
+}
+
+// Counts only what happens inside step, the setup around it is left out
+template <typename Step>
+void measure(Run& run, Step&& step) {
+    QElapsedTimer timer;
+    timer.start();
+    const quint64 start = allocationCount();
+    step();
+    run.allocations += allocationCount() - start;
+    run.ms += timer.nsecsElapsed() / 1.0e6;
+    run.steps++;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const int points = argc > 1 ? std::max(2, std::atoi(argv[1])) : 2000;
+    const int perMesh = argc > 2 ? std::max(1, std::atoi(argv[2])) : 4;
+    const int strokes = argc > 3 ? std::max(1, std::atoi(argv[3])) : 200;
+
+    StrokeProcessor processor;
+    const QVector<StrokePoint> stroke = makeStroke(points);
+    QVector<StrokePoint> prefix;
+    prefix.reserve(points);
+
+    // Live meshes: every few points the worker tessellates the whole stroke and hands the
+    // mesh to the GUI thread, which keeps the newest while the worker builds the next
+    Run freshMeshes, reusedMeshes;
+    {
+        QVector<Vertex> held;
+        prefix.clear();
+        for (int i = 0; i < points; ++i) {
+            prefix.append(stroke[i]);
+            if (prefix.size() < 2 || i % perMesh != 0) continue;
+            measure(freshMeshes, [&]() {
+                QVector<Vertex> result;
+                result.reserve(processor.maxVertexCount(prefix));
+                processor.generateVertices(prefix, result);
+                held = std::move(result);
+            });
+        }
+    }
+    {
+        QVector<Vertex> held;
+        QVector<Vertex> buffers[3]; // TessellationWorker::liveBufferCount
+        int next = 0;
+        prefix.clear();
+        for (int i = 0; i < points; ++i) {
+            prefix.append(stroke[i]);
+            if (prefix.size() < 2 || i % perMesh != 0) continue;
+            measure(reusedMeshes, [&]() {
+                next = (next + 1) % 3;
+                QVector<Vertex>& buffer = buffers[next];
+                buffer.clear();
+                buffer.reserve(processor.maxVertexCount(prefix));
+                processor.generateVertices(prefix, buffer);
+                QVector<Vertex> result = buffer;
+                held = std::move(result);
+            });
+        }
+    }
+    report("live mesh vertices", freshMeshes, reusedMeshes);
+
+    // Sample batches: the points drawn since the last one go to the worker, which appends
+    // them to its copy of the stroke and, with the reused buffers, hands the batch back
+    Run freshSamples, reusedSamples;
+    {
+        QVector<StrokePoint> worker;
+        for (int queued = 0; queued < points; queued += perMesh) {
+            const QVector<StrokePoint> drawn = stroke.mid(0, std::min(points, queued + perMesh));
+            measure(freshSamples, [&]() {
+                QVector<StrokePoint> batch = drawn.mid(queued);
+                worker += batch;
+            });
+        }
+    }
+    {
+        QVector<StrokePoint> worker;
+        QVector<StrokePoint> spare;
+        for (int queued = 0; queued < points; queued += perMesh) {
+            const QVector<StrokePoint> drawn = stroke.mid(0, std::min(points, queued + perMesh));
+            measure(reusedSamples, [&]() {
+                QVector<StrokePoint> batch = std::move(spare);
+                for (int i = queued; i < drawn.size(); ++i) batch.append(drawn[i]);
+                worker += batch;
+                batch.clear();
+                spare = std::move(batch);
+            });
+        }
+    }
+    report("live sample batches", freshSamples, reusedSamples);
+
+    // Commits: every stroke's vertices appended to the document's mirror
+    const QVector<StrokePoint> shortStroke = makeStroke(std::min(points, 300));
+    Run freshCommits, reusedCommits;
+    {
+        QVector<Vertex> mirror;
+        for (int i = 0; i < strokes; ++i) {
+            measure(freshCommits, [&]() {
+                QVector<Vertex> strokeVertices = processor.generateVertices(shortStroke);
+                mirror += strokeVertices;
+            });
+        }
+    }
+    {
+        QVector<Vertex> mirror;
+        for (int i = 0; i < strokes; ++i) {
+            measure(reusedCommits, [&]() { processor.tessellate(shortStroke, EntryKind::Stroke, mirror); });
+        }
+    }
+    report("committed strokes", freshCommits, reusedCommits);
+
+    // Fills the same way
+    const QVector<StrokePoint> fill = makeFill(std::max(1, points / 4));
+    Run freshFills, reusedFills;
+    {
+        QVector<Vertex> mirror;
+        for (int i = 0; i < strokes; ++i) {
+            measure(freshFills, [&]() {
+                QVector<Vertex> fillVertices;
+                processor.generateFillVertices(fill, fillVertices);
+                mirror += fillVertices;
+            });
+        }
+    }
+    {
+        QVector<Vertex> mirror;
+        for (int i = 0; i < strokes; ++i) {
+            measure(reusedFills, [&]() { processor.tessellate(fill, EntryKind::Fill, mirror); });
+        }
+    }
+    report("committed fills", freshFills, reusedFills);
+
+#ifndef LANCER_COUNT_ALLOCATIONS
+    std::printf("(allocation counts need glibc)\n");
+#endif
+    return 0;
+}
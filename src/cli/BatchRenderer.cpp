@@ -0,0 +1,179 @@
+#include "BatchRenderer.h"
+#include "../core/StrokeRasterizer.h"
+#include "../core/VectorExporter.h"
+#include "../core/TiledCanvas.h"
+#include "../core/BrushEngine.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QImageWriter>
+
+namespace {
+
+double msSince(const QElapsedTimer& timer) {
+    return timer.nsecsElapsed() / 1.0e6;
+}
+
+} // namespace
+
+BatchRenderer::BatchRenderer(const BatchOptions& options) : options(options) {}
+
+bool BatchRenderer::formatForName(const QString& name, BatchFormat& format) {
+    const QString lower = name.toLower();
+    if (lower == "png") format = BatchFormat::Png;
+    else if (lower == "svg") format = BatchFormat::Svg;
+    else if (lower == "pdf") format = BatchFormat::Pdf;
+    else if (lower == "tif" || lower == "tiff") format = BatchFormat::Tiff;
+    else if (lower == DocumentFile::suffix) format = BatchFormat::Lancer;
+    else return false;
+    return true;
+}
+
+QString BatchRenderer::suffixFor(BatchFormat format) {
+    switch (format) {
+    case BatchFormat::Png: return "png";
+    case BatchFormat::Svg: return "svg";
+    case BatchFormat::Pdf: return "pdf";
+    case BatchFormat::Tiff: return "tif";
+    case BatchFormat::Lancer: return DocumentFile::suffix;
+    }
+    return QString();
+}
+
+QString BatchRenderer::outputPath(const QString& input) const {
+    const QFileInfo info(input);
+    const QDir dir(options.outputDir.isEmpty() ? info.absolutePath() : options.outputDir);
+    return dir.filePath(info.completeBaseName() + "." + suffixFor(options.format));
+}
+
+QImage BatchRenderer::render(const Document& document, qreal scale) {
+    const QSize pixels = (QSizeF(document.size) * scale).toSize();
+    QImage image(pixels, QImage::Format_RGB32);
+    if (image.isNull()) return image; // past what QImage can allocate, TIFF handles those
+
+    StrokeRasterizer::render(image, scale, document.layers, document.rasters, StrokeSnapshot(document.strokes));
+    return image;
+}
+
+bool BatchRenderer::writeTiff(const Document& document, qreal scale, const QString& path, BatchResult& result) const {
+    TileStoreOptions tileOptions;
+    bool ok = false;
+    const int cacheMB = qEnvironmentVariableIntValue("LANCER_TILE_CACHE_MB", &ok);
+    if (ok && cacheMB > 0) tileOptions.workingSetBytes = cacheMB * 1024ll * 1024;
+
+    TiledCanvas tiled(tileOptions);
+    if (!tiled.create(document.size, scale, document.layers)) {
+        result.error = tiled.errorString();
+        return false;
+    }
+    for (auto it = document.rasters.cbegin(); it != document.rasters.cend(); ++it) {
+        tiled.setLayerRaster(it.key(), it.value());
+    }
+    const StrokeSnapshot strokes(document.strokes);
+    const QHash<int, int> starts = BrushEngine::vectorStarts(document.strokes);
+    QVector<StrokePoint> scratch;
+    for (int i = 0; i < strokes.size(); ++i) {
+        const StrokeRecord& stroke = strokes.at(i);
+        if (!stroke.draws() || i < starts.value(stroke.layerId, 0)) continue;
+        tiled.addStroke(strokes.pointsOf(i, scratch), stroke.layerId, stroke.kind, stroke.symmetry);
+    }
+    result.pixels = tiled.pixelSize();
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        result.error = file.errorString();
+        return false;
+    }
+    if (!tiled.writeTiff(&file)) {
+        result.error = tiled.errorString();
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit()) {
+        result.error = file.errorString();
+        return false;
+    }
+    result.renderMs = tiled.getStats().rasterMs; // tiles are drawn while they're written
+    return true;
+}
+
+BatchResult BatchRenderer::process(const QString& input) const {
+    BatchResult result;
+    result.input = input;
+    result.output = outputPath(input);
+    if (QFileInfo(result.output).absoluteFilePath() == QFileInfo(input).absoluteFilePath()) {
+        result.error = "Would overwrite the input, pick another --output";
+        return result;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Document document;
+    if (!DocumentFile::load(input, document, &result.error)) return result;
+    result.loadMs = msSince(timer);
+    result.strokes = document.strokes.size();
+
+    if (options.width > 0 && document.size.width() <= 0) {
+        result.error = "Document has no width to scale from";
+        return result;
+    }
+    const qreal scale = options.width > 0 ? qreal(options.width) / document.size.width() : options.scale;
+
+    switch (options.format) {
+    case BatchFormat::Png: {
+        timer.restart();
+        const QImage image = render(document, scale);
+        result.renderMs = msSince(timer);
+        if (image.isNull()) {
+            result.error = "Too big for PNG at this scale, use TIFF";
+            return result;
+        }
+        result.pixels = image.size();
+
+        timer.restart();
+        QImageWriter writer(result.output, "png");
+        if (!writer.write(image)) {
+            result.error = writer.errorString();
+            return result;
+        }
+        result.writeMs = msSince(timer);
+        break;
+    }
+    case BatchFormat::Svg:
+    case BatchFormat::Pdf: {
+        // Vector coordinates are document pixels, the scale doesn't apply
+        timer.restart();
+        QSaveFile file(result.output);
+        if (!file.open(QIODevice::WriteOnly)) {
+            result.error = file.errorString();
+            return result;
+        }
+        VectorExporter exporter(options.format == BatchFormat::Svg ? VectorFormat::Svg : VectorFormat::Pdf);
+        if (!exporter.write(&file, document.size, document.layers, StrokeSnapshot(document.strokes))) {
+            result.error = exporter.errorString();
+            file.cancelWriting();
+            return result;
+        }
+        if (!file.commit()) {
+            result.error = file.errorString();
+            return result;
+        }
+        result.writeMs = msSince(timer); // outlines are built while they're written
+        break;
+    }
+    case BatchFormat::Tiff:
+        timer.restart();
+        if (!writeTiff(document, scale, result.output, result)) return result;
+        result.writeMs = msSince(timer) - result.renderMs;
+        break;
+    case BatchFormat::Lancer:
+        timer.restart();
+        if (!DocumentFile::save(result.output, document, &result.error)) return result;
+        result.writeMs = msSince(timer);
+        break;
+    }
+
+    result.ok = true;
+    return result;
+}
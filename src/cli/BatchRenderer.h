@@ -0,0 +1,61 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+#include <QString>
+#include <QImage>
+#include <QSize>
+#include "../core/DocumentFile.h"
+
+enum class BatchFormat {
+    Png,
+    Svg,
+    Pdf,
+    Tiff,   // tiled, out of core, for sizes a QImage can't hold
+    Lancer  // saved again, e.g. to bring an old file up to the current format
+};
+
+struct BatchOptions {
+    BatchFormat format = BatchFormat::Png;
+    qreal scale = 1.0; // output pixels per document pixel, raster formats
+    int width = 0;     // > 0: scale to this many pixels across instead
+    QString outputDir; // empty: next to the input
+};
+
+// One file's outcome, times in ms
+struct BatchResult {
+    QString input;
+    QString output;
+    bool ok = false;
+    QString error;
+    QSize pixels; // raster output size
+    int strokes = 0;
+    double loadMs = 0.0;
+    double renderMs = 0.0;
+    double writeMs = 0.0;
+};
+
+// Loads a .lancer document and writes it in another format, no widgets or GL involved.
+// process() is reentrant, one renderer serves every thread of a batch.
+class BatchRenderer {
+
+public:
+
+    explicit BatchRenderer(const BatchOptions& options);
+
+    BatchResult process(const QString& input) const;
+
+    // White background plus every visible layer, like the canvas shows it. Null if it is too big.
+    static QImage render(const Document& document, qreal scale);
+
+    static bool formatForName(const QString& name, BatchFormat& format); // png, svg, pdf, tif(f), lancer
+    static QString suffixFor(BatchFormat format);
+
+private:
+
+    QString outputPath(const QString& input) const;
+    bool writeTiff(const Document& document, qreal scale, const QString& path, BatchResult& result) const;
+
+    BatchOptions options;
+};
+
+#endif // BATCHRENDERER_H
@@ -0,0 +1,138 @@
+#include "BrushDynamics.h"
+#include <algorithm>
+#include <cmath>
+
+DynamicsCurve DynamicsCurve::linear(float from, float to) {
+    DynamicsCurve curve;
+    curve.points = { QPointF(0.0, from), QPointF(1.0, to) };
+    return curve;
+}
+
+// Fritsch-Carlson: Hermite tangents limited so the curve never overshoots between
+// two control points, a rising curve stays rising
+float DynamicsCurve::evaluate(float x) const {
+    const int n = points.size();
+    if (n == 0) return x;
+    if (n == 1 || x <= points.first().x()) return static_cast<float>(points.first().y());
+    if (x >= points.last().x()) return static_cast<float>(points.last().y());
+
+    int i = 0;
+    while (i < n - 2 && x > points[i + 1].x()) ++i;
+
+    auto slope = [this](int k) {
+        double dx = points[k + 1].x() - points[k].x();
+        return dx > 1e-9 ? (points[k + 1].y() - points[k].y()) / dx : 0.0;
+    };
+    auto tangent = [&](int k) {
+        if (k == 0) return slope(0);
+        if (k == n - 1) return slope(n - 2);
+        double a = slope(k - 1);
+        double b = slope(k);
+        if (a * b <= 0.0) return 0.0; // local extremum, flat
+        return 2.0 / (1.0 / a + 1.0 / b); // harmonic mean stays within both
+    };
+
+    const QPointF& p0 = points[i];
+    const QPointF& p1 = points[i + 1];
+    double h = p1.x() - p0.x();
+    if (h <= 1e-9) return static_cast<float>(p1.y());
+
+    double t = (x - p0.x()) / h;
+    double t2 = t * t;
+    double t3 = t2 * t;
+    double y = (2 * t3 - 3 * t2 + 1) * p0.y() + (t3 - 2 * t2 + t) * h * tangent(i)
+             + (-2 * t3 + 3 * t2) * p1.y() + (t3 - t2) * h * tangent(i + 1);
+    return static_cast<float>(std::clamp(y, 0.0, 1.0));
+}
+
+BrushDynamics::BrushDynamics() {
+    setSettings(presets().first());
+}
+
+const QVector<DynamicsSettings>& BrushDynamics::presets() {
+    static const QVector<DynamicsSettings> list = [] {
+        QVector<DynamicsSettings> result;
+
+        // What the brush always did: size follows pressure, fast mouse strokes thin out,
+        // a stylus ignores speed
+        DynamicsSettings standard;
+        standard.name = "Default";
+        standard.pressureSize = DynamicsCurve::linear();
+        standard.pressureOpacity = DynamicsCurve::linear();
+        standard.speedSize = DynamicsCurve::linear(1.0f, 0.0f);
+        result.append(standard);
+
+        DynamicsSettings soft = standard;
+        soft.name = "Soft";
+        soft.pressureSize.points = { QPointF(0.0, 0.0), QPointF(0.5, 0.2), QPointF(1.0, 1.0) };
+        soft.pressureOpacity.points = { QPointF(0.0, 0.1), QPointF(0.6, 0.4), QPointF(1.0, 1.0) };
+        soft.speedSensitivity = 0.5f;
+        result.append(soft);
+
+        DynamicsSettings firm = standard;
+        firm.name = "Firm";
+        firm.pressureSize.points = { QPointF(0.0, 0.3), QPointF(0.4, 0.85), QPointF(1.0, 1.0) };
+        firm.pressureOpacity.points = { QPointF(0.0, 0.6), QPointF(0.3, 0.9), QPointF(1.0, 1.0) };
+        firm.speedSensitivity = 0.3f;
+        result.append(firm);
+
+        // Speed never matters, mouse strokes keep one size
+        DynamicsSettings pressureOnly = standard;
+        pressureOnly.name = "Pressure only";
+        pressureOnly.speedSensitivity = 0.0f;
+        result.append(pressureOnly);
+
+        // Quick flicks taper hard, slow lines stay full
+        DynamicsSettings taper = standard;
+        taper.name = "Speed taper";
+        taper.pressureSize = DynamicsCurve::linear(0.6f, 1.0f);
+        taper.speedSize.points = { QPointF(0.0, 1.0), QPointF(0.3, 0.8), QPointF(1.0, 0.05) };
+        taper.speedSensitivity = 1.0f;
+        taper.stylusSpeed = true;
+        result.append(taper);
+
+        return result;
+    }();
+    return list;
+}
+
+void BrushDynamics::setSettings(const DynamicsSettings& value) {
+    settings = value;
+    bake(settings.pressureSize, sizeLut);
+    bake(settings.pressureOpacity, opacityLut);
+    bake(settings.speedSize, speedLut);
+}
+
+void BrushDynamics::setThicknessRange(float min, float max) {
+    settings.minThickness = std::max(0.1f, std::min(min, max));
+    settings.maxThickness = std::max(settings.minThickness, max);
+}
+
+void BrushDynamics::setSpeedSensitivity(float sensitivity) {
+    settings.speedSensitivity = std::clamp(sensitivity, 0.0f, 1.0f);
+}
+
+void BrushDynamics::bake(const DynamicsCurve& curve, Lut& lut) {
+    for (int i = 0; i < lutSize; ++i) {
+        lut[i] = curve.evaluate(static_cast<float>(i) / (lutSize - 1));
+    }
+}
+
+float BrushDynamics::lookup(const Lut& lut, float x) {
+    float f = std::clamp(x, 0.0f, 1.0f) * (lutSize - 1);
+    int i = std::min(static_cast<int>(f), lutSize - 2);
+    float t = f - i;
+    return lut[i] + (lut[i + 1] - lut[i]) * t;
+}
+
+float BrushDynamics::speedFactor(float speed) const {
+    float x = speed / settings.maxSpeed;
+    float drop = 1.0f - lookup(speedLut, x);
+    if (x > 1.0f) drop *= x;
+    return std::max(0.1f, 1.0f - settings.speedSensitivity * drop);
+}
+
+float BrushDynamics::thickness(float pressure, float speedScale) const {
+    float size = lookup(sizeLut, pressure) * speedScale;
+    return settings.minThickness + (settings.maxThickness - settings.minThickness) * size;
+}
@@ -0,0 +1,67 @@
+#ifndef BRUSHDYNAMICS_H
+#define BRUSHDYNAMICS_H
+
+#include <QVector>
+#include <QPointF>
+#include <QString>
+#include <array>
+
+// Response curve, a few control points with x and y in 0..1, sorted by x.
+// Evaluated as a monotone cubic through the points, flat past the ends.
+struct DynamicsCurve {
+    QVector<QPointF> points;
+
+    static DynamicsCurve linear(float from = 0.0f, float to = 1.0f);
+    float evaluate(float x) const; // exact, for baking and drawing, not per sample
+};
+
+struct DynamicsSettings {
+    QString name;
+    DynamicsCurve pressureSize;     // pressure -> position in the thickness range
+    DynamicsCurve pressureOpacity;  // pressure -> dab opacity, brushes with pressureOpacity only
+    DynamicsCurve speedSize;        // speed / maxSpeed -> size factor
+    float minThickness = 1.0f;
+    float maxThickness = 5.0f;
+    float speedSensitivity = 0.75f; // how much of speedSize applies, 0 ignores speed
+    float maxSpeed = 1000.0f;       // px/s at the right end of speedSize
+    bool stylusSpeed = false;       // stylus size follows speed too, otherwise a mouse-only thing
+};
+
+// Turns pressure and speed into thickness and opacity for new points. The curves are baked
+// into lookup tables whenever they change, per sample it's a table read. Points store the
+// results, so editing a curve never touches strokes that are already down.
+class BrushDynamics {
+
+public:
+
+    static constexpr int lutSize = 256;
+
+    BrushDynamics();
+
+    static const QVector<DynamicsSettings>& presets();
+
+    void setSettings(const DynamicsSettings& settings); // bakes every curve
+    const DynamicsSettings& getSettings() const { return settings; }
+    void setThicknessRange(float min, float max);
+    void setSpeedSensitivity(float sensitivity);
+
+    // Size factor for a pointer speed in px/s, never below 0.1 so fast strokes don't vanish.
+    // Past maxSpeed the drop keeps growing in proportion, like the old linear formula.
+    float speedFactor(float speed) const;
+    float thickness(float pressure, float speedScale = 1.0f) const;
+    float opacity(float pressure) const { return lookup(opacityLut, pressure); }
+
+private:
+
+    using Lut = std::array<float, lutSize>;
+
+    static void bake(const DynamicsCurve& curve, Lut& lut);
+    static float lookup(const Lut& lut, float x); // x in 0..1, linear between entries
+
+    DynamicsSettings settings;
+    Lut sizeLut;
+    Lut opacityLut;
+    Lut speedLut;
+};
+
+#endif // BRUSHDYNAMICS_H
@@ -0,0 +1,163 @@
+#include "BrushEngine.h"
+#include <cmath>
+#include <algorithm>
+
+BrushEngine::BrushEngine() {}
+
+const QVector<BrushSettings>& BrushEngine::presets() {
+    static const QVector<BrushSettings> list = [] {
+        QVector<BrushSettings> brushes;
+
+        BrushSettings solid;
+        solid.name = "Solid";
+        brushes.append(solid);
+
+        BrushSettings pencil;
+        pencil.name = "Pencil";
+        pencil.textured = true;
+        pencil.tip = BrushTip::Grain;
+        pencil.sizeScale = 1.2f;
+        pencil.spacing = 0.15f;
+        pencil.sizeJitter = 0.1f;
+        pencil.angleJitter = 3.14159f;
+        pencil.opacity = 0.6f;
+        pencil.pressureOpacity = true;
+        brushes.append(pencil);
+
+        BrushSettings airbrush;
+        airbrush.name = "Airbrush";
+        airbrush.textured = true;
+        airbrush.tip = BrushTip::Soft;
+        airbrush.sizeScale = 8.0f;
+        airbrush.spacing = 0.1f;
+        airbrush.scatter = 0.05f;
+        airbrush.opacity = 0.08f;
+        airbrush.pressureOpacity = true;
+        brushes.append(airbrush);
+
+        BrushSettings ink;
+        ink.name = "Ink";
+        ink.textured = true;
+        ink.tip = BrushTip::Flat;
+        ink.sizeScale = 2.5f;
+        ink.spacing = 0.05f;
+        ink.opacity = 1.0f;
+        ink.followDirection = true;
+        brushes.append(ink);
+
+        return brushes;
+    }();
+    return list;
+}
+
+const BrushSettings& BrushEngine::preset(int id) {
+    const auto& list = presets();
+    return (id >= 0 && id < list.size()) ? list[id] : list[0];
+}
+
+float BrushEngine::Random::next() {
+    // xorshift32
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state & 0xFFFFFF) / static_cast<float>(0x7FFFFF) - 1.0f;
+}
+
+quint32 BrushEngine::seedFor(const QVector<StrokePoint>& stroke) {
+    if (stroke.isEmpty()) return 1u;
+    // Only from where the stroke starts: the same for every live mesh as the stroke grows,
+    // across undo/redo and layer edits, and after StrokeCodec (1/16 px, like here) packs it.
+    // Rounded to an integer first, a float cast to unsigned is undefined when negative.
+    const quint64 x = static_cast<quint64>(std::llround(stroke.first().pos.x() * 16.0));
+    const quint64 y = static_cast<quint64>(std::llround(stroke.first().pos.y() * 16.0));
+    const quint64 mixed = x * 73856093ull ^ y * 19349663ull;
+    const quint32 seed = static_cast<quint32>(mixed ^ (mixed >> 32));
+    return seed ? seed : 1u;
+}
+
+QHash<int, int> BrushEngine::vectorStarts(const QVector<StrokeRecord>& strokes) {
+    QHash<int, int> starts;
+    for (int i = 0; i < strokes.size(); ++i) {
+        if (strokes[i].kind == EntryKind::Flatten) starts.insert(strokes[i].layerId, i + 1);
+    }
+    return starts;
+}
+
+QVector<Dab> BrushEngine::generateDabs(const QVector<StrokePoint>& stroke, const BrushSettings& brush) const {
+    QVector<Dab> dabs;
+    appendDabs(stroke, brush, dabs);
+    return dabs;
+}
+
+int BrushEngine::appendDabs(const QVector<StrokePoint>& stroke, const BrushSettings& brush, QVector<Dab>& dabs) const {
+    const int before = dabs.size();
+    if (!brush.textured || stroke.isEmpty()) return 0;
+
+    Random random = { seedFor(stroke) };
+
+    auto emitDab = [&](const QPointF& pos, const StrokePoint& a, const StrokePoint& b, float t, float direction) {
+        float thickness = a.thickness * (1.0f - t) + b.thickness * t;
+        float opacity = a.opacity * (1.0f - t) + b.opacity * t;
+
+        Dab dab;
+        dab.size = std::max(0.5f, thickness * brush.sizeScale * (1.0f + brush.sizeJitter * random.next()));
+        dab.x = static_cast<float>(pos.x()) + brush.scatter * dab.size * random.next();
+        dab.y = static_cast<float>(pos.y()) + brush.scatter * dab.size * random.next();
+        dab.angle = (brush.followDirection ? direction : 0.0f) + brush.angleJitter * random.next();
+        dab.r = a.r * (1.0f - t) + b.r * t;
+        dab.g = a.g * (1.0f - t) + b.g * t;
+        dab.b = a.b * (1.0f - t) + b.b * t;
+        dab.opacity = brush.opacity * (brush.pressureOpacity ? std::clamp(opacity, 0.05f, 1.0f) : 1.0f);
+        dab.tip = static_cast<float>(brush.tip);
+        dabs.append(dab);
+    };
+
+    if (stroke.size() == 1) {
+        emitDab(stroke.first().pos, stroke.first(), stroke.first(), 0.0f, 0.0f);
+        return 1;
+    }
+
+    // Rough reserve, saves most of the regrowth on long strokes. Only for a fresh buffer,
+    // reserving on every append to a long one would give up its geometric growth.
+    if (dabs.isEmpty()) dabs.reserve(stroke.size() * 4);
+
+    // Walk the polyline and drop a dab every `spacing * size` px, carrying leftover distance across segments
+    float carry = 0.0f;
+    for (int i = 0; i < stroke.size() - 1; ++i) {
+        const StrokePoint& p1 = stroke[i];
+        const StrokePoint& p2 = stroke[i + 1];
+
+        float dx = p2.pos.x() - p1.pos.x();
+        float dy = p2.pos.y() - p1.pos.y();
+        float length = std::sqrt(dx * dx + dy * dy);
+        if (length < 0.01f) continue;
+
+        float direction = std::atan2(dy, dx);
+        float travelled = carry;
+
+        while (travelled <= length) {
+            float t = travelled / length;
+            emitDab(QPointF(p1.pos.x() + dx * t, p1.pos.y() + dy * t), p1, p2, t, direction);
+
+            float size = (p1.thickness * (1.0f - t) + p2.thickness * t) * brush.sizeScale;
+            travelled += std::max(0.5f, size * brush.spacing);
+        }
+        carry = travelled - length;
+    }
+
+    return dabs.size() - before;
+}
+
+QRectF BrushEngine::padBounds(const QRectF& bounds, const QVector<StrokePoint>& stroke, const BrushSettings& brush) {
+    if (!brush.textured || bounds.isEmpty()) return bounds;
+
+    float maxThickness = 0.0f;
+    for (const StrokePoint& point : stroke) {
+        maxThickness = std::max(maxThickness, point.thickness);
+    }
+
+    // Half the largest possible dab, diagonal so rotated tips fit, plus scatter
+    float size = maxThickness * brush.sizeScale * (1.0f + brush.sizeJitter);
+    float pad = size * (0.71f + brush.scatter) + 1.0f;
+    return bounds.adjusted(-pad, -pad, pad, pad);
+}
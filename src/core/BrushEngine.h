@@ -0,0 +1,46 @@
+#ifndef BRUSHENGINE_H
+#define BRUSHENGINE_H
+
+#include <QVector>
+#include <QHash>
+#include <QRectF>
+#include "../data/StrokePoint.h"
+#include "../data/Brush.h"
+#include "../data/Dab.h"
+#include "../data/StrokeRecord.h"
+
+// Turns stroke points into a stream of dabs for textured brushes.
+// Strokes only remember which preset they were drawn with, dabs are always derived,
+// so the same stroke data works with any brush.
+class BrushEngine {
+
+public:
+
+    BrushEngine();
+
+    static const QVector<BrushSettings>& presets();
+    static const BrushSettings& preset(int id); // falls back to the solid brush
+
+    // Index of the first stroke each layer still draws as a vector, the ones before its last
+    // Flatten entry are in its raster. Layers that were never flattened aren't in it.
+    static QHash<int, int> vectorStarts(const QVector<StrokeRecord>& strokes);
+
+    QVector<Dab> generateDabs(const QVector<StrokePoint>& stroke, const BrushSettings& brush) const;
+    // Same dabs appended to out, so a buffer that's kept around doesn't allocate. Returns how many.
+    int appendDabs(const QVector<StrokePoint>& stroke, const BrushSettings& brush, QVector<Dab>& out) const;
+
+    // Dabs can be a lot wider than the solid strip, grow stroke bounds to match
+    static QRectF padBounds(const QRectF& bounds, const QVector<StrokePoint>& stroke, const BrushSettings& brush);
+
+private:
+
+    // Small deterministic RNG, seeded per stroke so jitter doesn't change on re-generation
+    struct Random {
+        quint32 state;
+        float next(); // -1..1
+    };
+
+    static quint32 seedFor(const QVector<StrokePoint>& stroke);
+};
+
+#endif // BRUSHENGINE_H
@@ -1,11 +1,15 @@
 #include "CanvasController.h"
 #include "mathUtils.h"
+#include <QDebug>
 
 
 CanvasController::CanvasController() {
     strokeProcessor = std::make_unique<StrokeProcessor>();
-    strokeRenderer = std::make_unique<StrokeRenderer>();
     strokeManager = std::make_unique<StrokeManager>();
+    strokePredictor = std::make_unique<StrokePredictor>();
+    selectionTool = std::make_unique<SelectionTool>();
+    brushEngine = std::make_unique<BrushEngine>();
+    brushDynamics = std::make_unique<BrushDynamics>();
 }
 
 void CanvasController::onMousePress(QMouseEvent* event)
@@ -16,14 +20,20 @@ void CanvasController::onMousePress(QMouseEvent* event)
 
         StrokePoint point;
         point.pos = event->pos();
-        point.r = currentColor.redF();
-        point.g = currentColor.greenF();
-        point.b = currentColor.blueF();
+        point.r = strokeColor.r;
+        point.g = strokeColor.g;
+        point.b = strokeColor.b;
         point.pressure = 0.2f;  // starting pressure
-        point.thickness = minThickness + (maxThickness - minThickness) * point.pressure;
+        point.thickness = brushDynamics->thickness(point.pressure);
+        point.opacity = brushDynamics->opacity(point.pressure);
         point.strokeTime = QTime::currentTime();
+        speedScale = point.pressure; // strokes ease in from the press
 
         currentStroke.append(point);
+
+        strokePredictor->reset();
+        predictedTail.clear();
+        updatePrediction(point.pos, point.pressure, event->timestamp());
     }
 }
 
@@ -38,30 +48,26 @@ void CanvasController::onMouseMove(QMouseEvent* event) {
             float dy = newPos.y() - lastPos.y();
             float distance = std::sqrt(dx * dx + dy * dy);
 
-            if (distance < 1.5f) return; // Skip if movement is too small
+            if (distance < 1.5f) {
+                // Too small to keep, but still useful for the predictor's velocity estimate
+                updatePrediction(newPos, currentStroke.last().pressure, event->timestamp());
+                return; // Skip if movement is too small
+            }
         }
 
-        const auto& color = currentColor;
         StrokePoint point;
         point.pos = newPos;
         point.strokeTime = QTime::currentTime();
-        point.r = color.redF();
-        point.g = color.greenF();
-        point.b = color.blueF();
-
-        if (!currentStroke.isEmpty()) {
-            const StrokePoint& lastPoint = currentStroke.last();
-            qint64 timeDelta = lastPoint.strokeTime.msecsTo(point.strokeTime);
-            point.pressure = calculatePressure(point.pos, lastPoint.pos, timeDelta, speedSensitivity);
-            // Smooth pressure changes
-            point.pressure = lastPoint.pressure * 0.25f + point.pressure * 0.75f;
-        }
-        else {
-            point.pressure = 0.25f;
-        }
-
-        point.thickness = minThickness + (maxThickness - minThickness) * point.pressure;
+        point.r = strokeColor.r;
+        point.g = strokeColor.g;
+        point.b = strokeColor.b;
+
+        // A mouse has no pressure, the speed curve stands in for it
+        point.pressure = currentStroke.isEmpty() ? 0.25f : smoothedSpeedFactor(point);
+        point.thickness = brushDynamics->thickness(point.pressure);
+        point.opacity = brushDynamics->opacity(point.pressure);
         currentStroke.append(point);
+        updatePrediction(point.pos, point.pressure, event->timestamp());
     }
 }
 
@@ -84,7 +90,10 @@ bool CanvasController::tabletEvent(QTabletEvent* event)
         float dx = newPos.x() - lastPos.x();
         float dy = newPos.y() - lastPos.y();
         float distance = std::sqrt(dx * dx + dy * dy);
-        if (distance < 1.5f) return false;
+        if (distance < 1.5f) {
+            updatePrediction(newPos, std::max(static_cast<float>(event->pressure()), 0.01f), event->timestamp());
+            return false;
+        }
     }
 
     // Add point
@@ -92,26 +101,77 @@ bool CanvasController::tabletEvent(QTabletEvent* event)
     point.pos = newPos;
     point.strokeTime = QTime::currentTime();
 
-    const auto& color = currentColor;
-    point.r = color.redF();
-    point.g = color.greenF();
-    point.b = color.blueF();
+    point.r = strokeColor.r;
+    point.g = strokeColor.g;
+    point.b = strokeColor.b;
 
     point.pressure = std::max(static_cast<float>(event->pressure()), 0.01f);
-    point.thickness = minThickness + (maxThickness - minThickness) * point.pressure;
+    point.thickness = brushDynamics->getSettings().stylusSpeed
+        ? brushDynamics->thickness(point.pressure, smoothedSpeedFactor(point))
+        : brushDynamics->thickness(point.pressure);
+    point.opacity = brushDynamics->opacity(point.pressure);
 
     currentStroke.append(point);
+    updatePrediction(point.pos, point.pressure, event->timestamp());
     event->accept();
     return true; // Drawing occurred
 }
 
 
-void CanvasController::initializeRenderer(QOpenGLBuffer* buffer) {
-    strokeRenderer->initialize(buffer);
-}
-
 void CanvasController::onMouseLift(QMouseEvent* event) {
         setDrawingToFalse();
+        predictedTail.clear();
+
+        if (strokePredictor->isMeasuring()) {
+            const PredictionStats& stats = strokePredictor->getStats();
+            qDebug() << "[Prediction] samples:" << stats.samples
+                     << "error px:" << stats.meanErrorPx
+                     << "no-prediction error px:" << stats.meanBaselinePx
+                     << "horizon ms:" << stats.horizonMs
+                     << "effective latency reduction ms:" << stats.effectiveReductionMs;
+        }
+        strokePredictor->reset();
+}
+
+float CanvasController::smoothedSpeedFactor(const StrokePoint& point) {
+    if (currentStroke.isEmpty()) return speedScale;
+
+    const StrokePoint& lastPoint = currentStroke.last();
+    float speed = calculateSpeed(point.pos, lastPoint.pos, lastPoint.strokeTime.msecsTo(point.strokeTime));
+    // No time between the samples counts as half, what the mouse always got
+    float factor = speed >= 0.0f ? brushDynamics->speedFactor(speed) : 0.5f;
+    // Smooth changes, single samples are jittery
+    speedScale = speedScale * 0.25f + factor * 0.75f;
+    return speedScale;
+}
+
+void CanvasController::updatePrediction(const QPointF& pos, float pressure, quint64 timestamp) {
+    if (!predictionEnabled && !strokePredictor->isMeasuring()) return;
+
+    strokePredictor->addSample(pos, pressure, timestamp);
+    if (currentStroke.isEmpty()) return;
+
+    // In measurement-only mode we still predict (to score it) but don't show the tail
+    QVector<StrokePoint> tail = strokePredictor->predictTail(currentStroke.last(), *brushDynamics);
+    if (predictionEnabled) {
+        predictedTail = tail;
+    }
+}
+
+const QVector<StrokePoint>& CanvasController::getPredictedTail() const {
+    return predictedTail;
+}
+
+void CanvasController::setPredictionEnabled(bool value) {
+    predictionEnabled = value;
+    if (!predictionEnabled) {
+        predictedTail.clear();
+    }
+}
+
+void CanvasController::setLatencyMeasurement(bool value) {
+    strokePredictor->setMeasuring(value);
+    strokePredictor->resetStats();
 }
 
 const QVector<StrokePoint>& CanvasController::getCurrentStroke() const {
@@ -120,6 +180,7 @@ const QVector<StrokePoint>& CanvasController::getCurrentStroke() const {
 
 void CanvasController::clearCurrentStroke() {
     currentStroke.clear();
+    predictedTail.clear();
 }
 
 void CanvasController::appendToCurrentStroke(StrokePoint& point) {
@@ -140,4 +201,5 @@ QColor CanvasController::getCurrentColor() {
 
 void CanvasController::setCurrentColor(const QColor& color) {
     currentColor = color;
+    strokeColor = ColorSpace::fromQColor(color); // converted once, not per point
 }
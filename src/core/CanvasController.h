@@ -11,6 +11,21 @@
 #include "../rendering/StrokeRenderer.h"
 #include "StrokeProcessor.h"
 #include "StrokeManager.h"
+#include "StrokePredictor.h"
+#include "SelectionTool.h"
+#include "BrushEngine.h"
+#include "BrushDynamics.h"
+#include "ColorSpaceQt.h"
+
+enum class Tool {
+    Brush,
+    Lasso,
+    RectSelect,
+    Fill,   // paint bucket
+    Blur,   // raster filter brushes, see RasterFilter
+    Smudge,
+    Sharpen
+};
 
 class CanvasController
 {
@@ -32,36 +47,71 @@ public:
     void setDrawingToFalse();
     QColor getCurrentColor();
     void setCurrentColor(const QColor& color);
+    const RGBf& getStrokeColor() const { return strokeColor; }
 
-    void initializeRenderer(QOpenGLBuffer* buffer);
+    // Motion prediction, draws a provisional tail ahead of the pen
+    const QVector<StrokePoint>& getPredictedTail() const;
+    void setPredictionEnabled(bool value);
+    bool isPredictionEnabled() const { return predictionEnabled; }
+    void setLatencyMeasurement(bool value);
 
     StrokeProcessor& getProcessor() {
         return *strokeProcessor;  // Dereference the unique_ptr
     }
 
-    StrokeRenderer& getRenderer() {
-        return *strokeRenderer;  // Dereference the unique_ptr
-    }
-
     StrokeManager& getManager() {
         return *strokeManager;  // Dereference the unique_ptr
     }
 
+    StrokePredictor& getPredictor() {
+        return *strokePredictor;  // Dereference the unique_ptr
+    }
+
+    SelectionTool& getSelection() {
+        return *selectionTool;  // Dereference the unique_ptr
+    }
+
+    BrushEngine& getBrushEngine() {
+        return *brushEngine;  // Dereference the unique_ptr
+    }
+
+    BrushDynamics& getDynamics() {
+        return *brushDynamics;  // Dereference the unique_ptr
+    }
+
+    // Preset id from BrushEngine::presets(), new strokes are tagged with it
+    int getCurrentBrush() const { return currentBrush; }
+    void setCurrentBrush(int id) { currentBrush = id; }
+    // New strokes repeat this way, see Symmetry
+    const Symmetry& getSymmetry() const { return symmetry; }
+    void setSymmetry(const Symmetry& value) { symmetry = value; }
+
+    Tool getTool() const { return currentTool; }
+    void setTool(Tool tool) { currentTool = tool; }
+
 private:
 
     std::unique_ptr<StrokeProcessor> strokeProcessor;
-    std::unique_ptr<StrokeRenderer> strokeRenderer;
     std::unique_ptr<StrokeManager> strokeManager;
+    std::unique_ptr<StrokePredictor> strokePredictor;
+    std::unique_ptr<SelectionTool> selectionTool;
+    std::unique_ptr<BrushEngine> brushEngine;
+    std::unique_ptr<BrushDynamics> brushDynamics;
+
+    void updatePrediction(const QPointF& pos, float pressure, quint64 timestamp);
+    float smoothedSpeedFactor(const StrokePoint& point); // from the distance/time to the last point
 
     bool drawing = false;             // Are we currently drawing?
 
     QVector<StrokePoint> currentStroke;
+    QVector<StrokePoint> predictedTail; // replaced every time a real sample comes in
     QColor currentColor = QColor(0, 0, 0);  // default black
-
-    // You can add thickness limits here
-    float minThickness = 1.0f;
-    float maxThickness = 5.0f;
-    float speedSensitivity = 0.75f;
+    RGBf strokeColor = { 0.0f, 0.0f, 0.0f }; // currentColor as the floats stored on points
+    bool predictionEnabled = false;
+    Tool currentTool = Tool::Brush;
+    int currentBrush = 0; // solid
+    Symmetry symmetry;
+    float speedScale = 1.0f; // last speed factor, smoothed between samples
 };
 
 #endif // CANVASCONTROLLER_H
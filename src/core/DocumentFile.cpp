@@ -0,0 +1,202 @@
+#include "DocumentFile.h"
+#include "StrokeCodec.h"
+#include <QDataStream>
+#include <QBuffer>
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+
+namespace {
+
+constexpr quint32 magic = 0x4C4E4352; // "LNCR"
+constexpr quint16 fileVersion = 3; // 2 added the entry kind, 3 filters and flattens as kinds
+// How older versions told entries apart, reserved brush ids
+constexpr qint32 oldFillBrush = -1;
+constexpr qint32 oldBlurBrush = -2;  // then the other filters in FilterType order, down to -7
+constexpr qint32 oldFlattenBrush = -8;
+constexpr QDataStream::Version streamVersion = QDataStream::Qt_6_0;
+constexpr qint32 maxSide = 1 << 16;
+constexpr qint32 maxCount = 1 << 24; // strokes or layers, anything past it is a broken file
+
+void setError(QString* error, const QString& message) {
+    if (error) *error = message;
+}
+
+} // namespace
+
+namespace DocumentFile {
+
+bool write(QIODevice* device, const Document& document, QString* error) {
+    QDataStream out(device);
+    out.setVersion(streamVersion);
+    out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    out << magic << fileVersion << qint32(document.size.width()) << qint32(document.size.height());
+
+    out << qint32(document.layers.size());
+    for (const Layer& layer : document.layers) {
+        out << qint32(layer.id) << layer.name << layer.visible << layer.opacity << quint8(layer.blendMode);
+    }
+
+    // Transforms are baked into the points already, the file keeps no history. Filters are
+    // in the rasters, but flattens say which strokes are too
+    auto stored = [](const StrokeRecord& stroke) { return stroke.kind != EntryKind::Transform; };
+    out << qint32(std::count_if(document.strokes.cbegin(), document.strokes.cend(), stored));
+    for (const StrokeRecord& stroke : document.strokes) {
+        if (!stored(stroke)) continue;
+        const Symmetry& symmetry = stroke.symmetry;
+        out << quint8(stroke.kind);
+        if (stroke.kind == EntryKind::Filter) out << quint8(stroke.filter);
+        out << qint32(stroke.layerId) << qint32(stroke.brushId)
+            << quint8(symmetry.mode) << symmetry.order << symmetry.cx << symmetry.cy << symmetry.angle
+            << (stroke.isPacked() ? stroke.packed : StrokeCodec::encode(stroke.points));
+    }
+
+    out << qint32(document.rasters.size());
+    for (auto it = document.rasters.cbegin(); it != document.rasters.cend(); ++it) {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        if (!it.value().save(&buffer, "PNG", 100)) { // 100 = fastest, the pixels are exact either way
+            setError(error, "Could not encode the raster of layer " + QString::number(it.key()));
+            return false;
+        }
+        out << qint32(it.key()) << png;
+    }
+
+    if (out.status() != QDataStream::Ok) {
+        setError(error, device->errorString());
+        return false;
+    }
+    return true;
+}
+
+bool read(QIODevice* device, Document& document, QString* error) {
+    document = Document();
+
+    QDataStream in(device);
+    in.setVersion(streamVersion);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 fileMagic = 0;
+    quint16 version = 0;
+    in >> fileMagic >> version;
+    if (fileMagic != magic) {
+        setError(error, "Not a Lancer document");
+        return false;
+    }
+    if (version > fileVersion) {
+        setError(error, "Made by a newer Lancer (format " + QString::number(version) + ")");
+        return false;
+    }
+
+    qint32 width = 0, height = 0, count = 0;
+    in >> width >> height >> count;
+    if (width <= 0 || height <= 0 || width > maxSide || height > maxSide || count < 0 || count > maxCount) {
+        setError(error, "Corrupt header");
+        return false;
+    }
+    document.size = QSize(width, height);
+
+    for (int i = 0; i < count; ++i) {
+        Layer layer;
+        qint32 id = 0;
+        quint8 blend = 0;
+        in >> id >> layer.name >> layer.visible >> layer.opacity >> blend;
+        layer.id = id;
+        layer.opacity = qBound(0.0f, layer.opacity, 1.0f);
+        layer.blendMode = blend <= quint8(BlendMode::Add) ? BlendMode(blend) : BlendMode::Normal;
+        document.layers.append(layer);
+    }
+
+    in >> count;
+    if (in.status() != QDataStream::Ok || count < 0 || count > maxCount) {
+        setError(error, "Corrupt layers");
+        return false;
+    }
+    document.strokes.reserve(count);
+    QByteArray packed;
+    for (int i = 0; i < count; ++i) {
+        StrokeRecord stroke;
+        qint32 layerId = 0, brushId = 0;
+        quint8 kind = quint8(EntryKind::Stroke), filter = 0, mode = 0;
+        Symmetry& symmetry = stroke.symmetry;
+        if (version >= 2) in >> kind;
+        if (version >= 3 && kind == quint8(EntryKind::Filter)) in >> filter;
+        in >> layerId >> brushId >> mode >> symmetry.order >> symmetry.cx >> symmetry.cy >> symmetry.angle >> packed;
+        if (version < 2 && brushId == oldFillBrush) {
+            kind = quint8(EntryKind::Fill);
+            brushId = 0;
+        }
+        else if (version < 3 && brushId <= oldBlurBrush && brushId > oldFlattenBrush) {
+            kind = quint8(EntryKind::Filter);
+            filter = quint8(oldBlurBrush - brushId);
+            brushId = 0;
+        }
+        else if (version < 3 && brushId == oldFlattenBrush) {
+            kind = quint8(EntryKind::Flatten);
+            brushId = 0;
+        }
+        const bool validKind = kind <= quint8(EntryKind::Flatten) && kind != quint8(EntryKind::Transform)
+                               && filter <= quint8(FilterType::LayerSharpen);
+        if (in.status() != QDataStream::Ok || !validKind || mode > quint8(SymmetryMode::Kaleidoscope)
+            || !StrokeCodec::decode(packed, stroke.points)) {
+            setError(error, "Corrupt stroke " + QString::number(i));
+            return false;
+        }
+        stroke.kind = EntryKind(kind);
+        stroke.filter = FilterType(filter);
+        if (stroke.kind == EntryKind::Flatten) stroke.points.clear(); // older versions kept the layer's corners
+        symmetry.mode = SymmetryMode(mode);
+        symmetry.order = qMin<quint8>(symmetry.order, Symmetry::maxOrder);
+        stroke.layerId = layerId;
+        stroke.brushId = brushId;
+        document.strokes.append(stroke);
+    }
+
+    in >> count;
+    if (in.status() != QDataStream::Ok || count < 0 || count > document.layers.size()) {
+        setError(error, "Corrupt rasters");
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        qint32 layerId = 0;
+        in >> layerId >> packed;
+        QImage raster;
+        if (in.status() != QDataStream::Ok || !raster.loadFromData(packed, "PNG")) {
+            setError(error, "Corrupt raster " + QString::number(i));
+            return false;
+        }
+        document.rasters.insert(layerId, raster.convertToFormat(QImage::Format_ARGB32_Premultiplied));
+    }
+    return true;
+}
+
+bool save(const QString& path, const Document& document, QString* error) {
+    // A failed save leaves the old file alone
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        setError(error, file.errorString());
+        return false;
+    }
+    if (!write(&file, document, error)) {
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit()) {
+        setError(error, file.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool load(const QString& path, Document& document, QString* error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        setError(error, file.errorString());
+        return false;
+    }
+    return read(&file, document, error);
+}
+
+} // namespace DocumentFile
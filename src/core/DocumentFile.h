@@ -0,0 +1,41 @@
+#ifndef DOCUMENTFILE_H
+#define DOCUMENTFILE_H
+
+#include <QVector>
+#include <QHash>
+#include <QImage>
+#include <QSize>
+#include <QString>
+#include "../data/StrokePoint.h"
+#include "../data/Layer.h"
+#include "../data/Symmetry.h"
+#include "../data/StrokeRecord.h"
+
+class QIODevice;
+
+// Everything needed to draw a document again, without the app around it.
+// Strokes are records like in StrokeManager, packed ones are written as they are.
+// Everything but transforms is stored (kind, points, layer, brush, symmetry), read ones come back unpacked.
+struct Document {
+    QSize size;
+    QVector<Layer> layers; // drawing order
+    QVector<StrokeRecord> strokes;
+    QHash<int, QImage> rasters; // layer id -> pixels under its strokes (fills, filters)
+};
+
+// .lancer files. Strokes are stored StrokeCodec packed, rasters as PNG, the rest as a
+// QDataStream in a fixed version so files stay readable across Qt versions.
+// Reference images aren't part of it, they're only something to trace over.
+namespace DocumentFile {
+
+    constexpr const char* suffix = "lancer";
+
+    bool write(QIODevice* device, const Document& document, QString* error = nullptr);
+    bool read(QIODevice* device, Document& document, QString* error = nullptr); // replaces document
+
+    bool save(const QString& path, const Document& document, QString* error = nullptr); // atomic, QSaveFile
+    bool load(const QString& path, Document& document, QString* error = nullptr);
+
+} // namespace DocumentFile
+
+#endif // DOCUMENTFILE_H
@@ -0,0 +1,303 @@
+#include "FloodFill.h"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLOODFILL_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline bool matches(QRgb pixel, QRgb target, int tolerance) {
+    return std::abs(qRed(pixel) - qRed(target)) <= tolerance
+        && std::abs(qGreen(pixel) - qGreen(target)) <= tolerance
+        && std::abs(qBlue(pixel) - qBlue(target)) <= tolerance;
+}
+
+#ifdef FLOODFILL_SSE2
+
+// -1 in the lanes of the 4 pixels at p that are within tolerance on every channel, alpha ignored
+inline __m128i matches4(const quint32* p, __m128i target, __m128i tolerance, __m128i rgb) {
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(pixels, target), _mm_subs_epu8(target, pixels));
+    __m128i over = _mm_and_si128(_mm_subs_epu8(diff, tolerance), rgb);
+    return _mm_cmpeq_epi32(over, _mm_setzero_si128());
+}
+
+// Bit i set where row[i] == value, for the 16 bytes at row
+inline int equalMask16(const quint8* row, quint8 value) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(value))));
+}
+
+#endif
+
+// First x in [x, end) with row[x] == value, or end
+int findValue(const quint8* row, int x, int end, quint8 value) {
+#ifdef FLOODFILL_SSE2
+    while (x + 16 <= end && equalMask16(row + x, value) == 0) x += 16;
+#endif
+    while (x < end && row[x] != value) ++x;
+    return x;
+}
+
+// First x in [x, end) with row[x] != value, or end
+int findOther(const quint8* row, int x, int end, quint8 value) {
+#ifdef FLOODFILL_SSE2
+    while (x + 16 <= end && equalMask16(row + x, value) == 0xffff) x += 16;
+#endif
+    while (x < end && row[x] == value) ++x;
+    return x;
+}
+
+// out[i] = in[i] | in[i - shift], in[i] where that falls outside the n bytes
+void orShifted(const quint8* in, quint8* out, qint64 n, qint64 shift) {
+    const qint64 s = std::min(std::abs(shift), n);
+    const quint8* other = shift > 0 ? in - s : in + s;
+    const qint64 first = shift > 0 ? s : 0;
+    const qint64 last = shift > 0 ? n : n - s;
+
+    std::memcpy(out, in, first);
+    qint64 i = first;
+#ifdef FLOODFILL_SSE2
+    for (; i + 16 <= last; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(other + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(a, b));
+    }
+#endif
+    for (; i < last; ++i) out[i] = in[i] | other[i];
+    std::memcpy(out + last, in + last, n - last);
+}
+
+// out[i] = 1 where in[i] == value, 0 elsewhere
+void equalTo(const quint8* in, quint8* out, qint64 n, quint8 value) {
+    qint64 i = 0;
+#ifdef FLOODFILL_SSE2
+    const __m128i values = _mm_set1_epi8(static_cast<char>(value));
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_and_si128(_mm_cmpeq_epi8(bytes, values), one));
+    }
+#endif
+    for (; i < n; ++i) out[i] = in[i] == value;
+}
+
+// Start of the run of value that ends at x (row[x - 1] and on back)
+int runStart(const quint8* row, int x, quint8 value) {
+#ifdef FLOODFILL_SSE2
+    while (x >= 16 && equalMask16(row + x - 16, value) == 0xffff) x -= 16;
+#endif
+    while (x > 0 && row[x - 1] == value) --x;
+    return x;
+}
+
+} // namespace
+
+QVector<QRect> FloodFill::fill(const QImage& image, const QPoint& seed, const FloodFillSettings& settings) {
+    QElapsedTimer timer;
+    timer.start();
+
+    width = image.width();
+    height = image.height();
+    stats.size = image.size();
+    stats.pixels = 0;
+    stats.rects = 0;
+    if (seed.x() < 0 || seed.y() < 0 || seed.x() >= width || seed.y() >= height) return {};
+
+    const qint64 count = static_cast<qint64>(width) * height;
+    open.resize(count);
+    const QRgb target = reinterpret_cast<const QRgb*>(image.constScanLine(seed.y()))[seed.x()];
+    matchColor(image, target, std::clamp(settings.tolerance, 0, 255));
+
+    // Gap closing: the fill only walks pixels at least radius away from an edge (marked 3
+    // until then), so it can't squeeze through anything narrower than twice that
+    const int radius = std::max(settings.gapClosing, 0);
+    const qint64 seedIndex = static_cast<qint64>(seed.y()) * width + seed.x();
+    bool closing = radius > 0;
+    if (closing) {
+        dilate(open, 0, radius, closed);
+        quint8* mask = open.data();
+        const quint8* near = closed.constData();
+        for (qint64 i = 0; i < count; ++i) {
+            if (near[i] && mask[i]) mask[i] = 3;
+        }
+        if (open[seedIndex] != 1) {
+            // Clicked into a spot narrower than the gaps, fill it as it is
+            std::replace(open.begin(), open.end(), static_cast<quint8>(3), static_cast<quint8>(1));
+            closing = false;
+        }
+    }
+
+    scanlineFill(seed);
+
+    const QVector<quint8>* result = &open;
+    quint8 filled = 2;
+    if (closing) {
+        // Back out to the edges, over pixels close to the color only
+        dilate(open, 2, radius, closed);
+        quint8* grown = closed.data();
+        const quint8* mask = open.constData();
+        for (qint64 i = 0; i < count; ++i) {
+            grown[i] = grown[i] && mask[i];
+        }
+        result = &closed;
+        filled = 1;
+    }
+    if (settings.grow > 0) {
+        QVector<quint8>& grown = result == &open ? closed : open;
+        dilate(*result, filled, settings.grow, grown);
+        result = &grown;
+        filled = 1;
+    }
+
+    QVector<QRect> rects = collectRects(*result, filled);
+    stats.rects = rects.size();
+    stats.fillMs = timer.nsecsElapsed() / 1.0e6;
+    return rects;
+}
+
+void FloodFill::matchColor(const QImage& image, QRgb target, int tolerance) {
+#ifdef FLOODFILL_SSE2
+    const __m128i targets = _mm_set1_epi32(static_cast<int>(target));
+    const __m128i tolerances = _mm_set1_epi8(static_cast<char>(tolerance));
+    const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+    const __m128i one = _mm_set1_epi8(1);
+#endif
+
+    for (int y = 0; y < height; ++y) {
+        const quint32* line = reinterpret_cast<const quint32*>(image.constScanLine(y));
+        quint8* out = open.data() + static_cast<qint64>(y) * width;
+        int x = 0;
+#ifdef FLOODFILL_SSE2
+        // 16 pixels to 16 mask bytes
+        for (; x + 16 <= width; x += 16) {
+            __m128i a = _mm_packs_epi32(matches4(line + x, targets, tolerances, rgb), matches4(line + x + 4, targets, tolerances, rgb));
+            __m128i b = _mm_packs_epi32(matches4(line + x + 8, targets, tolerances, rgb), matches4(line + x + 12, targets, tolerances, rgb));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_and_si128(_mm_packs_epi16(a, b), one));
+        }
+#endif
+        for (; x < width; ++x) {
+            out[x] = matches(line[x], target, tolerance) ? 1 : 0;
+        }
+    }
+}
+
+// Square neighbourhood. Each axis grows both ways in log steps, a step ORs the mask with
+// itself shifted by up to the width covered so far. Plain byte loops, they vectorize.
+void FloodFill::dilate(const QVector<quint8>& src, quint8 value, int radius, QVector<quint8>& dst) {
+    const qint64 count = static_cast<qint64>(width) * height;
+    scratch.resize(count);
+    dst.resize(count);
+
+    quint8* a = dst.data();
+    quint8* b = scratch.data();
+    equalTo(src.constData(), a, count, value);
+
+    auto step = [&](int shift, bool alongRows) {
+        if (alongRows) {
+            for (int y = 0; y < height; ++y) {
+                const qint64 row = static_cast<qint64>(y) * width;
+                orShifted(a + row, b + row, width, shift);
+            }
+        }
+        else {
+            orShifted(a, b, count, static_cast<qint64>(shift) * width);
+        }
+        std::swap(a, b);
+    };
+    for (bool alongRows : { true, false }) {
+        for (int direction : { 1, -1 }) {
+            for (int covered = 1; covered <= radius; ) {
+                const int shift = std::min(covered, radius + 1 - covered);
+                step(direction * shift, alongRows);
+                covered += shift;
+            }
+        }
+    }
+    if (a != dst.data()) std::memcpy(dst.data(), a, count);
+}
+
+// Fills the whole run a seed is in, then leaves one seed per run above and below it
+void FloodFill::scanlineFill(const QPoint& seed) {
+    seeds.clear();
+    seeds.append(seed);
+    while (!seeds.isEmpty()) {
+        const QPoint p = seeds.takeLast();
+        quint8* row = open.data() + static_cast<qint64>(p.y()) * width;
+        if (row[p.x()] != 1) continue; // filled from another seed meanwhile
+
+        const int x0 = runStart(row, p.x(), 1);
+        const int x1 = findOther(row, p.x(), width, 1);
+        std::memset(row + x0, 2, x1 - x0);
+
+        for (int y : { p.y() - 1, p.y() + 1 }) {
+            if (y < 0 || y >= height) continue;
+            const quint8* next = open.constData() + static_cast<qint64>(y) * width;
+            for (int x = findValue(next, x0, x1, 1); x < x1; x = findValue(next, x, x1, 1)) {
+                seeds.append(QPoint(x, y));
+                x = findOther(next, x, x1, 1);
+            }
+        }
+    }
+}
+
+// Runs that line up exactly with a run in the row above extend its rectangle
+QVector<QRect> FloodFill::collectRects(const QVector<quint8>& mask, quint8 value) {
+    QVector<QRect> rects;
+    QVector<QRect> active; // open downwards, left to right
+    QVector<QRect> next;
+    qint64 pixels = 0;
+
+    for (int y = 0; y < height; ++y) {
+        const quint8* row = mask.constData() + static_cast<qint64>(y) * width;
+        int i = 0;
+        for (int x = findValue(row, 0, width, value); x < width; x = findValue(row, x, width, value)) {
+            const int end = findOther(row, x, width, value);
+            pixels += end - x;
+
+            while (i < active.size() && active[i].left() < x) rects.append(active[i++]);
+            if (i < active.size() && active[i].left() == x && active[i].right() == end - 1) {
+                QRect grown = active[i++];
+                grown.setBottom(y);
+                next.append(grown);
+            }
+            else {
+                next.append(QRect(x, y, end - x, 1));
+            }
+            x = end;
+        }
+        while (i < active.size()) rects.append(active[i++]);
+        std::swap(active, next);
+        next.clear();
+    }
+    rects += active;
+
+    stats.pixels = pixels;
+    return rects;
+}
+
+QVector<StrokePoint> FloodFill::toStroke(const QVector<QRect>& rects, const RGBf& color, const QTime& time) {
+    QVector<StrokePoint> points;
+    points.reserve(rects.size() * 4);
+
+    StrokePoint point;
+    point.pressure = 1.0f;
+    point.thickness = 0.0f;
+    point.strokeTime = time;
+    point.r = color.r;
+    point.g = color.g;
+    point.b = color.b;
+    for (const QRect& rect : rects) {
+        const qreal left = rect.x(), top = rect.y();
+        const qreal right = rect.x() + rect.width(), bottom = rect.y() + rect.height();
+        for (const QPointF& corner : { QPointF(left, top), QPointF(right, top), QPointF(left, bottom), QPointF(right, bottom) }) {
+            point.pos = corner;
+            points.append(point);
+        }
+    }
+    return points;
+}
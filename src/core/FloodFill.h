@@ -0,0 +1,59 @@
+#ifndef FLOODFILL_H
+#define FLOODFILL_H
+
+#include <QVector>
+#include <QImage>
+#include <QRect>
+#include <QTime>
+#include "../data/StrokePoint.h"
+#include "ColorSpace.h"
+
+struct FloodFillSettings {
+    int tolerance = 32;  // 0-255, how far a channel may be from the clicked color
+    int gapClosing = 0;  // px, gaps in the line art up to twice this don't let the fill through
+    int grow = 1;        // px the fill spreads under the edges it stopped at, hides antialiasing seams
+};
+
+struct FloodFillStats {
+    QSize size;
+    qint64 pixels = 0;   // filled
+    int rects = 0;       // quads in the fill
+    double rasterMs = 0.0; // set by whoever rendered the image
+    double fillMs = 0.0;
+};
+
+// Paint bucket over a rendered image. Pixels close enough to the clicked color are found
+// a row at a time with SIMD compares, then a scanline fill walks them from the seed, runs
+// found 16 pixels at a time. Gap closing fills the eroded region and grows it back.
+// The result is the filled area as rectangles, row runs merged with the rows below.
+// Buffers are kept between fills.
+class FloodFill {
+
+public:
+
+    // image is Format_RGB32. Empty when seed is outside the image.
+    QVector<QRect> fill(const QImage& image, const QPoint& seed, const FloodFillSettings& settings);
+
+    // The rectangles as the points of a fill (EntryKind::Fill): 4 per rectangle,
+    // top left, top right, bottom left, bottom right. Pixel edges, so they cover whole pixels.
+    static QVector<StrokePoint> toStroke(const QVector<QRect>& rects, const RGBf& color, const QTime& time);
+
+    FloodFillStats& getStats() { return stats; }
+
+private:
+
+    void matchColor(const QImage& image, QRgb target, int tolerance); // into open
+    void dilate(const QVector<quint8>& src, quint8 value, int radius, QVector<quint8>& dst); // dst = 1 near value
+    void scanlineFill(const QPoint& seed); // open 1 -> 2 from seed
+    QVector<QRect> collectRects(const QVector<quint8>& mask, quint8 value);
+
+    int width = 0;
+    int height = 0;
+    QVector<quint8> open;    // 1 close to the clicked color, 2 once filled
+    QVector<quint8> closed;  // scratch for the morphology
+    QVector<quint8> scratch;
+    QVector<QPoint> seeds;
+    FloodFillStats stats;
+};
+
+#endif // FLOODFILL_H
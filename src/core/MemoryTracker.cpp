@@ -0,0 +1,78 @@
+#include "MemoryTracker.h"
+#include <algorithm>
+
+MemoryTracker::MemoryTracker() {}
+
+void MemoryTracker::setUsage(MemoryCategory category, qint64 cpuBytes, qint64 gpuBytes) {
+    MemoryUsage& entry = usage[static_cast<int>(category)];
+    entry.cpuBytes = std::max<qint64>(cpuBytes, 0);
+    entry.gpuBytes = std::max<qint64>(gpuBytes, 0);
+    entry.peakCpuBytes = std::max(entry.peakCpuBytes, entry.cpuBytes);
+    entry.peakGpuBytes = std::max(entry.peakGpuBytes, entry.gpuBytes);
+
+    peakCpu = std::max(peakCpu, totalCpuBytes());
+    peakGpu = std::max(peakGpu, totalGpuBytes());
+}
+
+const MemoryUsage& MemoryTracker::getUsage(MemoryCategory category) const {
+    return usage[static_cast<int>(category)];
+}
+
+qint64 MemoryTracker::totalCpuBytes() const {
+    qint64 total = 0;
+    for (const MemoryUsage& entry : usage) total += entry.cpuBytes;
+    return total;
+}
+
+qint64 MemoryTracker::totalGpuBytes() const {
+    qint64 total = 0;
+    for (const MemoryUsage& entry : usage) total += entry.gpuBytes;
+    return total;
+}
+
+void MemoryTracker::setSoftLimits(qint64 cpuBytes, qint64 gpuBytes) {
+    cpuLimit = std::max<qint64>(cpuBytes, 0);
+    gpuLimit = std::max<qint64>(gpuBytes, 0);
+}
+
+QString MemoryTracker::summary() const {
+    return QString("CPU %1 (peak %2) | GPU %3 (peak %4)")
+        .arg(formatBytes(totalCpuBytes()), formatBytes(peakCpu),
+             formatBytes(totalGpuBytes()), formatBytes(peakGpu));
+}
+
+QString MemoryTracker::details() const {
+    QString text;
+    for (int i = 0; i < static_cast<int>(MemoryCategory::Count); ++i) {
+        const MemoryUsage& entry = usage[i];
+        if (!text.isEmpty()) text += '\n';
+        text += QString("%1: CPU %2 (peak %3), GPU %4 (peak %5)")
+            .arg(categoryName(static_cast<MemoryCategory>(i)))
+            .arg(formatBytes(entry.cpuBytes), formatBytes(entry.peakCpuBytes),
+                 formatBytes(entry.gpuBytes), formatBytes(entry.peakGpuBytes));
+    }
+    return text;
+}
+
+const char* MemoryTracker::categoryName(MemoryCategory category) {
+    switch (category) {
+    case MemoryCategory::Strokes: return "Strokes";
+    case MemoryCategory::RedoHistory: return "Redo history";
+    case MemoryCategory::Vertices: return "Vertices";
+    case MemoryCategory::Dabs: return "Brush dabs";
+    case MemoryCategory::VertexBuffer: return "Vertex buffers";
+    case MemoryCategory::LiveStrokeBuffer: return "Live stroke buffers";
+    case MemoryCategory::LayerCaches: return "Layer caches";
+    case MemoryCategory::Rasters: return "Layer rasters";
+    case MemoryCategory::References: return "Reference images";
+    case MemoryCategory::Count: break;
+    }
+    return "Unknown";
+}
+
+QString MemoryTracker::formatBytes(qint64 bytes) {
+    if (bytes < 1024) return QString("%1 B").arg(bytes);
+    if (bytes < 1024 * 1024) return QString("%1 KB").arg(bytes / 1024.0, 0, 'f', 1);
+    if (bytes < 1024LL * 1024 * 1024) return QString("%1 MB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+    return QString("%1 GB").arg(bytes / (1024.0 * 1024.0 * 1024.0), 0, 'f', 2);
+}
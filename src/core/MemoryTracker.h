@@ -0,0 +1,65 @@
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <QtGlobal>
+#include <QString>
+
+enum class MemoryCategory {
+    Strokes,          // stroke points plus the per-stroke bookkeeping arrays
+    RedoHistory,      // strokes waiting in the redo list
+    Vertices,         // CPU mirror of the main VBO
+    Dabs,             // CPU dab stream for textured brushes
+    VertexBuffer,     // main VBO + dab instance buffer
+    LiveStrokeBuffer, // temp buffers for the stroke being drawn
+    LayerCaches,      // per-layer FBO textures
+    Rasters,          // layer rasters, the pixels filter strokes replaced, their textures
+    References,       // reference image mip chains, the tiles of them on the GPU
+    Count
+};
+
+struct MemoryUsage {
+    qint64 cpuBytes = 0;
+    qint64 gpuBytes = 0; // estimated from what we allocated, drivers may keep more
+    qint64 peakCpuBytes = 0;
+    qint64 peakGpuBytes = 0;
+};
+
+// Bytes per subsystem with high-water marks. Owners report their current size,
+// the tracker only adds things up and compares them against the soft limits.
+class MemoryTracker {
+
+public:
+
+    MemoryTracker();
+
+    void setUsage(MemoryCategory category, qint64 cpuBytes, qint64 gpuBytes = 0);
+    const MemoryUsage& getUsage(MemoryCategory category) const;
+
+    qint64 totalCpuBytes() const;
+    qint64 totalGpuBytes() const;
+    qint64 peakCpuBytes() const { return peakCpu; }
+    qint64 peakGpuBytes() const { return peakGpu; }
+
+    // 0 disables a limit
+    void setSoftLimits(qint64 cpuBytes, qint64 gpuBytes);
+    qint64 getCpuLimit() const { return cpuLimit; }
+    qint64 getGpuLimit() const { return gpuLimit; }
+    bool isOverCpuLimit() const { return cpuLimit > 0 && totalCpuBytes() > cpuLimit; }
+    bool isOverGpuLimit() const { return gpuLimit > 0 && totalGpuBytes() > gpuLimit; }
+
+    QString summary() const; // one line for the status bar
+    QString details() const; // one line per category, for tooltips and logs
+
+    static const char* categoryName(MemoryCategory category);
+    static QString formatBytes(qint64 bytes);
+
+private:
+
+    MemoryUsage usage[static_cast<int>(MemoryCategory::Count)];
+    qint64 peakCpu = 0;
+    qint64 peakGpu = 0;
+    qint64 cpuLimit = 0;
+    qint64 gpuLimit = 0;
+};
+
+#endif // MEMORYTRACKER_H
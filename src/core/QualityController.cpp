@@ -0,0 +1,90 @@
+#include "QualityController.h"
+#include <algorithm>
+
+namespace {
+
+constexpr double smoothing = 0.3;  // weight of the newest frame in the average
+constexpr int slowToDowngrade = 3;
+constexpr int fastToUpgrade = 60;  // about a second of comfortable frames
+constexpr int settleAfterChange = 2;
+
+const QualitySettings levels[QualityController::levelCount] = {
+    { 3, 1.0,  true,  true },  // full
+    { 2, 1.0,  false, true },  // no smoothing, fewer live pieces
+    { 1, 0.75, false, true },  // committed content at 3/4 resolution
+    { 1, 0.5,  false, false }, // half resolution, no predicted tail
+};
+
+} // namespace
+
+QualityController::QualityController() {}
+
+const QualitySettings& QualityController::levelSettings(int level) {
+    return levels[std::clamp(level, 0, levelCount - 1)];
+}
+
+void QualityController::setBudget(double ms) {
+    budgetMs = std::max(1.0, ms);
+}
+
+void QualityController::setEnabled(bool value) {
+    enabled = value;
+    if (!enabled) restore();
+}
+
+void QualityController::setLevel(int level) {
+    currentLevel = level;
+    stats.level = level;
+    slowFrames = 0;
+    fastFrames = 0;
+    settleFrames = settleAfterChange;
+    averageMs = 0.0; // the old average was measured at the old level
+}
+
+bool QualityController::frameFinished(double ms) {
+    stats.frames++;
+    stats.lastFrameMs = ms;
+    if (ms > budgetMs) stats.overBudget++;
+    if (!enabled) return false;
+
+    if (settleFrames > 0) {
+        settleFrames--;
+        return false;
+    }
+
+    averageMs = averageMs == 0.0 ? ms : averageMs + (ms - averageMs) * smoothing;
+    stats.averageMs = averageMs;
+
+    if (averageMs > budgetMs) {
+        fastFrames = 0;
+        if (++slowFrames >= slowToDowngrade && currentLevel < levelCount - 1) {
+            setLevel(currentLevel + 1);
+            stats.downgrades++;
+            return true;
+        }
+        return false;
+    }
+
+    slowFrames = 0;
+    if (averageMs < budgetMs * 0.5 && currentLevel > 0) {
+        if (++fastFrames >= fastToUpgrade
+            && levelSettings(currentLevel - 1).renderScale == settings().renderScale) {
+            setLevel(currentLevel - 1);
+            stats.upgrades++;
+            return true;
+        }
+    }
+    else {
+        fastFrames = 0;
+    }
+    return false;
+}
+
+bool QualityController::restore() {
+    slowFrames = 0;
+    fastFrames = 0;
+    if (currentLevel == 0) return false;
+    setLevel(0);
+    stats.restores++;
+    return true;
+}
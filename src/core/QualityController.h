@@ -0,0 +1,68 @@
+#ifndef QUALITYCONTROLLER_H
+#define QUALITYCONTROLLER_H
+
+#include <QtGlobal>
+
+// What a quality level trades away, cheapest last
+struct QualitySettings {
+    int interpolationSegments = 3; // live stroke only, committed strokes are always full density
+    qreal renderScale = 1.0;       // layer caches, the live stroke is still drawn at full resolution
+    bool lineSmoothing = true;     // GL_LINE_SMOOTH on the selection outlines, slow under software GL
+    bool prediction = true;        // predicted tail on the live stroke
+};
+
+struct QualityStats {
+    int level = 0;
+    double lastFrameMs = 0.0;
+    double averageMs = 0.0;     // smoothed
+    quint64 frames = 0;
+    quint64 overBudget = 0;     // frames that took longer than the budget
+    quint64 downgrades = 0;
+    quint64 upgrades = 0;       // while drawing, restores after idle not counted
+    quint64 restores = 0;
+};
+
+// Watches frame times and steps the render quality down when they stay over budget,
+// one level per few slow frames so a single expensive redraw (undo, resize) doesn't count.
+// Under half the budget for a while it steps back up, but only to levels with the same
+// render scale, changing that means re-rendering every layer cache. Going idle
+// restores full quality (see restore()), the next frame pays for the full redraw once.
+class QualityController {
+
+public:
+
+    static constexpr int levelCount = 4;
+
+    QualityController();
+
+    void setBudget(double ms);
+    double getBudget() const { return budgetMs; }
+    void setEnabled(bool enabled); // off pins full quality
+    bool isEnabled() const { return enabled; }
+
+    // Call once per rendered frame, true when the level changed
+    bool frameFinished(double ms);
+    // Back to full quality, true when that changed anything
+    bool restore();
+
+    int level() const { return currentLevel; }
+    const QualitySettings& settings() const { return levelSettings(currentLevel); }
+    static const QualitySettings& levelSettings(int level);
+
+    const QualityStats& getStats() const { return stats; }
+
+private:
+
+    void setLevel(int level);
+
+    double budgetMs = 16.0;
+    bool enabled = true;
+    int currentLevel = 0;
+    double averageMs = 0.0;
+    int slowFrames = 0;   // in a row
+    int fastFrames = 0;   // in a row, under half the budget
+    int settleFrames = 0; // ignored after a level change, the first one redraws everything
+    QualityStats stats;
+};
+
+#endif // QUALITYCONTROLLER_H
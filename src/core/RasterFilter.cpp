@@ -0,0 +1,410 @@
+#include "RasterFilter.h"
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QSemaphore>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RASTERFILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int weightBits = 14;
+
+// rect of source (which sits at origin in image coords) into out, pixels outside it repeat the edge
+void copyClamped(const QImage& source, const QPoint& origin, const QRect& rect, quint32* out, qptrdiff outStride) {
+    const int sw = source.width(), sh = source.height();
+    const int left = rect.left() - origin.x();
+    const int x0 = std::clamp(-left, 0, rect.width());               // first column inside the source
+    const int x1 = std::clamp(sw - left, x0, rect.width());          // past the last one
+    for (int y = 0; y < rect.height(); ++y) {
+        const int sy = std::clamp(rect.top() - origin.y() + y, 0, sh - 1);
+        const quint32* line = reinterpret_cast<const quint32*>(source.constScanLine(sy));
+        quint32* row = out + y * outStride;
+        std::fill(row, row + x0, line[0]);
+        if (x1 > x0) std::memcpy(row + x0, line + left + x0, (x1 - x0) * sizeof(quint32));
+        std::fill(row + x1, row + rect.width(), line[sw - 1]);
+    }
+}
+
+// out[i] = sum over k of weights[k] * in[i + k * tap], for count pixels. taps is even.
+void convolve(const quint32* in, qptrdiff tap, int count, const qint16* weights, const quint32* pairs, int taps, quint32* out) {
+#ifdef RASTERFILTER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(1 << (weightBits - 1));
+    int i = 0;
+    // 4 outputs at a time: the taps k and k + 1 of 4 neighbouring outputs are 4 neighbouring pixels each
+    for (; i + 4 <= count; i += 4) {
+        const quint32* p = in + i;
+        __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+        for (int k = 0; k < taps; k += 2) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k * tap));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + (k + 1) * tap));
+            const __m128i w = _mm_set1_epi32(static_cast<int>(pairs[k / 2]));
+            const __m128i lo = _mm_unpacklo_epi8(a, b);
+            const __m128i hi = _mm_unpackhi_epi8(a, b);
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w));
+        }
+        const __m128i first = _mm_packs_epi32(_mm_srai_epi32(acc0, weightBits), _mm_srai_epi32(acc1, weightBits));
+        const __m128i second = _mm_packs_epi32(_mm_srai_epi32(acc2, weightBits), _mm_srai_epi32(acc3, weightBits));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(first, second));
+    }
+    for (; i < count; ++i) {
+        const quint32* p = in + i;
+        __m128i acc = round;
+        for (int k = 0; k < taps; k += 2) {
+            // b0 b1 g0 g1 r0 r1 a0 a1 as 16 bit, so madd sums the two taps per channel
+            __m128i pair = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(p[k * tap])),
+                                             _mm_cvtsi32_si128(static_cast<int>(p[(k + 1) * tap])));
+            pair = _mm_unpacklo_epi8(pair, zero);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(pair, _mm_set1_epi32(static_cast<int>(pairs[k / 2]))));
+        }
+        acc = _mm_srai_epi32(acc, weightBits);
+        acc = _mm_packs_epi32(acc, acc);
+        out[i] = static_cast<quint32>(_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc)));
+    }
+#else
+    Q_UNUSED(pairs);
+    for (int i = 0; i < count; ++i) {
+        const quint32* p = in + i;
+        int acc[4] = { 1 << (weightBits - 1), 1 << (weightBits - 1), 1 << (weightBits - 1), 1 << (weightBits - 1) };
+        for (int k = 0; k < taps; ++k) {
+            const quint32 px = p[k * tap];
+            for (int c = 0; c < 4; ++c) acc[c] += weights[k] * static_cast<int>((px >> (8 * c)) & 0xff);
+        }
+        quint32 result = 0;
+        for (int c = 0; c < 4; ++c) result |= static_cast<quint32>(std::min(acc[c] >> weightBits, 255)) << (8 * c);
+        out[i] = result;
+    }
+#endif
+}
+
+// out = orig + amount / 32 * (orig - blurred), colors kept at or below alpha
+void unsharp(const quint32* orig, const quint32* blurred, int count, int amount, quint32* out) {
+    int i = 0;
+#ifdef RASTERFILTER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i scale = _mm_set1_epi16(static_cast<short>(amount));
+    for (; i + 4 <= count; i += 4) {
+        const __m128i o = _mm_loadu_si128(reinterpret_cast<const __m128i*>(orig + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blurred + i));
+        __m128i lo = _mm_unpacklo_epi8(o, zero);
+        __m128i hi = _mm_unpackhi_epi8(o, zero);
+        lo = _mm_add_epi16(lo, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(lo, _mm_unpacklo_epi8(b, zero)), scale), 5));
+        hi = _mm_add_epi16(hi, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(hi, _mm_unpackhi_epi8(b, zero)), scale), 5));
+        __m128i result = _mm_packus_epi16(lo, hi);
+
+        __m128i alpha = _mm_srli_epi32(result, 24);
+        alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 8));
+        alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_min_epu8(result, alpha));
+    }
+#endif
+    for (; i < count; ++i) {
+        int channels[4];
+        for (int c = 0; c < 4; ++c) {
+            const int o = (orig[i] >> (8 * c)) & 0xff;
+            const int b = (blurred[i] >> (8 * c)) & 0xff;
+            channels[c] = std::clamp(o + (((o - b) * amount) >> 5), 0, 255);
+        }
+        quint32 result = static_cast<quint32>(channels[3]) << 24;
+        for (int c = 0; c < 3; ++c) result |= static_cast<quint32>(std::min(channels[c], channels[3])) << (8 * c);
+        out[i] = result;
+    }
+}
+
+// dst moves towards src by mask * strength / 128, both 0-128
+void blendRow(quint32* dst, const quint32* src, const quint8* mask, int strength, int count) {
+    int i = 0;
+#ifdef RASTERFILTER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 2 <= count; i += 2) {
+        const short m0 = static_cast<short>((mask[i] * strength) >> 7);
+        const short m1 = static_cast<short>((mask[i + 1] * strength) >> 7);
+        if ((m0 | m1) == 0) continue;
+        const __m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(dst + i)), zero);
+        const __m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)), zero);
+        const __m128i m = _mm_set_epi16(m1, m1, m1, m1, m0, m0, m0, m0);
+        const __m128i result = _mm_add_epi16(d, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(s, d), m), 7));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(result, result));
+    }
+#endif
+    for (; i < count; ++i) {
+        const int m = (mask[i] * strength) >> 7;
+        if (m == 0) continue;
+        quint32 result = 0;
+        for (int c = 0; c < 4; ++c) {
+            const int d = (dst[i] >> (8 * c)) & 0xff;
+            const int s = (src[i] >> (8 * c)) & 0xff;
+            result |= static_cast<quint32>(d + (((s - d) * m) >> 7)) << (8 * c);
+        }
+        dst[i] = result;
+    }
+}
+
+} // namespace
+
+RasterFilter::Kernel RasterFilter::makeKernel(float radius, FilterKernel type) {
+    Kernel kernel;
+    const int total = 1 << weightBits;
+    radius = std::clamp(radius, 0.0f, 250.0f); // past that the weights round away to nothing
+    QVector<double> shape;
+    if (type == FilterKernel::Box) {
+        kernel.radius = std::max(1, qRound(radius));
+        shape.fill(1.0, 2 * kernel.radius + 1);
+    }
+    else {
+        // Reaches out to 3 sigma
+        kernel.radius = std::max(1, static_cast<int>(std::ceil(radius)));
+        const double sigma = std::max(radius / 3.0, 0.3);
+        for (int k = -kernel.radius; k <= kernel.radius; ++k) {
+            shape.append(std::exp(-k * k / (2.0 * sigma * sigma)));
+        }
+    }
+
+    double sum = 0.0;
+    for (double w : shape) sum += w;
+    int assigned = 0;
+    kernel.weights.resize(2 * kernel.radius + 2);
+    for (int k = 0; k < shape.size(); ++k) {
+        kernel.weights[k] = static_cast<qint16>(std::lround(shape[k] / sum * total));
+        assigned += kernel.weights[k];
+    }
+    kernel.weights[kernel.radius] += total - assigned; // rounding, so flat areas stay exactly flat
+    kernel.weights.last() = 0;
+
+    for (int k = 0; k < kernel.weights.size(); k += 2) {
+        kernel.pairs.append((static_cast<quint32>(static_cast<quint16>(kernel.weights[k + 1])) << 16)
+                            | static_cast<quint16>(kernel.weights[k]));
+    }
+    return kernel;
+}
+
+// tile (image coords) of the filtered source into out. The source is read with the kernel margin
+// around the tile, horizontal pass over all of those rows, then the vertical pass.
+void RasterFilter::filterTile(const QImage& source, const QPoint& origin, const QRect& tile, const Kernel& kernel,
+                              int sharpen, quint32* out, qptrdiff outStride) {
+    thread_local QVector<quint32> padded;
+    thread_local QVector<quint32> horizontal;
+    thread_local QVector<quint32> row;
+
+    const int r = kernel.radius;
+    const int taps = kernel.weights.size();
+    const int tw = tile.width(), th = tile.height();
+    const int pw = tw + taps - 1, ph = th + taps - 1;
+    padded.resize(pw * ph);
+    horizontal.resize(tw * ph);
+    row.resize(tw);
+
+    copyClamped(source, origin, QRect(tile.left() - r, tile.top() - r, pw, ph), padded.data(), pw);
+    for (int y = 0; y < ph; ++y) {
+        convolve(padded.constData() + y * pw, 1, tw, kernel.weights.constData(), kernel.pairs.constData(), taps,
+                 horizontal.data() + y * tw);
+    }
+    for (int y = 0; y < th; ++y) {
+        quint32* target = out + y * outStride;
+        if (sharpen > 0) {
+            convolve(horizontal.constData() + y * tw, tw, tw, kernel.weights.constData(), kernel.pairs.constData(), taps, row.data());
+            unsharp(padded.constData() + (y + r) * pw + r, row.constData(), tw, sharpen, target);
+        }
+        else {
+            convolve(horizontal.constData() + y * tw, tw, tw, kernel.weights.constData(), kernel.pairs.constData(), taps, target);
+        }
+    }
+}
+
+void RasterFilter::filterRegion(QImage& image, const QRect& region, const Kernel& kernel, int sharpen) {
+    QElapsedTimer timer;
+    timer.start();
+
+    const QRect area = region.intersected(image.rect());
+    stats.tiles = 0;
+    stats.threads = 0;
+    stats.pixels = 0;
+    if (area.isEmpty() || image.format() != QImage::Format_ARGB32_Premultiplied) return;
+
+    // Tiles read the unfiltered pixels, including their neighbours' margins
+    const int margin = kernel.radius + 1;
+    const QRect sourceRect = area.adjusted(-margin, -margin, margin, margin).intersected(image.rect());
+    const QImage source = image.copy(sourceRect);
+    quint32* bits = reinterpret_cast<quint32*>(image.bits()); // detaches here, not on the pool
+    const qptrdiff stride = image.bytesPerLine() / 4;
+
+    QVector<QRect> tiles;
+    for (int y = area.top(); y <= area.bottom(); y += tileSize) {
+        for (int x = area.left(); x <= area.right(); x += tileSize) {
+            tiles.append(QRect(x, y, std::min(tileSize, area.right() + 1 - x), std::min(tileSize, area.bottom() + 1 - y)));
+        }
+    }
+
+    std::atomic<int> next{ 0 };
+    auto work = [&]() {
+        for (int i = next++; i < tiles.size(); i = next++) {
+            const QRect& tile = tiles[i];
+            filterTile(source, sourceRect.topLeft(), tile, kernel, sharpen, bits + tile.top() * stride + tile.left(), stride);
+        }
+    };
+
+    // Only threads that are free right now, the caller does the rest itself
+    QThreadPool* pool = QThreadPool::globalInstance();
+    QSemaphore done;
+    int helpers = 0;
+    const int wanted = std::min<int>(tiles.size() - 1, pool->maxThreadCount());
+    while (helpers < wanted && pool->tryStart([&work, &done]() { work(); done.release(); })) {
+        ++helpers;
+    }
+    work();
+    done.acquire(helpers);
+
+    stats.tiles = tiles.size();
+    stats.threads = helpers + 1;
+    stats.pixels = static_cast<qint64>(area.width()) * area.height();
+    stats.ms = timer.nsecsElapsed() / 1.0e6;
+}
+
+void RasterFilter::blur(QImage& image, const QRect& region, float radius, FilterKernel kernel) {
+    filterRegion(image, region, makeKernel(radius, kernel), 0);
+}
+
+void RasterFilter::sharpen(QImage& image, const QRect& region, float radius, float amount) {
+    const int scaled = std::clamp(qRound(amount * 32.0f), 0, 127); // 5 fractional bits, see unsharp
+    if (scaled == 0) return;
+    filterRegion(image, region, makeKernel(radius, FilterKernel::Gaussian), scaled);
+}
+
+void RasterFilter::beginStroke(FilterType type) {
+    brush = type;
+    started = false;
+    patch.clear();
+    travelled = 0.0;
+    stats.dabs = 0;
+    stats.dabMs = 0.0;
+}
+
+// Same dab for every point of a stroke, sized by its first point
+void RasterFilter::setupDab(float radius) {
+    dabRadius = std::clamp(qRound(radius), 1, 500);
+    const int side = 2 * dabRadius + 1;
+    const double reach = (dabRadius + 0.5) * (dabRadius + 0.5);
+    dabMask.resize(side * side);
+    for (int y = 0; y < side; ++y) {
+        for (int x = 0; x < side; ++x) {
+            const double dx = x - dabRadius, dy = y - dabRadius;
+            const double falloff = 1.0 - (dx * dx + dy * dy) / reach;
+            dabMask[y * side + x] = static_cast<quint8>(falloff > 0.0 ? std::lround(falloff * 128.0) : 0);
+        }
+    }
+
+    // Small kernels, the dabs overlap a lot so the effect builds up along the stroke
+    dabSharpen = 0;
+    if (brush == FilterType::Sharpen) {
+        dabKernel = makeKernel(std::clamp(dabRadius * 0.15f, 1.0f, 6.0f), FilterKernel::Gaussian);
+        dabSharpen = 24;
+    }
+    else {
+        dabKernel = makeKernel(std::clamp(dabRadius * 0.3f, 1.0f, 12.0f), FilterKernel::Gaussian);
+    }
+}
+
+QRect RasterFilter::dab(QImage& image, const QPointF& pos, float strength) {
+    const QPoint center = pos.toPoint();
+    const int side = 2 * dabRadius + 1;
+    const QRect square(center.x() - dabRadius, center.y() - dabRadius, side, side);
+    const QRect area = square.intersected(image.rect());
+    if (area.isEmpty()) return QRect();
+    stats.dabs++;
+
+    const quint32* source = nullptr;
+    if (brush == FilterType::Smudge) {
+        if (patch.isEmpty()) {
+            // First dab only picks the paint up
+            patch.resize(side * side);
+            copyClamped(image, QPoint(0, 0), square, patch.data(), side);
+            return QRect();
+        }
+        source = patch.constData();
+    }
+    else {
+        filtered.resize(side * side);
+        filterTile(image, QPoint(0, 0), square, dabKernel, dabSharpen, filtered.data(), side);
+        source = filtered.constData();
+    }
+
+    const int amount = std::clamp(qRound(strength * 128.0f), 0, 128);
+    const int offset = (area.top() - square.top()) * side + area.left() - square.left();
+    for (int y = 0; y < area.height(); ++y) {
+        quint32* row = reinterpret_cast<quint32*>(image.scanLine(area.top() + y)) + area.left();
+        blendRow(row, source + offset + y * side, dabMask.constData() + offset + y * side, amount, area.width());
+    }
+
+    // Smudge carries what is under this dab now on to the next one
+    if (brush == FilterType::Smudge) {
+        copyClamped(image, QPoint(0, 0), square, patch.data(), side);
+    }
+    return area;
+}
+
+QRect RasterFilter::addPoints(QImage& image, const QVector<StrokePoint>& stroke, int first) {
+    QElapsedTimer timer;
+    timer.start();
+    QRect dirty;
+    if (image.format() != QImage::Format_ARGB32_Premultiplied) return dirty;
+
+    for (int i = std::max(first, 0); i < stroke.size(); ++i) {
+        const StrokePoint& point = stroke[i];
+        const float strength = std::clamp(point.pressure, 0.0f, 1.0f);
+        if (!started || i == 0) {
+            started = true;
+            setupDab(point.thickness);
+            travelled = 0.0;
+            dirty |= dab(image, point.pos, strength);
+            continue;
+        }
+
+        // Dabs a quarter radius apart, carried over from segment to segment
+        const qreal spacing = std::max(1.0, dabRadius * 0.25);
+        const QPointF from = stroke[i - 1].pos;
+        const QPointF delta = point.pos - from;
+        const qreal length = std::hypot(delta.x(), delta.y());
+        qreal along = spacing - travelled;
+        for (; along <= length; along += spacing) {
+            dirty |= dab(image, from + delta * (along / length), strength);
+        }
+        travelled = length - (along - spacing);
+    }
+
+    stats.dabMs += timer.nsecsElapsed() / 1.0e6;
+    return dirty;
+}
+
+QRect RasterFilter::applyStroke(QImage& image, const QVector<StrokePoint>& stroke, FilterType type) {
+    if (stroke.isEmpty()) return QRect();
+
+    // Whole-layer filters keep their radius and strength in the first point
+    const StrokePoint& settings = stroke.first();
+    switch (type) {
+    case FilterType::LayerGaussian:
+        blur(image, image.rect(), settings.thickness, FilterKernel::Gaussian);
+        return image.rect();
+    case FilterType::LayerBox:
+        blur(image, image.rect(), settings.thickness, FilterKernel::Box);
+        return image.rect();
+    case FilterType::LayerSharpen:
+        sharpen(image, image.rect(), settings.thickness, settings.pressure * 4.0f);
+        return image.rect();
+    case FilterType::Blur:
+    case FilterType::Smudge:
+    case FilterType::Sharpen:
+        break;
+    }
+    beginStroke(type);
+    return addPoints(image, stroke, 0);
+}
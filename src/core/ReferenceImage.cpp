@@ -0,0 +1,159 @@
+#include "ReferenceImage.h"
+#include <QImageReader>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QThread>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define REFERENCEIMAGE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#ifdef REFERENCEIMAGE_SSE2
+// 4 pixels of two rows -> their 2 averages, 16 bit lanes, rounded like the scalar path
+inline __m128i average2x2(__m128i top, __m128i bottom) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+    const __m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+    const __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+#endif
+
+inline quint32 average4(quint32 a, quint32 b, quint32 c, quint32 d) {
+    quint32 out = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const quint32 sum = ((a >> shift) & 0xff) + ((b >> shift) & 0xff) + ((c >> shift) & 0xff) + ((d >> shift) & 0xff);
+        out |= ((sum + 2) >> 2) << shift;
+    }
+    return out;
+}
+
+} // namespace
+
+std::shared_ptr<const ReferenceImage> ReferenceImage::load(const QString& path, int maxSide, QString* error) {
+    QElapsedTimer timer;
+    timer.start();
+
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    const QSize source = reader.size();
+    if (maxSide > 0 && source.isValid() && (source.width() > maxSide || source.height() > maxSide)) {
+        // JPEG scales while decoding, the rest decode whole and get scaled down after
+        reader.setScaledSize(source.scaled(maxSide, maxSide, Qt::KeepAspectRatio));
+    }
+
+    QImage image;
+    if (!reader.read(&image)) {
+        if (error) *error = reader.errorString();
+        return nullptr;
+    }
+    image.convertTo(QImage::Format_ARGB32_Premultiplied);
+
+    auto reference = std::make_shared<ReferenceImage>();
+    reference->stats.sourceSize = source.isValid() ? source : image.size();
+    reference->stats.decodeMs = timer.nsecsElapsed() / 1.0e6;
+    reference->levels.append(image);
+
+    timer.restart();
+    reference->buildMips();
+    reference->stats.mipMs = timer.nsecsElapsed() / 1.0e6;
+
+#ifdef QT_DEBUG
+    qDebug() << "Reference" << path << reference->stats.sourceSize << "->" << image.size() << ","
+             << reference->levelCount() << "levels, decode" << reference->stats.decodeMs << "ms, mips" << reference->stats.mipMs << "ms";
+#endif
+    return reference;
+}
+
+void ReferenceImage::buildMips() {
+    while (levels.last().width() > tileSize || levels.last().height() > tileSize) {
+        levels.append(halve(levels.last()));
+    }
+}
+
+// 2x2 box filter, an odd last row or column is averaged with itself
+QImage ReferenceImage::halve(const QImage& source) {
+    const int sw = source.width(), sh = source.height();
+    QImage out((sw + 1) / 2, (sh + 1) / 2, QImage::Format_ARGB32_Premultiplied);
+    const int pairs = sw / 2; // output columns with two source columns
+
+    for (int y = 0; y < out.height(); ++y) {
+        const quint32* top = reinterpret_cast<const quint32*>(source.constScanLine(2 * y));
+        const quint32* bottom = reinterpret_cast<const quint32*>(source.constScanLine(std::min(2 * y + 1, sh - 1)));
+        quint32* row = reinterpret_cast<quint32*>(out.scanLine(y));
+
+        int x = 0;
+#ifdef REFERENCEIMAGE_SSE2
+        for (; x + 4 <= pairs; x += 4) {
+            const __m128i* t = reinterpret_cast<const __m128i*>(top + 2 * x);
+            const __m128i* b = reinterpret_cast<const __m128i*>(bottom + 2 * x);
+            const __m128i first = average2x2(_mm_loadu_si128(t), _mm_loadu_si128(b));
+            const __m128i second = average2x2(_mm_loadu_si128(t + 1), _mm_loadu_si128(b + 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), _mm_packus_epi16(first, second));
+        }
+#endif
+        for (; x < pairs; ++x) {
+            row[x] = average4(top[2 * x], top[2 * x + 1], bottom[2 * x], bottom[2 * x + 1]);
+        }
+        if (pairs < out.width()) {
+            row[pairs] = average4(top[sw - 1], top[sw - 1], bottom[sw - 1], bottom[sw - 1]);
+        }
+    }
+    return out;
+}
+
+int ReferenceImage::levelFor(const QSizeF& deviceSize) const {
+    for (int i = levels.size() - 1; i > 0; --i) {
+        const QSize size = levels[i].size();
+        if (size.width() >= deviceSize.width() && size.height() >= deviceSize.height()) return i;
+    }
+    return 0;
+}
+
+QVector<QRect> ReferenceImage::tiles(int index) const {
+    QVector<QRect> out;
+    const QSize size = levels[index].size();
+    for (int y = 0; y < size.height(); y += tileSize) {
+        for (int x = 0; x < size.width(); x += tileSize) {
+            out.append(QRect(x, y, std::min(tileSize, size.width() - x), std::min(tileSize, size.height() - y)));
+        }
+    }
+    return out;
+}
+
+qint64 ReferenceImage::bytes() const {
+    qint64 total = 0;
+    for (const QImage& level : levels) total += level.sizeInBytes();
+    return total;
+}
+
+ReferenceLoader::ReferenceLoader(QObject* parent) : QObject(parent) {
+    // Formats that can't scale while decoding need the whole source in memory first,
+    // past Qt's default cap of 256 MB for a big scan
+    if (QImageReader::allocationLimit() > 0 && QImageReader::allocationLimit() < 2048) {
+        QImageReader::setAllocationLimit(2048);
+    }
+    // Two at most, a handful of big scans decoding at once would need all that several times over
+    pool.setMaxThreadCount(std::clamp(QThread::idealThreadCount(), 1, 2));
+}
+
+ReferenceLoader::~ReferenceLoader() {
+    pool.clear();
+    pool.waitForDone();
+}
+
+void ReferenceLoader::load(int layerId, const QString& path) {
+    const int side = maxSide;
+    pool.start([this, layerId, path, side]() {
+        QString error;
+        std::shared_ptr<const ReferenceImage> image = ReferenceImage::load(path, side, &error);
+        // Back on our thread. Still alive, the destructor waits for us
+        QMetaObject::invokeMethod(this, [this, layerId, image, error]() {
+            emit loaded(layerId, image, error);
+        }, Qt::QueuedConnection);
+    });
+}
@@ -0,0 +1,79 @@
+#ifndef REFERENCEIMAGE_H
+#define REFERENCEIMAGE_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QVector>
+#include <QImage>
+#include <QRect>
+#include <QSizeF>
+#include <QString>
+#include <memory>
+
+struct ReferenceImageStats {
+    QSize sourceSize;      // as stored in the file
+    double decodeMs = 0.0;
+    double mipMs = 0.0;
+};
+
+// A decoded reference image and its mip chain, each level half the one before down to a single tile.
+// Levels are ARGB32 premultiplied like the layer caches. Never changes once built, so it is shared
+// between the loader, the canvas and the frames that upload its tiles without copies.
+class ReferenceImage {
+
+public:
+
+    // Decodes and builds the mips, blocking. Sources larger than maxSide on either side
+    // are scaled down to fit it (while decoding, for formats that can).
+    static std::shared_ptr<const ReferenceImage> load(const QString& path, int maxSide, QString* error = nullptr);
+
+    int levelCount() const { return levels.size(); }
+    const QImage& level(int index) const { return levels[index]; }
+    QSize size() const { return levels.isEmpty() ? QSize() : levels.first().size(); }
+
+    // Coarsest level that still has at least deviceSize pixels, so it is only ever minified by < 2x
+    int levelFor(const QSizeF& deviceSize) const;
+    // Tile grid of a level, level pixel coords
+    QVector<QRect> tiles(int level) const;
+
+    qint64 bytes() const;
+    const ReferenceImageStats& getStats() const { return stats; }
+
+    static const int tileSize = 512;
+
+private:
+
+    void buildMips();
+    static QImage halve(const QImage& source);
+
+    QVector<QImage> levels;
+    ReferenceImageStats stats;
+};
+
+// Loads reference images on a pool of its own, loaded comes back on the loader's thread.
+// Destroying the loader waits for loads that are still going.
+class ReferenceLoader : public QObject {
+    Q_OBJECT
+
+public:
+
+    explicit ReferenceLoader(QObject* parent = nullptr);
+    ~ReferenceLoader();
+
+    void load(int layerId, const QString& path);
+    void setMaxSide(int side) { maxSide = side; }
+
+    static const int defaultMaxSide = 8192;
+
+signals:
+
+    // image is null when it failed, error says why
+    void loaded(int layerId, std::shared_ptr<const ReferenceImage> image, const QString& error);
+
+private:
+
+    QThreadPool pool;
+    int maxSide = defaultMaxSide;
+};
+
+#endif // REFERENCEIMAGE_H
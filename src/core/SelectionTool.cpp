@@ -0,0 +1,167 @@
+#include "SelectionTool.h"
+#include "StrokeManager.h"
+#include "BrushEngine.h"
+#include <cmath>
+#include <algorithm>
+
+SelectionTool::SelectionTool() {}
+
+void SelectionTool::beginPath(const QPointF& pos, SelectionShape pathShape) {
+    selecting = true;
+    shape = pathShape;
+    path.clear();
+    path.append(pos);
+}
+
+void SelectionTool::extendPath(const QPointF& pos) {
+    if (!selecting) return;
+
+    if (shape == SelectionShape::Rectangle) {
+        // Keep just the two corners
+        if (path.size() > 1) path.removeLast();
+        path.append(pos);
+        return;
+    }
+
+    // Lasso: skip tiny moves, same idea as the stroke input
+    QPointF d = pos - path.last();
+    if (d.manhattanLength() < 2.0) return;
+    path.append(pos);
+}
+
+QVector<QPointF> SelectionTool::getPathOutline() const {
+    QVector<QPointF> outline;
+    if (path.isEmpty()) return outline;
+
+    if (shape == SelectionShape::Rectangle) {
+        QRectF r = QRectF(path.first(), path.last()).normalized();
+        outline = { r.topLeft(), r.topRight(), r.bottomRight(), r.bottomLeft() };
+    }
+    else {
+        outline = QVector<QPointF>(path.begin(), path.end());
+    }
+    return outline;
+}
+
+QRectF SelectionTool::getPathBounds() const {
+    if (path.isEmpty()) return QRectF();
+    if (shape == SelectionShape::Rectangle) {
+        return QRectF(path.first(), path.last()).normalized();
+    }
+    return path.boundingRect();
+}
+
+void SelectionTool::finishPath(const StrokeManager& manager, int layerId)
+{
+    const QVector<StrokeRecord>& strokes = manager.getStrokeRecords();
+    const int strokeCount = strokes.size();
+
+    selecting = false;
+    selectedStrokes.clear();
+    selectionMask = QVector<bool>(strokeCount, false);
+    selectedBounds = QRectF();
+    selectionLayer = layerId;
+    transform.reset();
+
+    QRectF area = getPathBounds();
+    if (area.isEmpty()) {
+        path.clear();
+        return;
+    }
+
+    QPolygonF polygon = shape == SelectionShape::Rectangle ? QPolygonF(area) : path;
+
+    // Strokes flattened into the raster are pixels now, moving them wouldn't move those
+    const int first = BrushEngine::vectorStarts(strokes).value(layerId, 0);
+    for (int i = first; i < strokeCount; ++i) {
+        const QRectF& bounds = strokes[i].bounds;
+        if (strokes[i].layerId != layerId || !strokes[i].draws()) continue;
+        if (!bounds.intersects(area)) continue; // cheap reject
+
+        const QVector<StrokePoint> points = manager.getStroke(i);
+        for (const StrokePoint& point : points) {
+            bool inside = shape == SelectionShape::Rectangle
+                ? area.contains(point.pos)
+                : polygon.containsPoint(point.pos, Qt::OddEvenFill);
+            if (inside) {
+                selectedStrokes.append(i);
+                selectionMask[i] = true;
+                selectedBounds = selectedBounds.isEmpty() ? bounds : selectedBounds.united(bounds);
+                break;
+            }
+        }
+    }
+
+    path.clear();
+}
+
+bool SelectionTool::hitsSelection(const QPointF& pos) const {
+    return hasSelection() && getSelectionBounds().contains(pos);
+}
+
+void SelectionTool::beginDrag(const QPointF& pos, TransformMode dragMode) {
+    if (!hasSelection()) return;
+    mode = dragMode;
+    dragStart = pos;
+    transform.reset();
+}
+
+void SelectionTool::updateDrag(const QPointF& pos) {
+    if (mode == TransformMode::None) return;
+
+    const QPointF center = selectedBounds.center();
+    transform.reset();
+
+    switch (mode) {
+    case TransformMode::Move: {
+        QPointF d = pos - dragStart;
+        transform.translate(d.x(), d.y());
+        break;
+    }
+    case TransformMode::Scale: {
+        // Ratio of distances from the center, uniform so strokes keep their shape
+        QPointF a = dragStart - center;
+        QPointF b = pos - center;
+        double la = std::sqrt(QPointF::dotProduct(a, a));
+        double lb = std::sqrt(QPointF::dotProduct(b, b));
+        double s = la > 1.0 ? std::max(0.05, lb / la) : 1.0;
+        transform.translate(center.x(), center.y());
+        transform.scale(s, s);
+        transform.translate(-center.x(), -center.y());
+        break;
+    }
+    case TransformMode::Rotate: {
+        QPointF a = dragStart - center;
+        QPointF b = pos - center;
+        double angle = std::atan2(b.y(), b.x()) - std::atan2(a.y(), a.x());
+        transform.translate(center.x(), center.y());
+        transform.rotateRadians(angle);
+        transform.translate(-center.x(), -center.y());
+        break;
+    }
+    case TransformMode::None:
+        break;
+    }
+}
+
+void SelectionTool::endDrag() {
+    mode = TransformMode::None;
+    // Caller bakes the transform into the points, after that the selection sits where it was dropped
+    selectedBounds = transform.mapRect(selectedBounds);
+    transform.reset();
+}
+
+void SelectionTool::clear() {
+    selecting = false;
+    path.clear();
+    selectedStrokes.clear();
+    selectionMask.clear();
+    selectedBounds = QRectF();
+    selectionLayer = -1;
+    mode = TransformMode::None;
+    transform.reset();
+}
+
+QRectF SelectionTool::getSelectionBounds() const {
+    return transform.mapRect(selectedBounds);
+}
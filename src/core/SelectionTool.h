@@ -0,0 +1,75 @@
+#ifndef SELECTIONTOOL_H
+#define SELECTIONTOOL_H
+
+#include <QVector>
+#include <QPointF>
+#include <QRectF>
+#include <QPolygonF>
+#include <QTransform>
+#include "../data/StrokePoint.h"
+
+class StrokeManager;
+
+enum class SelectionShape {
+    Lasso,
+    Rectangle
+};
+
+enum class TransformMode {
+    None,
+    Move,
+    Scale,  // about the selection center
+    Rotate  // about the selection center
+};
+
+// Picks strokes with a lasso or rectangle and tracks a move/scale/rotate drag.
+// While dragging only the matrix changes, the points are rewritten by the caller on release.
+class SelectionTool {
+
+public:
+
+    SelectionTool();
+
+    // Selection path
+    void beginPath(const QPointF& pos, SelectionShape shape);
+    void extendPath(const QPointF& pos);
+    bool isSelecting() const { return selecting; }
+    QVector<QPointF> getPathOutline() const; // what to draw while selecting
+    QRectF getPathBounds() const;
+
+    // Ends the path and picks every stroke on layerId with a point inside it.
+    // Only strokes whose bounds touch the path get their points looked at (and decoded if cold).
+    void finishPath(const StrokeManager& manager, int layerId);
+
+    // Transform drag
+    bool hitsSelection(const QPointF& pos) const;
+    void beginDrag(const QPointF& pos, TransformMode mode);
+    void updateDrag(const QPointF& pos);
+    void endDrag();
+    bool isDragging() const { return mode != TransformMode::None; }
+    const QTransform& getTransform() const { return transform; }
+
+    void clear();
+    bool hasSelection() const { return !selectedStrokes.isEmpty(); }
+    const QVector<int>& getSelectedStrokes() const { return selectedStrokes; }
+    const QVector<bool>& getSelectionMask() const { return selectionMask; } // parallel to strokes
+    int getSelectionLayer() const { return selectionLayer; }
+    QRectF getSelectionBounds() const; // with the current drag transform applied
+
+private:
+
+    bool selecting = false;
+    SelectionShape shape = SelectionShape::Lasso;
+    QPolygonF path;
+
+    QVector<int> selectedStrokes;
+    QVector<bool> selectionMask;
+    QRectF selectedBounds; // untransformed
+    int selectionLayer = -1;
+
+    TransformMode mode = TransformMode::None;
+    QPointF dragStart;
+    QTransform transform;
+};
+
+#endif // SELECTIONTOOL_H
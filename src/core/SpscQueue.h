@@ -0,0 +1,55 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Fixed size ring buffer for exactly one producer thread and one consumer thread.
+// No locks: each side only writes its own index and reads the other one's, the
+// release/acquire pair on the index publishes the slot it guards.
+template <typename T, int Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+
+    // Producer side. Only moves from value when there was room.
+    bool tryPush(T&& value) {
+        const size_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail - headIndex.load(std::memory_order_acquire) == Capacity) return false; // full
+
+        ring[tail & mask] = std::move(value);
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool tryPop(T& value) {
+        const size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head == tailIndex.load(std::memory_order_acquire)) return false; // empty
+
+        value = std::move(ring[head & mask]);
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side, only a snapshot
+    int size() const {
+        return static_cast<int>(tailIndex.load(std::memory_order_acquire) - headIndex.load(std::memory_order_acquire));
+    }
+    bool isEmpty() const { return size() == 0; }
+
+    static constexpr int capacity() { return Capacity; }
+
+private:
+
+    static constexpr size_t mask = Capacity - 1;
+
+    // Each index on its own cache line, the two threads hammer them from different cores
+    alignas(64) std::atomic<size_t> headIndex{ 0 }; // next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tailIndex{ 0 }; // next slot to push, written by the producer
+    alignas(64) T ring[Capacity];
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,84 @@
+#include "StartupTrace.h"
+#include <QElapsedTimer>
+#include <QVector>
+#include <QDebug>
+
+namespace {
+
+struct Phase {
+    QString name;
+    qint64 ms;
+};
+
+struct Trace {
+    QElapsedTimer timer;
+    QVector<Phase> phases;
+    qint64 ready = -1;
+    bool reported = false;
+};
+
+Trace& trace() {
+    static Trace t;
+    return t;
+}
+
+bool loggingEnabled() {
+#ifdef QT_DEBUG
+    return true;
+#else
+    return qEnvironmentVariableIsSet("LANCER_STARTUP_TRACE");
+#endif
+}
+
+} // namespace
+
+namespace StartupTrace {
+
+void begin() {
+    trace().timer.start();
+    trace().phases.clear();
+    trace().ready = -1;
+    trace().reported = false;
+}
+
+void mark(const QString& phase) {
+    Trace& t = trace();
+    if (!t.timer.isValid()) return;
+    Phase p = { phase, t.timer.elapsed() };
+    t.phases.append(p);
+}
+
+void markReady() {
+    Trace& t = trace();
+    if (!t.timer.isValid() || t.ready >= 0) return;
+    t.ready = t.timer.elapsed();
+    mark("ready for input");
+}
+
+void report() {
+    Trace& t = trace();
+    if (t.reported || !t.timer.isValid()) return;
+    t.reported = true;
+    if (!loggingEnabled()) return;
+
+    qint64 previous = 0;
+    qInfo() << "[Startup] timeline";
+    for (const Phase& phase : t.phases) {
+        qInfo().noquote() << QString("  %1 ms (+%2)  %3").arg(phase.ms, 5).arg(phase.ms - previous, 4).arg(phase.name);
+        previous = phase.ms;
+    }
+
+    if (t.ready > targetReadyMs) {
+        qWarning() << "[Startup] ready after" << t.ready << "ms, target is" << targetReadyMs << "ms";
+    }
+}
+
+qint64 elapsedMs() {
+    return trace().timer.isValid() ? trace().timer.elapsed() : 0;
+}
+
+qint64 readyMs() {
+    return trace().ready;
+}
+
+} // namespace StartupTrace
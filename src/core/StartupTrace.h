@@ -0,0 +1,23 @@
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QtGlobal>
+#include <QString>
+
+// Startup timeline. Phases are marked as they finish, times are ms since begin().
+// The timeline is logged in debug builds or when LANCER_STARTUP_TRACE is set.
+namespace StartupTrace {
+
+    void begin(); // first thing in main()
+    void mark(const QString& phase);
+    void markReady(); // canvas painted and taking input, the time-to-first-stroke point
+    void report();    // logs everything marked so far, once
+
+    qint64 elapsedMs();
+    qint64 readyMs(); // -1 until markReady()
+
+    constexpr qint64 targetReadyMs = 200;
+
+} // namespace StartupTrace
+
+#endif // STARTUPTRACE_H
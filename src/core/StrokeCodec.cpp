@@ -0,0 +1,155 @@
+#include "StrokeCodec.h"
+#include "Varint.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr float positionScale = 16.0f;  // 1/16 px
+constexpr float thicknessScale = 64.0f;
+constexpr float pressureScale = 4095.0f; // 12 bits
+constexpr float opacityScale = 255.0f;
+constexpr int maxPoints = 1 << 24;
+
+enum Flags : quint8 {
+    UniformColor = 1, // one color up front, otherwise one per point
+    Timed = 2         // every point has a valid strokeTime
+};
+
+void writeFloat(QByteArray& out, float value) {
+    char bytes[sizeof(float)];
+    std::memcpy(bytes, &value, sizeof(float));
+    out.append(bytes, sizeof(float));
+}
+
+float readFloat(Varint::Reader& in) {
+    if (in.pos + static_cast<int>(sizeof(float)) > in.data.size()) {
+        in.failed = true;
+        return 0.0f;
+    }
+    float value;
+    std::memcpy(&value, in.data.constData() + in.pos, sizeof(float));
+    in.pos += sizeof(float);
+    return value;
+}
+
+qint64 quantize(float value, float scale) {
+    return std::llround(static_cast<double>(value) * scale);
+}
+
+} // namespace
+
+namespace StrokeCodec {
+
+QByteArray encode(const QVector<StrokePoint>& points) {
+    QByteArray out;
+    out.reserve(16 + points.size() * 8);
+    Varint::write(out, points.size());
+    if (points.isEmpty()) return out;
+
+    const StrokePoint& first = points.first();
+    quint8 flags = UniformColor | Timed;
+    for (const StrokePoint& p : points) {
+        if (p.r != first.r || p.g != first.g || p.b != first.b) flags &= ~UniformColor;
+        if (!p.strokeTime.isValid()) flags &= ~Timed;
+    }
+    out.append(static_cast<char>(flags));
+
+    if (flags & UniformColor) {
+        writeFloat(out, first.r);
+        writeFloat(out, first.g);
+        writeFloat(out, first.b);
+    }
+    if (flags & Timed) {
+        Varint::write(out, first.strokeTime.msecsSinceStartOfDay());
+    }
+
+    qint64 lastX = 0, lastY = 0, lastThickness = 0, lastPressure = 0, lastOpacity = 0;
+    qint64 lastTime = (flags & Timed) ? first.strokeTime.msecsSinceStartOfDay() : 0;
+    for (const StrokePoint& p : points) {
+        const qint64 x = quantize(p.pos.x(), positionScale);
+        const qint64 y = quantize(p.pos.y(), positionScale);
+        const qint64 thickness = quantize(std::max(p.thickness, 0.0f), thicknessScale);
+        const qint64 pressure = quantize(std::clamp(p.pressure, 0.0f, 1.0f), pressureScale);
+        const qint64 opacity = quantize(std::clamp(p.opacity, 0.0f, 1.0f), opacityScale);
+
+        Varint::writeSigned(out, x - lastX);
+        Varint::writeSigned(out, y - lastY);
+        Varint::writeSigned(out, thickness - lastThickness);
+        Varint::writeSigned(out, pressure - lastPressure);
+        Varint::writeSigned(out, opacity - lastOpacity);
+        lastX = x;
+        lastY = y;
+        lastThickness = thickness;
+        lastPressure = pressure;
+        lastOpacity = opacity;
+
+        if (flags & Timed) {
+            const qint64 time = p.strokeTime.msecsSinceStartOfDay();
+            Varint::writeSigned(out, time - lastTime); // negative past midnight
+            lastTime = time;
+        }
+        if (!(flags & UniformColor)) {
+            writeFloat(out, p.r);
+            writeFloat(out, p.g);
+            writeFloat(out, p.b);
+        }
+    }
+    return out;
+}
+
+bool decode(const QByteArray& data, QVector<StrokePoint>& points) {
+    points.clear();
+    Varint::Reader in{ data };
+
+    const quint64 count = in.varint();
+    if (in.failed || count > maxPoints) return false;
+    if (count == 0) return true;
+
+    const quint8 flags = in.byte();
+    StrokePoint p;
+    if (flags & UniformColor) {
+        p.r = readFloat(in);
+        p.g = readFloat(in);
+        p.b = readFloat(in);
+    }
+    qint64 time = (flags & Timed) ? static_cast<qint64>(in.varint()) : 0;
+    if (in.failed) return false;
+    points.reserve(static_cast<int>(count));
+
+    qint64 x = 0, y = 0, thickness = 0, pressure = 0, opacity = 0;
+    for (quint64 i = 0; i < count; ++i) {
+        x += in.signedVarint();
+        y += in.signedVarint();
+        thickness += in.signedVarint();
+        pressure += in.signedVarint();
+        opacity += in.signedVarint();
+
+        p.pos = QPointF(x / positionScale, y / positionScale);
+        p.thickness = thickness / thicknessScale;
+        p.pressure = pressure / pressureScale;
+        p.opacity = opacity / opacityScale;
+
+        if (flags & Timed) {
+            time += in.signedVarint();
+            p.strokeTime = QTime::fromMSecsSinceStartOfDay(static_cast<int>(time));
+        }
+        if (!(flags & UniformColor)) {
+            p.r = readFloat(in);
+            p.g = readFloat(in);
+            p.b = readFloat(in);
+        }
+        if (in.failed) return false;
+        points.append(p);
+    }
+    return true;
+}
+
+int pointCount(const QByteArray& data) {
+    Varint::Reader in{ data };
+    const quint64 count = in.varint();
+    return in.failed || count > maxPoints ? 0 : static_cast<int>(count);
+}
+
+} // namespace StrokeCodec
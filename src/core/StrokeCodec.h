@@ -0,0 +1,22 @@
+#ifndef STROKECODEC_H
+#define STROKECODEC_H
+
+#include <QByteArray>
+#include <QVector>
+#include "../data/StrokePoint.h"
+
+// Compact in-memory form of a committed stroke. Positions are 1/16 px and thickness 1/64 px
+// deltas in zigzag varints, pressure keeps 12 bits and opacity 8, both as deltas too, times
+// as ms deltas. Color is stored once, exactly, when the whole stroke has one (they all do).
+// A typical point ends up 6-8 bytes instead of the 48 a StrokePoint takes.
+// Lossy, but well below anything visible: positions move at most 1/32 px.
+namespace StrokeCodec {
+
+    QByteArray encode(const QVector<StrokePoint>& points);
+    bool decode(const QByteArray& data, QVector<StrokePoint>& points); // replaces points
+
+    int pointCount(const QByteArray& data); // without decoding the rest
+
+} // namespace StrokeCodec
+
+#endif // STROKECODEC_H
@@ -1,63 +1,220 @@
 #include "StrokeManager.h"
 #include "StrokeProcessor.h"
+#include "BrushEngine.h"
+#include "StrokeCodec.h"
+#include <cmath>
+#include <algorithm>
+#include <QRandomGenerator>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QDebug>
 
-StrokeManager::StrokeManager() {}
+namespace {
+constexpr int packBatch = 64; // commits between compression passes
+}
 
-void StrokeManager::addStroke(const QVector<StrokePoint>& stroke, StrokeProcessor& processor, QVector<Vertex>& vertices) {
-    
-    strokes.append(stroke);
+StrokeManager::StrokeManager() {
+    activeLayer = addLayer("Layer 1");
 
-    auto newVertices = processor.generateVertices(stroke);
-    vertices.append(newVertices);
-    strokeVertexCounts.append(newVertices.size());
+    // Random high bit ids until a relay hands out a real one, so strokes drawn offline
+    // can't collide with anybody's relay assigned ids
+    clientId = QRandomGenerator::global()->generate() | 0x80000000u;
 }
 
-void StrokeManager::undo(StrokeProcessor& processor, QVector<Vertex>& vertices) {
-    if (strokes.isEmpty()) return;
+void StrokeManager::addStroke(const QVector<StrokePoint>& stroke, StrokeProcessor& processor, QVector<Vertex>& vertices, int brushId,
+                              quint64 strokeId, int layerId, const Symmetry& symmetry) {
+    StrokeRecord record = newRecord(stroke, brushId, strokeId, layerId, symmetry);
 
-    changeSinceLastUndo = false;
-    // Remove the last completed stroke
-    strokeRedoList.append(strokes.back());
-    strokes.pop_back();
+    // Solid strips are always generated, they are the fallback when dabs can't be drawn
+    record.vertexCount = processor.tessellate(stroke, record.kind, vertices); // straight into the mirror
+    record.bounds = boundsFor(stroke, brushId, symmetry, processor);
+    appendStroke(std::move(record));
+}
 
-    // Rebuild vertex buffer from remaining strokes
-    vertices.clear();
-    strokeVertexCounts.clear();
+void StrokeManager::addFill(const QVector<StrokePoint>& quads, StrokeProcessor& processor, QVector<Vertex>& vertices,
+                            quint64 strokeId, int layerId) {
+    StrokeRecord record = newRecord(quads, 0, strokeId, layerId, Symmetry());
+    record.kind = EntryKind::Fill;
+    record.vertexCount = processor.tessellate(quads, record.kind, vertices);
+    record.bounds = processor.strokeBounds(quads);
+    appendStroke(std::move(record));
+}
 
-    // Generate vertices WITHOUT calling addStroke (to avoid recursion)
-    for (const QVector<StrokePoint>& stroke : strokes) {
-        auto newVertices = processor.generateVertices(stroke);
-        vertices += newVertices;  // Or use operator+=
-        strokeVertexCounts.append(newVertices.size());
+void StrokeManager::addFilter(FilterType filter, const QVector<StrokePoint>& points, const QRectF& bounds, quint64 strokeId, int layerId) {
+    StrokeRecord record = newRecord(points, 0, strokeId, layerId, Symmetry());
+    record.kind = EntryKind::Filter;
+    record.filter = filter;
+    record.bounds = bounds;
+    appendStroke(std::move(record));
+}
+
+void StrokeManager::addFlatten(const QRectF& bounds, quint64 strokeId, int layerId) {
+    StrokeRecord record = newRecord(QVector<StrokePoint>(), 0, strokeId, layerId, Symmetry());
+    record.kind = EntryKind::Flatten;
+    record.bounds = bounds;
+    appendStroke(std::move(record));
+}
+
+void StrokeManager::addTessellatedStroke(const QVector<StrokePoint>& stroke, const QVector<Vertex>& strokeVertices, const QRectF& bounds,
+                                         QVector<Vertex>& vertices, int brushId, quint64 strokeId, int layerId,
+                                         const Symmetry& symmetry) {
+    StrokeRecord record = newRecord(stroke, brushId, strokeId, layerId, symmetry);
+
+    vertices += strokeVertices;
+    record.vertexCount = strokeVertices.size();
+    record.bounds = symmetry.map(bounds);
+    appendStroke(std::move(record));
+}
+
+StrokeRecord StrokeManager::newRecord(const QVector<StrokePoint>& stroke, int brushId, quint64 strokeId, int layerId,
+                                      const Symmetry& symmetry) {
+    StrokeRecord record;
+    record.points = stroke;
+    record.layerId = layerId >= 0 && findLayer(layerId) ? layerId : activeLayer;
+    record.brushId = brushId;
+    record.symmetry = symmetry;
+    record.id = strokeId != 0 ? strokeId : newStrokeId();
+    return record;
+}
+
+void StrokeManager::appendStroke(StrokeRecord&& stroke) {
+    layerStrokeCounts[stroke.layerId]++;
+    strokes.append(std::move(stroke));
+
+    if (hotStrokes >= 0 && ++commitsSincePack >= packBatch) {
+        compressCold(hotStrokes);
     }
 }
 
+QRectF StrokeManager::boundsFor(const QVector<StrokePoint>& stroke, int brushId, const Symmetry& symmetry,
+                                StrokeProcessor& processor) const {
+    return symmetry.map(BrushEngine::padBounds(processor.strokeBounds(stroke), stroke, BrushEngine::preset(brushId)));
+}
+
+void StrokeManager::undo(StrokeProcessor& processor, QVector<Vertex>& vertices, int index) {
+    if (strokes.isEmpty()) return;
+    if (index < 0) index = strokes.size() - 1;
+    if (index >= strokes.size()) return;
+
+    changeSinceLastUndo = false;
+    // Remove the stroke, usually the last completed one. Synced canvases pass their own
+    // newest, a peer's stroke may be on top of it. Only its vertex range goes, the rest
+    // of the document (cold strokes included) isn't touched.
+    const int offset = vertexOffset(index);
+    StrokeRecord stroke = strokes.takeAt(index);
+    vertices.remove(offset, stroke.vertexCount);
+    if (stroke.kind == EntryKind::Transform) {
+        applyTransform(stroke, stroke.transform.inverted(), processor, vertices);
+    }
+    layerStrokeCounts[stroke.layerId]--;
+    stroke.vertexCount = 0;
+    redoStack.append(std::move(stroke));
+}
+
 void StrokeManager::redo(StrokeProcessor& processor, QVector<Vertex>& vertices){
-    if (strokeRedoList.isEmpty()) return;
+    if (redoStack.isEmpty()) return;
 
-    auto strokeToDo = strokeRedoList.back();
-    strokeRedoList.pop_back();
-    strokes.append(strokeToDo);
+    // Bounds, id and the rest come back as they were, it lands on top so its
+    // vertices go on the end
+    StrokeRecord stroke = redoStack.takeLast();
+    if (!findLayer(stroke.layerId)) stroke.layerId = activeLayer; // its layer was deleted meanwhile
+    if (stroke.kind == EntryKind::Transform) {
+        applyTransform(stroke, stroke.transform, processor, vertices);
+    }
+    else {
+        QVector<StrokePoint> scratch;
+        stroke.vertexCount = processor.tessellate(pointsOf(stroke, scratch), stroke.kind, vertices);
+    }
+    layerStrokeCounts[stroke.layerId]++;
+    strokes.append(std::move(stroke));
+}
 
-    vertices.clear();
-    strokeVertexCounts.clear();
+void StrokeManager::rebuildVertices(StrokeProcessor& processor, QVector<Vertex>& vertices) {
+    vertices.clear(); // keeps capacity
 
     // Generate vertices WITHOUT calling addStroke (to avoid recursion)
-    for (const QVector<StrokePoint>& stroke : strokes) {
-        auto newVertices = processor.generateVertices(stroke);
-        vertices += newVertices;  // Or use operator+=
-        strokeVertexCounts.append(newVertices.size());
+    QVector<StrokePoint> scratch;
+    for (StrokeRecord& stroke : strokes) {
+        stroke.vertexCount = processor.tessellate(pointsOf(stroke, scratch), stroke.kind, vertices);
     }
 }
 
-const QVector<QVector<StrokePoint>>& StrokeManager::getStrokes() const
-{
+QVector<StrokePoint> StrokeManager::getStroke(int index) const {
+    if (index < 0 || index >= strokes.size()) return {};
+    const StrokeRecord& stroke = strokes[index];
+    if (!stroke.isPacked()) return stroke.points;
+
+    QVector<StrokePoint> points;
+    decodeInto(stroke.packed, points);
+    return points;
+}
+
+const QVector<StrokeRecord>& StrokeManager::getStrokeRecords() const {
     return strokes;
 }
 
-QVector<int> StrokeManager::getStrokeVertexCounts()
-{
-    return strokeVertexCounts;
+StrokeSnapshot StrokeManager::snapshot() const {
+    return StrokeSnapshot(strokes);
+}
+
+const QVector<StrokePoint>& StrokeManager::pointsOf(const StrokeRecord& stroke, QVector<StrokePoint>& scratch) const {
+    if (!stroke.isPacked()) return stroke.points;
+    decodeInto(stroke.packed, scratch);
+    return scratch;
+}
+
+void StrokeManager::decodeInto(const QByteArray& packed, QVector<StrokePoint>& points) const {
+    QElapsedTimer timer;
+    timer.start();
+    if (!StrokeCodec::decode(packed, points)) {
+        qWarning() << "[StrokeManager] corrupt compressed stroke";
+        points.clear();
+    }
+    compression.decodeMs += timer.nsecsElapsed() / 1.0e6;
+    compression.decodedPoints += points.size();
+}
+
+void StrokeManager::pack(StrokeRecord& stroke) {
+    if (stroke.points.isEmpty() || stroke.isPacked()) return;
+
+    QElapsedTimer timer;
+    timer.start();
+    stroke.packed = StrokeCodec::encode(stroke.points);
+    stroke.packed.squeeze();
+    compression.encodeMs += timer.nsecsElapsed() / 1.0e6;
+    compression.encodedPoints += stroke.points.size();
+    stroke.points = QVector<StrokePoint>(); // frees it unless a frame or export still shares it
+}
+
+void StrokeManager::setHotStrokeCount(int count) {
+    hotStrokes = count;
+}
+
+void StrokeManager::compressCold(int keepHot) {
+    commitsSincePack = 0;
+    keepHot = std::max(0, keepHot);
+
+    for (int i = 0; i < strokes.size() - keepHot; ++i) {
+        pack(strokes[i]);
+    }
+
+    // The newest redo entries come back first, the rest can wait compressed
+    for (int i = 0; i < redoStack.size() - keepHot; ++i) {
+        pack(redoStack[i]);
+    }
+}
+
+StrokeCompressionStats StrokeManager::getCompressionStats() const {
+    StrokeCompressionStats stats = compression;
+    for (const QVector<StrokeRecord>* list : { &strokes, &redoStack }) {
+        for (const StrokeRecord& stroke : *list) {
+            if (!stroke.isPacked()) continue;
+            stats.packedStrokes++;
+            stats.packedBytes += stroke.packed.size();
+            stats.rawBytes += StrokeCodec::pointCount(stroke.packed) * static_cast<qint64>(sizeof(StrokePoint));
+        }
+    }
+    return stats;
 }
 
 void StrokeManager::setChangeSinceLastUndo(bool value){
@@ -65,18 +222,270 @@ void StrokeManager::setChangeSinceLastUndo(bool value){
 }
 
 void StrokeManager::clearRedoStack(){
-    strokeRedoList.clear();
+    redoStack.clear();
 }
 
 void StrokeManager::appendToStrokes(const QVector<StrokePoint>& stroke)
 {
-    strokes.append(stroke);
+    appendStroke(newRecord(stroke, 0, 0, activeLayer, Symmetry()));
 }
 
 void StrokeManager::clear() {
     strokes.clear();
+    layerStrokeCounts.clear();
+}
+
+int StrokeManager::addLayer(const QString& name) {
+    Layer layer;
+    layer.id = nextLayerId++;
+    layer.name = name;
+
+    // Goes right above the active layer, like most paint programs
+    int index = layers.size();
+    for (int i = 0; i < layers.size(); ++i) {
+        if (layers[i].id == activeLayer) {
+            index = i + 1;
+            break;
+        }
+    }
+    layers.insert(index, layer);
+    return layer.id;
+}
+
+bool StrokeManager::removeLayer(int id, StrokeProcessor& processor, QVector<Vertex>& vertices) {
+    if (layers.size() <= 1) return false; // always keep one layer to draw on
+
+    int index = -1;
+    for (int i = 0; i < layers.size(); ++i) {
+        if (layers[i].id == id) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) return false;
+    layers.removeAt(index);
+    layerStrokeCounts.remove(id);
+
+    // Drop the layer's strokes, the rest keep their order
+    auto onLayer = [id](const StrokeRecord& stroke) { return stroke.layerId == id; };
+    strokes.removeIf(onLayer);
+    redoStack.removeIf(onLayer);
+
+    if (activeLayer == id) {
+        activeLayer = layers[std::max(0, index - 1)].id;
+    }
+
+    rebuildVertices(processor, vertices);
+    return true;
+}
+
+bool StrokeManager::moveLayer(int id, int delta) {
+    for (int i = 0; i < layers.size(); ++i) {
+        if (layers[i].id == id) {
+            int target = i + delta;
+            if (target < 0 || target >= layers.size()) return false;
+            layers.move(i, target);
+            return true;
+        }
+    }
+    return false;
+}
+
+Layer* StrokeManager::findLayer(int id) {
+    for (Layer& layer : layers) {
+        if (layer.id == id) return &layer;
+    }
+    return nullptr;
+}
+
+const QVector<Layer>& StrokeManager::getLayers() const {
+    return layers;
+}
+
+int StrokeManager::getActiveLayer() const {
+    return activeLayer;
+}
+
+void StrokeManager::setActiveLayer(int id) {
+    if (findLayer(id)) {
+        activeLayer = id;
+    }
+}
+
+namespace {
+
+// Qt keeps a small header in front of every array allocation
+constexpr qint64 arrayHeaderBytes = 16;
+
+template <typename T>
+qint64 capacityBytes(const QVector<T>& v) {
+    return v.capacity() > 0 ? arrayHeaderBytes + v.capacity() * static_cast<qint64>(sizeof(T)) : 0;
+}
+
+qint64 recordListBytes(const QVector<StrokeRecord>& list) {
+    qint64 bytes = capacityBytes(list);
+    for (const StrokeRecord& stroke : list) {
+        bytes += capacityBytes(stroke.points) + capacityBytes(stroke.targets);
+        bytes += stroke.packed.capacity() > 0 ? arrayHeaderBytes + stroke.packed.capacity() : 0;
+    }
+    return bytes;
+}
+
+} // namespace
+
+qint64 StrokeManager::strokeBytes() const {
+    return recordListBytes(strokes);
+}
+
+qint64 StrokeManager::redoBytes() const {
+    return recordListBytes(redoStack);
+}
+
+void StrokeManager::compact() {
+    // Live strokes grow by doubling, so a finished stroke can carry up to 2x spare points
+    for (StrokeRecord& stroke : strokes) stroke.points.squeeze();
+    for (StrokeRecord& stroke : redoStack) stroke.points.squeeze();
+    strokes.squeeze();
+    redoStack.squeeze();
+}
+
+quint64 StrokeManager::newStrokeId() {
+    return (static_cast<quint64>(clientId) << 32) | nextStrokeNumber++;
+}
+
+void StrokeManager::setClientId(quint32 id) {
+    clientId = id;
+    nextStrokeNumber = 1;
+}
+
+int StrokeManager::vertexOffset(int index) const {
+    int offset = 0;
+    for (int i = 0; i < index; ++i) {
+        offset += strokes[i].vertexCount;
+    }
+    return offset;
+}
+
+int StrokeManager::indexOfStroke(quint64 id) const {
+    // Newest first, that's where synced undo/redo usually lands
+    for (int i = strokes.size() - 1; i >= 0; --i) {
+        if (strokes[i].id == id) return i;
+    }
+    return -1;
+}
+
+bool StrokeManager::removeStroke(int index, StrokeProcessor& processor, QVector<Vertex>& vertices) {
+    if (index < 0 || index >= strokes.size()) return false;
+
+    // Strokes are laid out in order in the mirror, cut out just this one's range
+    vertices.remove(vertexOffset(index), strokes[index].vertexCount);
+
+    StrokeRecord stroke = strokes.takeAt(index);
+    layerStrokeCounts[stroke.layerId]--;
+    if (stroke.kind == EntryKind::Transform) {
+        applyTransform(stroke, stroke.transform.inverted(), processor, vertices);
+    }
+    return true;
+}
+
+void StrokeManager::moveStroke(int from, int to, QVector<Vertex>& vertices) {
+    if (from < 0 || from >= strokes.size() || to < 0 || to >= strokes.size() || from == to) return;
+
+    // Its vertex range moves along, the mirror stays in stroke order
+    int fromOffset = 0, toOffset = 0;
+    for (int i = 0; i < std::max(from, to); ++i) {
+        if (i < from) fromOffset += strokes[i].vertexCount;
+        if (i < to) toOffset += strokes[i].vertexCount;
+    }
+    const int count = strokes[from].vertexCount;
+    auto begin = vertices.begin();
+    if (to < from) {
+        std::rotate(begin + toOffset, begin + fromOffset, begin + fromOffset + count);
+    } else {
+        std::rotate(begin + fromOffset, begin + fromOffset + count, begin + toOffset + strokes[to].vertexCount);
+    }
+
+    strokes.move(from, to);
+}
+
+quint64 StrokeManager::transformStrokes(const QVector<quint64>& ids, const QTransform& transform, StrokeProcessor& processor,
+                                        QVector<Vertex>& vertices, quint64 entryId) {
+    if (ids.isEmpty() || transform.isIdentity() || !transform.isInvertible()) return 0;
+
+    StrokeRecord entry;
+    entry.kind = EntryKind::Transform;
+    entry.targets = ids;
+    entry.transform = transform;
+    entry.id = entryId != 0 ? entryId : newStrokeId();
+    const int first = indexOfStroke(ids.first());
+    entry.layerId = first >= 0 ? strokes[first].layerId : activeLayer; // a selection is on one layer
+    applyTransform(entry, transform, processor, vertices);
+    if (entry.bounds.isEmpty()) return 0; // none of them are here
+
+    const quint64 id = entry.id;
+    appendStroke(std::move(entry));
+    return id;
+}
+
+void StrokeManager::transformPoints(QVector<StrokePoint>& points, const QTransform& transform) {
+    // Width follows the area scale, rotation and translation leave it alone
+    const float widthScale = static_cast<float>(std::sqrt(std::abs(transform.determinant())));
+    for (StrokePoint& point : points) {
+        point.pos = transform.map(point.pos);
+        point.thickness *= widthScale;
+    }
+}
+
+void StrokeManager::applyTransform(StrokeRecord& entry, const QTransform& transform, StrokeProcessor& processor,
+                                   QVector<Vertex>& vertices) {
+    const QSet<quint64> targets(entry.targets.cbegin(), entry.targets.cend());
+    QVector<int> moved;
+    entry.bounds = QRectF();
+    for (int i = 0; i < strokes.size(); ++i) {
+        StrokeRecord& stroke = strokes[i];
+        if (!stroke.draws() || !targets.contains(stroke.id)) continue; // some may be gone
+
+        // Edited, so hot again until the next compression pass
+        if (stroke.isPacked()) {
+            decodeInto(stroke.packed, stroke.points);
+            stroke.packed = QByteArray();
+        }
+
+        entry.bounds = entry.bounds.isEmpty() ? stroke.bounds : entry.bounds.united(stroke.bounds);
+        transformPoints(stroke.points, transform);
+        stroke.bounds = boundsFor(stroke.points, stroke.brushId, stroke.symmetry, processor);
+        entry.bounds = entry.bounds.united(stroke.bounds); // where they were and are, the damage either way
+        moved.append(i);
+    }
+
+    retessellate(moved, processor, vertices);
+}
+
+void StrokeManager::retessellate(const QVector<int>& indices, StrokeProcessor& processor, QVector<Vertex>& vertices) {
+    if (indices.isEmpty()) return;
+
+    // One pass: the given strokes (ascending) get new vertices, everyone else's are copied over
+    rebuilt.clear();
+    QVector<StrokePoint> scratch;
+    int offset = 0;
+    int next = 0;
+    for (int i = 0; i < strokes.size(); ++i) {
+        StrokeRecord& stroke = strokes[i];
+        const int count = stroke.vertexCount;
+        if (next < indices.size() && indices[next] == i) {
+            ++next;
+            stroke.vertexCount = processor.tessellate(pointsOf(stroke, scratch), stroke.kind, rebuilt);
+        }
+        else if (count > 0) {
+            const int at = rebuilt.size();
+            rebuilt.resize(at + count);
+            std::copy_n(vertices.constData() + offset, count, rebuilt.data() + at);
+        }
+        offset += count;
+    }
+    vertices.swap(rebuilt);
 }
 
-void StrokeManager::clearStrokeVertexCounts() {
-    strokeVertexCounts.clear();
+int StrokeManager::layerStrokeCount(int id) const {
+    return layerStrokeCounts.value(id, 0);
 }
@@ -1,28 +1,121 @@
 #pragma once
 
 #include <qvector.h>
+#include <QHash>
+#include <QRectF>
+#include <QTransform>
+#include <QByteArray>
 #include "../data/StrokePoint.h"
 #include "../data/Vertex.h"
+#include "../data/Layer.h"
+#include "../data/Symmetry.h"
+#include "../data/StrokeRecord.h"
 #include "StrokeProcessor.h"
+#include "StrokeSnapshot.h"
 
+struct StrokeCompressionStats {
+    int packedStrokes = 0;  // compressed right now, document and redo history
+    qint64 rawBytes = 0;    // what those would take as StrokePoints
+    qint64 packedBytes = 0;
+    quint64 encodedPoints = 0;
+    double encodeMs = 0.0;
+    quint64 decodedPoints = 0;
+    double decodeMs = 0.0;
+
+    double ratio() const { return packedBytes > 0 ? static_cast<double>(rawBytes) / packedBytes : 1.0; }
+    double decodedPointsPerSecond() const { return decodeMs > 0.0 ? decodedPoints * 1000.0 / decodeMs : 0.0; }
+};
 
 class StrokeManager {
 public:
     StrokeManager();
-    void addStroke(const QVector<StrokePoint>& stroke, StrokeProcessor& processor, QVector<Vertex>& vertices);
-    void undo(StrokeProcessor& processor, QVector<Vertex>& vertices);
+    // strokeId 0 picks a new id, layerId -1 means the active layer
+    void addStroke(const QVector<StrokePoint>& stroke, StrokeProcessor& processor, QVector<Vertex>& vertices, int brushId = 0,
+                   quint64 strokeId = 0, int layerId = -1, const Symmetry& symmetry = Symmetry());
+    // Same, for a stroke tessellated elsewhere (TessellationWorker), strokeVertices are copied in as they are.
+    // bounds are the source stroke's, the symmetry copies get added
+    void addTessellatedStroke(const QVector<StrokePoint>& stroke, const QVector<Vertex>& strokeVertices, const QRectF& bounds,
+                              QVector<Vertex>& vertices, int brushId = 0, quint64 strokeId = 0, int layerId = -1,
+                              const Symmetry& symmetry = Symmetry());
+    // A bucket fill, FloodFill::toStroke's quads
+    void addFill(const QVector<StrokePoint>& quads, StrokeProcessor& processor, QVector<Vertex>& vertices,
+                 quint64 strokeId = 0, int layerId = -1);
+    // Raster entries, no mesh. A filter keeps its settings in points (FilterType), bounds is what it changed
+    void addFilter(FilterType filter, const QVector<StrokePoint>& points, const QRectF& bounds, quint64 strokeId = 0, int layerId = -1);
+    void addFlatten(const QRectF& bounds, quint64 strokeId = 0, int layerId = -1);
+    void undo(StrokeProcessor& processor, QVector<Vertex>& vertices, int index = -1); // -1 is the newest
     void redo(StrokeProcessor& processor, QVector<Vertex>& vertices);
     void clear();
-    void clearStrokeVertexCounts();
     void clearRedoStack();
-    const QVector<QVector<StrokePoint>>& getStrokes() const;
-    QVector<int> getStrokeVertexCounts();
+    int strokeCount() const { return strokes.size(); }
+    QVector<StrokePoint> getStroke(int index) const; // decoded if it was compressed
+    const StrokeRecord& strokeAt(int index) const { return strokes[index]; }
+    const QVector<StrokeRecord>& getStrokeRecords() const; // drawing order, implicitly shared
+    StrokeSnapshot snapshot() const; // nothing decoded up front, for exports and the timelapse
     void setChangeSinceLastUndo(bool value);
     void appendToStrokes(const QVector<StrokePoint>& stroke);
 //    bool canUndo() const;
+
+    // Layers, bottom first. New strokes go to the active layer.
+    int addLayer(const QString& name);
+    bool removeLayer(int id, StrokeProcessor& processor, QVector<Vertex>& vertices);
+    bool moveLayer(int id, int delta); // +1 moves up (towards the top of the stack)
+    Layer* findLayer(int id);
+    const QVector<Layer>& getLayers() const;
+    int getActiveLayer() const;
+    void setActiveLayer(int id);
+    int layerStrokeCount(int id) const;
+
+    // Stroke ids are unique across synced instances: client id in the high 32 bits
+    quint64 newStrokeId();
+    void setClientId(quint32 id);
+    int indexOfStroke(quint64 id) const; // -1 if not there
+    // Drops it for good, no redo entry. A transform entry puts its strokes back first.
+    bool removeStroke(int index, StrokeProcessor& processor, QVector<Vertex>& vertices);
+    void moveStroke(int from, int to, QVector<Vertex>& vertices); // drawing order only, nothing is re-tessellated
+
+    // Bakes a selection transform into the points of the strokes with these ids and adds it to the
+    // history as one Transform entry, so undo moves them back. Only they are re-tessellated.
+    // entryId 0 makes a new id. Returns the entry's id, 0 if nothing moved.
+    quint64 transformStrokes(const QVector<quint64>& ids, const QTransform& transform, StrokeProcessor& processor,
+                             QVector<Vertex>& vertices, quint64 entryId = 0);
+    static void transformPoints(QVector<StrokePoint>& points, const QTransform& transform); // what it does to each stroke
+
+    // Memory accounting, allocated capacity rather than used size
+    qint64 strokeBytes() const;
+    qint64 redoBytes() const;
+    void compact(); // gives back spare capacity
+
+    // Cold strokes. All but the newest hotStrokes are kept compressed (StrokeCodec) and
+    // decoded on demand, for re-tessellation, hit testing and export. Negative never compresses.
+    void setHotStrokeCount(int count);
+    void compressCold(int keepHot); // right now, the memory limits use 0
+    StrokeCompressionStats getCompressionStats() const;
 private:
-    QVector<QVector<StrokePoint>> strokes;
-    QVector<int> strokeVertexCounts;
-    QVector<QVector<StrokePoint>> strokeRedoList;
+    const QVector<StrokePoint>& pointsOf(const StrokeRecord& stroke, QVector<StrokePoint>& scratch) const; // scratch holds decoded ones
+    void decodeInto(const QByteArray& packed, QVector<StrokePoint>& points) const;
+    void pack(StrokeRecord& stroke);
+    void rebuildVertices(StrokeProcessor& processor, QVector<Vertex>& vertices);
+    int vertexOffset(int index) const; // where stroke index starts in the mirror
+    void retessellate(const QVector<int>& indices, StrokeProcessor& processor, QVector<Vertex>& vertices); // just those
+    void applyTransform(StrokeRecord& entry, const QTransform& transform, StrokeProcessor& processor, QVector<Vertex>& vertices);
+    StrokeRecord newRecord(const QVector<StrokePoint>& stroke, int brushId, quint64 strokeId, int layerId, const Symmetry& symmetry);
+    void appendStroke(StrokeRecord&& stroke);
+    QRectF boundsFor(const QVector<StrokePoint>& stroke, int brushId, const Symmetry& symmetry, StrokeProcessor& processor) const;
+
+    QVector<StrokeRecord> strokes;   // the document, drawing order
+    QVector<StrokeRecord> redoStack; // undone strokes, the next redo last
+    int hotStrokes = 256;
+    int commitsSincePack = 0;
+    mutable StrokeCompressionStats compression; // decoding is const, it counts anyway
+    QVector<Vertex> rebuilt; // retessellate's new mirror, swapped with the caller's
+
+    quint32 clientId = 0;
+    quint32 nextStrokeNumber = 1;
+
+    QVector<Layer> layers;
+    QHash<int, int> layerStrokeCounts; // layer id -> number of strokes on it
+    int activeLayer = 0;
+    int nextLayerId = 0;
     bool changeSinceLastUndo = false;
 };
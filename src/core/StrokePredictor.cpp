@@ -0,0 +1,184 @@
+#include "StrokePredictor.h"
+#include <QtGlobal>
+#include <cmath>
+#include <algorithm>
+
+StrokePredictor::StrokePredictor() {}
+
+void StrokePredictor::reset() {
+    samples.clear();
+    pending.clear();
+}
+
+void StrokePredictor::setHorizonMs(float ms) {
+    horizonMs = std::clamp(ms, 0.0f, 100.0f);
+}
+
+void StrokePredictor::setMeasuring(bool value) {
+    measuring = value;
+    pending.clear();
+}
+
+void StrokePredictor::resetStats() {
+    stats = PredictionStats();
+    errorSum = 0.0;
+    baselineSum = 0.0;
+}
+
+void StrokePredictor::addSample(const QPointF& pos, float pressure, quint64 timestampMs) {
+    Sample s = { pos, pressure, static_cast<double>(timestampMs) };
+
+    if (!samples.isEmpty()) {
+        const Sample& prev = samples.last();
+        if (s.t < prev.t) {
+            // Timestamps went backwards (device switch etc.), start over
+            samples.clear();
+            pending.clear();
+        }
+        else if (measuring) {
+            checkPending(prev, s);
+        }
+    }
+
+    samples.append(s);
+
+    // Drop samples that are too old or over the cap
+    while (samples.size() > maxSamples || (samples.size() > 2 && s.t - samples.first().t > windowMs)) {
+        samples.removeFirst();
+    }
+}
+
+// Least squares fit over the sample window, quadratic when we have enough points,
+// evaluated dt ms past the newest sample. Times and positions are taken relative
+// to the newest sample so the normal equations stay well conditioned.
+bool StrokePredictor::predictAt(double dt, QPointF& pos, float& pressure) const {
+    const int n = samples.size();
+    if (n < 2) return false;
+
+    const Sample& last = samples.last();
+    if (last.t - samples.first().t < 1.0) return false; // all in the same ms, no velocity info
+
+    double s0 = n, s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+    double x0 = 0, x1 = 0, x2 = 0;
+    double y0 = 0, y1 = 0, y2 = 0;
+    double p0 = 0, p1 = 0;
+
+    for (const Sample& s : samples) {
+        double t = s.t - last.t; // <= 0
+        double x = s.pos.x() - last.pos.x();
+        double y = s.pos.y() - last.pos.y();
+        double t2 = t * t;
+
+        s1 += t; s2 += t2; s3 += t2 * t; s4 += t2 * t2;
+        x0 += x; x1 += x * t; x2 += x * t2;
+        y0 += y; y1 += y * t; y2 += y * t2;
+        p0 += s.pressure; p1 += s.pressure * t;
+    }
+
+    double vx = 0, vy = 0, ax = 0, ay = 0;
+
+    double det = 0;
+    if (n >= 3) {
+        det = s0 * (s2 * s4 - s3 * s3) - s1 * (s1 * s4 - s3 * s2) + s2 * (s1 * s3 - s2 * s2);
+    }
+
+    if (std::abs(det) > 1e-6) {
+        // Cramer's rule for c + b*t + a*t^2, we only need b and a
+        auto solve = [&](double b0, double b1, double b2, double& b, double& a) {
+            b = (s0 * (b1 * s4 - s3 * b2) - b0 * (s1 * s4 - s3 * s2) + s2 * (s1 * b2 - b1 * s2)) / det;
+            a = (s0 * (s2 * b2 - b1 * s3) - s1 * (s1 * b2 - b1 * s2) + b0 * (s1 * s3 - s2 * s2)) / det;
+        };
+        solve(x0, x1, x2, vx, ax);
+        solve(y0, y1, y2, vy, ay);
+        // Acceleration is noisy, only trust half of it
+        ax *= 0.5;
+        ay *= 0.5;
+    }
+    else {
+        double denom = s0 * s2 - s1 * s1;
+        if (std::abs(denom) < 1e-9) return false;
+        vx = (s0 * x1 - s1 * x0) / denom;
+        vy = (s0 * y1 - s1 * y0) / denom;
+    }
+
+    double dx = vx * dt + ax * dt * dt;
+    double dy = vy * dt + ay * dt * dt;
+
+    double len = std::sqrt(dx * dx + dy * dy);
+    if (len > maxTailLength) {
+        dx *= maxTailLength / len;
+        dy *= maxTailLength / len;
+    }
+
+    pos = last.pos + QPointF(dx, dy);
+
+    double pDenom = s0 * s2 - s1 * s1;
+    double pSlope = std::abs(pDenom) > 1e-9 ? (s0 * p1 - s1 * p0) / pDenom : 0.0;
+    pressure = std::clamp(static_cast<float>(last.pressure + pSlope * dt), 0.01f, 1.0f);
+
+    return true;
+}
+
+QVector<StrokePoint> StrokePredictor::predictTail(const StrokePoint& lastPoint, const BrushDynamics& dynamics) {
+    QVector<StrokePoint> tail;
+    if (horizonMs <= 0.0f || samples.size() < 2) return tail;
+
+    tail.reserve(tailSteps);
+    for (int i = 1; i <= tailSteps; ++i) {
+        double dt = horizonMs * i / tailSteps;
+
+        QPointF pos;
+        float pressure;
+        if (!predictAt(dt, pos, pressure)) break;
+
+        StrokePoint point = lastPoint;
+        point.pos = pos;
+        point.pressure = pressure;
+        point.thickness = dynamics.thickness(pressure);
+        point.opacity = dynamics.opacity(pressure);
+        tail.append(point);
+    }
+
+    if (measuring && !tail.isEmpty()) {
+        PendingCheck check = { samples.last().t + horizonMs, tail.last().pos, samples.last().pos };
+        pending.append(check);
+    }
+
+    return tail;
+}
+
+void StrokePredictor::checkPending(const Sample& prev, const Sample& current) {
+    int i = 0;
+    while (i < pending.size()) {
+        const PendingCheck& check = pending[i];
+        if (check.targetTime > current.t) {
+            ++i;
+            continue;
+        }
+
+        // Where the pen actually was at the target time
+        QPointF actual = current.pos;
+        double span = current.t - prev.t;
+        if (span > 0.0 && check.targetTime > prev.t) {
+            double t = (check.targetTime - prev.t) / span;
+            actual = prev.pos * (1.0 - t) + current.pos * t;
+        }
+
+        QPointF predErr = check.predicted - actual;
+        QPointF baseErr = check.baseline - actual;
+        errorSum += std::sqrt(QPointF::dotProduct(predErr, predErr));
+        baselineSum += std::sqrt(QPointF::dotProduct(baseErr, baseErr));
+
+        stats.samples++;
+        stats.meanErrorPx = errorSum / stats.samples;
+        stats.meanBaselinePx = baselineSum / stats.samples;
+        stats.horizonMs = horizonMs;
+
+        // If the prediction is no better than just showing the last sample we gained nothing,
+        // if it is spot on we gained the full horizon
+        double gain = stats.meanBaselinePx > 0.0 ? 1.0 - stats.meanErrorPx / stats.meanBaselinePx : 0.0;
+        stats.effectiveReductionMs = horizonMs * std::clamp(gain, 0.0, 1.0);
+
+        pending.removeAt(i);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef STROKEPREDICTOR_H
+#define STROKEPREDICTOR_H
+
+#include <QVector>
+#include <QPointF>
+#include "../data/StrokePoint.h"
+#include "BrushDynamics.h"
+
+// Stats gathered while latency measurement is on
+struct PredictionStats {
+    int samples = 0;             // predictions that have been checked against real input
+    double meanErrorPx = 0.0;    // predicted tip vs where the pen actually went
+    double meanBaselinePx = 0.0; // last real sample vs where the pen actually went (no prediction)
+    double horizonMs = 0.0;      // how far ahead we extrapolate
+    double effectiveReductionMs = 0.0; // horizon scaled by how much closer the prediction got
+};
+
+class StrokePredictor {
+
+public:
+
+    StrokePredictor();
+
+    void reset();
+    void addSample(const QPointF& pos, float pressure, quint64 timestampMs);
+
+    // Provisional points past the last real sample, empty if there is not enough history
+    QVector<StrokePoint> predictTail(const StrokePoint& lastPoint, const BrushDynamics& dynamics);
+
+    void setHorizonMs(float ms);
+    float getHorizonMs() const { return horizonMs; }
+
+    void setMeasuring(bool value);
+    bool isMeasuring() const { return measuring; }
+    const PredictionStats& getStats() const { return stats; }
+    void resetStats();
+
+private:
+
+    struct Sample {
+        QPointF pos;
+        float pressure;
+        double t; // ms
+    };
+
+    struct PendingCheck {
+        double targetTime;
+        QPointF predicted;
+        QPointF baseline;
+    };
+
+    bool predictAt(double dt, QPointF& pos, float& pressure) const;
+    void checkPending(const Sample& prev, const Sample& current);
+
+    QVector<Sample> samples;          // most recent last, capped at maxSamples
+    QVector<PendingCheck> pending;    // predictions waiting for the real pen to catch up
+
+    static constexpr int maxSamples = 8;
+    static constexpr double windowMs = 80.0; // ignore samples older than this
+    static constexpr int tailSteps = 3;
+
+    float horizonMs = 24.0f;  // ~1.5 frames at 60Hz
+    float maxTailLength = 60.0f; // px, stops wild overshoot on sharp flicks
+
+    bool measuring = false;
+    PredictionStats stats;
+    double errorSum = 0.0;
+    double baselineSum = 0.0;
+};
+
+#endif // STROKEPREDICTOR_H
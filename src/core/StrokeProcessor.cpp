@@ -1,8 +1,14 @@
 #include "StrokeProcessor.h"
 #include "math/mathUtils.h"
+#include <algorithm>
+#include <cmath>
 
 StrokeProcessor::StrokeProcessor() {}
 
+void StrokeProcessor::setInterpolationSegments(int segments) {
+    interpolationSegments = std::clamp(segments, 1, maxInterpolationSegments);
+}
+
 QVector<QPointF> StrokeProcessor::interpolatePoints(const QPointF& p1, const QPointF& p2, int segments) {
     QVector<QPointF> result; //Create empty stroke
     for (int i = 0; i <= segments; ++i) { //loop for # of segments
@@ -19,12 +25,55 @@ QVector<QPointF> StrokeProcessor::interpolatePoints(const QPointF& p1, const QPo
 }
 
 
-QVector<Vertex> StrokeProcessor::generateVertices(const QVector<StrokePoint>& stroke) {
+QRectF StrokeProcessor::strokeBounds(const QVector<StrokePoint>& stroke, int first) const {
+    if (first < 0) first = 0;
+    if (first >= stroke.size()) return QRectF();
+
+    qreal minX = stroke[first].pos.x(), maxX = minX;
+    qreal minY = stroke[first].pos.y(), maxY = minY;
+    for (int i = first + 1; i < stroke.size(); ++i) {
+        const QPointF& p = stroke[i].pos;
+        minX = std::min(minX, p.x());
+        maxX = std::max(maxX, p.x());
+        minY = std::min(minY, p.y());
+        maxY = std::max(maxY, p.y());
+    }
 
+    // Half thickness is capped at 2px in generateVertices, plus a bit for GL_LINE_SMOOTH
+    const qreal pad = 3.0;
+    return QRectF(QPointF(minX, minY), QPointF(maxX, maxY)).adjusted(-pad, -pad, pad, pad);
+}
+
+QVector<Vertex> StrokeProcessor::generateVertices(const QVector<StrokePoint>& stroke) {
     QVector<Vertex> vertices;
+    generateVertices(stroke, vertices);
+    return vertices;
+}
+
+int StrokeProcessor::maxVertexCount(const QVector<StrokePoint>& stroke) const {
+    // Each segment is split into at most interpolationSegments pieces, 2 vertices per piece
+    return stroke.size() < 2 ? 0 : (stroke.size() - 1) * interpolationSegments * 2;
+}
+
+int StrokeProcessor::generateVertices(const QVector<StrokePoint>& stroke, QVector<Vertex>& out) {
+    const int oldSize = out.size();
+    const int needed = oldSize + maxVertexCount(stroke);
+    if (needed > out.capacity()) {
+        out.reserve(std::max<qsizetype>(needed, out.capacity() * 2));
+        stats.allocations++;
+    }
+
+    out.resize(needed);
+    int written = generateVertices(stroke, out.data() + oldSize, needed - oldSize);
+    out.resize(oldSize + written); // capacity stays
+    return written;
+}
 
-    if (stroke.size() < 2) return vertices;
+int StrokeProcessor::generateVertices(const QVector<StrokePoint>& stroke, Vertex* out, int capacity) {
+    stats.calls++;
+    if (stroke.size() < 2 || !out) return 0;
 
+    int count = 0;
     for (int i = 0; i < stroke.size() - 1; ++i) {
         const StrokePoint& p1 = stroke[i];
         const StrokePoint& p2 = stroke[i + 1];
@@ -33,35 +82,36 @@ QVector<Vertex> StrokeProcessor::generateVertices(const QVector<StrokePoint>& st
         float dx = p2.pos.x() - p1.pos.x();
         float dy = p2.pos.y() - p1.pos.y();
         float distance = std::sqrt(dx * dx + dy * dy);
+        const int pieces = distance > 5.0f ? interpolationSegments : 1;
 
-        QVector<QPointF> points;
-        if (distance > 5.0f) {
-            // Only interpolate if points are far apart
-            points = interpolatePoints(p1.pos, p2.pos, 3); // Reduce interpolation
-        }
-        else {
-            points.append(p1.pos);
-            points.append(p2.pos);
-        }
-
-        for (int j = 0; j < points.size() - 1; ++j) {
-            QPointF currentPos = points[j];
-            QPointF nextPos = points[j + 1];
+        // Same points interpolatePoints would give, computed in place
+        QPointF currentPos = p1.pos;
+        for (int j = 0; j < pieces; ++j) {
+            float tNext = static_cast<float>(j + 1) / pieces;
+            QPointF nextPos(p1.pos.x() * (1 - tNext) + p2.pos.x() * tNext,
+                            p1.pos.y() * (1 - tNext) + p2.pos.y() * tNext);
 
             // Calculate direction
             float dirX = nextPos.x() - currentPos.x();
             float dirY = nextPos.y() - currentPos.y();
             float len = std::sqrt(dirX * dirX + dirY * dirY);
 
-            if (len < 0.1f) continue;
+            if (len < 0.1f) {
+                currentPos = nextPos;
+                continue;
+            }
+            if (count + 2 > capacity) {
+                stats.vertices += count;
+                return count; // out of room, caller sized it wrong
+            }
 
             dirX /= len;
             dirY /= len;
 
             // Interpolate thickness
-            float t = static_cast<float>(j) / (points.size() - 1);
+            float t = static_cast<float>(j) / pieces;
             float thick = p1.thickness * (1.0f - t) + p2.thickness * t;
-            thick = std::min<float>(thick, 4.0f) * 0.5f; // Limit and reduce thickness
+            thick = halfWidth(thick); // Limit and reduce thickness
             // Perpendicular offset
             float perpX = -dirY * thick;
             float perpY = dirX * thick;
@@ -69,13 +119,66 @@ QVector<Vertex> StrokeProcessor::generateVertices(const QVector<StrokePoint>& st
             float cx, cy;
             convertToOpenGLCoords(currentPos, cx, cy);
 
-            Vertex v1 = { cx + perpX, cy + perpY, p1.r, p1.g, p1.b, thick };
-            Vertex v2 = { cx - perpX, cy - perpY, p2.r, p2.g, p2.b, thick };
+            out[count++] = { cx + perpX, cy + perpY, p1.r, p1.g, p1.b, thick };
+            out[count++] = { cx - perpX, cy - perpY, p2.r, p2.g, p2.b, thick };
 
-            vertices.append(v1);
-            vertices.append(v2);
+            currentPos = nextPos;
         }
     }
 
-    return vertices;
+    stats.vertices += count;
+    return count;
+}
+
+int StrokeProcessor::generateFillVertices(const QVector<StrokePoint>& fill, QVector<Vertex>& out) {
+    stats.calls++;
+    const int quads = fill.size() / 4;
+    if (quads == 0) return 0;
+
+    const int oldSize = out.size();
+    const int needed = oldSize + quads * 6 - 2;
+    if (needed > out.capacity()) {
+        out.reserve(std::max<qsizetype>(needed, out.capacity() * 2));
+        stats.allocations++;
+    }
+
+    auto vertex = [](const StrokePoint& p) {
+        float x, y;
+        convertToOpenGLCoords(p.pos, x, y);
+        return Vertex{ x, y, p.r, p.g, p.b, 0.0f };
+    };
+
+    // Top left, top right, bottom left, bottom right is already strip order
+    for (int q = 0; q < quads; ++q) {
+        const StrokePoint* corners = fill.constData() + q * 4;
+        if (q > 0) {
+            out.append(out.last());         // end of the last quad
+            out.append(vertex(corners[0])); // start of this one
+        }
+        for (int i = 0; i < 4; ++i) {
+            out.append(vertex(corners[i]));
+        }
+    }
+
+    stats.vertices += out.size() - oldSize;
+    return out.size() - oldSize;
+}
+
+int StrokeProcessor::tessellate(const QVector<StrokePoint>& stroke, EntryKind kind, QVector<Vertex>& out) {
+    switch (kind) {
+    case EntryKind::Stroke:
+        return generateVertices(stroke, out);
+    case EntryKind::Fill:
+        return generateFillVertices(stroke, out);
+    case EntryKind::Transform:
+    case EntryKind::Filter:
+    case EntryKind::Flatten:
+        break; // no mesh of their own
+    }
+    return 0;
+}
+
+TessellationScratch& StrokeProcessor::scratch() {
+    thread_local TessellationScratch buffers;
+    return buffers;
 }
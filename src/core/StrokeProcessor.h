@@ -3,8 +3,23 @@
 
 #include <QVector>
 #include <QPoint>
+#include <QRectF>
+#include <algorithm>
 #include "../data/Vertex.h"
 #include "../data/StrokePoint.h"
+#include "../data/EntryKind.h"
+
+// Reusable buffers for code that tessellates every frame (the live stroke).
+// One per thread, cleared but never shrunk, so after warm-up nothing is allocated.
+struct TessellationScratch {
+    QVector<StrokePoint> stroke;
+};
+
+struct TessellationStats {
+    quint64 calls = 0;
+    quint64 vertices = 0;
+    quint64 allocations = 0; // output buffer had to grow
+};
 
 class StrokeProcessor {
 
@@ -15,6 +30,40 @@ public:
     QVector<QPointF> interpolatePoints(const QPointF& p1, const QPointF& p2, int segments);
     QVector<Vertex> generateVertices(const QVector<StrokePoint>& stroke);
 
+    // Allocation free versions. The span one writes at most capacity vertices and returns how
+    // many it wrote, maxVertexCount() is always enough. The QVector one appends to out and
+    // only allocates when out has no spare capacity left.
+    int maxVertexCount(const QVector<StrokePoint>& stroke) const;
+    int generateVertices(const QVector<StrokePoint>& stroke, Vertex* out, int capacity);
+    int generateVertices(const QVector<StrokePoint>& stroke, QVector<Vertex>& out);
+
+    // Fills (EntryKind::Fill), every 4 points a quad. One strip, the quads
+    // joined by degenerate triangles. Appends to out like the above.
+    int generateFillVertices(const QVector<StrokePoint>& fill, QVector<Vertex>& out);
+    // Whichever the entry needs, nothing for the ones without a mesh
+    int tessellate(const QVector<StrokePoint>& stroke, EntryKind kind, QVector<Vertex>& out);
+
+    static TessellationScratch& scratch(); // this thread's buffers
+
+    // Pieces per segment when points are far apart. Fewer is cheaper and a bit more angular,
+    // the quality controller lowers it for the live stroke only.
+    static constexpr int maxInterpolationSegments = 3;
+    void setInterpolationSegments(int segments);
+    int getInterpolationSegments() const { return interpolationSegments; }
+
+    // Half width of the strip drawn for a point of this thickness, exporters use it too
+    static float halfWidth(float thickness) { return std::min(thickness, 4.0f) * 0.5f; }
+
+    const TessellationStats& getStats() const { return stats; }
+    void resetStats() { stats = TessellationStats(); }
+
+    // Screen space area covered by stroke[first..], padded for thickness and line smoothing
+    QRectF strokeBounds(const QVector<StrokePoint>& stroke, int first = 0) const;
+
+private:
+
+    int interpolationSegments = maxInterpolationSegments;
+    TessellationStats stats;
 };
 
 #endif
@@ -0,0 +1,183 @@
+#include "StrokeRasterizer.h"
+#include "StrokeProcessor.h"
+#include "BrushEngine.h"
+#include <QPolygonF>
+#include <QPainterPath>
+#include <cmath>
+
+namespace {
+
+QColor colorOf(const StrokePoint& p) {
+    return QColor::fromRgbF(qBound(0.0f, p.r, 1.0f), qBound(0.0f, p.g, 1.0f), qBound(0.0f, p.b, 1.0f));
+}
+
+// Quarter pixel steps, consecutive segments with the same width go out as one polyline
+float penWidth(const StrokePoint& a, const StrokePoint& b) {
+    float width = 2.0f * StrokeProcessor::halfWidth((a.thickness + b.thickness) * 0.5f);
+    return std::max(0.25f, std::round(width * 4.0f) / 4.0f);
+}
+
+QPainter::CompositionMode compositionFor(BlendMode mode) {
+    switch (mode) {
+    case BlendMode::Multiply: return QPainter::CompositionMode_Multiply;
+    case BlendMode::Screen: return QPainter::CompositionMode_Screen;
+    case BlendMode::Add: return QPainter::CompositionMode_Plus;
+    case BlendMode::Normal:
+    default: return QPainter::CompositionMode_SourceOver;
+    }
+}
+
+// One path for all the quads, so the edges they share don't show
+void drawQuads(QPainter& painter, const QVector<StrokePoint>& fill, int first, int last) {
+    QPainterPath path;
+    path.setFillRule(Qt::WindingFill);
+    for (int q = (first + 3) / 4; q < last / 4; ++q) {
+        const StrokePoint* corners = fill.constData() + q * 4;
+        path.moveTo(corners[0].pos);
+        path.lineTo(corners[1].pos);
+        path.lineTo(corners[3].pos);
+        path.lineTo(corners[2].pos);
+        path.closeSubpath();
+    }
+    if (path.isEmpty()) return;
+
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.fillPath(path, colorOf(fill.first()));
+}
+
+} // namespace
+
+void StrokeRasterizer::drawPoints(QPainter& painter, const QVector<StrokePoint>& stroke, int first, int last, EntryKind kind) {
+    last = std::min(last, static_cast<int>(stroke.size()));
+    if (first >= last || (kind != EntryKind::Stroke && kind != EntryKind::Fill)) return;
+    if (kind == EntryKind::Fill) {
+        drawQuads(painter, stroke, first, last);
+        return;
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing);
+    QPen pen(colorOf(stroke.first()), 1.0, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin);
+
+    if (stroke.size() == 1) {
+        pen.setWidthF(std::max(1.0f, 2.0f * StrokeProcessor::halfWidth(stroke.first().thickness)));
+        painter.setPen(pen);
+        painter.drawPoint(stroke.first().pos);
+        return;
+    }
+
+    QPolygonF run;
+    float runWidth = -1.0f;
+    auto flush = [&]() {
+        if (run.size() < 2) return;
+        pen.setWidthF(runWidth);
+        painter.setPen(pen);
+        painter.drawPolyline(run);
+    };
+
+    for (int j = std::max(first, 1); j < last; ++j) {
+        float width = penWidth(stroke[j - 1], stroke[j]);
+        if (width != runWidth) {
+            flush();
+            run.clear();
+            run.append(stroke[j - 1].pos);
+            runWidth = width;
+        }
+        run.append(stroke[j].pos);
+    }
+    flush();
+}
+
+void StrokeRasterizer::drawStroke(QPainter& painter, const QVector<StrokePoint>& stroke, EntryKind kind,
+                                  const Symmetry& symmetry) {
+    drawPoints(painter, stroke, 0, stroke.size(), kind);
+    for (int copy = 1; copy < symmetry.copies(); ++copy) {
+        painter.save();
+        painter.setTransform(symmetry.transform(copy), true); // under whatever scale the painter has
+        drawPoints(painter, stroke, 0, stroke.size(), kind);
+        painter.restore();
+    }
+}
+
+QImage StrokeRasterizer::newLayerImage(const QSize& size) {
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    return image;
+}
+
+void StrokeRasterizer::composite(QImage& target, const QVector<Layer>& layers, const QVector<QImage>& layerImages) {
+    target.fill(Qt::white);
+    QPainter painter(&target);
+    for (int i = 0; i < layers.size() && i < layerImages.size(); ++i) {
+        if (!layers[i].visible || layerImages[i].isNull()) continue;
+        painter.setOpacity(layers[i].opacity);
+        painter.setCompositionMode(compositionFor(layers[i].blendMode));
+        painter.drawImage(0, 0, layerImages[i]);
+    }
+}
+
+void StrokeRasterizer::render(QImage& target, qreal scale, const QVector<Layer>& layers, const QHash<int, QImage>& rasters,
+                              const StrokeSnapshot& strokes) {
+    LayerRender layerRender(layers, target.size(), scale);
+    for (auto it = rasters.cbegin(); it != rasters.cend(); ++it) {
+        const int index = layerRender.indexOf(it.key());
+        if (index >= 0) layerRender.drawRaster(index, it.value());
+    }
+
+    const QHash<int, int> starts = BrushEngine::vectorStarts(strokes.records());
+    QVector<StrokePoint> scratch;
+    for (int i = 0; i < strokes.size(); ++i) {
+        const StrokeRecord& stroke = strokes.at(i);
+        const int index = layerRender.indexOf(stroke.layerId);
+        if (index < 0 || !layers[index].visible) continue; // not worth decoding
+        if (!stroke.draws()) continue; // filters are in the rasters, transforms in the points
+        if (i < starts.value(stroke.layerId, 0)) continue; // so are flattened strokes
+        layerRender.drawStroke(index, strokes.pointsOf(i, scratch), stroke.kind, stroke.symmetry);
+    }
+    layerRender.composite(target);
+}
+
+LayerRender::LayerRender(const QVector<Layer>& layers, const QSize& pixels, qreal scale)
+    : layers(layers), pixels(pixels), scale(scale), images(layers.size()), painters(layers.size())
+{
+    for (int i = 0; i < layers.size(); ++i) {
+        layerIndex.insert(layers[i].id, i);
+    }
+}
+
+void LayerRender::begin(const QPoint& topLeft) {
+    for (auto& painter : painters) painter.reset();
+    origin = topLeft;
+}
+
+QPainter* LayerRender::painterFor(int index) {
+    if (index < 0 || index >= layers.size() || !layers[index].visible) return nullptr;
+
+    std::unique_ptr<QPainter>& painter = painters[index];
+    if (!painter) {
+        if (images[index].isNull()) images[index] = StrokeRasterizer::newLayerImage(pixels);
+        else images[index].fill(Qt::transparent);
+        painter = std::make_unique<QPainter>(&images[index]);
+        painter->translate(-origin);
+        painter->scale(scale, scale);
+        painter->setRenderHint(QPainter::SmoothPixmapTransform, scale != 1.0);
+    }
+    return painter.get();
+}
+
+void LayerRender::drawRaster(int index, const QImage& raster) {
+    if (QPainter* painter = painterFor(index)) painter->drawImage(QPointF(0, 0), raster);
+}
+
+void LayerRender::drawStroke(int index, const QVector<StrokePoint>& stroke, EntryKind kind, const Symmetry& symmetry) {
+    if (QPainter* painter = painterFor(index)) StrokeRasterizer::drawStroke(*painter, stroke, kind, symmetry);
+}
+
+void LayerRender::composite(QImage& target) {
+    QVector<QImage> drawn(layers.size());
+    for (int i = 0; i < layers.size(); ++i) {
+        if (!painters[i]) continue;
+        painters[i].reset(); // done drawing
+        drawn[i] = images[i];
+    }
+    StrokeRasterizer::composite(target, layers, drawn);
+}
@@ -0,0 +1,79 @@
+#ifndef STROKERASTERIZER_H
+#define STROKERASTERIZER_H
+
+#include <QVector>
+#include <QHash>
+#include <QImage>
+#include <QPainter>
+#include <memory>
+#include <vector>
+#include "StrokeSnapshot.h"
+#include "../data/StrokePoint.h"
+#include "../data/Layer.h"
+#include "../data/Symmetry.h"
+#include "../data/EntryKind.h"
+
+// CPU drawing of strokes with QPainter, for everything that needs pixels without a GL context
+// (timelapse frames, offscreen renders). Strokes come out as round-capped polylines with the
+// renderer's half widths, textured brushes as their solid shape.
+class StrokeRasterizer {
+
+public:
+
+    // Draws what points [first, last) add to the stroke: the segment into each point,
+    // or a dot for a single point stroke. Drawing a stroke in pieces gives the same pixels.
+    // Fills draw the quads whose 4 points are all in the range, the other kinds draw nothing.
+    static void drawPoints(QPainter& painter, const QVector<StrokePoint>& stroke, int first, int last,
+                           EntryKind kind = EntryKind::Stroke);
+    // Every symmetry copy of the whole stroke
+    static void drawStroke(QPainter& painter, const QVector<StrokePoint>& stroke, EntryKind kind = EntryKind::Stroke,
+                           const Symmetry& symmetry = Symmetry());
+
+    // Layer image the painters above expect, transparent
+    static QImage newLayerImage(const QSize& size);
+
+    // White background plus every visible layer with its opacity and blend mode.
+    // layerImages is parallel to layers, null images are skipped.
+    static void composite(QImage& target, const QVector<Layer>& layers, const QVector<QImage>& layerImages);
+
+    // A whole document onto target at scale (output pixels per document pixel), like the canvas
+    // shows it: rasters at the bottom of their layer, then the strokes that aren't filters or
+    // flattened into them.
+    static void render(QImage& target, qreal scale, const QVector<Layer>& layers, const QHash<int, QImage>& rasters,
+                       const StrokeSnapshot& strokes);
+};
+
+// Draws layers onto images of their own and composites them, a painter per layer opened on its
+// first raster or stroke. The images are kept between begin()s, so drawing tile after tile
+// doesn't allocate. Hidden layers draw nothing.
+class LayerRender {
+
+public:
+
+    // pixels: size of the output, scale: output pixels per document pixel
+    LayerRender(const QVector<Layer>& layers, const QSize& pixels, qreal scale = 1.0);
+
+    int indexOf(int layerId) const { return layerIndex.value(layerId, -1); } // -1 if there's no such layer
+
+    // Starts over with origin (output pixels) at the top left, drops what wasn't composited
+    void begin(const QPoint& origin = QPoint());
+    // Pixels under the layer's strokes, document pixels from the origin, before any of them
+    void drawRaster(int index, const QImage& raster);
+    void drawStroke(int index, const QVector<StrokePoint>& stroke, EntryKind kind, const Symmetry& symmetry);
+    // White plus what was drawn since begin(), target is the output size
+    void composite(QImage& target);
+
+private:
+
+    QPainter* painterFor(int index); // null for hidden layers
+
+    QVector<Layer> layers;
+    QHash<int, int> layerIndex;
+    QSize pixels;
+    qreal scale = 1.0;
+    QPoint origin;
+    QVector<QImage> images; // parallel to layers, allocated on first use
+    std::vector<std::unique_ptr<QPainter>> painters;
+};
+
+#endif // STROKERASTERIZER_H
@@ -0,0 +1,13 @@
+#include "StrokeSnapshot.h"
+#include "StrokeCodec.h"
+#include <QDebug>
+
+const QVector<StrokePoint>& StrokeSnapshot::pointsOf(int index, QVector<StrokePoint>& scratch) const {
+    const StrokeRecord& stroke = strokes[index];
+    if (!stroke.isPacked()) return stroke.points;
+    if (!StrokeCodec::decode(stroke.packed, scratch)) {
+        qWarning() << "[StrokeSnapshot] corrupt compressed stroke";
+        scratch.clear();
+    }
+    return scratch;
+}
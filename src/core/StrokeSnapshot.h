@@ -0,0 +1,32 @@
+#ifndef STROKESNAPSHOT_H
+#define STROKESNAPSHOT_H
+
+#include <QVector>
+#include "../data/StrokePoint.h"
+#include "../data/StrokeRecord.h"
+
+// Strokes the way StrokeManager holds them: hot ones as points, cold ones StrokeCodec
+// packed with empty points. The list is implicitly shared, so taking one is cheap,
+// and a stroke is only decoded when it is asked for, into the caller's scratch.
+// Exports and the timelapse walk a document with it, one decoded stroke at a time.
+class StrokeSnapshot {
+
+public:
+
+    StrokeSnapshot() = default;
+    explicit StrokeSnapshot(const QVector<StrokeRecord>& strokes) : strokes(strokes) {}
+
+    int size() const { return strokes.size(); }
+    bool isEmpty() const { return strokes.isEmpty(); }
+    const StrokeRecord& at(int index) const { return strokes[index]; } // layer, brush, symmetry
+    const QVector<StrokeRecord>& records() const { return strokes; }
+
+    // The points of stroke index, scratch holds them if they had to be decoded
+    const QVector<StrokePoint>& pointsOf(int index, QVector<StrokePoint>& scratch) const;
+
+private:
+
+    QVector<StrokeRecord> strokes;
+};
+
+#endif // STROKESNAPSHOT_H
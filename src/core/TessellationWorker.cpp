@@ -0,0 +1,263 @@
+#include "TessellationWorker.h"
+#include <algorithm>
+
+TessellationWorker::TessellationWorker(QObject* parent) : QObject(parent) {
+    thread = QThread::create([this]() { run(); });
+    thread->setObjectName("Tessellation");
+    thread->start();
+}
+
+TessellationWorker::~TessellationWorker() {
+    stopping.store(true, std::memory_order_release);
+    wake.release();
+    {
+        QMutexLocker lock(&progressMutex);
+        resultsRoom.wakeAll(); // in case it waits in publish()
+    }
+    thread->wait();
+    delete thread;
+}
+
+bool TessellationWorker::submit(TessellationJob&& job) {
+    if (!jobs.tryPush(std::move(job))) return false;
+    ++submitted;
+    wake.release();
+    return true;
+}
+
+void TessellationWorker::submitBlocking(TessellationJob&& job) {
+    if (submit(std::move(job))) return;
+
+    stallCount.fetch_add(1, std::memory_order_relaxed);
+    QMutexLocker lock(&progressMutex);
+    while (!submit(std::move(job))) {
+        drainResults(); // the worker may be waiting on us for room too
+        progressed.wait(&progressMutex); // the worker's batch ends, the queue has room again
+    }
+}
+
+QVector<StrokePoint> TessellationWorker::takeSampleBuffer() {
+    QVector<StrokePoint> buffer;
+    spareSamples.tryPop(buffer);
+    return buffer;
+}
+
+int TessellationWorker::takeResults(QVector<TessellationResult>& out) {
+    // Reset first, a result published while we drain then raises a fresh signal
+    notified.store(false, std::memory_order_release);
+
+    int taken = drained.size();
+    for (TessellationResult& result : drained) out.append(std::move(result));
+    drained.clear(); // keeps capacity
+
+    TessellationResult result;
+    while (results.tryPop(result)) {
+        out.append(std::move(result));
+        ++taken;
+    }
+    if (taken > 0) {
+        QMutexLocker lock(&progressMutex);
+        resultsRoom.wakeOne();
+    }
+    return taken;
+}
+
+void TessellationWorker::waitForIdle() {
+    QMutexLocker lock(&progressMutex);
+    while (!isIdle()) {
+        drainResults();
+        if (isIdle()) break;
+        progressed.wait(&progressMutex);
+    }
+}
+
+void TessellationWorker::drainResults() {
+    TessellationResult result;
+    bool any = false;
+    while (results.tryPop(result)) {
+        drained.append(std::move(result));
+        any = true;
+    }
+    if (any) resultsRoom.wakeOne();
+}
+
+void TessellationWorker::notifyProgress() {
+    // Taking the lock orders this after a waiter's check, so the wake can't get lost
+    QMutexLocker lock(&progressMutex);
+    progressed.wakeAll();
+}
+
+TessellationWorkerStats TessellationWorker::getStats() const {
+    TessellationWorkerStats stats;
+    stats.jobs = jobCount.load(std::memory_order_relaxed);
+    stats.liveMeshes = liveMeshCount.load(std::memory_order_relaxed);
+    stats.commits = commitCount.load(std::memory_order_relaxed);
+    stats.coalesced = coalescedCount.load(std::memory_order_relaxed);
+    stats.stalls = stallCount.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TessellationWorker::run() {
+    TessellationJob job;
+
+    while (true) {
+        wake.acquire();
+        wake.tryAcquire(wake.available()); // one pass drains everything that was pushed
+        if (stopping.load(std::memory_order_acquire)) break;
+
+        quint64 batch = 0;
+        quint64 sampleJobs = 0;
+        while (jobs.tryPop(job)) {
+            ++batch;
+            if (job.type == TessellationJob::Type::LiveSamples) {
+                addSamples(job);
+                ++sampleJobs;
+                job.points.clear(); // keeps capacity, the GUI thread fills it again
+                spareSamples.tryPush(std::move(job.points));
+            }
+            else {
+                commitStroke(job);
+            }
+        }
+
+        // Samples that arrived together only need the newest mesh
+        if (liveDirty) {
+            publishLiveMesh();
+            coalescedCount.fetch_add(sampleJobs - 1, std::memory_order_relaxed);
+        }
+        else if (sampleJobs > 0) {
+            coalescedCount.fetch_add(sampleJobs, std::memory_order_relaxed); // overtaken by their commit
+        }
+
+        jobCount.fetch_add(batch, std::memory_order_relaxed);
+        completed.fetch_add(batch, std::memory_order_release);
+        notifyProgress();
+    }
+}
+
+void TessellationWorker::addSamples(TessellationJob& job) {
+    if (job.strokeId != liveId) {
+        liveId = job.strokeId;
+        liveStroke.clear();
+        liveDirty = false;
+    }
+
+    // Only the segment into the new points changes, plus the tail
+    if (!liveDirty) liveChangedFrom = std::max(0, static_cast<int>(liveStroke.size()) - 1);
+
+    liveStroke += job.points;
+    liveTail = std::move(job.tail);
+    liveColor = job.color;
+    liveBrush = job.brushId;
+    liveDabs = job.dabs;
+    liveSegments = job.segments;
+    liveDirty = true;
+}
+
+void TessellationWorker::publishLiveMesh() {
+    liveDirty = false;
+
+    // Reused every mesh, this thread's own scratch
+    QVector<StrokePoint>& coloredStroke = StrokeProcessor::scratch().stroke;
+    coloredStroke.clear();
+    coloredStroke += liveStroke;
+    coloredStroke += liveTail; // provisional, rebuilt on every real sample
+    if (coloredStroke.size() < 2) return;
+
+    for (auto& pt : coloredStroke) {
+        pt.r = liveColor.r;
+        pt.g = liveColor.g;
+        pt.b = liveColor.b;
+    }
+
+    TessellationResult result;
+    result.type = TessellationResult::Type::LiveMesh;
+    result.strokeId = liveId;
+    result.brushId = liveBrush;
+
+    const BrushSettings& brush = BrushEngine::preset(liveBrush);
+    liveBuffer = (liveBuffer + 1) % liveBufferCount;
+    if (liveDabs) {
+        QVector<Dab>& dabs = liveDabBuffers[liveBuffer];
+        dabs.clear(); // keeps capacity, unless the GUI thread still has this one and it takes a new one
+        brushEngine.appendDabs(coloredStroke, brush, dabs);
+        result.dabs = dabs; // shared, not copied
+    }
+    else {
+        QVector<Vertex>& vertices = liveVertexBuffers[liveBuffer];
+        vertices.clear(); // same
+        vertices.reserve(processor.maxVertexCount(coloredStroke)); // only grows
+        processor.setInterpolationSegments(liveSegments);
+        processor.generateVertices(coloredStroke, vertices);
+        processor.setInterpolationSegments(StrokeProcessor::maxInterpolationSegments);
+        result.vertices = vertices;
+    }
+
+    QRectF bounds = processor.strokeBounds(liveStroke, std::min(liveChangedFrom, std::max(0, static_cast<int>(liveStroke.size()) - 2)));
+    if (brush.textured) {
+        // Dab spacing carries over and jitter is seeded per stroke, so the tip's dabs
+        // can land a bit differently each mesh
+        bounds = BrushEngine::padBounds(bounds, liveStroke, brush);
+    }
+    if (!liveTail.isEmpty()) {
+        bounds = bounds.united(BrushEngine::padBounds(processor.strokeBounds(liveTail), liveTail, brush));
+        if (!liveStroke.isEmpty()) {
+            liveJoint.resize(2);
+            liveJoint[0] = liveStroke.last();
+            liveJoint[1] = liveTail.first();
+            bounds = bounds.united(processor.strokeBounds(liveJoint));
+        }
+    }
+    result.bounds = bounds;
+
+    liveMeshCount.fetch_add(1, std::memory_order_relaxed);
+    publish(std::move(result));
+}
+
+void TessellationWorker::commitStroke(TessellationJob& job) {
+    if (job.strokeId == liveId) {
+        // The commit supersedes whatever live samples are still pending
+        liveId = 0;
+        liveStroke.clear();
+        liveTail.clear();
+        liveDirty = false;
+    }
+    if (job.points.size() < 2) return;
+
+    TessellationResult result;
+    result.type = TessellationResult::Type::StrokeMesh;
+    result.strokeId = job.strokeId;
+    result.brushId = job.brushId;
+    result.layerId = job.layerId;
+    result.symmetry = job.symmetry;
+
+    // Solid strips are always generated, they are the fallback when dabs can't be drawn
+    const BrushSettings& brush = BrushEngine::preset(job.brushId);
+    result.vertices.reserve(processor.maxVertexCount(job.points));
+    processor.generateVertices(job.points, result.vertices);
+    if (job.dabs) {
+        result.dabs = brushEngine.generateDabs(job.points, brush);
+    }
+    result.bounds = BrushEngine::padBounds(processor.strokeBounds(job.points), job.points, brush);
+    result.points = std::move(job.points);
+
+    commitCount.fetch_add(1, std::memory_order_relaxed);
+    publish(std::move(result));
+}
+
+void TessellationWorker::publish(TessellationResult&& result) {
+    if (!results.tryPush(std::move(result))) {
+        // GUI thread is behind, results can't be dropped (the live mesh dirty rects chain)
+        stallCount.fetch_add(1, std::memory_order_relaxed);
+        QMutexLocker lock(&progressMutex);
+        while (!results.tryPush(std::move(result))) {
+            if (stopping.load(std::memory_order_acquire)) return;
+            progressed.wakeAll(); // a GUI thread blocked on us drains
+            resultsRoom.wait(&progressMutex);
+        }
+    }
+
+    if (!notified.exchange(true, std::memory_order_acq_rel)) {
+        emit resultsReady();
+    }
+}
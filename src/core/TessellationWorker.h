@@ -0,0 +1,148 @@
+#ifndef TESSELLATIONWORKER_H
+#define TESSELLATIONWORKER_H
+
+#include <QObject>
+#include <QThread>
+#include <QSemaphore>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QRectF>
+#include <atomic>
+#include "../data/StrokePoint.h"
+#include "../data/Vertex.h"
+#include "../data/Dab.h"
+#include "../data/Symmetry.h"
+#include "StrokeProcessor.h"
+#include "BrushEngine.h"
+#include "SpscQueue.h"
+#include "ColorSpace.h"
+
+// GUI thread -> worker
+struct TessellationJob {
+    enum class Type {
+        LiveSamples, // points appended to the live stroke since the last job, plus the current tail
+        Commit       // the finished stroke, whole
+    };
+
+    Type type = Type::LiveSamples;
+    quint64 strokeId = 0;
+    QVector<StrokePoint> points;
+    QVector<StrokePoint> tail;  // predicted, LiveSamples only
+    RGBf color;                 // live stroke color, LiveSamples only
+    int brushId = 0;
+    int layerId = -1;
+    Symmetry symmetry;          // Commit only, handed back with the mesh
+    bool dabs = false;          // textured brush the renderer can draw, generate dabs too
+    int segments = StrokeProcessor::maxInterpolationSegments; // live mesh density, LiveSamples only
+};
+
+// Worker -> GUI thread
+struct TessellationResult {
+    enum class Type {
+        LiveMesh,  // live stroke + tail, replaces the previous one
+        StrokeMesh // a committed stroke, ready to append to the document
+    };
+
+    Type type = Type::LiveMesh;
+    quint64 strokeId = 0;
+    QVector<StrokePoint> points; // StrokeMesh only, handed back for the stroke manager
+    QVector<Vertex> vertices;
+    QVector<Dab> dabs;
+    QRectF bounds; // LiveMesh: area that changed since the previous mesh, StrokeMesh: the whole stroke. Source stroke only
+    int brushId = 0;
+    int layerId = -1;
+    Symmetry symmetry; // StrokeMesh only
+};
+
+struct TessellationWorkerStats {
+    quint64 jobs = 0;
+    quint64 liveMeshes = 0;
+    quint64 commits = 0;
+    quint64 coalesced = 0; // sample jobs folded into a later mesh
+    quint64 stalls = 0;    // times a side had to wait for room in a queue
+};
+
+// Tessellates on its own thread so committing a long stroke never holds up input.
+// Jobs and results travel through lock-free single producer/single consumer queues,
+// the GUI thread is the only producer of jobs and the only consumer of results.
+class TessellationWorker : public QObject {
+    Q_OBJECT
+
+public:
+
+    explicit TessellationWorker(QObject* parent = nullptr);
+    ~TessellationWorker();
+
+    // GUI thread only
+    bool submit(TessellationJob&& job);          // false when the queue is full, job is left alone
+    void submitBlocking(TessellationJob&& job);  // waits for room, for jobs that can't be dropped
+    int takeResults(QVector<TessellationResult>& out); // appends, returns how many
+    // An empty buffer for a LiveSamples job's points, one the worker is done with when there is one
+    QVector<StrokePoint> takeSampleBuffer();
+    void waitForIdle(); // until every submitted job has its result out, takeResults has them
+    bool isIdle() const { return completed.load(std::memory_order_acquire) == submitted; }
+
+    TessellationWorkerStats getStats() const;
+
+    static constexpr int queueCapacity = 256;
+
+signals:
+
+    // Emitted from the worker thread once per batch of results, connect queued
+    void resultsReady();
+
+private:
+
+    void run();
+    void addSamples(TessellationJob& job);
+    void publishLiveMesh();
+    void commitStroke(TessellationJob& job);
+    void publish(TessellationResult&& result);
+    void drainResults(); // GUI thread, progressMutex held: a worker stuck on a full results queue can go on
+    void notifyProgress(); // worker thread, after a batch
+
+    SpscQueue<TessellationJob, queueCapacity> jobs;
+    SpscQueue<TessellationResult, queueCapacity> results;
+    SpscQueue<QVector<StrokePoint>, queueCapacity> spareSamples; // emptied LiveSamples points, back to the GUI thread
+    QSemaphore wake;
+    // Only for the blocking waits: the worker wakes the GUI thread after each batch and when
+    // its results don't fit, the GUI thread wakes the worker when it made room
+    QMutex progressMutex;
+    QWaitCondition progressed;
+    QWaitCondition resultsRoom;
+    QThread* thread = nullptr;
+    std::atomic<bool> stopping{ false };
+    std::atomic<bool> notified{ false };
+    std::atomic<quint64> completed{ 0 };
+    quint64 submitted = 0; // GUI thread
+    QVector<TessellationResult> drained; // GUI thread, popped by a wait, before anything in results
+
+    std::atomic<quint64> jobCount{ 0 };
+    std::atomic<quint64> liveMeshCount{ 0 };
+    std::atomic<quint64> commitCount{ 0 };
+    std::atomic<quint64> coalescedCount{ 0 };
+    std::atomic<quint64> stallCount{ 0 };
+
+    // Worker thread only
+    StrokeProcessor processor;
+    BrushEngine brushEngine;
+    quint64 liveId = 0;
+    QVector<StrokePoint> liveStroke;
+    QVector<StrokePoint> liveTail;
+    RGBf liveColor;
+    int liveBrush = 0;
+    bool liveDabs = false;
+    int liveSegments = StrokeProcessor::maxInterpolationSegments;
+    bool liveDirty = false;
+    // Live meshes go out in these in turn. The GUI thread holds on to the newest one or two it got,
+    // so by the time a buffer comes round again it's usually free and clearing keeps its capacity.
+    static constexpr int liveBufferCount = 3;
+    QVector<Vertex> liveVertexBuffers[liveBufferCount];
+    QVector<Dab> liveDabBuffers[liveBufferCount];
+    int liveBuffer = 0;
+    QVector<StrokePoint> liveJoint; // the segment from the last real point to the tail
+    int liveChangedFrom = 0; // first point whose segment changed since the last mesh
+};
+
+#endif // TESSELLATIONWORKER_H
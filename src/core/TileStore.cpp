@@ -0,0 +1,92 @@
+#include "TileStore.h"
+#include <QDir>
+#include <algorithm>
+
+namespace {
+constexpr int growSlots = 64; // the file grows this many tiles at a time
+}
+
+TileStore::TileStore(const TileStoreOptions& storeOptions)
+    : options(storeOptions)
+{
+    options.tileSize = std::max(16, options.tileSize);
+}
+
+TileStore::~TileStore() {
+    for (const Mapped& m : mapped) {
+        file.unmap(m.data);
+    }
+}
+
+bool TileStore::open() {
+    const QString dir = options.directory.isEmpty() ? QDir::tempPath() : options.directory;
+    file.setFileTemplate(QDir(dir).filePath("lancer-tiles-XXXXXX"));
+    if (!file.open()) {
+        error = "Could not create a tile file in " + dir + ": " + file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void TileStore::setWorkingSet(qint64 bytes) {
+    options.workingSetBytes = bytes;
+    evictTo(bytes);
+}
+
+void TileStore::evictTo(qint64 bytes) {
+    while (!lru.empty() && static_cast<qint64>(mapped.size()) * tileBytes() > bytes) {
+        const quint64 oldest = lru.back();
+        lru.pop_back();
+        auto it = mapped.find(oldest);
+        if (it != mapped.end()) {
+            file.unmap(it->data);
+            mapped.erase(it);
+            stats.evictions++;
+        }
+    }
+    stats.mapped = mapped.size();
+    stats.mappedBytes = mapped.size() * tileBytes();
+}
+
+uchar* TileStore::map(quint64 key, bool* created) {
+    if (created) *created = false;
+
+    auto it = mapped.find(key);
+    if (it != mapped.end()) {
+        lru.splice(lru.begin(), lru, it->lru); // most recent
+        return it->data;
+    }
+
+    auto slot = slotIndex.find(key);
+    const bool isNew = slot == slotIndex.end();
+    if (isNew) {
+        if (slotIndex.size() >= slotCapacity) {
+            // New space reads back as zeros, a transparent tile
+            if (!file.resize((slotCapacity + growSlots) * tileBytes())) {
+                error = "Could not grow the tile file: " + file.errorString();
+                return nullptr;
+            }
+            slotCapacity += growSlots;
+            stats.fileBytes = file.size();
+        }
+        slot = slotIndex.insert(key, slotIndex.size());
+        stats.tiles = slotIndex.size();
+    }
+
+    // Room first, so the new one is never the one that goes
+    evictTo(options.workingSetBytes - tileBytes());
+
+    uchar* data = file.map(*slot * tileBytes(), tileBytes());
+    if (!data) {
+        error = "Could not map a tile: " + file.errorString();
+        return nullptr;
+    }
+    if (!isNew) stats.pageIns++;
+
+    lru.push_front(key);
+    mapped.insert(key, { data, lru.begin() });
+    stats.mapped = mapped.size();
+    stats.mappedBytes = mapped.size() * tileBytes();
+    if (created) *created = isNew;
+    return data;
+}
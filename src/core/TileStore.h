@@ -0,0 +1,71 @@
+#ifndef TILESTORE_H
+#define TILESTORE_H
+
+#include <QTemporaryFile>
+#include <QHash>
+#include <QString>
+#include <list>
+
+struct TileStoreOptions {
+    int tileSize = 512;                              // px, square, 4 bytes a pixel
+    qint64 workingSetBytes = 1024ll * 1024 * 1024;   // mapped at once, the rest stays on disk
+    QString directory;                               // for the backing file, empty = system temp
+};
+
+struct TileStoreStats {
+    int tiles = 0;        // with a slot in the file
+    int mapped = 0;
+    qint64 fileBytes = 0;
+    qint64 mappedBytes = 0;
+    quint64 pageIns = 0;  // tiles mapped back in after being evicted
+    quint64 evictions = 0;
+};
+
+// Raster tiles in a temporary file, mapped into memory a tile at a time. The most recently
+// used tiles stay mapped up to the working set, older ones are unmapped and live on in the
+// file (the OS writes them back). A tile gets its slot on first use, zero filled, so a huge
+// canvas only costs disk for the tiles that were actually drawn.
+class TileStore {
+
+public:
+
+    explicit TileStore(const TileStoreOptions& options = TileStoreOptions());
+    ~TileStore();
+
+    bool open(); // creates the backing file
+    QString errorString() const { return error; }
+
+    int tileSize() const { return options.tileSize; }
+    qint64 tileBytes() const { return static_cast<qint64>(options.tileSize) * options.tileSize * 4; }
+    void setWorkingSet(qint64 bytes); // evicts down to it right away
+
+    static quint64 key(int tx, int ty) { return (static_cast<quint64>(static_cast<quint32>(ty)) << 32) | static_cast<quint32>(tx); }
+    bool contains(quint64 key) const { return slotIndex.contains(key); }
+
+    // tileSize() rows of tileSize() * 4 bytes, created if needed (created is set then).
+    // Stays valid until a later map() evicts it, the tile just mapped never goes first.
+    // nullptr when the file can't grow or map.
+    uchar* map(quint64 key, bool* created = nullptr);
+
+    const TileStoreStats& getStats() const { return stats; }
+
+private:
+
+    struct Mapped {
+        uchar* data = nullptr;
+        std::list<quint64>::iterator lru;
+    };
+
+    void evictTo(qint64 bytes);
+
+    TileStoreOptions options;
+    QTemporaryFile file;
+    QHash<quint64, int> slotIndex;   // tile -> slot in the file
+    int slotCapacity = 0;        // slots the file has room for
+    QHash<quint64, Mapped> mapped;
+    std::list<quint64> lru;      // most recent first
+    QString error;
+    TileStoreStats stats;
+};
+
+#endif // TILESTORE_H
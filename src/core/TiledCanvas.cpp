@@ -0,0 +1,349 @@
+#include "TiledCanvas.h"
+#include "StrokeCodec.h"
+#include "StrokeProcessor.h"
+#include "StrokeRasterizer.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr qint64 initialStrokeBytes = 16ll * 1024 * 1024;
+
+// TIFF is written little endian, whatever the host is
+void putLE(QByteArray& out, quint64 value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.append(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+enum TiffType : quint16 { Short = 3, Long = 4, Long8 = 16 };
+
+struct TiffEntry {
+    quint16 tag;
+    quint16 type;
+    quint64 count;
+    QByteArray value; // little endian, placed after the tiles when it doesn't fit the entry
+};
+
+int typeSize(quint16 type) {
+    return type == Short ? 2 : (type == Long ? 4 : 8);
+}
+
+TiffEntry tiffEntry(quint16 tag, quint16 type, const QVector<quint64>& values) {
+    TiffEntry entry{ tag, type, static_cast<quint64>(values.size()), QByteArray() };
+    for (quint64 v : values) putLE(entry.value, v, typeSize(type));
+    return entry;
+}
+
+} // namespace
+
+TiledCanvas::TiledCanvas(const TileStoreOptions& options)
+    : store(options)
+{
+}
+
+TiledCanvas::~TiledCanvas() {
+    if (strokeData) strokeFile.unmap(strokeData);
+}
+
+bool TiledCanvas::create(const QSize& documentSize, qreal outputScale, const QVector<Layer>& documentLayers) {
+    scale = outputScale;
+    size = QSize(qCeil(documentSize.width() * scale), qCeil(documentSize.height() * scale));
+    layers = documentLayers;
+    layerIndex.clear();
+    for (int i = 0; i < layers.size(); ++i) {
+        layerIndex.insert(layers[i].id, i);
+    }
+
+    if (size.isEmpty()) {
+        error = "Nothing to render";
+        return false;
+    }
+    if (!store.open()) {
+        error = store.errorString();
+        return false;
+    }
+
+    strokeFile.setFileTemplate(QDir(QDir::tempPath()).filePath("lancer-strokes-XXXXXX"));
+    if (!strokeFile.open()) {
+        error = "Could not create the stroke file: " + strokeFile.errorString();
+        return false;
+    }
+
+    const int ts = store.tileSize();
+    layerRender = std::make_unique<LayerRender>(layers, QSize(ts, ts), scale);
+    layerRasters = QVector<QImage>(layers.size());
+    blank = QImage(ts, ts, QImage::Format_RGB32);
+    blank.fill(Qt::white);
+    return true;
+}
+
+bool TiledCanvas::appendStrokeData(const QByteArray& packed, qint64& offset) {
+    if (strokeUsed + packed.size() > strokeCapacity) {
+        qint64 capacity = std::max(initialStrokeBytes, strokeCapacity);
+        while (capacity < strokeUsed + packed.size()) capacity *= 2;
+
+        if (strokeData) strokeFile.unmap(strokeData);
+        strokeData = nullptr;
+        if (!strokeFile.resize(capacity) || !(strokeData = strokeFile.map(0, capacity))) {
+            error = "Could not grow the stroke file: " + strokeFile.errorString();
+            return false;
+        }
+        strokeCapacity = capacity;
+    }
+
+    offset = strokeUsed;
+    std::copy(packed.constData(), packed.constData() + packed.size(), strokeData + strokeUsed);
+    strokeUsed += packed.size();
+    return true;
+}
+
+void TiledCanvas::addStroke(const QVector<StrokePoint>& points, int layerId, EntryKind kind, const Symmetry& symmetry) {
+    const int layer = layerIndex.value(layerId, -1);
+    if (points.isEmpty() || layer < 0) return;
+
+    qreal minX = points.first().pos.x(), maxX = minX;
+    qreal minY = points.first().pos.y(), maxY = minY;
+    float thickest = 0.0f;
+    for (const StrokePoint& p : points) {
+        minX = std::min(minX, p.pos.x());
+        maxX = std::max(maxX, p.pos.x());
+        minY = std::min(minY, p.pos.y());
+        maxY = std::max(maxY, p.pos.y());
+        thickest = std::max(thickest, p.thickness);
+    }
+    const qreal pad = StrokeProcessor::halfWidth(thickest) + 1.0; // + antialiasing
+    const QRectF bounds = symmetry.map(QRectF(QPointF(minX - pad, minY - pad), QPointF(maxX + pad, maxY + pad)));
+    const QRectF pixels(bounds.topLeft() * scale, bounds.bottomRight() * scale);
+
+    const int ts = store.tileSize();
+    const int x0 = std::max(0, static_cast<int>(std::floor(pixels.left() / ts)));
+    const int y0 = std::max(0, static_cast<int>(std::floor(pixels.top() / ts)));
+    const int x1 = std::min(columns() - 1, static_cast<int>(std::floor(pixels.right() / ts)));
+    const int y1 = std::min(rows() - 1, static_cast<int>(std::floor(pixels.bottom() / ts)));
+    if (x0 > x1 || y0 > y1) return; // off the canvas
+
+    StrokeRef ref;
+    ref.layerIndex = layer;
+    ref.kind = kind;
+    ref.symmetry = symmetry;
+    const QByteArray packed = StrokeCodec::encode(points);
+    ref.size = packed.size();
+    if (!appendStrokeData(packed, ref.offset)) return;
+    stats.strokes++;
+
+    for (int ty = y0; ty <= y1; ++ty) {
+        for (int tx = x0; tx <= x1; ++tx) {
+            const quint64 key = TileStore::key(tx, ty);
+            regions[key].append(ref);
+            if (store.contains(key)) stale.insert(key);
+        }
+    }
+}
+
+void TiledCanvas::setLayerRaster(int layerId, const QImage& raster) {
+    const int layer = layerIndex.value(layerId, -1);
+    if (layer < 0 || raster.isNull()) return;
+    layerRasters[layer] = raster;
+
+    // Every tile under it has something to draw now
+    const int ts = store.tileSize();
+    const int x1 = std::min(columns() - 1, static_cast<int>(std::ceil(raster.width() * scale)) / ts);
+    const int y1 = std::min(rows() - 1, static_cast<int>(std::ceil(raster.height() * scale)) / ts);
+    for (int ty = 0; ty <= y1; ++ty) {
+        for (int tx = 0; tx <= x1; ++tx) {
+            const quint64 key = TileStore::key(tx, ty);
+            regions[key]; // may have no strokes
+            if (store.contains(key)) stale.insert(key);
+        }
+    }
+}
+
+void TiledCanvas::setViewport(const QRect& rect) {
+    const int ts = store.tileSize();
+    const QRect area = rect.intersected(QRect(QPoint(0, 0), size));
+    if (area.isEmpty()) return;
+
+    for (int ty = area.top() / ts; ty <= area.bottom() / ts; ++ty) {
+        for (int tx = area.left() / ts; tx <= area.right() / ts; ++tx) {
+            tile(tx, ty);
+        }
+    }
+}
+
+QImage TiledCanvas::tile(int tx, int ty) {
+    if (tx < 0 || ty < 0 || tx >= columns() || ty >= rows()) return QImage();
+
+    const quint64 key = TileStore::key(tx, ty);
+    if (!regions.contains(key)) return blank;
+
+    bool created = false;
+    uchar* data = store.map(key, &created);
+    if (!data) {
+        error = store.errorString();
+        return QImage();
+    }
+    if (created || stale.remove(key)) {
+        rasterize(tx, ty, data);
+    }
+
+    const int ts = store.tileSize();
+    return QImage(data, ts, ts, ts * 4, QImage::Format_RGB32);
+}
+
+void TiledCanvas::rasterize(int tx, int ty, uchar* data) {
+    QElapsedTimer timer;
+    timer.start();
+
+    const int ts = store.tileSize();
+    const QVector<StrokeRef>& refs = regions[TileStore::key(tx, ty)];
+
+    // Same layering as StrokeRasterizer::render, for just this tile's rasters and strokes
+    layerRender->begin(QPoint(tx * ts, ty * ts));
+    const QRectF area(tx * ts / scale, ty * ts / scale, ts / scale, ts / scale);
+    for (int i = 0; i < layerRasters.size(); ++i) {
+        const QImage& raster = layerRasters[i];
+        if (!raster.isNull() && area.intersects(QRectF(raster.rect()))) layerRender->drawRaster(i, raster);
+    }
+
+    QVector<StrokePoint> points;
+    for (const StrokeRef& ref : refs) {
+        const QByteArray packed = QByteArray::fromRawData(reinterpret_cast<const char*>(strokeData + ref.offset), ref.size);
+        if (StrokeCodec::decode(packed, points)) {
+            layerRender->drawStroke(ref.layerIndex, points, ref.kind, ref.symmetry);
+        }
+    }
+
+    QImage target(data, ts, ts, ts * 4, QImage::Format_RGB32);
+    layerRender->composite(target);
+
+    stats.rasterized++;
+    stats.rasterMs += timer.nsecsElapsed() / 1.0e6;
+}
+
+bool TiledCanvas::writeTiff(QIODevice* out, const std::atomic<bool>* cancel, const std::function<void(int, int)>& progress) {
+    const int ts = store.tileSize();
+    const int tileCount = columns() * rows();
+    const qint64 tileBytes = static_cast<qint64>(ts) * ts * 3;
+
+    // Everything has a known size, so the layout is settled before the first tile goes out:
+    // header, tiles, then the values too big for their entry, then the directory
+    QVector<quint64> offsets(tileCount), counts(tileCount, static_cast<quint64>(tileBytes));
+    const qint64 dataBytes = tileCount * tileBytes;
+    const bool big = dataBytes + tileCount * 16ll + 4096 > 0xffffffffll;
+    const int headerSize = big ? 16 : 8;
+    for (int i = 0; i < tileCount; ++i) {
+        offsets[i] = headerSize + i * tileBytes;
+    }
+
+    const quint16 offsetType = big ? Long8 : Long;
+    const QVector<TiffEntry> entries = {
+        tiffEntry(256, Long, { static_cast<quint64>(size.width()) }),
+        tiffEntry(257, Long, { static_cast<quint64>(size.height()) }),
+        tiffEntry(258, Short, { 8, 8, 8 }),   // bits per sample
+        tiffEntry(259, Short, { 1 }),         // no compression
+        tiffEntry(262, Short, { 2 }),         // RGB
+        tiffEntry(277, Short, { 3 }),         // samples per pixel
+        tiffEntry(284, Short, { 1 }),         // chunky
+        tiffEntry(322, Long, { static_cast<quint64>(ts) }),
+        tiffEntry(323, Long, { static_cast<quint64>(ts) }),
+        tiffEntry(324, offsetType, offsets),
+        tiffEntry(325, offsetType, counts),
+    };
+
+    const int inlineBytes = big ? 8 : 4;
+    const quint64 tailStart = headerSize + dataBytes;
+    QByteArray tail;   // out of line values
+    QVector<quint64> valueOffsets;
+    for (const TiffEntry& entry : entries) {
+        if (entry.value.size() > inlineBytes) {
+            valueOffsets.append(tailStart + tail.size());
+            tail += entry.value;
+            if (tail.size() % 2) tail.append('\0'); // word aligned
+        }
+        else {
+            valueOffsets.append(0);
+        }
+    }
+    const quint64 ifdOffset = tailStart + tail.size();
+
+    QByteArray header("II");
+    if (big) {
+        putLE(header, 43, 2);
+        putLE(header, 8, 2);  // offset size
+        putLE(header, 0, 2);
+        putLE(header, ifdOffset, 8);
+    }
+    else {
+        putLE(header, 42, 2);
+        putLE(header, ifdOffset, 4);
+    }
+    if (out->write(header) != header.size()) {
+        error = "Write failed: " + out->errorString();
+        return false;
+    }
+
+    // Tiles, left to right, top to bottom. Edge tiles are written whole, readers crop them.
+    QByteArray rgb(static_cast<int>(tileBytes), '\0');
+    for (int ty = 0, done = 0; ty < rows(); ++ty) {
+        for (int tx = 0; tx < columns(); ++tx, ++done) {
+            if (cancel && cancel->load()) {
+                error = "Cancelled";
+                return false;
+            }
+
+            const QImage image = tile(tx, ty);
+            if (image.isNull()) return false;
+
+            char* dst = rgb.data();
+            for (int y = 0; y < ts; ++y) {
+                const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+                for (int x = 0; x < ts; ++x) {
+                    *dst++ = static_cast<char>(qRed(line[x]));
+                    *dst++ = static_cast<char>(qGreen(line[x]));
+                    *dst++ = static_cast<char>(qBlue(line[x]));
+                }
+            }
+            if (out->write(rgb) != rgb.size()) {
+                error = "Write failed: " + out->errorString();
+                return false;
+            }
+            if (progress) progress(done + 1, tileCount);
+        }
+    }
+
+    QByteArray ifd = tail;
+    putLE(ifd, entries.size(), big ? 8 : 2);
+    for (int i = 0; i < entries.size(); ++i) {
+        const TiffEntry& entry = entries[i];
+        putLE(ifd, entry.tag, 2);
+        putLE(ifd, entry.type, 2);
+        putLE(ifd, entry.count, big ? 8 : 4);
+        if (valueOffsets[i] == 0) {
+            QByteArray value = entry.value;
+            value.append(QByteArray(inlineBytes - value.size(), '\0'));
+            ifd += value;
+        }
+        else {
+            putLE(ifd, valueOffsets[i], inlineBytes);
+        }
+    }
+    putLE(ifd, 0, big ? 8 : 4); // no next directory
+
+    if (out->write(ifd) != ifd.size()) {
+        error = "Write failed: " + out->errorString();
+        return false;
+    }
+    return true;
+}
+
+TiledCanvasStats TiledCanvas::getStats() const {
+    TiledCanvasStats s = stats;
+    s.tiles = store.getStats();
+    s.regions = regions.size();
+    s.strokeBytes = strokeUsed;
+    return s;
+}
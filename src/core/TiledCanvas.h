@@ -0,0 +1,105 @@
+#ifndef TILEDCANVAS_H
+#define TILEDCANVAS_H
+
+#include <QVector>
+#include <QImage>
+#include <QHash>
+#include <QSet>
+#include <QRect>
+#include <QTemporaryFile>
+#include <QIODevice>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "TileStore.h"
+#include "../data/StrokePoint.h"
+#include "../data/Layer.h"
+#include "../data/Symmetry.h"
+#include "../data/EntryKind.h"
+
+class LayerRender;
+
+struct TiledCanvasStats {
+    TileStoreStats tiles;
+    int strokes = 0;
+    int regions = 0;          // grid cells with at least one stroke
+    qint64 strokeBytes = 0;   // compressed points in the stroke file
+    quint64 rasterized = 0;   // tiles drawn from their strokes
+    double rasterMs = 0.0;
+};
+
+// A document rendered at any scale, out of core. Strokes go into a memory-mapped file
+// (StrokeCodec packed) and are indexed by the tile grid cells they touch, a tile is drawn
+// from just its own cell's strokes. Drawn tiles live in a TileStore, so what stays in RAM
+// is the working set, whatever the size of the canvas. Tiles are drawn when first asked for
+// and again after a stroke lands on them.
+class TiledCanvas {
+
+public:
+
+    explicit TiledCanvas(const TileStoreOptions& options = TileStoreOptions());
+    ~TiledCanvas();
+
+    // scale: output pixels per document pixel
+    bool create(const QSize& documentSize, qreal scale, const QVector<Layer>& layers);
+    QString errorString() const { return error; }
+
+    QSize pixelSize() const { return size; }
+    int tileSize() const { return store.tileSize(); }
+    int columns() const { return (size.width() + tileSize() - 1) / tileSize(); }
+    int rows() const { return (size.height() + tileSize() - 1) / tileSize(); }
+
+    void addStroke(const QVector<StrokePoint>& points, int layerId, EntryKind kind = EntryKind::Stroke,
+                   const Symmetry& symmetry = Symmetry()); // document coords, strokes and fills
+    // Pixels under a layer's strokes (ARGB32 premultiplied, document pixels from the origin), scaled with the rest
+    void setLayerRaster(int layerId, const QImage& raster);
+
+    // Brings the tiles under rect (output pixels) up to date, newest in the LRU
+    void setViewport(const QRect& rect);
+
+    // Composited, opaque. Points into the store, valid until the next tile() or setViewport().
+    // A null image if the store failed.
+    QImage tile(int tx, int ty);
+
+    // Tiled TIFF (BigTIFF past 4 GB), written a tile at a time. progress(done, total)
+    bool writeTiff(QIODevice* out, const std::atomic<bool>* cancel = nullptr,
+                   const std::function<void(int, int)>& progress = nullptr);
+
+    TiledCanvasStats getStats() const;
+
+private:
+
+    struct StrokeRef {
+        qint64 offset = 0;
+        int size = 0;
+        int layerIndex = 0;
+        EntryKind kind = EntryKind::Stroke;
+        Symmetry symmetry;
+    };
+
+    bool appendStrokeData(const QByteArray& packed, qint64& offset);
+    void rasterize(int tx, int ty, uchar* data);
+
+    TileStore store;
+    QSize size;
+    qreal scale = 1.0;
+    QVector<Layer> layers;
+    QHash<int, int> layerIndex; // id -> index in layers
+
+    // Stroke file, mapped whole and remapped when it has to grow
+    QTemporaryFile strokeFile;
+    uchar* strokeData = nullptr;
+    qint64 strokeCapacity = 0;
+    qint64 strokeUsed = 0;
+
+    QHash<quint64, QVector<StrokeRef>> regions; // tile key -> strokes touching it, in paint order
+    QSet<quint64> stale;                        // drawn tiles a newer stroke landed on
+    std::unique_ptr<LayerRender> layerRender;   // tile sized
+    QVector<QImage> layerRasters;               // parallel to layers, null for most
+    QImage blank;                               // tiles nobody drew on
+
+    QString error;
+    TiledCanvasStats stats;
+};
+
+#endif // TILEDCANVAS_H
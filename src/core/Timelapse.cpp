@@ -0,0 +1,335 @@
+#include "Timelapse.h"
+#include "StrokeRasterizer.h"
+#include <QDir>
+#include <QFile>
+#include <QImageWriter>
+#include <QSet>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr qint64 dayMs = 24ll * 60 * 60 * 1000;
+constexpr qint64 untimedPointMs = 8;   // strokes without times (from a shared canvas) get a steady pace
+constexpr qint64 untimedGapMs = 250;
+
+// Difference of two times of day, a session that runs past midnight wraps around
+qint64 elapsedBetween(qint64 from, qint64 to) {
+    qint64 d = to - from;
+    if (d < -dayMs / 2) d += dayMs;
+    return std::max<qint64>(0, d);
+}
+
+bool isTimed(const QVector<StrokePoint>& stroke) {
+    return !stroke.isEmpty() && stroke.first().strokeTime.isValid();
+}
+
+} // namespace
+
+Timelapse::Timelapse(const TimelapseOptions& timelapseOptions)
+    : options(timelapseOptions)
+{
+    interval = std::max(1, options.checkpointInterval);
+}
+
+void Timelapse::setDocument(const TimelapseDocument& value) {
+    endPainting();
+    document = value;
+    currentIndex = -1;
+    layerIndex.clear();
+    for (int i = 0; i < document.layers.size(); ++i) {
+        layerIndex.insert(document.layers[i].id, i);
+    }
+
+    checkpoints.clear();
+    interval = std::max(1, options.checkpointInterval);
+    stats = TimelapseStats();
+    stats.checkpointInterval = interval;
+    frame = QImage(document.size, QImage::Format_RGB32);
+    restore(nullptr);
+    buildTimeline();
+}
+
+const QVector<StrokePoint>& Timelapse::strokeAt(int index) const {
+    // Seeks and replays ask for the same stroke over and over, one decode each
+    if (index != currentIndex) {
+        current = &document.strokes.pointsOf(index, decoded);
+        currentIndex = index;
+    }
+    return *current;
+}
+
+void Timelapse::buildTimeline() {
+    strokeStarts.resize(document.strokes.size());
+
+    qint64 t = 0;
+    qint64 lastEnd = -1; // time of day the previous timed stroke ended
+    for (int i = 0; i < document.strokes.size(); ++i) {
+        const QVector<StrokePoint>& stroke = strokeAt(i);
+        if (isTimed(stroke)) {
+            qint64 start = stroke.first().strokeTime.msecsSinceStartOfDay();
+            if (lastEnd >= 0) t += std::min<qint64>(elapsedBetween(lastEnd, start), options.maxGapMs);
+            strokeStarts[i] = t;
+            lastEnd = stroke.last().strokeTime.msecsSinceStartOfDay();
+            t += elapsedBetween(start, lastEnd);
+        }
+        else {
+            t += i > 0 ? untimedGapMs : 0;
+            strokeStarts[i] = t;
+            t += stroke.size() * untimedPointMs;
+        }
+    }
+    totalMs = t;
+}
+
+qint64 Timelapse::pointTime(int strokeIndex, int point) const {
+    const QVector<StrokePoint>& stroke = strokeAt(strokeIndex);
+    if (!isTimed(stroke)) return strokeStarts[strokeIndex] + point * untimedPointMs;
+    return strokeStarts[strokeIndex] + elapsedBetween(stroke.first().strokeTime.msecsSinceStartOfDay(),
+                                                      stroke[point].strokeTime.msecsSinceStartOfDay());
+}
+
+Timelapse::Cursor Timelapse::cursorAt(qint64 ms) const {
+    Cursor c;
+    auto it = std::upper_bound(strokeStarts.begin(), strokeStarts.end(), ms);
+    int started = static_cast<int>(it - strokeStarts.begin());
+    if (started == 0) return c;
+
+    // The last stroke that started may still be in progress
+    c.stroke = started - 1;
+    const int size = strokeAt(c.stroke).size();
+    while (c.point < size && pointTime(c.stroke, c.point) <= ms) ++c.point;
+    if (c.point >= size) {
+        c.stroke++;
+        c.point = 0;
+    }
+    return c;
+}
+
+const Timelapse::Checkpoint* Timelapse::checkpointBefore(int stroke) const {
+    auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), stroke,
+                               [](int s, const Checkpoint& c) { return s < c.stroke; });
+    return it == checkpoints.begin() ? nullptr : &*(it - 1);
+}
+
+void Timelapse::restore(const Checkpoint* checkpoint) {
+    endPainting();
+    layerImages = checkpoint ? checkpoint->layers : QVector<QImage>(document.layers.size());
+    cursor = Cursor();
+    cursor.stroke = checkpoint ? checkpoint->stroke : 0;
+    frameDirty = true;
+}
+
+QPainter& Timelapse::painterFor(int index) {
+    if (painters.size() < static_cast<size_t>(layerImages.size())) painters.resize(layerImages.size());
+    if (!painters[index]) {
+        QImage& image = layerImages[index];
+        if (image.isNull()) {
+            image = StrokeRasterizer::newLayerImage(document.size);
+        }
+        else if (!image.isDetached()) {
+            image = image.copy(); // still a checkpoint's, leave that one alone
+        }
+        painters[index] = std::make_unique<QPainter>(&image);
+    }
+    return *painters[index];
+}
+
+void Timelapse::endPainting() {
+    painters.clear(); // ends them
+}
+
+void Timelapse::advanceTo(const Cursor& target) {
+    while (cursor < target && cursor.stroke < document.strokes.size()) {
+        const QVector<StrokePoint>& stroke = strokeAt(cursor.stroke);
+        const int last = cursor.stroke == target.stroke ? target.point : stroke.size();
+
+        // Only strokes and fills draw. Transforms have no points, their strokes show up where they
+        // ended up. Filters and flattens change rasters, which aren't replayed.
+        const StrokeRecord& record = document.strokes.at(cursor.stroke);
+        if (last > cursor.point && record.draws()) {
+            int index = layerIndex.value(record.layerId, -1);
+            if (index >= 0) {
+                QPainter& painter = painterFor(index);
+                const EntryKind kind = record.kind; // fills draw a quad at a time
+                const Symmetry& symmetry = record.symmetry;
+                StrokeRasterizer::drawPoints(painter, stroke, cursor.point, last, kind);
+                for (int copy = 1; copy < symmetry.copies(); ++copy) {
+                    painter.save();
+                    painter.setTransform(symmetry.transform(copy), true);
+                    StrokeRasterizer::drawPoints(painter, stroke, cursor.point, last, kind);
+                    painter.restore();
+                }
+                frameDirty = true;
+            }
+        }
+
+        if (last < stroke.size()) {
+            cursor.point = last;
+            break;
+        }
+
+        cursor.stroke++;
+        cursor.point = 0;
+        stats.lastSeekStrokes++;
+        if (cursor.stroke % interval == 0) addCheckpoint();
+    }
+}
+
+void Timelapse::addCheckpoint() {
+    auto it = std::lower_bound(checkpoints.begin(), checkpoints.end(), cursor.stroke,
+                               [](const Checkpoint& c, int s) { return c.stroke < s; });
+    if (it != checkpoints.end() && it->stroke == cursor.stroke) return; // made on an earlier pass
+
+    endPainting(); // the images get shared, nothing may be drawing into them
+    Checkpoint checkpoint;
+    checkpoint.stroke = cursor.stroke;
+    checkpoint.layers = layerImages;
+    checkpoints.insert(static_cast<int>(it - checkpoints.begin()), checkpoint);
+    enforceBudget();
+}
+
+// Layers nobody drew on between two checkpoints share their image, count those once.
+// Over budget, every other checkpoint goes and the interval doubles.
+void Timelapse::enforceBudget() {
+    auto measure = [this]() {
+        QSet<qint64> seen;
+        qint64 bytes = 0;
+        for (const Checkpoint& checkpoint : checkpoints) {
+            for (const QImage& image : checkpoint.layers) {
+                if (image.isNull() || seen.contains(image.cacheKey())) continue;
+                seen.insert(image.cacheKey());
+                bytes += image.sizeInBytes();
+            }
+        }
+        return bytes;
+    };
+
+    qint64 bytes = measure();
+    while (bytes > options.checkpointBudgetBytes && checkpoints.size() > 1) {
+        interval *= 2;
+        checkpoints.erase(std::remove_if(checkpoints.begin(), checkpoints.end(),
+                                         [this](const Checkpoint& c) { return c.stroke % interval != 0; }),
+                          checkpoints.end());
+        bytes = measure();
+    }
+
+    stats.checkpoints = checkpoints.size();
+    stats.checkpointBytes = bytes;
+    stats.checkpointInterval = interval;
+}
+
+QImage Timelapse::frameAt(qint64 ms) {
+    QElapsedTimer timer;
+    timer.start();
+    stats.lastSeekStrokes = 0;
+
+    const Cursor target = cursorAt(ms);
+    const Checkpoint* checkpoint = checkpointBefore(target.stroke);
+    if (target < cursor) {
+        restore(checkpoint); // back in time
+    }
+    else if (checkpoint && cursor.stroke < checkpoint->stroke) {
+        restore(checkpoint); // far ahead, skip what the checkpoint already has
+    }
+    advanceTo(target);
+
+    if (frameDirty && !frame.isNull()) {
+        endPainting();
+        StrokeRasterizer::composite(frame, document.layers, layerImages);
+        frameDirty = false;
+    }
+
+    stats.lastFrameMs = timer.elapsed();
+    return frame;
+}
+
+bool Timelapse::exportFrames(const QString& dir, const TimelapseExportOptions& exportOptions,
+                             const std::atomic<bool>* cancel, const std::function<void(int, int)>& progress)
+{
+    error.clear();
+    QDir out(dir);
+    if (!out.exists() && !out.mkpath(".")) {
+        error = "Could not create " + dir;
+        return false;
+    }
+
+    const double speed = std::max(0.01, exportOptions.speed);
+    const int fps = std::max(1, exportOptions.fps);
+    const qint64 frames = static_cast<qint64>(std::ceil(totalMs / speed * fps / 1000.0)) + 1; // + the finished picture
+    if (frames > std::numeric_limits<int>::max()) {
+        error = "Too many frames, raise the speed";
+        return false;
+    }
+    const int total = static_cast<int>(frames);
+
+    auto framePath = [&](int index) {
+        return out.filePath(QString("frame_%1.%2").arg(index, 6, 10, QChar('0')).arg(exportOptions.format));
+    };
+
+    // Encoding is the slow part, it runs on the pool while the next frames get drawn.
+    // The semaphore keeps a bounded number of frames in memory.
+    QThreadPool* pool = QThreadPool::globalInstance();
+    const int maxInFlight = std::max(2, pool->maxThreadCount() * 2);
+    QSemaphore inFlight(maxInFlight);
+    std::atomic<bool> failed{ false };
+
+    restore(nullptr);
+    qint64 lastKey = 0;
+    int lastWritten = -1;
+    QVector<QPair<int, int>> copies; // frame, frame with the same picture
+
+    int i = 0;
+    for (; i < total; ++i) {
+        if ((cancel && cancel->load()) || failed.load()) break;
+
+        const qint64 t = std::min(totalMs, static_cast<qint64>(std::llround(i * 1000.0 * speed / fps)));
+        QImage image = frameAt(t);
+
+        if (lastWritten >= 0 && image.cacheKey() == lastKey) {
+            copies.append(qMakePair(i, lastWritten)); // idle, no need to encode it again
+        }
+        else {
+            lastKey = image.cacheKey();
+            lastWritten = i;
+            inFlight.acquire();
+            const QString path = framePath(i);
+            const QByteArray format = exportOptions.format.toLatin1();
+            const int quality = exportOptions.quality;
+            pool->start([image, path, format, quality, &failed, &inFlight]() {
+                QImageWriter writer(path, format);
+                writer.setQuality(quality);
+                if (!writer.write(image)) failed = true;
+                inFlight.release();
+            });
+        }
+
+        if (progress) progress(i + 1, total);
+    }
+
+    inFlight.acquire(maxInFlight); // every encode is done
+    inFlight.release(maxInFlight);
+
+    for (const auto& copy : copies) {
+        const QString target = framePath(copy.first);
+        QFile::remove(target);
+        if (!QFile::copy(framePath(copy.second), target)) {
+            failed = true;
+            break;
+        }
+    }
+
+    if (failed) {
+        error = "Could not write frames to " + dir;
+        return false;
+    }
+    if (i < total) {
+        error = "Cancelled";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,125 @@
+#ifndef TIMELAPSE_H
+#define TIMELAPSE_H
+
+#include <QVector>
+#include <QImage>
+#include <QSize>
+#include <QHash>
+#include <QString>
+#include <QPair>
+#include <QPainter>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "../data/StrokePoint.h"
+#include "../data/Layer.h"
+#include "../data/Symmetry.h"
+#include "StrokeSnapshot.h"
+
+// What gets replayed, copied from the document (the vectors are implicitly shared, cheap,
+// and cold strokes stay packed until the replay gets to them). Fills are drawn differently,
+// symmetry copies grow along with the source.
+struct TimelapseDocument {
+    QSize size;
+    QVector<Layer> layers;
+    StrokeSnapshot strokes;
+};
+
+struct TimelapseOptions {
+    int checkpointInterval = 250;                        // strokes between raster checkpoints
+    qint64 checkpointBudgetBytes = 512ll * 1024 * 1024; // past it every other checkpoint goes
+    int maxGapMs = 1000;                                 // idle time between strokes is capped at this
+};
+
+struct TimelapseExportOptions {
+    double speed = 10.0; // timeline ms per output ms
+    int fps = 30;
+    QString format = "png";
+    int quality = 90;    // QImageWriter quality, for png higher is faster and bigger
+};
+
+struct TimelapseStats {
+    int checkpoints = 0;
+    qint64 checkpointBytes = 0; // images shared between checkpoints count once
+    int checkpointInterval = 0;
+    int lastSeekStrokes = 0;    // strokes replayed by the last frameAt
+    qint64 lastFrameMs = 0;
+};
+
+// Replays a document in drawing order, timed by the points' strokeTime. Frames are
+// rendered on the CPU one layer image per layer, advancing from the previous frame when
+// time moves forward. Every checkpointInterval strokes the layer images are kept, a seek
+// starts from the nearest checkpoint before it instead of from the first stroke.
+// Checkpoints are made on the way, the first seek to the end pays for the full replay.
+class Timelapse {
+
+public:
+
+    Timelapse(const TimelapseOptions& options = TimelapseOptions());
+
+    void setDocument(const TimelapseDocument& document);
+    qint64 duration() const { return totalMs; } // timeline ms, gaps capped
+    int strokeCount() const { return document.strokes.size(); }
+
+    // The document as it was at time ms
+    QImage frameAt(qint64 ms);
+
+    // Writes frame_000000.<format>... into dir. Blocking, meant for a worker thread:
+    // encoding runs on the global thread pool, frames where nothing changed are copied.
+    // progress(frame, total) may be called from the calling thread, cancel stops early.
+    bool exportFrames(const QString& dir, const TimelapseExportOptions& options,
+                      const std::atomic<bool>* cancel = nullptr,
+                      const std::function<void(int, int)>& progress = nullptr);
+
+    QString errorString() const { return error; }
+    const TimelapseStats& getStats() const { return stats; }
+
+private:
+
+    // Strokes before stroke are drawn, and the first point points of stroke
+    struct Cursor {
+        int stroke = 0;
+        int point = 0;
+        bool operator<(const Cursor& o) const { return stroke < o.stroke || (stroke == o.stroke && point < o.point); }
+    };
+
+    struct Checkpoint {
+        int stroke = 0; // strokes drawn
+        QVector<QImage> layers;
+    };
+
+    const QVector<StrokePoint>& strokeAt(int index) const; // decodes when index changes
+    void buildTimeline();
+    qint64 pointTime(int stroke, int point) const;
+    Cursor cursorAt(qint64 ms) const;
+    void advanceTo(const Cursor& target);
+    void restore(const Checkpoint* checkpoint); // nullptr = blank
+    const Checkpoint* checkpointBefore(int stroke) const;
+    void addCheckpoint();
+    void enforceBudget();
+    QPainter& painterFor(int layerIndex);
+    void endPainting();
+
+    TimelapseOptions options;
+    TimelapseDocument document;
+    QHash<int, int> layerIndex; // layer id -> index in document.layers
+    QVector<qint64> strokeStarts;
+    mutable QVector<StrokePoint> decoded;
+    mutable const QVector<StrokePoint>* current = nullptr; // strokeAt's, decoded or the hot stroke itself
+    mutable int currentIndex = -1;
+    qint64 totalMs = 0;
+
+    QVector<QImage> layerImages;
+    std::vector<std::unique_ptr<QPainter>> painters; // open on layerImages while replaying
+    Cursor cursor;
+    QVector<Checkpoint> checkpoints; // by stroke, ascending
+    int interval = 0;
+
+    QImage frame;
+    bool frameDirty = true;
+
+    QString error;
+    TimelapseStats stats;
+};
+
+#endif // TIMELAPSE_H
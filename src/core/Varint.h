@@ -0,0 +1,63 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+// LEB128 style varints, zigzag for signed values. Shared by the sync wire format and
+// the in-memory stroke compression.
+namespace Varint {
+
+inline void write(QByteArray& out, quint64 value) {
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+inline void writeSigned(QByteArray& out, qint64 value) {
+    write(out, (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63)); // zigzag
+}
+
+// Reads from the front, failed sticks once anything ran past the end
+struct Reader {
+    const QByteArray& data;
+    int pos = 0;
+    bool failed = false;
+
+    quint64 varint() {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= data.size()) break;
+            quint8 byte = static_cast<quint8>(data[pos++]);
+            value |= static_cast<quint64>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        failed = true;
+        return 0;
+    }
+
+    qint64 signedVarint() {
+        quint64 v = varint();
+        return static_cast<qint64>(v >> 1) ^ -static_cast<qint64>(v & 1);
+    }
+
+    quint8 byte() {
+        if (pos >= data.size()) {
+            failed = true;
+            return 0;
+        }
+        return static_cast<quint8>(data[pos++]);
+    }
+
+    quint32 u32() {
+        quint32 v = 0;
+        for (int i = 0; i < 4; ++i) v = (v << 8) | byte();
+        return v;
+    }
+};
+
+} // namespace Varint
+
+#endif // VARINT_H
@@ -0,0 +1,548 @@
+#include "VectorExporter.h"
+#include "StrokeProcessor.h"
+#include <QIODevice>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+
+// Fixed point with trailing zeros dropped, QByteArray::number is too slow for millions of coords
+void appendNumber(QByteArray& out, double value, int scale) {
+    qint64 v = qRound64(value * scale);
+    if (v < 0) {
+        out.append('-');
+        v = -v;
+    }
+    qint64 whole = v / scale;
+    qint64 frac = v % scale;
+
+    if (whole || !frac) { // .5 rather than 0.5
+        char digits[24];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + whole % 10);
+            whole /= 10;
+        } while (whole);
+        while (n) out.append(digits[--n]);
+    }
+
+    if (frac) {
+        out.append('.');
+        for (int s = scale / 10; s > 0 && frac; s /= 10) {
+            out.append(static_cast<char>('0' + frac / s));
+            frac %= s;
+        }
+    }
+}
+
+void appendPoint(QByteArray& out, const QPointF& p) {
+    appendNumber(out, p.x(), 10);
+    out.append(' ');
+    appendNumber(out, p.y(), 10);
+}
+
+void appendArc(QVector<QPointF>& out, const QPointF& center, float radius, double start, double sweep) {
+    // About one point per pixel of arc, the end points are the caller's
+    int steps = std::clamp(static_cast<int>(std::ceil(std::abs(sweep) * radius)), 2, 16);
+    for (int i = 1; i < steps; ++i) {
+        double a = start + sweep * i / steps;
+        out.append(center + QPointF(std::cos(a), std::sin(a)) * radius);
+    }
+}
+
+double segmentDistance2(const QPointF& p, const QPointF& a, const QPointF& b) {
+    QPointF ab = b - a;
+    QPointF ap = p - a;
+    double len2 = QPointF::dotProduct(ab, ab);
+    double t = len2 > 0.0 ? std::clamp(QPointF::dotProduct(ap, ab) / len2, 0.0, 1.0) : 0.0;
+    QPointF d = ap - ab * t;
+    return QPointF::dotProduct(d, d);
+}
+
+QByteArray hexColor(const StrokePoint& p) {
+    auto channel = [](float c) { return qBound(0, qRound(c * 255.0f), 255); };
+    char text[8];
+    std::snprintf(text, sizeof(text), "#%02x%02x%02x", channel(p.r), channel(p.g), channel(p.b));
+    return QByteArray(text);
+}
+
+const char* svgBlendMode(BlendMode mode) {
+    switch (mode) {
+    case BlendMode::Multiply: return "multiply";
+    case BlendMode::Screen: return "screen";
+    case BlendMode::Add: return "plus-lighter";
+    case BlendMode::Normal:
+    default: return nullptr;
+    }
+}
+
+const char* pdfBlendMode(BlendMode mode) {
+    switch (mode) {
+    case BlendMode::Multiply: return "/Multiply";
+    case BlendMode::Screen: return "/Screen";
+    case BlendMode::Add: // PDF has no additive mode, Normal is the closest
+    case BlendMode::Normal:
+    default: return "/Normal";
+    }
+}
+
+} // namespace
+
+VectorExporter::VectorExporter(VectorFormat outputFormat, const VectorExportOptions& exportOptions)
+    : format(outputFormat), options(exportOptions) {}
+
+bool VectorExporter::formatForPath(const QString& path, VectorFormat& result) {
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "svg") {
+        result = VectorFormat::Svg;
+        return true;
+    }
+    if (suffix == "pdf") {
+        result = VectorFormat::Pdf;
+        return true;
+    }
+    return false;
+}
+
+bool VectorExporter::write(QIODevice* target, const QSize& size, const QVector<Layer>& layers,
+                           const StrokeSnapshot& strokes)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    stats = VectorExportStats();
+    error.clear();
+    device = target;
+    buffer.clear();
+    buffer.reserve(options.chunkBytes + 4096);
+    written = 0;
+    offsets.clear();
+
+    if (!device || !device->isWritable()) {
+        error = "Output is not writable";
+        return false;
+    }
+
+    bool ok = format == VectorFormat::Svg
+        ? writeSvg(size, layers, strokes)
+        : writePdf(size, layers, strokes);
+
+    stats.bytes = written;
+    stats.elapsedMs = timer.elapsed();
+    device = nullptr;
+    buffer = QByteArray(); // don't hang on to the chunk
+    return ok;
+}
+
+// Left side forward, round cap, right side back, round cap. Half widths are interpolated
+// point to point by the renderer, here every centerline point gets its own.
+bool VectorExporter::buildOutline(const QVector<StrokePoint>& stroke) {
+    center.clear();
+    widths.clear();
+    for (const StrokePoint& point : stroke) {
+        float w = StrokeProcessor::halfWidth(point.thickness);
+        if (!center.isEmpty()) {
+            QPointF d = point.pos - center.last();
+            if (QPointF::dotProduct(d, d) < 0.01) {
+                widths.last() = std::max(widths.last(), w);
+                continue;
+            }
+        }
+        center.append(point.pos);
+        widths.append(w);
+    }
+
+    outline.clear();
+    const int n = center.size();
+    if (n == 0) return false;
+
+    if (n == 1) {
+        // A dot
+        const float r = std::max(widths[0], 0.5f);
+        const int steps = 12;
+        for (int i = 0; i < steps; ++i) {
+            double a = 2.0 * Pi * i / steps;
+            outline.append(center[0] + QPointF(std::cos(a), std::sin(a)) * r);
+        }
+    }
+    else {
+        left.resize(n);
+        right.resize(n);
+        double startAngle = 0.0;
+        double endAngle = 0.0;
+        for (int i = 0; i < n; ++i) {
+            QPointF d = center[std::min(i + 1, n - 1)] - center[std::max(i - 1, 0)];
+            double len = std::sqrt(QPointF::dotProduct(d, d));
+            if (len < 1e-6) {
+                // Doubled straight back, use the incoming direction
+                d = center[i] - center[i - 1];
+                len = std::sqrt(QPointF::dotProduct(d, d));
+            }
+            d /= len;
+            QPointF normal(-d.y(), d.x());
+            left[i] = center[i] + normal * widths[i];
+            right[i] = center[i] - normal * widths[i];
+
+            if (i == 0) startAngle = std::atan2(d.y(), d.x());
+            if (i == n - 1) endAngle = std::atan2(d.y(), d.x());
+        }
+
+        outline.reserve(2 * n + 32);
+        for (int i = 0; i < n; ++i) outline.append(left[i]);
+        appendArc(outline, center[n - 1], widths[n - 1], endAngle + Pi / 2, -Pi);
+        for (int i = n - 1; i >= 0; --i) outline.append(right[i]);
+        appendArc(outline, center[0], widths[0], startAngle - Pi / 2, -Pi);
+    }
+
+    stats.inputPoints += outline.size();
+    simplifyOutline();
+    return kept.size() >= 3;
+}
+
+// Douglas-Peucker on the closed outline, iterative so long strokes can't blow the stack
+void VectorExporter::simplifyOutline() {
+    kept.clear();
+    const int n = outline.size();
+    if (n < 4) {
+        kept = outline;
+        return;
+    }
+
+    outline.append(outline.first()); // close it, index n is the start again
+    keep.fill(false, n + 1);
+    keep[0] = true;
+    keep[n] = true;
+
+    const double tolerance2 = options.tolerance * options.tolerance;
+    ranges.clear();
+    ranges.append(qMakePair(0, n));
+    while (!ranges.isEmpty()) {
+        QPair<int, int> range = ranges.takeLast();
+        double worst = tolerance2;
+        int split = -1;
+        for (int i = range.first + 1; i < range.second; ++i) {
+            double d2 = segmentDistance2(outline[i], outline[range.first], outline[range.second]);
+            if (d2 > worst) {
+                worst = d2;
+                split = i;
+            }
+        }
+        if (split >= 0) {
+            keep[split] = true;
+            ranges.append(qMakePair(range.first, split));
+            ranges.append(qMakePair(split, range.second));
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        if (keep[i]) kept.append(outline[i]);
+    }
+    outline.removeLast();
+
+    if (kept.size() < 3) kept = outline; // smaller than the tolerance, keep it as is
+}
+
+// Catmull-Rom through the kept points, as cubic Beziers. Coordinates are snapped to tenths
+// of a pixel first, SVG then writes them relative to the previous end point (short numbers,
+// and no drift since the differences are exact).
+void VectorExporter::appendPath(QByteArray& out) {
+    const bool svg = format == VectorFormat::Svg;
+    const int m = kept.size();
+
+    auto snap = [](const QPointF& p) { return QPointF(qRound64(p.x() * 10.0) / 10.0, qRound64(p.y() * 10.0) / 10.0); };
+    QPointF current = snap(kept[0]);
+    auto appendTo = [&](const QPointF& p) {
+        const QPointF snapped = snap(p);
+        appendPoint(out, svg ? snapped - current : snapped);
+    };
+
+    out.append(svg ? "M" : "");
+    appendPoint(out, current);
+    out.append(svg ? "c" : " m\n");
+
+    for (int i = 0; i < m; ++i) {
+        const QPointF& p0 = kept[(i + m - 1) % m];
+        const QPointF& p1 = kept[i];
+        const QPointF& p2 = kept[(i + 1) % m];
+        const QPointF& p3 = kept[(i + 2) % m];
+
+        if (svg && i > 0) out.append(' '); // c repeats implicitly
+        appendTo(p1 + (p2 - p0) / 6.0);
+        out.append(' ');
+        appendTo(p2 - (p3 - p1) / 6.0);
+        out.append(' ');
+        appendTo(p2);
+        if (!svg) out.append(" c\n");
+        current = snap(p2);
+    }
+    out.append(svg ? "z" : "h f\n");
+    stats.segments += m;
+}
+
+// Straight edges, absolute coordinates. Quads of one fill share edges, nonzero winding
+// (the default in both formats) fills them as one area.
+void VectorExporter::appendQuads(QByteArray& out, const QVector<StrokePoint>& fill) {
+    const bool svg = format == VectorFormat::Svg;
+    const int quads = fill.size() / 4;
+
+    for (int q = 0; q < quads; ++q) {
+        const StrokePoint* corners = fill.constData() + q * 4;
+        const int order[4] = { 0, 1, 3, 2 };
+        for (int i = 0; i < 4; ++i) {
+            if (svg) out.append(i == 0 ? "M" : "L");
+            appendPoint(out, corners[order[i]].pos);
+            if (!svg) out.append(i == 0 ? " m\n" : " l\n");
+        }
+        out.append(svg ? "Z" : "h\n");
+    }
+    if (!svg) out.append("f\n");
+
+    stats.inputPoints += quads * 4;
+    stats.segments += quads * 4;
+}
+
+bool VectorExporter::writeRaw(const QByteArray& data) {
+    if (device->write(data) != data.size()) {
+        error = device->errorString();
+        return false;
+    }
+    written += data.size();
+    return true;
+}
+
+bool VectorExporter::flush() {
+    bool ok = writeRaw(buffer);
+    buffer.clear();
+    return ok;
+}
+
+void VectorExporter::appendMatrix(QByteArray& out, const QTransform& t) {
+    const double m[6] = {t.m11(), t.m12(), t.m21(), t.m22(), t.dx(), t.dy()};
+    for (int i = 0; i < 6; ++i) {
+        if (i > 0) out.append(' ');
+        appendNumber(out, m[i], 10000);
+    }
+}
+
+bool VectorExporter::writeSvg(const QSize& size, const QVector<Layer>& layers, const StrokeSnapshot& strokes)
+{
+    const QByteArray w = QByteArray::number(size.width());
+    const QByteArray h = QByteArray::number(size.height());
+    buffer.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    buffer.append("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" + w + "\" height=\"" + h
+                  + "\" viewBox=\"0 0 " + w + " " + h + "\">\n");
+    buffer.append("<rect width=\"100%\" height=\"100%\" fill=\"#fff\"/>\n");
+
+    for (const Layer& layer : layers) {
+        if (!layer.visible) continue;
+
+        buffer.append("<g id=\"layer-" + QByteArray::number(layer.id) + "\"");
+        if (layer.opacity < 1.0f) {
+            buffer.append(" opacity=\"");
+            appendNumber(buffer, layer.opacity, 1000);
+            buffer.append('"');
+        }
+        if (const char* mode = svgBlendMode(layer.blendMode)) {
+            buffer.append(" style=\"mix-blend-mode:");
+            buffer.append(mode);
+            buffer.append('"');
+        }
+        buffer.append(">\n");
+
+        // Runs of strokes with the same color share a group so paths don't repeat the fill
+        QByteArray fill;
+        for (int i = 0; i < strokes.size(); ++i) {
+            const StrokeRecord& record = strokes.at(i);
+            if (record.layerId != layer.id || !record.draws()) continue; // filters are raster only
+            const bool isFill = record.kind == EntryKind::Fill;
+            const QVector<StrokePoint>& stroke = strokes.pointsOf(i, decoded);
+            if (isFill ? stroke.size() < 4 : !buildOutline(stroke)) continue;
+
+            QByteArray color = hexColor(stroke.first());
+            if (color != fill) {
+                if (!fill.isEmpty()) buffer.append("</g>\n");
+                buffer.append("<g fill=\"" + color + "\">\n");
+                fill = color;
+            }
+
+            // Symmetry copies reuse the path instead of writing it again
+            const Symmetry& symmetry = record.symmetry;
+            const QByteArray id = "s" + QByteArray::number(i);
+            buffer.append("<path");
+            if (symmetry.isActive()) buffer.append(" id=\"" + id + "\"");
+            buffer.append(" d=\"");
+            if (isFill) appendQuads(buffer, stroke);
+            else appendPath(buffer);
+            buffer.append("\"/>\n");
+            for (int copy = 1; copy < symmetry.copies(); ++copy) {
+                buffer.append("<use href=\"#" + id + "\" transform=\"matrix(");
+                appendMatrix(buffer, symmetry.transform(copy));
+                buffer.append(")\"/>\n");
+            }
+            stats.strokes++;
+
+            if (buffer.size() >= options.chunkBytes && !flush()) return false;
+        }
+        if (!fill.isEmpty()) buffer.append("</g>\n");
+        buffer.append("</g>\n");
+    }
+
+    buffer.append("</svg>\n");
+    return flush();
+}
+
+int VectorExporter::newObject() {
+    offsets.append(0);
+    return offsets.size(); // objects count from 1
+}
+
+bool VectorExporter::writePdfObject(int object, const QByteArray& body) {
+    offsets[object - 1] = written;
+    return writeRaw(QByteArray::number(object) + " 0 obj\n" + body + "\nendobj\n");
+}
+
+bool VectorExporter::writePdfStream(int object, const QByteArray& entries, const QByteArray& data, bool compress) {
+    QByteArray payload = data;
+    if (compress) {
+        // Fastest level, the coordinates hardly compress better at higher ones and take many times longer
+        payload = qCompress(data, 1).mid(4); // zlib stream without Qt's length prefix
+    }
+
+    QByteArray body = "<< " + entries + " /Length " + QByteArray::number(payload.size());
+    if (compress) body.append(" /Filter /FlateDecode");
+    body.append(" >>\nstream\n");
+
+    offsets[object - 1] = written;
+    return writeRaw(QByteArray::number(object) + " 0 obj\n" + body)
+        && writeRaw(payload)
+        && writeRaw("\nendstream\nendobj\n");
+}
+
+// One page. Every layer is a transparency group form so its opacity and blend mode apply to
+// the layer as a whole, like the compositor does. The group only calls its chunk forms, each
+// chunk is one compressed stream of outlines, written as soon as it fills up.
+bool VectorExporter::writePdf(const QSize& size, const QVector<Layer>& layers, const StrokeSnapshot& strokes)
+{
+    const QByteArray bbox = "/BBox [0 0 " + QByteArray::number(size.width()) + " "
+                            + QByteArray::number(size.height()) + "]";
+
+    if (!writeRaw("%PDF-1.4\n%\xE2\xE3\xCF\xD3\n")) return false;
+    const int catalog = newObject();
+    const int pages = newObject();
+    const int page = newObject();
+
+    QByteArray pageContent = "1 g 0 0 " + QByteArray::number(size.width()) + " "
+                             + QByteArray::number(size.height()) + " re f\n";
+    // Stroke coordinates are y down
+    pageContent.append("q 1 0 0 -1 0 " + QByteArray::number(size.height()) + " cm\n");
+    QByteArray pageXObjects;
+    QByteArray pageStates;
+
+    QVector<int> chunks;
+    for (const Layer& layer : layers) {
+        if (!layer.visible) continue;
+
+        chunks.clear();
+        QByteArray lastColor;
+        auto writeChunk = [&]() {
+            int chunk = newObject();
+            chunks.append(chunk);
+            bool ok = writePdfStream(chunk, "/Type /XObject /Subtype /Form " + bbox, buffer, true);
+            buffer.clear();
+            lastColor.clear(); // every form starts with a fresh graphics state
+            return ok;
+        };
+
+        for (int i = 0; i < strokes.size(); ++i) {
+            const StrokeRecord& record = strokes.at(i);
+            if (record.layerId != layer.id || !record.draws()) continue; // filters are raster only
+            const bool isFill = record.kind == EntryKind::Fill;
+            const QVector<StrokePoint>& stroke = strokes.pointsOf(i, decoded);
+            if (isFill ? stroke.size() < 4 : !buildOutline(stroke)) continue;
+
+            const StrokePoint& p = stroke.first();
+            QByteArray color;
+            appendNumber(color, qBound(0.0f, p.r, 1.0f), 1000);
+            color.append(' ');
+            appendNumber(color, qBound(0.0f, p.g, 1.0f), 1000);
+            color.append(' ');
+            appendNumber(color, qBound(0.0f, p.b, 1.0f), 1000);
+            if (color != lastColor) {
+                buffer.append(color + " rg\n");
+                lastColor = color;
+            }
+
+            // Every copy is the same path under its own matrix
+            const Symmetry& symmetry = record.symmetry;
+            for (int copy = 0; copy < symmetry.copies(); ++copy) {
+                if (copy > 0) {
+                    buffer.append("q ");
+                    appendMatrix(buffer, symmetry.transform(copy));
+                    buffer.append(" cm\n");
+                }
+                if (isFill) appendQuads(buffer, stroke);
+                else appendPath(buffer);
+                if (copy > 0) buffer.append("Q\n");
+            }
+            stats.strokes++;
+
+            if (buffer.size() >= options.chunkBytes && !writeChunk()) return false;
+        }
+        if (!buffer.isEmpty() && !writeChunk()) return false;
+        if (chunks.isEmpty()) continue;
+
+        QByteArray groupContent;
+        QByteArray groupXObjects;
+        for (int chunk : chunks) {
+            const QByteArray name = "/C" + QByteArray::number(chunk);
+            groupContent.append(name + " Do\n");
+            groupXObjects.append(name + " " + QByteArray::number(chunk) + " 0 R ");
+        }
+
+        const int group = newObject();
+        if (!writePdfStream(group, "/Type /XObject /Subtype /Form " + bbox
+                            + " /Group << /S /Transparency /CS /DeviceRGB >>"
+                            + " /Resources << /XObject << " + groupXObjects + ">> >>",
+                            groupContent, false)) {
+            return false;
+        }
+
+        const QByteArray id = QByteArray::number(layer.id);
+        QByteArray alpha;
+        appendNumber(alpha, layer.opacity, 1000);
+        pageStates.append("/G" + id + " << /ca " + alpha + " /CA " + alpha + " /BM "
+                          + pdfBlendMode(layer.blendMode) + " >> ");
+        pageXObjects.append("/L" + id + " " + QByteArray::number(group) + " 0 R ");
+        pageContent.append("/G" + id + " gs /L" + id + " Do\n");
+    }
+    pageContent.append("Q\n");
+
+    const int content = newObject();
+    bool ok = writePdfStream(content, QByteArray(), pageContent, false)
+        && writePdfObject(page, "<< /Type /Page /Parent " + QByteArray::number(pages) + " 0 R"
+                          + " /MediaBox [0 0 " + QByteArray::number(size.width()) + " "
+                          + QByteArray::number(size.height()) + "]"
+                          + " /Group << /S /Transparency /CS /DeviceRGB >>"
+                          + " /Resources << /XObject << " + pageXObjects + ">> /ExtGState << " + pageStates + ">> >>"
+                          + " /Contents " + QByteArray::number(content) + " 0 R >>")
+        && writePdfObject(pages, "<< /Type /Pages /Kids [" + QByteArray::number(page) + " 0 R] /Count 1 >>")
+        && writePdfObject(catalog, "<< /Type /Catalog /Pages " + QByteArray::number(pages) + " 0 R >>");
+    if (!ok) return false;
+
+    // Cross reference table, every entry exactly 20 bytes
+    const qint64 xref = written;
+    QByteArray table = "xref\n0 " + QByteArray::number(offsets.size() + 1) + "\n0000000000 65535 f \n";
+    for (qint64 offset : offsets) {
+        char entry[32];
+        std::snprintf(entry, sizeof(entry), "%010lld 00000 n \n", static_cast<long long>(offset));
+        table.append(entry);
+    }
+    table.append("trailer\n<< /Size " + QByteArray::number(offsets.size() + 1) + " /Root "
+                 + QByteArray::number(catalog) + " 0 R >>\nstartxref\n" + QByteArray::number(xref) + "\n%%EOF\n");
+    return writeRaw(table);
+}
@@ -0,0 +1,98 @@
+#ifndef VECTOREXPORTER_H
+#define VECTOREXPORTER_H
+
+#include <QVector>
+#include <QPointF>
+#include <QSize>
+#include <QByteArray>
+#include <QString>
+#include <QPair>
+#include "../data/StrokePoint.h"
+#include "../data/Layer.h"
+#include "../data/Symmetry.h"
+#include "StrokeSnapshot.h"
+
+class QIODevice;
+
+enum class VectorFormat {
+    Svg,
+    Pdf
+};
+
+struct VectorExportOptions {
+    double tolerance = 0.25;        // px an outline may move when points are dropped
+    int chunkBytes = 256 * 1024;    // output buffered before it goes to the device (PDF: one compressed stream)
+};
+
+struct VectorExportStats {
+    int strokes = 0;
+    qint64 inputPoints = 0;  // outline points before simplification
+    qint64 segments = 0;     // curves written
+    qint64 bytes = 0;
+    qint64 elapsedMs = 0;
+};
+
+// Writes the document as filled outlines, one closed path per stroke, built from the same
+// half widths the renderer uses. Output goes straight to the device in chunks, there is no
+// DOM and memory stays bounded by the chunk size no matter how many strokes there are.
+// Outlines are simplified (Douglas-Peucker) and the kept points joined with Catmull-Rom
+// curves written as cubic Beziers, which keeps files small without visible faceting.
+// Textured brushes come out as their solid outline, fills as their quads.
+class VectorExporter {
+
+public:
+
+    VectorExporter(VectorFormat format, const VectorExportOptions& options = VectorExportOptions());
+
+    // Layers in drawing order, hidden ones are skipped. Coordinates are widget pixels.
+    // Strokes are decoded one at a time as they're written. A stroke's brush tells fills
+    // apart, its symmetry repeats the path once per copy transform.
+    bool write(QIODevice* device, const QSize& size, const QVector<Layer>& layers, const StrokeSnapshot& strokes);
+
+    static bool formatForPath(const QString& path, VectorFormat& format); // by suffix
+
+    QString errorString() const { return error; }
+    const VectorExportStats& getStats() const { return stats; }
+
+private:
+
+    bool writeSvg(const QSize& size, const QVector<Layer>& layers, const StrokeSnapshot& strokes);
+    bool writePdf(const QSize& size, const QVector<Layer>& layers, const StrokeSnapshot& strokes);
+
+    // Outline of one stroke into kept, false if there is nothing to draw
+    bool buildOutline(const QVector<StrokePoint>& stroke);
+    void simplifyOutline();
+    void appendPath(QByteArray& out); // kept as M/C/Z (SVG) or m/c/h (PDF)
+    void appendQuads(QByteArray& out, const QVector<StrokePoint>& fill); // a fill's quads as one path
+    static void appendMatrix(QByteArray& out, const QTransform& t); // a b c d e f
+
+    // Output
+    bool flush(); // SVG, buffer to device
+    bool writeRaw(const QByteArray& data);
+    int newObject(); // PDF object number, written later with writePdfObject/Stream
+    bool writePdfObject(int object, const QByteArray& body);
+    bool writePdfStream(int object, const QByteArray& entries, const QByteArray& data, bool compress);
+
+    VectorFormat format;
+    VectorExportOptions options;
+    VectorExportStats stats;
+    QString error;
+
+    QIODevice* device = nullptr;
+    QByteArray buffer;
+    qint64 written = 0;
+    QVector<qint64> offsets; // PDF xref, by object number, 0 = not written yet
+
+    // Scratch, reused for every stroke
+    QVector<StrokePoint> decoded; // a cold stroke's points
+    QVector<QPointF> center;
+    QVector<float> widths;
+    QVector<QPointF> left;
+    QVector<QPointF> right;
+    QVector<QPointF> outline;
+    QVector<QPointF> kept;
+    QVector<bool> keep;
+    QVector<QPair<int, int>> ranges;
+};
+
+#endif // VECTOREXPORTER_H
@@ -0,0 +1,213 @@
+#include "ColorSpace.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLORSPACE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline float clamp01(float x) {
+    return std::clamp(x, 0.0f, 1.0f);
+}
+
+// Branch free HSV: channel n is v - v*s*clamp(min(k, 4 - k), 0, 1), k = (n + h/60) mod 6,
+// with n = 5, 3, 1 for r, g, b. Same formula in the SIMD path.
+inline float hsvChannel(float n, float h, float s, float v) {
+    float k = n + h / 60.0f;
+    k -= 6.0f * std::floor(k / 6.0f);
+    return v - v * s * clamp01(std::min(k, 4.0f - k));
+}
+
+struct SrgbTables {
+    float toLinear[256];
+    quint8 toSrgb[4096]; // indexed by linear * 4095
+
+    SrgbTables() {
+        for (int i = 0; i < 256; ++i) {
+            toLinear[i] = ColorSpace::srgbToLinear(i / 255.0f);
+        }
+        for (int i = 0; i < 4096; ++i) {
+            toSrgb[i] = static_cast<quint8>(std::lround(ColorSpace::linearToSrgb(i / 4095.0f) * 255.0f));
+        }
+    }
+};
+
+const SrgbTables& srgbTables() {
+    static const SrgbTables tables;
+    return tables;
+}
+
+#ifdef COLORSPACE_SSE2
+
+inline __m128 floor4(__m128 x) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+inline __m128 clamp4(__m128 x) {
+    return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+}
+
+inline __m128 hsvChannel4(float n, __m128 h6, __m128 s, __m128 v) {
+    __m128 k = _mm_add_ps(_mm_set1_ps(n), h6);
+    k = _mm_sub_ps(k, _mm_mul_ps(_mm_set1_ps(6.0f), floor4(_mm_mul_ps(k, _mm_set1_ps(1.0f / 6.0f)))));
+    __m128 w = clamp4(_mm_min_ps(k, _mm_sub_ps(_mm_set1_ps(4.0f), k)));
+    return _mm_sub_ps(v, _mm_mul_ps(_mm_mul_ps(v, s), w));
+}
+
+// One lane per pixel, channels 0..1 in, 0xAARRGGBB out
+inline void pack4(__m128 r, __m128 g, __m128 b, __m128 a, quint32* out) {
+    const __m128 scale = _mm_set1_ps(255.0f);
+    __m128i ri = _mm_cvtps_epi32(_mm_mul_ps(clamp4(r), scale));
+    __m128i gi = _mm_cvtps_epi32(_mm_mul_ps(clamp4(g), scale));
+    __m128i bi = _mm_cvtps_epi32(_mm_mul_ps(clamp4(b), scale));
+    __m128i ai = _mm_cvtps_epi32(_mm_mul_ps(clamp4(a), scale));
+
+    __m128i packed = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(ai, 24), _mm_slli_epi32(ri, 16)),
+                                  _mm_or_si128(_mm_slli_epi32(gi, 8), bi));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+}
+
+#endif
+
+} // namespace
+
+namespace ColorSpace {
+
+RGBf hsvToRgb(float h, float s, float v) {
+    return { hsvChannel(5.0f, h, s, v), hsvChannel(3.0f, h, s, v), hsvChannel(1.0f, h, s, v) };
+}
+
+HSVf rgbToHsv(const RGBf& rgb) {
+    float maxC = std::max({ rgb.r, rgb.g, rgb.b });
+    float minC = std::min({ rgb.r, rgb.g, rgb.b });
+    float delta = maxC - minC;
+
+    HSVf hsv = { 0.0f, maxC > 0.0f ? delta / maxC : 0.0f, maxC };
+    if (delta <= 0.0f) return hsv;
+
+    if (maxC == rgb.r) hsv.h = 60.0f * std::fmod((rgb.g - rgb.b) / delta, 6.0f);
+    else if (maxC == rgb.g) hsv.h = 60.0f * ((rgb.b - rgb.r) / delta + 2.0f);
+    else hsv.h = 60.0f * ((rgb.r - rgb.g) / delta + 4.0f);
+
+    if (hsv.h < 0.0f) hsv.h += 360.0f;
+    return hsv;
+}
+
+float srgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float linearToSrgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+RGBf srgbToLinear(const RGBf& rgb) {
+    return { srgbToLinear(rgb.r), srgbToLinear(rgb.g), srgbToLinear(rgb.b) };
+}
+
+RGBf linearToSrgb(const RGBf& rgb) {
+    return { linearToSrgb(rgb.r), linearToSrgb(rgb.g), linearToSrgb(rgb.b) };
+}
+
+quint32 packRGBA8(const RGBf& rgb, float alpha) {
+    return (quint32(qRound(clamp01(alpha) * 255.0f)) << 24) | (quint32(qRound(clamp01(rgb.r) * 255.0f)) << 16)
+         | (quint32(qRound(clamp01(rgb.g) * 255.0f)) << 8) | quint32(qRound(clamp01(rgb.b) * 255.0f));
+}
+
+RGBf unpackRGBA8(quint32 packed) {
+    return { ((packed >> 16) & 0xff) / 255.0f, ((packed >> 8) & 0xff) / 255.0f, (packed & 0xff) / 255.0f };
+}
+
+void hsvToRgb(const float* h, const float* s, const float* v, float* r, float* g, float* b, int n) {
+    int i = 0;
+#ifdef COLORSPACE_SSE2
+    const __m128 toSextant = _mm_set1_ps(1.0f / 60.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 h6 = _mm_mul_ps(_mm_loadu_ps(h + i), toSextant);
+        __m128 sv = _mm_loadu_ps(s + i);
+        __m128 vv = _mm_loadu_ps(v + i);
+        _mm_storeu_ps(r + i, hsvChannel4(5.0f, h6, sv, vv));
+        _mm_storeu_ps(g + i, hsvChannel4(3.0f, h6, sv, vv));
+        _mm_storeu_ps(b + i, hsvChannel4(1.0f, h6, sv, vv));
+    }
+#endif
+    for (; i < n; ++i) {
+        RGBf rgb = hsvToRgb(h[i], s[i], v[i]);
+        r[i] = rgb.r;
+        g[i] = rgb.g;
+        b[i] = rgb.b;
+    }
+}
+
+void hsvToPremultipliedRGBA8(const float* h, const float* s, const float* v, const float* alpha, quint32* out, int n) {
+    int i = 0;
+#ifdef COLORSPACE_SSE2
+    const __m128 toSextant = _mm_set1_ps(1.0f / 60.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 h6 = _mm_mul_ps(_mm_loadu_ps(h + i), toSextant);
+        __m128 sv = _mm_loadu_ps(s + i);
+        __m128 vv = _mm_loadu_ps(v + i);
+        __m128 a = alpha ? clamp4(_mm_loadu_ps(alpha + i)) : _mm_set1_ps(1.0f);
+        pack4(_mm_mul_ps(hsvChannel4(5.0f, h6, sv, vv), a),
+              _mm_mul_ps(hsvChannel4(3.0f, h6, sv, vv), a),
+              _mm_mul_ps(hsvChannel4(1.0f, h6, sv, vv), a), a, out + i);
+    }
+#endif
+    for (; i < n; ++i) {
+        float a = alpha ? clamp01(alpha[i]) : 1.0f;
+        RGBf rgb = hsvToRgb(h[i], s[i], v[i]);
+        out[i] = packRGBA8({ rgb.r * a, rgb.g * a, rgb.b * a }, a);
+    }
+}
+
+void packRGBA8(const float* rgba, quint32* out, int n) {
+    int i = 0;
+#ifdef COLORSPACE_SSE2
+    for (; i + 4 <= n; i += 4) {
+        // Interleaved pixels to one register per channel
+        __m128 p0 = _mm_loadu_ps(rgba + 4 * i);
+        __m128 p1 = _mm_loadu_ps(rgba + 4 * i + 4);
+        __m128 p2 = _mm_loadu_ps(rgba + 4 * i + 8);
+        __m128 p3 = _mm_loadu_ps(rgba + 4 * i + 12);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        pack4(p0, p1, p2, p3, out + i);
+    }
+#endif
+    for (; i < n; ++i) {
+        const float* p = rgba + 4 * i;
+        out[i] = packRGBA8({ p[0], p[1], p[2] }, p[3]);
+    }
+}
+
+void srgb8ToLinear(const quint8* in, float* out, int n) {
+    const float* table = srgbTables().toLinear;
+    for (int i = 0; i < n; ++i) {
+        out[i] = table[in[i]];
+    }
+}
+
+void linearToSrgb8(const float* in, quint8* out, int n) {
+    const quint8* table = srgbTables().toSrgb;
+    int i = 0;
+#ifdef COLORSPACE_SSE2
+    const __m128 scale = _mm_set1_ps(4095.0f);
+    alignas(16) qint32 index[4];
+    for (; i + 4 <= n; i += 4) {
+        __m128i idx = _mm_cvtps_epi32(_mm_mul_ps(clamp4(_mm_loadu_ps(in + i)), scale));
+        _mm_store_si128(reinterpret_cast<__m128i*>(index), idx);
+        out[i] = table[index[0]];
+        out[i + 1] = table[index[1]];
+        out[i + 2] = table[index[2]];
+        out[i + 3] = table[index[3]];
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = table[static_cast<int>(clamp01(in[i]) * 4095.0f + 0.5f)];
+    }
+}
+
+} // namespace ColorSpace
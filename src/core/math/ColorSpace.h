@@ -0,0 +1,46 @@
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+#include <QtGlobal>
+
+// Color conversions in one place. Scalar versions for single colors,
+// batch versions (SSE2 where available) for filling images and packing strokes.
+// Hue is in degrees [0, 360), everything else is 0..1. Packed colors are QRgb (0xAARRGGBB).
+// Core only so the relay can use it, the QColor helpers are in ColorSpaceQt.h.
+
+struct RGBf {
+    float r, g, b;
+};
+
+struct HSVf {
+    float h, s, v;
+};
+
+namespace ColorSpace {
+
+    // Scalar
+    RGBf hsvToRgb(float h, float s, float v);
+    HSVf rgbToHsv(const RGBf& rgb); // hue is 0 for greys
+    float srgbToLinear(float c);
+    float linearToSrgb(float c);
+    RGBf srgbToLinear(const RGBf& rgb);
+    RGBf linearToSrgb(const RGBf& rgb);
+    quint32 packRGBA8(const RGBf& rgb, float alpha = 1.0f);
+    RGBf unpackRGBA8(quint32 packed);
+
+    // Batch, arrays of n elements
+    void hsvToRgb(const float* h, const float* s, const float* v, float* r, float* g, float* b, int n);
+
+    // Premultiplied packed output, alpha may be null for opaque
+    void hsvToPremultipliedRGBA8(const float* h, const float* s, const float* v, const float* alpha, quint32* out, int n);
+
+    // rgba is interleaved r, g, b, a floats, 4 per pixel
+    void packRGBA8(const float* rgba, quint32* out, int n);
+
+    // 8 bit sRGB channels to linear floats and back, through lookup tables
+    void srgb8ToLinear(const quint8* in, float* out, int n);
+    void linearToSrgb8(const float* in, quint8* out, int n);
+
+} // namespace ColorSpace
+
+#endif // COLORSPACE_H
@@ -0,0 +1,17 @@
+#ifndef COLORSPACEQT_H
+#define COLORSPACEQT_H
+
+#include <QColor>
+#include "ColorSpace.h"
+
+// The QColor side of ColorSpace, kept apart so the Core only targets don't need QtGui
+namespace ColorSpace {
+
+    // sRGB, no QColor call per channel later on
+    inline RGBf fromQColor(const QColor& color) {
+        return { static_cast<float>(color.redF()), static_cast<float>(color.greenF()), static_cast<float>(color.blueF()) };
+    }
+
+} // namespace ColorSpace
+
+#endif // COLORSPACEQT_H
@@ -3,7 +3,7 @@
 
 #include <QPoint>
 
-float calculatePressure(const QPointF& posF, const QPointF& posI, qint64 deltaT, float speedSense);
+float calculateSpeed(const QPointF& posF, const QPointF& posI, qint64 deltaT); // px/s, -1 without a time delta
 void convertToOpenGLCoords(const QPointF& qtPoint, float& x, float& y);
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef BRUSH_H
+#define BRUSH_H
+
+#include <QString>
+
+// Tile index in the brush tip atlas
+enum class BrushTip {
+    Round = 0,
+    Grain = 1,    // pencil
+    Soft = 2,     // airbrush
+    Flat = 3      // ink nib, meant to follow the stroke direction
+};
+
+struct BrushSettings {
+    QString name;
+    bool textured = false;        // false = the classic solid triangle strip
+    BrushTip tip = BrushTip::Round;
+    float sizeScale = 1.0f;       // dab diameter = point thickness * sizeScale
+    float spacing = 0.25f;        // distance between dabs as a fraction of dab size
+    float sizeJitter = 0.0f;      // 0-1, random size variation
+    float angleJitter = 0.0f;     // radians
+    float scatter = 0.0f;         // random offset as a fraction of dab size
+    float opacity = 1.0f;         // per dab
+    bool followDirection = false; // rotate dabs along the stroke
+    bool pressureOpacity = false; // pressure also drives opacity
+};
+
+#endif // BRUSH_H
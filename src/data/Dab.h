@@ -0,0 +1,14 @@
+#ifndef DAB_H
+#define DAB_H
+
+// One stamp of a textured brush, uploaded as-is as per-instance attributes
+struct Dab {
+    float x, y;         // center
+    float size;         // diameter in px
+    float angle;        // radians
+    float r, g, b;      // color
+    float opacity;
+    float tip;          // BrushTip, float so it can go straight into an attribute
+};
+
+#endif
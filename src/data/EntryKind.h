@@ -0,0 +1,28 @@
+#ifndef ENTRYKIND_H
+#define ENTRYKIND_H
+
+#include <QtGlobal>
+
+// What a history entry is (StrokeRecord). Strokes and fills draw, the others change what is
+// already there. Apart from the record so the relay, which has no QtGui, can check sync ops.
+enum class EntryKind : quint8 {
+    Stroke,
+    Fill,      // bucket fill, every 4 points a quad (FloodFill::toStroke), drawn filled
+    Transform, // a selection moved, baked into its targets' points already
+    Filter,    // a RasterFilter ran over the layer raster, which filter is in the record's filter
+    Flatten    // the layer's strokes before it were drawn into its raster and aren't drawn again
+};
+
+// Raster filters (RasterFilter). Brush points are the path, thickness the radius and pressure
+// the strength. Whole-layer filters only use their first point: thickness the radius, pressure
+// the strength (the sharpen amount / 4 for LayerSharpen).
+enum class FilterType : quint8 {
+    Blur,
+    Smudge,
+    Sharpen,
+    LayerGaussian,
+    LayerBox,
+    LayerSharpen
+};
+
+#endif // ENTRYKIND_H
@@ -0,0 +1,21 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include <QString>
+
+enum class BlendMode {
+    Normal,
+    Multiply,
+    Screen,
+    Add
+};
+
+struct Layer {
+    int id;              // stable, strokes refer to their layer by id
+    QString name;
+    bool visible = true;
+    float opacity = 1.0f; // 0.0-1.0
+    BlendMode blendMode = BlendMode::Normal;
+};
+
+#endif // LAYER_H
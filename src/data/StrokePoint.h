@@ -10,6 +10,7 @@ struct StrokePoint {
     float thickness;  // thickness based on pressure and speed
     QTime strokeTime; // time when point was captured, calculate speed
     float r, g, b; //color
+    float opacity = 1.0f; // from the brush dynamics, textured brushes with pressure opacity use it
 };
 
 #endif // !STROKEPOINT_H
\ No newline at end of file
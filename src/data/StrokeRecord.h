@@ -0,0 +1,35 @@
+#ifndef STROKERECORD_H
+#define STROKERECORD_H
+
+#include <QVector>
+#include <QByteArray>
+#include <QRectF>
+#include <QTransform>
+#include "StrokePoint.h"
+#include "EntryKind.h"
+#include "Symmetry.h"
+
+// One stroke with everything that goes with it, the way StrokeManager keeps the document
+// and the redo history. Hot strokes have their points, cold ones are StrokeCodec packed
+// and have none until somebody decodes them (StrokeSnapshot::pointsOf).
+struct StrokeRecord {
+    EntryKind kind = EntryKind::Stroke;
+    QVector<StrokePoint> points;
+    QByteArray packed;
+    QRectF bounds;       // with the symmetry copies, used to cull and for damage rects
+    int vertexCount = 0; // its range in the vertex mirror, strokes in the document only
+    int layerId = -1;
+    int brushId = 0;     // preset it was drawn with
+    FilterType filter = FilterType::Blur; // Filter: which one
+    Symmetry symmetry;   // copies are drawn, never stored
+    quint64 id = 0;
+    QVector<quint64> targets; // Transform: ids of the strokes it moved
+    QTransform transform;     // Transform: what they went through, undo applies the inverse
+
+    bool isPacked() const { return !packed.isEmpty(); }
+    bool draws() const { return kind == EntryKind::Stroke || kind == EntryKind::Fill; }
+    // Filters and flattens, their pixels are kept apart (Canvas::rasterEdits) and never synced
+    bool editsRaster() const { return kind == EntryKind::Filter || kind == EntryKind::Flatten; }
+};
+
+#endif // STROKERECORD_H
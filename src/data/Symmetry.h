@@ -0,0 +1,68 @@
+#ifndef SYMMETRY_H
+#define SYMMETRY_H
+
+#include <QtGlobal>
+#include <QRectF>
+#include <QTransform>
+#include <QtMath>
+
+enum class SymmetryMode : quint8 {
+    None,
+    Mirror,      // the stroke and its reflection across the axis
+    Radial,      // order copies turned evenly around the center
+    Kaleidoscope // radial, every copy mirrored as well: 2 * order, order 2 is the 4-way mirror
+};
+
+// How a stroke repeats. Only the source stroke is stored and tessellated, renderers draw its
+// vertices once per copy transform, so a 16-way stroke costs what a plain one does.
+struct Symmetry {
+    SymmetryMode mode = SymmetryMode::None;
+    quint8 order = 2;           // Radial and Kaleidoscope
+    float cx = 0.0f, cy = 0.0f; // center, widget coords
+    float angle = 0.0f;         // of the mirror axis, radians from vertical
+
+    static constexpr int maxOrder = 16;
+    static constexpr int maxCopies = 2 * maxOrder;
+
+    int copies() const {
+        switch (mode) {
+        case SymmetryMode::Mirror: return 2;
+        case SymmetryMode::Radial: return qBound(1, int(order), maxOrder);
+        case SymmetryMode::Kaleidoscope: return 2 * qBound(1, int(order), maxOrder);
+        case SymmetryMode::None: break;
+        }
+        return 1;
+    }
+    bool isActive() const { return copies() > 1; }
+
+    // Copy 0 is the stroke itself. The first spokes turn, the rest are the mirrored spokes.
+    QTransform transform(int copy) const {
+        QTransform t;
+        if (copy <= 0 || copy >= copies()) return t;
+        const int spokes = mode == SymmetryMode::Mirror ? 1 : copies() / (mode == SymmetryMode::Kaleidoscope ? 2 : 1);
+        t.translate(cx, cy);
+        t.rotateRadians(2.0 * M_PI * (copy % spokes) / spokes);
+        if (copy >= spokes) {
+            t.rotateRadians(angle);
+            t.scale(-1.0, 1.0);
+            t.rotateRadians(-angle);
+        }
+        t.translate(-cx, -cy);
+        return t;
+    }
+
+    // Bounds of all the copies of something with these bounds
+    QRectF map(const QRectF& bounds) const {
+        QRectF all = bounds;
+        for (int i = 1; i < copies(); ++i) all = all.united(transform(i).mapRect(bounds));
+        return all;
+    }
+
+    bool operator==(const Symmetry& other) const {
+        return mode == other.mode && (mode == SymmetryMode::None
+            || (order == other.order && cx == other.cx && cy == other.cy && angle == other.angle));
+    }
+    bool operator!=(const Symmetry& other) const { return !(*this == other); }
+};
+
+#endif // SYMMETRY_H
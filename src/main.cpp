@@ -1,13 +1,30 @@
 // main.cpp
 #include <QApplication>
+#include <QSurfaceFormat>
 #include "ui/MainWindow.h"
+#include "core/StartupTrace.h"
 
 int main(int argc, char* argv[])
 {
+    StartupTrace::begin();
+
+    // Textured brushes need instancing (GL 3.3), compatibility profile keeps the
+    // fixed function stroke path working. Has to be set before the app is created.
+    QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    QSurfaceFormat::setDefaultFormat(format);
+
     QApplication app(argc, argv);
+    // Names the cache directory Qt keeps compiled shader program binaries in
+    QCoreApplication::setOrganizationName("Lancer");
+    QCoreApplication::setApplicationName("Lancer");
+    StartupTrace::mark("application created");
 
     MainWindow window;
+    StartupTrace::mark("main window built");
     window.show();
+    StartupTrace::mark("window shown");
 
     return app.exec();
 }
\ No newline at end of file
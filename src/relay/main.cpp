@@ -0,0 +1,22 @@
+// main.cpp (lancer-relay)
+#include <QCoreApplication>
+#include "../sync/RelayServer.h"
+
+// Local relay for shared canvases: lancer-relay [port]
+// Point Lancer at it with LANCER_RELAY=127.0.0.1:<port>
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    quint16 port = SyncProtocol::defaultPort;
+    if (argc > 1) {
+        bool ok = false;
+        int value = QString(argv[1]).toInt(&ok);
+        if (ok && value > 0 && value < 65536) port = static_cast<quint16>(value);
+    }
+
+    RelayServer relay;
+    if (!relay.listen(port)) return 1;
+
+    return app.exec();
+}
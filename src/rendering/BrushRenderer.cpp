@@ -0,0 +1,283 @@
+#include "BrushRenderer.h"
+#include <QOpenGLContext>
+#include <QImage>
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+const char* dabVertexShader = R"(
+#version 330
+in vec2 corner;
+in vec4 dabShape;   // x, y, size, angle
+in vec4 dabColor;   // r, g, b, opacity
+in float dabTip;
+uniform mat4 projection;
+uniform mat4 copies[32]; // model transform of each symmetry copy, instances go dab by dab, copy by copy
+uniform int copyCount;
+uniform float atlasTiles;
+out vec2 uv;
+out vec4 color;
+void main() {
+    float c = cos(dabShape.w);
+    float s = sin(dabShape.w);
+    vec2 offset = vec2(c * corner.x - s * corner.y, s * corner.x + c * corner.y) * dabShape.z;
+    gl_Position = projection * copies[gl_InstanceID % copyCount] * vec4(dabShape.xy + offset, 0.0, 1.0);
+    uv = vec2((dabTip + corner.x + 0.5) / atlasTiles, corner.y + 0.5);
+    color = dabColor;
+}
+)";
+
+const char* dabFragmentShader = R"(
+#version 330
+in vec2 uv;
+in vec4 color;
+uniform sampler2D tips;
+out vec4 fragColor;
+void main() {
+    fragColor = vec4(color.rgb, color.a * texture(tips, uv).a);
+}
+)";
+
+enum Attribute {
+    CornerAttribute = 0, // per vertex, must be 0 in compatibility contexts
+    ShapeAttribute = 1,
+    ColorAttribute = 2,
+    TipAttribute = 3
+};
+
+}
+
+BrushRenderer::BrushRenderer() : quadBuffer(QOpenGLBuffer::VertexBuffer) {}
+
+BrushRenderer::~BrushRenderer() {
+    // GL objects need the owner's context current, the Canvas destructor takes care of that
+    quadBuffer.destroy();
+}
+
+void BrushRenderer::initialize() {
+    initializeOpenGLFunctions();
+
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if (!context || context->isOpenGLES() || context->format().version() < qMakePair(3, 3)) {
+        qWarning() << "[BrushRenderer] GL 3.3 not available, textured brushes fall back to solid strokes";
+        return;
+    }
+
+    program = std::make_unique<QOpenGLShaderProgram>();
+    // Cacheable: Qt stores the linked binary on disk keyed by the driver and the source,
+    // so later starts skip compiling and linking
+    program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, dabVertexShader);
+    program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, dabFragmentShader);
+    program->bindAttributeLocation("corner", CornerAttribute);
+    program->bindAttributeLocation("dabShape", ShapeAttribute);
+    program->bindAttributeLocation("dabColor", ColorAttribute);
+    program->bindAttributeLocation("dabTip", TipAttribute);
+    if (!program->link()) {
+        qWarning() << "[BrushRenderer] Shader link failed:" << program->log();
+        program.reset();
+        return;
+    }
+
+    const GLfloat corners[] = { -0.5f, -0.5f,  0.5f, -0.5f,  -0.5f, 0.5f,  0.5f, 0.5f };
+    quadBuffer.create();
+    quadBuffer.bind();
+    quadBuffer.allocate(corners, sizeof(corners));
+    quadBuffer.release();
+
+    createTipAtlas();
+    supported = true;
+}
+
+void BrushRenderer::createTipAtlas() {
+    const int tile = 64;
+    QImage atlas(tile * atlasTiles, tile, QImage::Format_RGBA8888);
+    atlas.fill(Qt::transparent);
+
+    const float edge = 1.5f / (tile * 0.5f); // ~1.5px of antialiasing
+
+    for (int t = 0; t < atlasTiles; ++t) {
+        for (int y = 0; y < tile; ++y) {
+            uchar* line = atlas.scanLine(y) + t * tile * 4;
+            for (int x = 0; x < tile; ++x) {
+                // -1..1 across the tile
+                float u = (x + 0.5f) / (tile * 0.5f) - 1.0f;
+                float v = (y + 0.5f) / (tile * 0.5f) - 1.0f;
+                float d = std::sqrt(u * u + v * v);
+                float a = 0.0f;
+
+                switch (static_cast<BrushTip>(t)) {
+                case BrushTip::Round:
+                    a = std::clamp((0.9f - d) / edge, 0.0f, 1.0f);
+                    break;
+                case BrushTip::Grain: {
+                    // Hash noise, gives the paper-tooth look once dabs overlap
+                    quint32 h = static_cast<quint32>(x * 374761393 + y * 668265263);
+                    h = (h ^ (h >> 13)) * 1274126177u;
+                    float noise = ((h >> 8) & 0xFF) / 255.0f;
+                    a = std::clamp((0.9f - d) / edge, 0.0f, 1.0f) * (0.35f + 0.65f * noise);
+                    break;
+                }
+                case BrushTip::Soft: {
+                    float f = std::max(0.0f, 1.0f - d * d);
+                    a = f * f;
+                    break;
+                }
+                case BrushTip::Flat: {
+                    float e = std::sqrt((u / 0.9f) * (u / 0.9f) + (v / 0.3f) * (v / 0.3f));
+                    a = std::clamp((1.0f - e) / (edge / 0.3f), 0.0f, 1.0f);
+                    break;
+                }
+                }
+
+                line[x * 4 + 0] = 255;
+                line[x * 4 + 1] = 255;
+                line[x * 4 + 2] = 255;
+                line[x * 4 + 3] = static_cast<uchar>(a * 255.0f + 0.5f);
+            }
+        }
+    }
+
+    tipAtlas = std::make_unique<QOpenGLTexture>(atlas, QOpenGLTexture::GenerateMipMaps);
+    tipAtlas->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    tipAtlas->setMagnificationFilter(QOpenGLTexture::Linear);
+    tipAtlas->setWrapMode(QOpenGLTexture::ClampToEdge);
+}
+
+void BrushRenderer::setProjection(const QMatrix4x4& matrix) {
+    projection = matrix;
+}
+
+void BrushRenderer::setModelTransform(const QTransform& transform) {
+    model = QMatrix4x4(transform);
+}
+
+void BrushRenderer::updateDabBuffer(QOpenGLBuffer& buffer, const QVector<Dab>& dabs) {
+    if (!buffer.isCreated()) buffer.create();
+    if (!buffer.bind()) return;
+    if (dabs.isEmpty()) {
+        buffer.allocate(nullptr, 0);
+    }
+    else {
+        buffer.allocate(dabs.constData(), dabs.size() * sizeof(Dab));
+    }
+    buffer.release();
+}
+
+void BrushRenderer::bindState(QOpenGLBuffer& buffer) {
+    program->bind();
+    program->setUniformValue("projection", projection);
+    program->setUniformValue("atlasTiles", static_cast<GLfloat>(atlasTiles));
+    program->setUniformValue("tips", 0);
+
+    glActiveTexture(GL_TEXTURE0);
+    tipAtlas->bind();
+
+    quadBuffer.bind();
+    glEnableVertexAttribArray(CornerAttribute);
+    glVertexAttribPointer(CornerAttribute, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glVertexAttribDivisor(CornerAttribute, 0);
+
+    buffer.bind();
+    glEnableVertexAttribArray(ShapeAttribute);
+    glEnableVertexAttribArray(ColorAttribute);
+    glEnableVertexAttribArray(TipAttribute);
+    setSymmetry(Symmetry());
+}
+
+void BrushRenderer::setSymmetry(const Symmetry& symmetry) {
+    // Copies go before the model transform, so they follow a dragged source
+    QMatrix4x4 matrices[Symmetry::maxCopies];
+    copyCount = symmetry.copies();
+    for (int i = 0; i < copyCount; ++i) {
+        matrices[i] = QMatrix4x4(symmetry.transform(i)) * model;
+    }
+    program->setUniformValueArray("copies", matrices, copyCount);
+    program->setUniformValue("copyCount", copyCount);
+
+    // Every dab stays for copyCount instances in a row
+    glVertexAttribDivisor(ShapeAttribute, copyCount);
+    glVertexAttribDivisor(ColorAttribute, copyCount);
+    glVertexAttribDivisor(TipAttribute, copyCount);
+}
+
+void BrushRenderer::drawRange(int firstDab, int count) {
+    if (count <= 0) return;
+
+    // Point the instance attributes at the first dab instead of relying on base instance support
+    const size_t base = static_cast<size_t>(firstDab) * sizeof(Dab);
+    glVertexAttribPointer(ShapeAttribute, 4, GL_FLOAT, GL_FALSE, sizeof(Dab), reinterpret_cast<void*>(base + offsetof(Dab, x)));
+    glVertexAttribPointer(ColorAttribute, 4, GL_FLOAT, GL_FALSE, sizeof(Dab), reinterpret_cast<void*>(base + offsetof(Dab, r)));
+    glVertexAttribPointer(TipAttribute, 1, GL_FLOAT, GL_FALSE, sizeof(Dab), reinterpret_cast<void*>(base + offsetof(Dab, tip)));
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count * copyCount);
+}
+
+void BrushRenderer::releaseState() {
+    glVertexAttribDivisor(ShapeAttribute, 0);
+    glVertexAttribDivisor(ColorAttribute, 0);
+    glVertexAttribDivisor(TipAttribute, 0);
+    glDisableVertexAttribArray(TipAttribute);
+    glDisableVertexAttribArray(ColorAttribute);
+    glDisableVertexAttribArray(ShapeAttribute);
+    glDisableVertexAttribArray(CornerAttribute);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    tipAtlas->release();
+    program->release();
+}
+
+void BrushRenderer::renderDabs(QOpenGLBuffer& buffer, const QVector<int>& dabCounts, const StrokeFilter& filter) {
+    if (!supported || !buffer.isCreated()) return;
+
+    static_assert(sizeof(Dab) == 9 * sizeof(float), "Dab struct is not packed correctly");
+
+    bindState(buffer);
+
+    // Neighbouring accepted strokes are contiguous in the buffer, so they go out as one draw,
+    // as long as they repeat the same way
+    static const Symmetry none;
+    const Symmetry* runSymmetry = &none;
+    int startDab = 0;
+    int runStart = -1;
+    int runCount = 0;
+    for (int i = 0; i < dabCounts.size(); ++i) {
+        int count = dabCounts[i];
+        if (count > 0 && filter.accepts(i)) {
+            const Symmetry* symmetry = filter.symmetryOf(i);
+            if (!symmetry) symmetry = &none;
+            if (runStart >= 0 && *symmetry != *runSymmetry) {
+                drawRange(runStart, runCount);
+                runStart = -1;
+                runCount = 0;
+            }
+            if (runStart < 0) {
+                if (*symmetry != *runSymmetry) setSymmetry(*symmetry);
+                runSymmetry = symmetry;
+                runStart = startDab;
+            }
+            runCount += count;
+        }
+        else if (count > 0 && runStart >= 0) {
+            drawRange(runStart, runCount);
+            runStart = -1;
+            runCount = 0;
+        }
+        startDab += count;
+    }
+    if (runStart >= 0) {
+        drawRange(runStart, runCount);
+    }
+
+    releaseState();
+}
+
+void BrushRenderer::renderDabs(QOpenGLBuffer& buffer, int firstDab, int count, const Symmetry& symmetry) {
+    if (!supported || !buffer.isCreated() || count <= 0) return;
+
+    bindState(buffer);
+    if (symmetry.isActive()) setSymmetry(symmetry);
+    drawRange(firstDab, count);
+    releaseState();
+}
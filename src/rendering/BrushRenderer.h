@@ -0,0 +1,55 @@
+#ifndef BRUSHRENDERER_H
+#define BRUSHRENDERER_H
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLBuffer>
+#include <QMatrix4x4>
+#include <QTransform>
+#include <QVector>
+#include <memory>
+#include "../data/Dab.h"
+#include "StrokeRenderer.h"
+
+// Draws dab streams as instanced quads, one instance per dab and symmetry copy, sampling the tip atlas.
+// Needs GL 3.3 (instanced arrays); isSupported() is false otherwise and callers
+// fall back to the solid triangle strips.
+class BrushRenderer : protected QOpenGLExtraFunctions {
+public:
+
+    BrushRenderer();
+    ~BrushRenderer();
+
+    void initialize();
+    bool isSupported() const { return supported; }
+
+    void setProjection(const QMatrix4x4& projection);
+    void setModelTransform(const QTransform& transform); // selection drag, identity otherwise
+
+    void updateDabBuffer(QOpenGLBuffer& buffer, const QVector<Dab>& dabs);
+
+    // Same stroke filtering as StrokeRenderer, dabCounts is parallel to strokes
+    void renderDabs(QOpenGLBuffer& buffer, const QVector<int>& dabCounts, const StrokeFilter& filter);
+    void renderDabs(QOpenGLBuffer& buffer, int firstDab, int count, const Symmetry& symmetry = Symmetry());
+
+    static constexpr int atlasTiles = 4; // tips side by side in one row
+
+private:
+
+    void createTipAtlas();
+    void bindState(QOpenGLBuffer& buffer);
+    void releaseState();
+    void drawRange(int firstDab, int count);
+    void setSymmetry(const Symmetry& symmetry); // program bound
+
+    std::unique_ptr<QOpenGLShaderProgram> program;
+    std::unique_ptr<QOpenGLTexture> tipAtlas;
+    QOpenGLBuffer quadBuffer; // 4 corners, shared by every instance
+    QMatrix4x4 projection;
+    QMatrix4x4 model;
+    int copyCount = 1;
+    bool supported = false;
+};
+
+#endif // BRUSHRENDERER_H
@@ -0,0 +1,154 @@
+#include "CanvasRenderThread.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions>
+#include <QDebug>
+#include <memory>
+#include <algorithm>
+
+CanvasRenderThread::CanvasRenderThread(QOpenGLContext* shareContext, QObject* parent) : QThread(parent) {
+    setObjectName("CanvasRender");
+
+    surface = new QOffscreenSurface();
+    surface->setFormat(shareContext->format());
+    surface->create();
+
+    context = new QOpenGLContext();
+    context->setFormat(shareContext->format());
+    context->setShareContext(shareContext);
+    if (!context->create()) {
+        qWarning() << "[CanvasRenderThread] could not create a shared context";
+    }
+    context->moveToThread(this);
+}
+
+CanvasRenderThread::~CanvasRenderThread() {
+    stop();
+    delete context;
+    delete surface; // back on the GUI thread, where it was made
+}
+
+void CanvasRenderThread::submit(FrameState&& state) {
+    QMutexLocker lock(&mutex);
+    pending.merge(std::move(state)); // also onto a frame that was skipped, see run()
+    hasPending = true;
+    wake.wakeOne();
+}
+
+void CanvasRenderThread::stop() {
+    {
+        QMutexLocker lock(&mutex);
+        stopping = true;
+        wake.wakeOne();
+    }
+    wait();
+}
+
+void CanvasRenderThread::setFrameInterval(int ms) {
+    QMutexLocker lock(&mutex);
+    frameIntervalMs = std::max(0, ms);
+}
+
+GLuint CanvasRenderThread::lockFrame(QSize* deviceSize) {
+    frameMutex.lock();
+    if (deviceSize) *deviceSize = frameSize;
+    return frameTexture;
+}
+
+void CanvasRenderThread::unlockFrame() {
+    frameMutex.unlock();
+}
+
+FrameStats CanvasRenderThread::getStats() const {
+    QMutexLocker lock(&mutex);
+    return stats;
+}
+
+void CanvasRenderThread::run() {
+    if (!context->isValid() || !context->makeCurrent(surface)) {
+        qWarning() << "[CanvasRenderThread] context not usable, nothing will be drawn";
+        context->moveToThread(QCoreApplication::instance()->thread());
+        return;
+    }
+
+    {
+        CanvasRenderer renderer;
+        renderer.initialize();
+        supported.store(renderer.brushesSupported(), std::memory_order_release);
+        emit initialized();
+
+        QOpenGLFunctions* gl = context->functions();
+        std::unique_ptr<QOpenGLFramebufferObject> work;    // rendered into, keeps its contents between frames
+        std::unique_ptr<QOpenGLFramebufferObject> present; // what the GUI thread draws
+        QElapsedTimer clock;
+        clock.start();
+        qint64 lastFrame = -1000;
+
+        while (true) {
+            FrameState state;
+            {
+                QMutexLocker lock(&mutex);
+                while (!hasPending && !stopping) {
+                    wake.wait(&mutex);
+                }
+
+                // Paced: wait out the rest of the interval, submits meanwhile merge into pending
+                qint64 remaining = lastFrame + frameIntervalMs - clock.elapsed();
+                while (remaining > 0 && !stopping) {
+                    wake.wait(&mutex, static_cast<unsigned long>(remaining));
+                    remaining = lastFrame + frameIntervalMs - clock.elapsed();
+                }
+                if (stopping) break;
+
+                state = std::move(pending);
+                pending = FrameState();
+                hasPending = false;
+            }
+            lastFrame = clock.elapsed();
+
+            const QSize device(qRound(state.size.width() * state.dpr), qRound(state.size.height() * state.dpr));
+            if (device.isEmpty()) {
+                // Nothing to draw into. The cache ops and uploads still have to happen, so the
+                // frame waits in pending and the next submit merges onto it.
+                QMutexLocker lock(&mutex);
+                if (hasPending) state.merge(std::move(pending));
+                pending = std::move(state);
+                continue;
+            }
+            if (!work || work->size() != device) {
+                work = std::make_unique<QOpenGLFramebufferObject>(device);
+                state.clip = QRectF(QPointF(0, 0), QSizeF(state.size)); // new and undefined
+            }
+
+            renderer.render(state, work->handle());
+
+            // Hand the frame over. The copy is on the GPU, the finish makes sure it is complete
+            // before the GUI context samples it.
+            {
+                QMutexLocker frameLock(&frameMutex);
+                if (!present || present->size() != device) {
+                    present = std::make_unique<QOpenGLFramebufferObject>(device);
+                }
+                QOpenGLFramebufferObject::blitFramebuffer(present.get(), work.get());
+                gl->glFinish();
+                frameTexture = present->texture();
+                frameSize = device;
+            }
+            {
+                QMutexLocker lock(&mutex);
+                stats = renderer.getStats();
+            }
+            emit frameReady();
+        }
+
+        // Renderer and FBOs go while the context is still current
+        QMutexLocker frameLock(&frameMutex);
+        frameTexture = 0;
+        present.reset();
+        work.reset();
+    }
+
+    context->doneCurrent();
+    context->moveToThread(QCoreApplication::instance()->thread());
+}
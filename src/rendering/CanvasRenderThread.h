@@ -0,0 +1,69 @@
+#ifndef CANVASRENDERTHREAD_H
+#define CANVASRENDERTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QOpenGLContext>
+#include <QOffscreenSurface>
+#include <QSize>
+#include <atomic>
+#include "CanvasRenderer.h"
+
+// Renders the canvas on its own thread, in its own GL context (sharing textures with the
+// widget's) on an offscreen surface. The GUI thread submits FrameStates and draws whatever
+// frame finished last, so widget layout, the color picker or a dialog never hold up a frame.
+class CanvasRenderThread : public QThread {
+    Q_OBJECT
+
+public:
+
+    // Call from the GUI thread with shareContext current (the surface has to be made there)
+    explicit CanvasRenderThread(QOpenGLContext* shareContext, QObject* parent = nullptr);
+    ~CanvasRenderThread(); // stops and joins
+
+    void submit(FrameState&& state); // merged into a pending one the thread hasn't got to yet
+    void stop();
+
+    // Pacing: a frame starts at least this long after the previous one,
+    // everything submitted meanwhile goes into it. 0 renders as soon as a state arrives.
+    void setFrameInterval(int ms);
+
+    // The last finished frame, 0 before the first one. Stays valid until unlockFrame,
+    // the caller draws it with a context that shares with ours and finishes before unlocking.
+    GLuint lockFrame(QSize* deviceSize);
+    void unlockFrame();
+
+    FrameStats getStats() const;
+    bool brushesSupported() const { return supported.load(std::memory_order_acquire); }
+
+signals:
+
+    void initialized(); // GL is up, brushesSupported() is valid
+    void frameReady();  // emitted from the render thread, connect queued
+
+protected:
+
+    void run() override;
+
+private:
+
+    QOpenGLContext* context = nullptr;
+    QOffscreenSurface* surface = nullptr;
+
+    mutable QMutex mutex; // guards everything below up to frameMutex
+    QWaitCondition wake;
+    FrameState pending;
+    bool hasPending = false;
+    bool stopping = false;
+    int frameIntervalMs = 0;
+    FrameStats stats;
+
+    QMutex frameMutex; // held while a finished frame is published or drawn
+    GLuint frameTexture = 0;
+    QSize frameSize;
+
+    std::atomic<bool> supported{ false };
+};
+
+#endif // CANVASRENDERTHREAD_H
@@ -0,0 +1,386 @@
+#include "CanvasRenderer.h"
+#include <QElapsedTimer>
+#include <QMatrix4x4>
+#include <QColor>
+#include <algorithm>
+
+void FrameState::merge(FrameState&& newer) {
+    QVector<CacheOp> ops = std::move(cacheOps);
+    ops += newer.cacheOps;
+    QRectF damage = clip.isEmpty() ? newer.clip : (newer.clip.isEmpty() ? clip : clip.united(newer.clip));
+    const bool changed = documentChanged || newer.documentChanged;
+    const bool release = releaseLiveBuffers || newer.releaseLiveBuffers;
+
+    *this = std::move(newer);
+    cacheOps = std::move(ops);
+    clip = damage;
+    documentChanged = changed;
+    releaseLiveBuffers = release;
+}
+
+CanvasRenderer::CanvasRenderer() {}
+
+CanvasRenderer::~CanvasRenderer() {
+    rasters.clear();
+    references.clear();
+    vBuffer.destroy();
+    dabBuffer.destroy();
+    liveBuffer.destroy();
+    liveDabBuffer.destroy();
+    remoteBuffer.destroy();
+}
+
+void CanvasRenderer::initialize() {
+    initializeOpenGLFunctions();
+
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);  // Background color
+    glEnable(GL_LINE_SMOOTH);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glLineWidth(3.0f);
+
+    vBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    vBuffer.create();
+    strokeRenderer.initialize(&vBuffer);
+    compositor.initialize();
+    brushRenderer.initialize();
+    dabBuffer.create();
+}
+
+void CanvasRenderer::resize(const QSize& size, qreal devicePixelRatio, qreal renderScale) {
+    widgetSize = size;
+    dpr = devicePixelRatio;
+
+    glMatrixMode(GL_PROJECTION); // Switch to projection matrix stack
+    glLoadIdentity();
+    glOrtho(0, size.width(), size.height(), 0, -1, 1); // Y is flipped because we are converting gl coords to Qt coords
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    // Same projection for the shader based brush renderer
+    QMatrix4x4 projection;
+    projection.ortho(0, size.width(), size.height(), 0, -1, 1);
+    brushRenderer.setProjection(projection);
+
+    compositor.resize(size, devicePixelRatio, renderScale);
+}
+
+void CanvasRenderer::applyCacheOps(const QVector<CacheOp>& ops) {
+    for (const CacheOp& op : ops) {
+        switch (op.type) {
+        case CacheOp::Type::Invalidate:
+            compositor.invalidate(op.layerId, op.rect);
+            break;
+        case CacheOp::Type::InvalidateLayer:
+            compositor.invalidateLayer(op.layerId);
+            break;
+        case CacheOp::Type::InvalidateAll:
+            compositor.invalidateAll();
+            break;
+        case CacheOp::Type::RemoveLayer:
+            compositor.removeLayer(op.layerId);
+            break;
+        case CacheOp::Type::Evict:
+            compositor.evictCaches(op.keep);
+            break;
+        case CacheOp::Type::UploadRaster:
+            uploadRaster(op);
+            break;
+        case CacheOp::Type::DropRaster:
+            rasters.erase(op.layerId);
+            break;
+        case CacheOp::Type::UploadReferenceTile:
+            uploadReferenceTile(op);
+            break;
+        case CacheOp::Type::DropReference:
+            dropReference(op.layerId, op.level);
+            break;
+        }
+    }
+}
+
+void CanvasRenderer::render(const FrameState& state, GLuint targetFbo) {
+    QElapsedTimer timer;
+    timer.start();
+
+    if (state.size != widgetSize || state.dpr != dpr || state.renderScale != compositor.getRenderScale()) {
+        resize(state.size, state.dpr, state.renderScale); // drops the caches, the caller marks a full redraw
+    }
+
+    if (state.lineSmoothing != lineSmoothing) {
+        lineSmoothing = state.lineSmoothing;
+        if (lineSmoothing) glEnable(GL_LINE_SMOOTH);
+        else glDisable(GL_LINE_SMOOTH);
+    }
+
+    applyCacheOps(state.cacheOps);
+
+    if (state.releaseLiveBuffers) {
+        liveBuffer.destroy();
+        liveDabBuffer.destroy();
+        remoteBuffer.destroy();
+        liveBytes = liveDabBytes = remoteBytes = 0;
+    }
+
+    if (state.documentChanged) {
+        strokeRenderer.updateVertexBuffer(vBuffer, state.vertices);
+        brushRenderer.updateDabBuffer(dabBuffer, state.dabs);
+    }
+
+    if (!state.clip.isEmpty()) {
+        glViewport(0, 0, qRound(widgetSize.width() * dpr), qRound(widgetSize.height() * dpr));
+
+        // Only the damaged area of the target gets cleared and recomposited,
+        // and only the damaged part of a changed layer gets re-rendered into its cache
+        compositor.composite(state.layers, targetFbo, state.clip,
+            [this, &state](int layerId, const QRectF& area) {
+                renderLayer(state, layerId, area);
+            },
+            [this, &state](int layerId) {
+                // Strokes being transformed sit on top of their own layer
+                if (state.dragging && layerId == state.selectionLayer) {
+                    renderSelectedStrokes(state);
+                }
+                // Render live stroke on top of the layer it will end up on
+                if (layerId == state.liveLayer) {
+                    renderLiveStroke(state);
+                }
+            });
+
+        // Other people's unfinished strokes, above every layer
+        renderRemoteStrokes(state);
+
+        renderSelectionOverlay(state);
+
+        glDisable(GL_SCISSOR_TEST);
+        stats.frames++;
+    }
+
+    stats.cacheBytes = compositor.gpuBytes();
+    stats.rasterBytes = 0;
+    for (const auto& raster : rasters) {
+        stats.rasterBytes += static_cast<qint64>(raster.second->width()) * raster.second->height() * 4;
+    }
+    stats.referenceBytes = 0;
+    for (const auto& reference : references) {
+        for (const ReferenceTile& tile : reference.second) {
+            stats.referenceBytes += static_cast<qint64>(tile.texture->width()) * tile.texture->height() * 4;
+        }
+    }
+    stats.liveBufferBytes = liveBytes + liveDabBytes + remoteBytes;
+    stats.renderMs = timer.nsecsElapsed() / 1.0e6;
+}
+
+// Splits the strokes into runs of solid and textured ones so the paint order is kept
+// while each run still goes out in as few draws as possible.
+void CanvasRenderer::renderStrokes(const FrameState& state, StrokeFilter filter) {
+    const QVector<int>& dabCounts = state.dabCounts;
+    filter.strokes = &state.strokes;
+    filter.vectorStarts = &state.vectorStarts;
+
+    if (!brushRenderer.isSupported() || dabCounts.size() != state.strokes.size() || state.dabs.isEmpty()) {
+        strokeRenderer.renderVertexBuffer(state.vertices, state.strokes, vBuffer, filter);
+        return;
+    }
+
+    const int strokeCount = dabCounts.size();
+    const int last = filter.last >= 0 ? std::min(filter.last, strokeCount) : strokeCount;
+    int i = std::max(filter.first, 0);
+    while (i < last) {
+        const bool textured = dabCounts[i] > 0;
+        int j = i + 1;
+        while (j < last && (dabCounts[j] > 0) == textured) ++j;
+
+        filter.first = i;
+        filter.last = j;
+        if (textured) {
+            brushRenderer.renderDabs(dabBuffer, dabCounts, filter);
+        }
+        else {
+            strokeRenderer.renderVertexBuffer(state.vertices, state.strokes, vBuffer, filter);
+        }
+        i = j;
+    }
+}
+
+void CanvasRenderer::renderLayer(const FrameState& state, int layerId, const QRectF& clip) {
+    renderReference(layerId, clip);
+    renderRaster(layerId);
+    if (state.vertices.isEmpty()) return;
+
+    StrokeFilter filter;
+    filter.clip = clip;
+    filter.layerId = layerId;
+    if (state.dragging) {
+        // Drawn separately with the drag transform, see renderSelectedStrokes
+        filter.selection = &state.selectionMask;
+        filter.selected = false;
+    }
+    renderStrokes(state, filter);
+}
+
+void CanvasRenderer::renderSelectedStrokes(const FrameState& state) {
+    if (state.vertices.isEmpty() || !state.hasSelection) return;
+
+    // QTransform is row-vector, GL wants column-major, which ends up the same layout
+    const QTransform& t = state.selectionTransform;
+    const GLfloat matrix[16] = {
+        static_cast<GLfloat>(t.m11()), static_cast<GLfloat>(t.m12()), 0.0f, 0.0f,
+        static_cast<GLfloat>(t.m21()), static_cast<GLfloat>(t.m22()), 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        static_cast<GLfloat>(t.dx()), static_cast<GLfloat>(t.dy()), 0.0f, 1.0f
+    };
+
+    StrokeFilter filter;
+    filter.selection = &state.selectionMask;
+    filter.selected = true;
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glMultMatrixf(matrix);
+    brushRenderer.setModelTransform(t);
+    renderStrokes(state, filter);
+    brushRenderer.setModelTransform(QTransform());
+    glPopMatrix();
+}
+
+void CanvasRenderer::renderLiveStroke(const FrameState& state) {
+    if (!state.liveDabs.isEmpty()) {
+        brushRenderer.updateDabBuffer(liveDabBuffer, state.liveDabs);
+        brushRenderer.renderDabs(liveDabBuffer, 0, state.liveDabs.size(), state.liveSymmetry);
+        liveDabBytes = state.liveDabs.size() * static_cast<qint64>(sizeof(Dab));
+        return;
+    }
+
+    if (state.liveVertices.isEmpty()) return;
+
+    // Use a separate temporary buffer for the current stroke
+    if (!liveBuffer.isCreated()) {
+        liveBuffer.create();
+    }
+    if (liveBuffer.bind()) {
+        liveBuffer.allocate(state.liveVertices.constData(), state.liveVertices.size() * sizeof(Vertex));
+        liveBytes = state.liveVertices.size() * static_cast<qint64>(sizeof(Vertex));
+        liveCount[0] = static_cast<int>(state.liveVertices.size());
+        StrokeFilter filter;
+        filter.symmetry = &state.liveSymmetry;
+        strokeRenderer.renderVertexBuffer(state.liveVertices, liveCount, liveBuffer, filter);
+        liveBuffer.release();
+    }
+}
+
+void CanvasRenderer::renderRemoteStrokes(const FrameState& state) {
+    if (state.remoteVertices.isEmpty()) return;
+
+    if (!remoteBuffer.isCreated()) {
+        remoteBuffer.create();
+    }
+    if (remoteBuffer.bind()) {
+        remoteBuffer.allocate(state.remoteVertices.constData(), state.remoteVertices.size() * sizeof(Vertex));
+        remoteBytes = state.remoteVertices.size() * static_cast<qint64>(sizeof(Vertex));
+        strokeRenderer.renderVertexBuffer(state.remoteVertices, state.remoteCounts, remoteBuffer);
+        remoteBuffer.release();
+    }
+}
+
+void CanvasRenderer::renderSelectionOverlay(const FrameState& state) {
+    if (state.selecting) {
+        strokeRenderer.renderOutline(state.selectionPath, true, QColor(40, 40, 40));
+    }
+    if (state.hasSelection) {
+        const QRectF& r = state.selectionBounds;
+        strokeRenderer.renderOutline({ r.topLeft(), r.topRight(), r.bottomRight(), r.bottomLeft() }, true, QColor(30, 120, 255));
+    }
+}
+
+void CanvasRenderer::uploadRaster(const CacheOp& op) {
+    if (op.pixels.isNull()) return;
+    const QRect rect = op.rect.toRect();
+    std::unique_ptr<QOpenGLTexture>& texture = rasters[op.layerId];
+
+    // A whole raster replaces the texture when the size changed, pieces only go into an existing one
+    const bool whole = rect == QRect(QPoint(0, 0), op.pixels.size());
+    if (whole && (!texture || texture->width() != rect.width() || texture->height() != rect.height())) {
+        texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+        texture->setSize(rect.width(), rect.height());
+        texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+        texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+        texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+        texture->allocateStorage(QOpenGLTexture::BGRA, QOpenGLTexture::UInt8);
+    }
+    if (!texture) {
+        rasters.erase(op.layerId);
+        return;
+    }
+
+    // ARGB32 is BGRA in memory, premultiplied like the caches
+    texture->setData(rect.x(), rect.y(), 0, rect.width(), rect.height(), 1,
+                     QOpenGLTexture::BGRA, QOpenGLTexture::UInt8, op.pixels.constBits());
+}
+
+void CanvasRenderer::renderRaster(int layerId) {
+    auto it = rasters.find(layerId);
+    if (it == rasters.end()) return;
+    drawTexture(*it->second, QRectF(0, 0, it->second->width(), it->second->height()));
+}
+
+void CanvasRenderer::uploadReferenceTile(const CacheOp& op) {
+    if (op.pixels.isNull()) return;
+
+    auto texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+    texture->setSize(op.pixels.width(), op.pixels.height());
+    texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear); // the level is within 2x of the screen
+    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    texture->allocateStorage(QOpenGLTexture::BGRA, QOpenGLTexture::UInt8);
+    texture->setData(QOpenGLTexture::BGRA, QOpenGLTexture::UInt8, op.pixels.constBits());
+
+    std::vector<ReferenceTile>& tiles = references[op.layerId];
+    auto at = std::find_if(tiles.begin(), tiles.end(), [&op](const ReferenceTile& tile) { return tile.level < op.level; });
+    tiles.insert(at, ReferenceTile{ op.level, op.rect, std::move(texture) });
+}
+
+void CanvasRenderer::dropReference(int layerId, int level) {
+    auto it = references.find(layerId);
+    if (it == references.end()) return;
+    if (level < 0) {
+        references.erase(it);
+        return;
+    }
+    std::vector<ReferenceTile>& tiles = it->second;
+    tiles.erase(std::remove_if(tiles.begin(), tiles.end(), [level](const ReferenceTile& tile) { return tile.level == level; }), tiles.end());
+}
+
+void CanvasRenderer::renderReference(int layerId, const QRectF& clip) {
+    auto it = references.find(layerId);
+    if (it == references.end()) return;
+    for (const ReferenceTile& tile : it->second) {
+        if (tile.rect.intersects(clip)) drawTexture(*tile.texture, tile.rect);
+    }
+}
+
+void CanvasRenderer::drawTexture(QOpenGLTexture& texture, const QRectF& rect) {
+    const GLfloat x0 = rect.left(), y0 = rect.top(), x1 = rect.right(), y1 = rect.bottom();
+    const GLfloat positions[] = { x0, y0,  x1, y0,  x0, y1,  x1, y1 };
+    const GLfloat texCoords[] = { 0, 0,  1, 0,  0, 1,  1, 1 }; // first row uploaded is the top one
+
+    // Premultiplied already, then back to the cache's blend (see LayerCompositor::updateCache)
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glBindBuffer(GL_ARRAY_BUFFER, 0); // client side arrays
+    glEnable(GL_TEXTURE_2D);
+    texture.bind();
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, positions);
+    glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    texture.release();
+    glDisable(GL_TEXTURE_2D);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+}
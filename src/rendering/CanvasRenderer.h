@@ -0,0 +1,157 @@
+#ifndef CANVASRENDERER_H
+#define CANVASRENDERER_H
+
+#include <qopenglfunctions.h>
+#include <QOpenGLBuffer>
+#include <QOpenGLTexture>
+#include <QImage>
+#include <QVector>
+#include <QHash>
+#include <QRectF>
+#include <QSize>
+#include <QTransform>
+#include <QPointF>
+#include <memory>
+#include <unordered_map>
+#include "../data/Vertex.h"
+#include "../data/Dab.h"
+#include "../data/Layer.h"
+#include "../data/StrokeRecord.h"
+#include "StrokeRenderer.h"
+#include "BrushRenderer.h"
+#include "LayerCompositor.h"
+
+// A layer cache change, queued by the document side and replayed by the renderer before it draws
+struct CacheOp {
+    enum class Type {
+        Invalidate,      // layerId, rect
+        InvalidateLayer, // layerId
+        InvalidateAll,
+        RemoveLayer,     // layerId
+        Evict,           // everything not in keep
+        UploadRaster,    // layerId, pixels go to rect of its raster texture. A whole raster (re)creates it
+        DropRaster,      // layerId
+        UploadReferenceTile, // layerId, level, a tile of pixels shown at rect
+        DropReference    // layerId, the tiles of level or all of them when it is -1
+    };
+
+    Type type = Type::Invalidate;
+    int layerId = -1;
+    QRectF rect;
+    QVector<int> keep;
+    QImage pixels;
+    int level = -1;
+};
+
+// Everything one frame needs, taken from the document by Canvas::takeFrameState.
+// The vectors are implicitly shared, so a snapshot is a handful of ref counts and stays
+// consistent on the render thread while the GUI thread goes on editing its own copies.
+struct FrameState {
+    QSize size;            // widget coords
+    qreal dpr = 1.0;
+    QRectF clip;           // damaged area, widget coords
+    QVector<CacheOp> cacheOps;
+    bool releaseLiveBuffers = false; // memory pressure, they come back with the next stroke
+    qreal renderScale = 1.0;   // layer caches, see QualityController. A change redraws everything
+    bool lineSmoothing = true;
+
+    QVector<Layer> layers; // only the ones with something to composite
+    bool documentChanged = false; // vertices and dabs need a re-upload
+    QVector<Vertex> vertices;
+    QVector<StrokeRecord> strokes; // vertex ranges, bounds, layers and symmetries of the above
+    QVector<Dab> dabs;
+    QVector<int> dabCounts; // parallel to strokes, 0 for solid strokes
+    QHash<int, int> vectorStarts; // BrushEngine::vectorStarts
+
+    int liveLayer = -1;    // layer the live stroke sits on, -1 when there is none
+    Symmetry liveSymmetry;
+    QVector<Vertex> liveVertices;
+    QVector<Dab> liveDabs;
+    QVector<Vertex> remoteVertices; // other people's unfinished strokes
+    QVector<int> remoteCounts;
+
+    // Selection
+    bool dragging = false;
+    int selectionLayer = -1;
+    QVector<bool> selectionMask;
+    QTransform selectionTransform;
+    bool selecting = false;
+    QVector<QPointF> selectionPath;
+    bool hasSelection = false;
+    QRectF selectionBounds;
+
+    // Folds a newer state into this one when a frame was skipped: the newer document wins,
+    // damage and cache changes add up
+    void merge(FrameState&& newer);
+};
+
+struct FrameStats {
+    qint64 cacheBytes = 0;      // layer caches
+    qint64 liveBufferBytes = 0; // live and remote stroke buffers
+    qint64 rasterBytes = 0;     // layer raster textures
+    qint64 referenceBytes = 0;  // reference image tiles
+    double renderMs = 0.0;      // CPU side of the last frame
+    quint64 frames = 0;
+};
+
+// Draws a FrameState into a framebuffer. Owns every GL object the canvas needs, so there is
+// one per context: the widget's, or the render thread's when that is on.
+class CanvasRenderer : protected QOpenGLFunctions {
+public:
+
+    CanvasRenderer();
+    ~CanvasRenderer(); // GL objects need the owner's context current
+
+    void initialize();
+    void render(const FrameState& state, GLuint targetFbo);
+
+    bool brushesSupported() const { return brushRenderer.isSupported(); }
+    const FrameStats& getStats() const { return stats; }
+
+private:
+
+    void resize(const QSize& size, qreal dpr, qreal renderScale);
+    void applyCacheOps(const QVector<CacheOp>& ops);
+    void renderStrokes(const FrameState& state, StrokeFilter filter);
+    void renderLayer(const FrameState& state, int layerId, const QRectF& clip);
+    void renderSelectedStrokes(const FrameState& state);
+    void renderLiveStroke(const FrameState& state);
+    void renderRemoteStrokes(const FrameState& state);
+    void renderSelectionOverlay(const FrameState& state);
+    void uploadRaster(const CacheOp& op);
+    void renderRaster(int layerId);
+    void uploadReferenceTile(const CacheOp& op);
+    void dropReference(int layerId, int level);
+    void renderReference(int layerId, const QRectF& clip);
+    void drawTexture(QOpenGLTexture& texture, const QRectF& rect); // premultiplied
+
+    StrokeRenderer strokeRenderer;
+    BrushRenderer brushRenderer;
+    LayerCompositor compositor; // per-layer cached textures
+    std::unordered_map<int, std::unique_ptr<QOpenGLTexture>> rasters; // layer id -> its raster pixels, drawn under its strokes
+    struct ReferenceTile {
+        int level;
+        QRectF rect;
+        std::unique_ptr<QOpenGLTexture> texture;
+    };
+    // layer id -> its reference image tiles, coarse levels first so finer ones land on top as they stream in
+    std::unordered_map<int, std::vector<ReferenceTile>> references;
+
+    QOpenGLBuffer vBuffer;
+    QOpenGLBuffer dabBuffer;
+    QOpenGLBuffer liveBuffer;    // re-filled every frame
+    QOpenGLBuffer liveDabBuffer;
+    QOpenGLBuffer remoteBuffer;
+    // The live stroke drawn as a one stroke buffer, kept so frames don't allocate
+    QVector<int> liveCount = { 0 };
+    qint64 liveBytes = 0;
+    qint64 liveDabBytes = 0;
+    qint64 remoteBytes = 0;
+
+    QSize widgetSize;
+    qreal dpr = 0.0;
+    bool lineSmoothing = true;
+    FrameStats stats;
+};
+
+#endif // CANVASRENDERER_H
@@ -0,0 +1,96 @@
+#include "FrameScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double marginMs = 2.0;      // slack between the paint finishing and the vsync
+constexpr double stalePhaseMs = 1000.0; // after this long without a swap the vsync phase is a guess
+
+} // namespace
+
+FrameScheduler::FrameScheduler(QWidget* widget)
+    : target(widget)
+{
+    timer.setSingleShot(true);
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, [this]() { target->update(); });
+    clock.start();
+}
+
+void FrameScheduler::setRefreshRate(qreal hz) {
+    intervalMs = hz > 0.0 ? 1000.0 / hz : 1000.0 / 60.0;
+}
+
+void FrameScheduler::requestFrame() {
+    stats.requests++;
+    if (pending) {
+        stats.coalesced++;
+        return;
+    }
+
+    pending = true;
+    requestedAt = now();
+    if (!painting) schedule(); // otherwise endFrame does
+}
+
+void FrameScheduler::schedule() {
+    const double t = now();
+    if (lastSwap < 0.0 || t - lastSwap > stalePhaseMs) {
+        if (swapPending) return; // frameSwapped brings a fresh phase, it schedules then
+
+        // Coming out of idle, nothing to line up with, go now
+        targetVsync = -1.0;
+        timer.start(0);
+        return;
+    }
+
+    // The first vsync we can still make, never the one the last frame went out on
+    // or the one a painted frame is still waiting for
+    const double ready = t + stats.paintMs + marginMs;
+    const double n = std::max(swapPending ? 2.0 : 1.0, std::ceil((ready - lastSwap) / intervalMs));
+    targetVsync = lastSwap + n * intervalMs;
+
+    const double start = targetVsync - stats.paintMs - marginMs;
+    timer.start(std::max(0, static_cast<int>(start - t)));
+}
+
+void FrameScheduler::beginFrame() {
+    painting = true;
+    paintStart = now();
+
+    // Whatever was requested so far makes it into this frame, expose and resize paints included
+    paintedVsync = pending ? targetVsync : -1.0;
+    paintedRequestAt = pending ? requestedAt : -1.0;
+    pending = false;
+    timer.stop();
+    stats.frames++;
+}
+
+void FrameScheduler::endFrame() {
+    painting = false;
+    swapPending = true;
+    const double ms = now() - paintStart;
+    stats.paintMs = stats.paintMs == 0.0 ? ms : stats.paintMs + (ms - stats.paintMs) * 0.2;
+
+    if (pending) schedule(); // requested while painting
+}
+
+void FrameScheduler::frameSwapped() {
+    const double t = now();
+
+    if (paintedVsync >= 0.0 && t > paintedVsync + intervalMs * 0.5) {
+        stats.missed += std::max<qint64>(1, std::llround((t - paintedVsync) / intervalMs));
+    }
+    if (paintedRequestAt >= 0.0) {
+        stats.lastLatencyMs = t - paintedRequestAt;
+        stats.maxLatencyMs = std::max(stats.maxLatencyMs, stats.lastLatencyMs);
+    }
+
+    paintedVsync = -1.0;
+    paintedRequestAt = -1.0;
+    swapPending = false;
+    lastSwap = t;
+
+    if (pending) schedule(); // lined up with the new phase
+}
@@ -0,0 +1,64 @@
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QWidget>
+
+struct FrameSchedulerStats {
+    quint64 requests = 0;
+    quint64 coalesced = 0;  // requests that joined a frame already scheduled
+    quint64 frames = 0;     // paints we scheduled
+    quint64 missed = 0;     // vsyncs that went by after their frame was due
+    double paintMs = 0.0;   // smoothed paintGL time, used to start it early enough
+    double lastLatencyMs = 0.0; // first request to swap
+    double maxLatencyMs = 0.0;
+};
+
+// Collects repaint requests and turns them into at most one update() per refresh interval.
+// The paint is started as late as it can be, the expected paint time plus a margin before
+// the next vsync, so it picks up the newest input. The vsync phase comes from the widget's
+// frameSwapped, which returns once the (blocking) swap is done. Nothing requested, nothing
+// runs: the timer only exists between a request and its paint.
+class FrameScheduler : public QObject {
+    Q_OBJECT
+
+public:
+
+    explicit FrameScheduler(QWidget* target);
+
+    void setRefreshRate(qreal hz);
+    void requestFrame();
+
+    // From paintGL, around the actual work
+    void beginFrame();
+    void endFrame();
+    // Connected to QOpenGLWidget::frameSwapped
+    void frameSwapped();
+
+    const FrameSchedulerStats& getStats() const { return stats; }
+
+private:
+
+    void schedule();
+    double now() const { return clock.nsecsElapsed() / 1.0e6; }
+
+    QWidget* target;
+    QTimer timer;
+    QElapsedTimer clock;
+    double intervalMs = 1000.0 / 60.0;
+
+    bool pending = false;   // requested, not painted yet
+    bool painting = false;
+    bool swapPending = false; // painted, not on screen yet, it has the next vsync
+    double requestedAt = -1.0; // first request of the pending frame
+    double paintStart = -1.0;
+    double lastSwap = -1.0;
+    double targetVsync = -1.0;  // the pending frame is meant for this one, -1 when it goes right away
+    double paintedVsync = -1.0; // same for the frame on its way to the screen
+    double paintedRequestAt = -1.0;
+    FrameSchedulerStats stats;
+};
+
+#endif // FRAMESCHEDULER_H
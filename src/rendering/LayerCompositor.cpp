@@ -0,0 +1,201 @@
+#include "LayerCompositor.h"
+#include <algorithm>
+
+LayerCompositor::LayerCompositor() {}
+
+LayerCompositor::~LayerCompositor() {
+    // FBOs need the owner's context current, the Canvas destructor takes care of that
+    caches.clear();
+}
+
+void LayerCompositor::initialize() {
+    initializeOpenGLFunctions();
+}
+
+void LayerCompositor::resize(const QSize& size, qreal devicePixelRatio, qreal renderScale) {
+    widgetSize = size;
+    dpr = devicePixelRatio;
+    deviceSize = QSize(qRound(size.width() * devicePixelRatio), qRound(size.height() * devicePixelRatio));
+    scale = renderScale;
+
+    QSize newCacheSize(std::max(1, qRound(deviceSize.width() * scale)), std::max(1, qRound(deviceSize.height() * scale)));
+    if (newCacheSize != cacheSize) {
+        cacheSize = newCacheSize;
+        caches.clear();
+    }
+}
+
+void LayerCompositor::invalidate(int layerId, const QRectF& rect) {
+    auto it = caches.find(layerId);
+    if (it == caches.end() || it->second.full || rect.isEmpty()) return;
+
+    Cache& cache = it->second;
+    cache.dirty = cache.dirty.isEmpty() ? rect : cache.dirty.united(rect);
+}
+
+void LayerCompositor::invalidateLayer(int layerId) {
+    auto it = caches.find(layerId);
+    if (it != caches.end()) {
+        it->second.full = true;
+    }
+}
+
+void LayerCompositor::invalidateAll() {
+    for (auto& entry : caches) {
+        entry.second.full = true;
+    }
+}
+
+void LayerCompositor::removeLayer(int layerId) {
+    caches.erase(layerId);
+}
+
+qint64 LayerCompositor::gpuBytes() const {
+    return static_cast<qint64>(caches.size()) * cacheSize.width() * cacheSize.height() * 4;
+}
+
+int LayerCompositor::evictCaches(const QVector<int>& keep) {
+    int evicted = 0;
+    for (auto it = caches.begin(); it != caches.end();) {
+        if (!keep.contains(it->first)) {
+            it = caches.erase(it);
+            ++evicted;
+        }
+        else {
+            ++it;
+        }
+    }
+    return evicted;
+}
+
+QRect LayerCompositor::toScissorRect(const QRectF& rect, qreal devicePixelRatio, const QSize& deviceSize) {
+    const QRect fb(QPoint(0, 0), deviceSize);
+    QRectF scaled(rect.x() * devicePixelRatio, rect.y() * devicePixelRatio,
+                  rect.width() * devicePixelRatio, rect.height() * devicePixelRatio);
+
+    // GL's origin is bottom left
+    QRect r = scaled.toAlignedRect();
+    return QRect(r.x(), fb.height() - r.y() - r.height(), r.width(), r.height()).intersected(fb);
+}
+
+LayerCompositor::Cache& LayerCompositor::cacheFor(int layerId) {
+    Cache& cache = caches[layerId];
+    if (!cache.fbo) {
+        cache.fbo = std::make_unique<QOpenGLFramebufferObject>(cacheSize);
+        cache.full = true;
+
+        // 1:1 texel to pixel needs no filtering, a reduced cache gets stretched
+        const GLint filter = cacheSize == deviceSize ? GL_NEAREST : GL_LINEAR;
+        glBindTexture(GL_TEXTURE_2D, cache.fbo->texture());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    return cache;
+}
+
+void LayerCompositor::updateCache(int layerId, Cache& cache, const std::function<void(int, const QRectF&)>& drawLayer) {
+    QRectF area = cache.full ? QRectF(QPointF(0, 0), QSizeF(widgetSize)) : cache.dirty;
+    QRect scissor = cache.full ? QRect(QPoint(0, 0), cacheSize) : toScissorRect(area, dpr * scale, cacheSize);
+
+    if (!scissor.isEmpty() && cache.fbo->bind()) {
+        glViewport(0, 0, cacheSize.width(), cacheSize.height()); // same projection, fewer pixels
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(scissor.x(), scissor.y(), scissor.width(), scissor.height());
+
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // Keep the cache premultiplied so compositing with opacity and blend modes is straightforward
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        drawLayer(layerId, area);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    cache.dirty = QRectF();
+    cache.full = false;
+}
+
+void LayerCompositor::composite(const QVector<Layer>& layers, GLuint targetFbo, const QRectF& clip,
+                                const std::function<void(int, const QRectF&)>& drawLayer,
+                                const std::function<void(int)>& afterLayer)
+{
+    if (deviceSize.isEmpty()) return;
+
+    // Bring caches up to date first, each in its own FBO
+    for (const Layer& layer : layers) {
+        if (!layer.visible) continue;
+        Cache& cache = cacheFor(layer.id);
+        if (cache.full || !cache.dirty.isEmpty()) {
+            updateCache(layer.id, cache, drawLayer);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
+    glViewport(0, 0, deviceSize.width(), deviceSize.height());
+
+    QRect scissor = toScissorRect(clip, dpr, deviceSize);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(scissor.x(), scissor.y(), scissor.width(), scissor.height());
+
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f); // Background color
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    for (const Layer& layer : layers) {
+        if (layer.visible) {
+            applyBlendMode(layer.blendMode);
+            drawLayerTexture(caches[layer.id].fbo->texture(), layer.opacity);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        afterLayer(layer.id);
+    }
+
+    // Scissor stays on, the caller may still draw inside clip
+}
+
+void LayerCompositor::applyBlendMode(BlendMode mode) {
+    // Source is premultiplied (see updateCache) and opacity is folded into the color
+    switch (mode) {
+    case BlendMode::Multiply:
+        glBlendFunc(GL_DST_COLOR, GL_ONE_MINUS_SRC_ALPHA);
+        break;
+    case BlendMode::Screen:
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_COLOR);
+        break;
+    case BlendMode::Add:
+        glBlendFunc(GL_ONE, GL_ONE);
+        break;
+    case BlendMode::Normal:
+    default:
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        break;
+    }
+}
+
+void LayerCompositor::drawLayerTexture(GLuint texture, float opacity) {
+    const float w = widgetSize.width();
+    const float h = widgetSize.height();
+
+    // The cache was rendered with the same projection, so widget top maps to texture top (v = 1)
+    const GLfloat positions[] = { 0, 0,  w, 0,  0, h,  w, h };
+    const GLfloat texCoords[] = { 0, 1,  1, 1,  0, 0,  1, 0 };
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0); // client side arrays
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glColor4f(opacity, opacity, opacity, opacity);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, positions);
+    glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+}
@@ -0,0 +1,70 @@
+#ifndef LAYERCOMPOSITOR_H
+#define LAYERCOMPOSITOR_H
+
+#include <qopenglfunctions.h>
+#include <QOpenGLFramebufferObject>
+#include <QVector>
+#include <QRectF>
+#include <QSize>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include "../data/Layer.h"
+
+// Keeps one cached raster (FBO texture) per layer and composites them.
+// A layer cache is only re-rendered in the areas invalidated since it was last drawn,
+// so drawing on one layer never touches the strokes of the others.
+class LayerCompositor : protected QOpenGLFunctions {
+public:
+
+    LayerCompositor();
+    ~LayerCompositor();
+
+    void initialize();
+    // Drops every cache when the cache size changes. Below 1 the caches are rendered smaller
+    // and stretched when composited, cheaper fill at the price of softer strokes.
+    void resize(const QSize& widgetSize, qreal devicePixelRatio, qreal renderScale = 1.0);
+
+    void invalidate(int layerId, const QRectF& rect); // widget coords
+    void invalidateLayer(int layerId);
+    void invalidateAll();
+    void removeLayer(int layerId);
+
+    // drawLayer(id, clip) renders a layer's strokes, afterLayer(id) lets the caller draw
+    // on top of a layer before the next one is composited (the live stroke).
+    void composite(const QVector<Layer>& layers, GLuint targetFbo, const QRectF& clip,
+                   const std::function<void(int, const QRectF&)>& drawLayer,
+                   const std::function<void(int)>& afterLayer);
+
+    // Widget rect to a scissor box in framebuffer pixels (bottom left origin)
+    static QRect toScissorRect(const QRectF& rect, qreal devicePixelRatio, const QSize& deviceSize);
+
+    int cacheCount() const { return static_cast<int>(caches.size()); }
+    qint64 gpuBytes() const; // RGBA8 color attachments, one per cache
+    qreal getRenderScale() const { return scale; }
+
+    // Drops caches of layers that are not in keep (hidden or empty ones), returns how many went
+    int evictCaches(const QVector<int>& keep);
+
+private:
+
+    struct Cache {
+        std::unique_ptr<QOpenGLFramebufferObject> fbo;
+        QRectF dirty;
+        bool full = true;
+    };
+
+    Cache& cacheFor(int layerId);
+    void updateCache(int layerId, Cache& cache, const std::function<void(int, const QRectF&)>& drawLayer);
+    void drawLayerTexture(GLuint texture, float opacity);
+    void applyBlendMode(BlendMode mode);
+
+    std::unordered_map<int, Cache> caches;
+    QSize widgetSize;
+    QSize deviceSize;
+    QSize cacheSize; // deviceSize * scale
+    qreal dpr = 1.0;
+    qreal scale = 1.0;
+};
+
+#endif // LAYERCOMPOSITOR_H
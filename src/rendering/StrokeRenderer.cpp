@@ -1,6 +1,7 @@
 #include "StrokeRenderer.h"
 #include <qopenglfunctions.h>
 #include "../data/Vertex.h"
+#include <QMatrix4x4>
 #include <cstddef>
 
 StrokeRenderer::StrokeRenderer() : vBuffer(nullptr) {}  
@@ -10,7 +11,21 @@ void StrokeRenderer::initialize(QOpenGLBuffer* vertexBuffer) {
     initializeOpenGLFunctions();
 }
 
-void StrokeRenderer::renderVertexBuffer(const QVector<Vertex>& vertices, const QVector<int>& strokeCounts, QOpenGLBuffer& buffer)
+void StrokeRenderer::renderVertexBuffer(const QVector<Vertex>& vertices, const QVector<int>& strokeCounts, QOpenGLBuffer& buffer,
+                                        const StrokeFilter& filter)
+{
+    drawStrokes(vertices, strokeCounts.size(), [&strokeCounts](int i) { return strokeCounts[i]; }, buffer, filter);
+}
+
+void StrokeRenderer::renderVertexBuffer(const QVector<Vertex>& vertices, const QVector<StrokeRecord>& strokes, QOpenGLBuffer& buffer,
+                                        const StrokeFilter& filter)
+{
+    drawStrokes(vertices, strokes.size(), [&strokes](int i) { return strokes[i].vertexCount; }, buffer, filter);
+}
+
+template <typename CountOf>
+void StrokeRenderer::drawStrokes(const QVector<Vertex>& vertices, int strokeCount, CountOf countOf, QOpenGLBuffer& buffer,
+                                 const StrokeFilter& filter)
 {
     if (vertices.isEmpty()) return;
 
@@ -30,11 +45,29 @@ void StrokeRenderer::renderVertexBuffer(const QVector<Vertex>& vertices, const Q
     glVertexPointer(2, GL_FLOAT, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, x)));
     glColorPointer(3, GL_FLOAT, sizeof(Vertex), reinterpret_cast<void*>(offsetof(Vertex, r)));
 
+    // Symmetry copies draw the same range again, their transform goes before whatever the
+    // matrix stack has (a selection drag moves the source, the copies follow it)
+    QMatrix4x4 model;
+    bool modelRead = false;
+
     int startVertex = 0;
-    for (int i = 0; i < strokeCounts.size(); ++i) {
-        int count = strokeCounts[i];
+    for (int i = 0; i < strokeCount; ++i) {
+        int count = countOf(i);
         if (count > 0) {
-            glDrawArrays(GL_TRIANGLE_STRIP, startVertex, count);
+            if (filter.accepts(i)) {
+                glDrawArrays(GL_TRIANGLE_STRIP, startVertex, count);
+                if (const Symmetry* symmetry = filter.symmetryOf(i)) {
+                    if (!modelRead) {
+                        glGetFloatv(GL_MODELVIEW_MATRIX, model.data());
+                        modelRead = true;
+                    }
+                    for (int copy = 1; copy < symmetry->copies(); ++copy) {
+                        glLoadMatrixf((QMatrix4x4(symmetry->transform(copy)) * model).constData());
+                        glDrawArrays(GL_TRIANGLE_STRIP, startVertex, count);
+                    }
+                    glLoadMatrixf(model.constData());
+                }
+            }
             startVertex += count;
         }
     }
@@ -64,6 +97,25 @@ void StrokeRenderer::updateVertexBuffer(QOpenGLBuffer& buffer, const QVector<Ver
     buffer.release();
 }
 
+void StrokeRenderer::renderOutline(const QVector<QPointF>& points, bool closed, const QColor& color) {
+    if (points.size() < 2) return;
+
+    QVector<GLfloat> coords;
+    coords.reserve(points.size() * 2);
+    for (const QPointF& p : points) {
+        coords.append(static_cast<GLfloat>(p.x()));
+        coords.append(static_cast<GLfloat>(p.y()));
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0); // client side array
+    glColor4f(color.redF(), color.greenF(), color.blueF(), color.alphaF());
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, coords.constData());
+    glDrawArrays(closed ? GL_LINE_LOOP : GL_LINE_STRIP, 0, points.size());
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+}
+
 void StrokeRenderer::clearBuffer(QOpenGLBuffer& buffer) {
     if (buffer.bind()) {
         buffer.allocate(nullptr, 0);
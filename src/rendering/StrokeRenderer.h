@@ -4,9 +4,43 @@
 #include <qopenglfunctions.h> // Add this include to ensure QOpenGLFunctions is available
 #include <qopenglbuffer.h>
 #include "../data/Vertex.h"
+#include "../data/Symmetry.h"
+#include "../data/StrokeRecord.h"
 #include <QVector>
+#include <QHash>
 #include <QColor>
 #include <QPointF>
+#include <QRectF>
+
+// Which strokes of a vertex buffer get drawn, everything by default
+struct StrokeFilter {
+    const QVector<StrokeRecord>* strokes = nullptr; // the buffer's strokes, clip, layerId and vectorStarts look at them
+    QRectF clip;      // skip strokes entirely outside clip
+    int layerId = -1; // only strokes on that layer, -1 is any
+    const QVector<bool>* selection = nullptr; // with selected, only strokes whose flag matches
+    bool selected = false;
+    int first = 0;   // only strokes in [first, last), last < 0 means to the end
+    int last = -1;
+    const QHash<int, int>* vectorStarts = nullptr; // skips strokes flattened into their raster
+    const Symmetry* symmetry = nullptr; // without strokes, every stroke is drawn once per copy of it (the live stroke)
+
+    const Symmetry* symmetryOf(int i) const {
+        const Symmetry* s = strokes ? (i < strokes->size() ? &(*strokes)[i].symmetry : nullptr) : symmetry;
+        return s && s->isActive() ? s : nullptr;
+    }
+
+    bool accepts(int i) const {
+        if (i < first || (last >= 0 && i >= last)) return false;
+        if (selection && ((i < selection->size() && (*selection)[i]) != selected)) return false;
+        if (!strokes || i >= strokes->size()) return true;
+
+        const StrokeRecord& stroke = (*strokes)[i];
+        if (clip.isValid() && !stroke.bounds.intersects(clip)) return false;
+        if (layerId >= 0 && stroke.layerId != layerId) return false;
+        if (vectorStarts && !vectorStarts->isEmpty() && i < vectorStarts->value(stroke.layerId, 0)) return false;
+        return true;
+    }
+};
 
 class StrokeRenderer : protected QOpenGLFunctions { // Inherit from QOpenGLFunctions to use initializeOpenGLFunctions
 public:
@@ -14,11 +48,22 @@ public:
     StrokeRenderer();
 
     void initialize(QOpenGLBuffer* vertexBuffer);
-    void renderVertexBuffer(const QVector<Vertex>& vertices, const QVector<int>& strokeCounts, QOpenGLBuffer& buffer);
+    void renderVertexBuffer(const QVector<Vertex>& vertices, const QVector<int>& strokeCounts, QOpenGLBuffer& buffer,
+                            const StrokeFilter& filter = StrokeFilter());
+    // The document's, every stroke's range is its record's vertexCount
+    void renderVertexBuffer(const QVector<Vertex>& vertices, const QVector<StrokeRecord>& strokes, QOpenGLBuffer& buffer,
+                            const StrokeFilter& filter);
     void updateVertexBuffer(QOpenGLBuffer& buffer, const QVector<Vertex>& vertices);
     void clearBuffer(QOpenGLBuffer& buffer);
 
+    // Line overlay (selection outlines), no VBO involved
+    void renderOutline(const QVector<QPointF>& points, bool closed, const QColor& color);
+
 private:
+    template <typename CountOf>
+    void drawStrokes(const QVector<Vertex>& vertices, int strokeCount, CountOf countOf, QOpenGLBuffer& buffer,
+                     const StrokeFilter& filter);
+
     QOpenGLBuffer* vBuffer;
 };
 
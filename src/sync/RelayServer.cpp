@@ -0,0 +1,135 @@
+#include "RelayServer.h"
+#include <QDebug>
+#include <QRandomGenerator>
+
+RelayServer::RelayServer(QObject* parent)
+    : QObject(parent)
+{
+    session = QRandomGenerator::global()->generate() | 1; // never 0, that's "no relay yet" for clients
+    nextClientId = (QRandomGenerator::global()->generate() & 0x3fffffff) + 1; // high bit is for offline ids
+    server = new QTcpServer(this);
+    connect(server, &QTcpServer::newConnection, this, &RelayServer::onNewConnection);
+}
+
+bool RelayServer::listen(quint16 port) {
+    if (!server->listen(QHostAddress::Any, port)) {
+        qWarning() << "[Relay] Could not listen on port" << port << ":" << server->errorString();
+        return false;
+    }
+    qInfo() << "[Relay] Listening on port" << server->serverPort();
+    return true;
+}
+
+void RelayServer::onNewConnection() {
+    while (QTcpSocket* socket = server->nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        Client client;
+        client.id = nextClientId++;
+        clients.insert(socket, client);
+
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            qInfo() << "[Relay] Client" << clients.value(socket).id << "left";
+            clients.remove(socket);
+            socket->deleteLater();
+        });
+
+        SyncOp hello;
+        hello.type = SyncOpType::Hello;
+        hello.clientId = client.id;
+        hello.session = session;
+        socket->write(SyncProtocol::encode(hello));
+
+        // Catch up on the document as it is now
+        for (const LoggedOp& logged : log) {
+            if (!logged.frame.isEmpty()) socket->write(logged.frame);
+        }
+        qInfo() << "[Relay] Client" << client.id << "joined, replayed" << logSize() << "ops";
+    }
+}
+
+void RelayServer::onReadyRead(QTcpSocket* socket) {
+    auto it = clients.find(socket);
+    if (it == clients.end()) return;
+
+    it->readBuffer += socket->readAll();
+
+    SyncOp op;
+    bool error = false;
+    while (SyncProtocol::decodeNext(it->readBuffer, op, error)) {
+        if (op.clientId != it->id) continue; // clients only speak for themselves
+        relay(socket, op);
+    }
+
+    if (error) {
+        qWarning() << "[Relay] Malformed data from client" << it->id << ", dropping it";
+        socket->abort();
+    }
+}
+
+void RelayServer::relay(QTcpSocket* from, SyncOp& op) {
+    op.relaySeq = ++relaySeq;
+    QByteArray frame = SyncProtocol::encode(op);
+
+    if (op.type == SyncOpType::Clear) {
+        // Nothing before a clear matters to someone joining later
+        log.clear();
+        entries.clear();
+        transformTargets.clear();
+        dropped = 0;
+    }
+    if (op.isPersistent()) {
+        logOp(op, frame);
+    }
+
+    // Document ops go back to the sender as well, the echo tells it where its op landed
+    // in the order. Live points are only for the others.
+    for (auto it = clients.begin(); it != clients.end(); ++it) {
+        if (it.key() != from || op.isPersistent()) {
+            it.key()->write(frame);
+        }
+    }
+}
+
+void RelayServer::logOp(const SyncOp& op, const QByteArray& frame) {
+    switch (op.type) {
+    case SyncOpType::AddStroke:
+    case SyncOpType::Redo:
+    case SyncOpType::Transform:
+        if (entries.contains(op.strokeId)) return; // sent again, everyone has it already
+        entries.insert(op.strokeId, log.size());
+        for (quint64 id : op.targets) transformTargets.insert(id);
+        break;
+    case SyncOpType::Undo: {
+        const auto it = entries.constFind(op.strokeId);
+        if (it == entries.cend()) return; // nothing in the log it could undo
+
+        // A stroke no transform moved can go along with its undo. Undoing a transform moves
+        // its strokes back, and a moved stroke takes part in that, so those stay.
+        LoggedOp& added = log[*it];
+        if (added.type != SyncOpType::Transform && !transformTargets.contains(op.strokeId)) {
+            added.frame = QByteArray();
+            entries.erase(it);
+            if (++dropped > log.size() / 2) compactLog();
+            return;
+        }
+        entries.erase(it); // a redo adds it again
+        break;
+    }
+    default:
+        break;
+    }
+    log.append({ op.type, op.strokeId, frame });
+}
+
+void RelayServer::compactLog() {
+    log.removeIf([](const LoggedOp& logged) { return logged.frame.isEmpty(); });
+    dropped = 0;
+
+    entries.clear();
+    for (int i = 0; i < log.size(); ++i) {
+        if (log[i].type == SyncOpType::Undo) entries.remove(log[i].strokeId);
+        else if (log[i].type != SyncOpType::Clear) entries.insert(log[i].strokeId, i);
+    }
+}
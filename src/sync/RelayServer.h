@@ -0,0 +1,56 @@
+#ifndef RELAYSERVER_H
+#define RELAYSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include "SyncProtocol.h"
+
+// Local stand-in for a hosted relay. Gives every client an id, puts one global order on
+// the ops it forwards and keeps the document ops so late joiners can catch up. The log is
+// compacted as it goes: an undone stroke and its undo leave it together, and entries sent
+// again (a client publishing its history after reconnecting) aren't logged twice.
+class RelayServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RelayServer(QObject* parent = nullptr);
+
+    bool listen(quint16 port = SyncProtocol::defaultPort);
+    quint16 port() const { return server->serverPort(); }
+    int clientCount() const { return clients.size(); }
+    int logSize() const { return log.size() - dropped; }
+
+private:
+    struct Client {
+        quint32 id = 0;
+        QByteArray readBuffer;
+    };
+
+    QTcpServer* server;
+    QHash<QTcpSocket*, Client> clients;
+    struct LoggedOp {
+        SyncOpType type = SyncOpType::Hello;
+        quint64 strokeId = 0;
+        QByteArray frame; // empty once compacted away
+    };
+    QVector<LoggedOp> log;          // persistent ops since the last clear, in relay order
+    QHash<quint64, int> entries;    // entry id -> the op in log that added it
+    QSet<quint64> transformTargets; // strokes a logged transform moved, their undos have to stay
+    int dropped = 0;
+    quint32 session;      // random per run, sent with Hello
+    quint32 nextClientId; // starts somewhere random too, so stroke ids of an earlier run don't come back
+    quint64 relaySeq = 0;
+
+    void onNewConnection();
+    void onReadyRead(QTcpSocket* socket);
+    void relay(QTcpSocket* from, SyncOp& op);
+    void logOp(const SyncOp& op, const QByteArray& frame);
+    void compactLog();
+};
+
+#endif // RELAYSERVER_H
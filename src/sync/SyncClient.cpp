@@ -0,0 +1,231 @@
+#include "SyncClient.h"
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+
+SyncClient::SyncClient(QObject* parent)
+    : QObject(parent)
+{
+    socket = new QTcpSocket(this);
+    socket->setSocketOption(QAbstractSocket::LowDelayOption, 1); // small frames, no Nagle
+
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(flushIntervalMs);
+
+    connect(flushTimer, &QTimer::timeout, this, &SyncClient::flushLive);
+    connect(socket, &QTcpSocket::readyRead, this, &SyncClient::onReadyRead);
+    connect(socket, &QTcpSocket::disconnected, this, [this]() {
+        clientId = 0;
+        readBuffer.clear();
+        unconfirmed.clear(); // no echo is coming for those any more
+        emit disconnectedFromRelay();
+    });
+    connect(socket, &QTcpSocket::errorOccurred, this, [this](QAbstractSocket::SocketError) {
+        qWarning() << "[Sync]" << socket->errorString();
+    });
+}
+
+void SyncClient::connectToRelay(const QString& host, quint16 port) {
+    socket->abort();
+    readBuffer.clear();
+    clientId = 0;
+    unconfirmed.clear();
+    socket->connectToHost(host, port);
+}
+
+void SyncClient::disconnectFromRelay() {
+    flushLive();
+    socket->disconnectFromHost();
+}
+
+quint64 SyncClient::send(SyncOp& op) {
+    if (!isConnected()) return 0;
+
+    op.clientId = clientId;
+    op.seq = nextSeq++;
+    if (op.sentMs == 0) op.sentMs = QDateTime::currentMSecsSinceEpoch();
+    seenOps.insert(op.key()); // a relay replay after reconnecting must not apply it twice
+
+    QByteArray frame = SyncProtocol::encode(op);
+    socket->write(frame);
+
+    stats.bytesSent += frame.size();
+    stats.opsSent++;
+    emit statsChanged();
+    return frame.size();
+}
+
+void SyncClient::sendStroke(quint64 strokeId, int layerId, int brushId, const QVector<StrokePoint>& points,
+                            const Symmetry& symmetry, EntryKind kind) {
+    flushLive(); // the tail of the live stream goes before the stroke itself
+
+    SyncOp op;
+    op.type = SyncOpType::AddStroke;
+    op.strokeId = strokeId;
+    op.layerId = layerId;
+    op.brushId = brushId;
+    op.entryKind = static_cast<quint8>(kind);
+    setSymmetry(op, symmetry);
+    op.points = points;
+    quint64 bytes = send(op);
+    if (bytes == 0) return;
+
+    unconfirmed.append(strokeId);
+    stats.strokesSent++;
+    stats.strokeBytes += bytes + (strokeId == liveStrokeId ? liveStrokeBytes : 0);
+}
+
+void SyncClient::sendUndo(quint64 strokeId) {
+    SyncOp op;
+    op.type = SyncOpType::Undo;
+    op.strokeId = strokeId;
+    send(op);
+}
+
+void SyncClient::sendRedo(quint64 strokeId, int layerId, int brushId, const QVector<StrokePoint>& points,
+                          const Symmetry& symmetry, EntryKind kind) {
+    SyncOp op;
+    op.type = SyncOpType::Redo;
+    op.strokeId = strokeId;
+    op.layerId = layerId;
+    op.brushId = brushId;
+    op.entryKind = static_cast<quint8>(kind);
+    setSymmetry(op, symmetry);
+    op.points = points;
+    if (send(op) > 0) unconfirmed.append(strokeId);
+}
+
+Symmetry SyncClient::symmetryOf(const SyncOp& op) {
+    Symmetry symmetry;
+    if (op.symmetryMode > static_cast<quint8>(SymmetryMode::Kaleidoscope) || op.symmetryOrder > Symmetry::maxOrder) {
+        return symmetry;
+    }
+    symmetry.mode = static_cast<SymmetryMode>(op.symmetryMode);
+    symmetry.order = op.symmetryOrder;
+    symmetry.cx = op.symmetryCx;
+    symmetry.cy = op.symmetryCy;
+    symmetry.angle = op.symmetryAngle;
+    return symmetry;
+}
+
+void SyncClient::setSymmetry(SyncOp& op, const Symmetry& symmetry) {
+    op.symmetryMode = static_cast<quint8>(symmetry.mode);
+    op.symmetryOrder = symmetry.order;
+    op.symmetryCx = symmetry.cx;
+    op.symmetryCy = symmetry.cy;
+    op.symmetryAngle = symmetry.angle;
+}
+
+void SyncClient::sendClear() {
+    SyncOp op;
+    op.type = SyncOpType::Clear;
+    send(op);
+}
+
+void SyncClient::sendTransform(quint64 entryId, const QVector<quint64>& targets, const QTransform& transform) {
+    SyncOp op;
+    op.type = SyncOpType::Transform;
+    op.strokeId = entryId;
+    op.targets = targets;
+    op.matrix[0] = transform.m11();
+    op.matrix[1] = transform.m12();
+    op.matrix[2] = transform.m21();
+    op.matrix[3] = transform.m22();
+    op.matrix[4] = transform.dx();
+    op.matrix[5] = transform.dy();
+    send(op);
+}
+
+QTransform SyncClient::transformOf(const SyncOp& op) {
+    const double* m = op.matrix;
+    return QTransform(m[0], m[1], m[2], m[3], m[4], m[5]);
+}
+
+void SyncClient::streamLivePoint(quint64 strokeId, const StrokePoint& point) {
+    if (!isConnected()) return;
+
+    if (strokeId != liveStrokeId) {
+        flushLive();
+        liveStrokeId = strokeId;
+        liveStrokeBytes = 0;
+    }
+    if (pendingLive.isEmpty()) {
+        pendingSince = QDateTime::currentMSecsSinceEpoch(); // latency counts from the oldest point
+    }
+    pendingLive.append(point);
+
+    if (!flushTimer->isActive()) flushTimer->start();
+}
+
+void SyncClient::endLiveStroke(quint64 strokeId) {
+    if (strokeId == liveStrokeId) flushLive();
+
+    SyncOp op;
+    op.type = SyncOpType::LiveEnd;
+    op.strokeId = strokeId;
+    send(op);
+}
+
+void SyncClient::flushLive() {
+    flushTimer->stop();
+    if (pendingLive.isEmpty()) return;
+
+    SyncOp op;
+    op.type = SyncOpType::LivePoints;
+    op.strokeId = liveStrokeId;
+    op.sentMs = pendingSince;
+    op.points = pendingLive;
+    pendingLive.clear(); // keeps capacity
+
+    liveStrokeBytes += send(op);
+}
+
+void SyncClient::onReadyRead() {
+    QByteArray data = socket->readAll();
+    stats.bytesReceived += data.size();
+    readBuffer += data;
+
+    SyncOp op;
+    bool error = false;
+    while (SyncProtocol::decodeNext(readBuffer, op, error)) {
+        if (op.type == SyncOpType::Hello) {
+            clientId = op.clientId;
+            nextSeq = 1;
+            // Keys from another relay run mean nothing here, and could match new ops
+            if (op.session != relaySession) seenOps.clear();
+            relaySession = op.session;
+            emit connectedToRelay(clientId);
+            continue;
+        }
+
+        // Our own op back from the relay, everyone has it in this place now
+        if (op.isPersistent() && op.clientId == clientId) {
+            if (op.carriesStroke()) unconfirmed.removeOne(op.strokeId);
+            continue;
+        }
+
+        // Idempotent: replays and duplicates of anything we already have are dropped
+        if (op.isPersistent()) {
+            if (seenOps.contains(op.key())) continue;
+            seenOps.insert(op.key());
+        }
+
+        stats.opsReceived++;
+        if (op.type == SyncOpType::LivePoints) {
+            // Same clock only when both ends run on one machine, which is what the local relay is for
+            qint64 latency = std::max<qint64>(0, QDateTime::currentMSecsSinceEpoch() - op.sentMs);
+            stats.latencySamples++;
+            stats.meanInkLatencyMs += (latency - stats.meanInkLatencyMs) / stats.latencySamples;
+            stats.maxInkLatencyMs = std::max(stats.maxInkLatencyMs, latency);
+        }
+
+        emit opReceived(op);
+    }
+
+    if (error) {
+        qWarning() << "[Sync] Malformed data from the relay, disconnecting";
+        socket->abort();
+    }
+    emit statsChanged();
+}
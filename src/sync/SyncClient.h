@@ -0,0 +1,96 @@
+#ifndef SYNCCLIENT_H
+#define SYNCCLIENT_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QSet>
+#include <QTransform>
+#include "SyncProtocol.h"
+#include "../data/Symmetry.h"
+
+struct SyncStats {
+    quint64 bytesSent = 0;
+    quint64 bytesReceived = 0;
+    quint64 opsSent = 0;
+    quint64 opsReceived = 0;
+    quint64 strokesSent = 0;
+    quint64 strokeBytes = 0;    // live chunks + final op of every stroke sent
+    double meanInkLatencyMs = 0; // capture on the other end to arrival here
+    qint64 maxInkLatencyMs = 0;
+    quint64 latencySamples = 0;
+
+    double bytesPerStroke() const { return strokesSent ? double(strokeBytes) / strokesSent : 0.0; }
+};
+
+// One connection to a relay. Outgoing ops get (clientId, seq) stamped, live points are
+// batched and flushed every flushIntervalMs. Incoming ops are deduplicated and handed on
+// in relay order through opReceived. Our own document ops come back from the relay too,
+// that's when they get their place in the order (unconfirmedStrokes).
+class SyncClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SyncClient(QObject* parent = nullptr);
+
+    void connectToRelay(const QString& host, quint16 port = SyncProtocol::defaultPort);
+    void disconnectFromRelay();
+    bool isConnected() const { return clientId != 0; }
+    quint32 getClientId() const { return clientId; }
+
+    // Strokes and fills, the other entry kinds have ops of their own or aren't synced
+    void sendStroke(quint64 strokeId, int layerId, int brushId, const QVector<StrokePoint>& points,
+                    const Symmetry& symmetry = Symmetry(), EntryKind kind = EntryKind::Stroke);
+    void sendUndo(quint64 strokeId);
+    void sendRedo(quint64 strokeId, int layerId, int brushId, const QVector<StrokePoint>& points,
+                  const Symmetry& symmetry = Symmetry(), EntryKind kind = EntryKind::Stroke);
+    void sendClear();
+    void sendTransform(quint64 entryId, const QVector<quint64>& targets, const QTransform& transform); // also its redo
+
+    void streamLivePoint(quint64 strokeId, const StrokePoint& point);
+    void endLiveStroke(quint64 strokeId);
+
+    const SyncStats& getStats() const { return stats; }
+
+    // Ids of strokes we sent (AddStroke, Redo) that the relay hasn't echoed yet. Everyone
+    // else gets them after whatever the relay forwards to us before the echo, so remote
+    // strokes go below these.
+    const QVector<quint64>& unconfirmedStrokes() const { return unconfirmed; }
+
+    // The op's symmetry fields and back, bad values come out as no symmetry
+    static Symmetry symmetryOf(const SyncOp& op);
+    static void setSymmetry(SyncOp& op, const Symmetry& symmetry);
+    static QTransform transformOf(const SyncOp& op);
+
+    static constexpr int flushIntervalMs = 16;
+
+signals:
+    void connectedToRelay(quint32 clientId);
+    void disconnectedFromRelay();
+    void opReceived(const SyncOp& op);
+    void statsChanged();
+
+private:
+    QTcpSocket* socket;
+    QTimer* flushTimer;
+    QByteArray readBuffer;
+    quint32 clientId = 0;
+    quint32 nextSeq = 1;
+    quint32 relaySession = 0;
+    QSet<quint64> seenOps; // keys of ops already applied or sent, survives reconnects to the same relay run
+    QVector<quint64> unconfirmed;
+
+    quint64 liveStrokeId = 0;
+    QVector<StrokePoint> pendingLive;
+    qint64 pendingSince = 0;
+    quint64 liveStrokeBytes = 0; // bytes streamed for the stroke being drawn
+
+    SyncStats stats;
+
+    quint64 send(SyncOp& op); // returns the frame size
+    void flushLive();
+    void onReadyRead();
+};
+
+#endif // SYNCCLIENT_H
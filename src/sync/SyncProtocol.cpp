@@ -0,0 +1,177 @@
+#include "SyncProtocol.h"
+#include "../core/math/ColorSpace.h"
+#include "../core/Varint.h"
+#include "../core/StrokeCodec.h"
+#include <QDataStream>
+#include <QIODevice>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr quint8 protocolVersion = 8;
+constexpr float positionScale = 8.0f;   // 1/8 px
+constexpr float thicknessScale = 16.0f;
+constexpr int maxPointsPerOp = 1 << 20;
+
+using Varint::Reader;
+
+} // namespace
+
+namespace SyncProtocol {
+
+QByteArray encodePoints(const QVector<StrokePoint>& points) {
+    QByteArray out;
+    out.reserve(8 + points.size() * 6);
+    Varint::write(out, points.size());
+    if (points.isEmpty()) return out;
+
+    // Strokes are single colored
+    const StrokePoint& first = points.first();
+    quint32 color = ColorSpace::packRGBA8({ first.r, first.g, first.b });
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.append(static_cast<char>((color >> shift) & 0xff));
+    }
+
+    qint64 lastX = 0, lastY = 0;
+    for (const StrokePoint& p : points) {
+        qint64 x = std::llround(p.pos.x() * positionScale);
+        qint64 y = std::llround(p.pos.y() * positionScale);
+        Varint::writeSigned(out, x - lastX);
+        Varint::writeSigned(out, y - lastY);
+        lastX = x;
+        lastY = y;
+
+        out.append(static_cast<char>(std::lround(std::clamp(p.pressure, 0.0f, 1.0f) * 255.0f)));
+        out.append(static_cast<char>(std::lround(std::clamp(p.opacity, 0.0f, 1.0f) * 255.0f)));
+        Varint::write(out, static_cast<quint64>(std::lround(std::max(p.thickness, 0.0f) * thicknessScale)));
+    }
+    return out;
+}
+
+bool decodePoints(const QByteArray& data, QVector<StrokePoint>& points) {
+    points.clear();
+    Reader in{ data };
+
+    quint64 count = in.varint();
+    if (in.failed || count > maxPointsPerOp) return false;
+    if (count == 0) return true;
+
+    RGBf color = ColorSpace::unpackRGBA8(in.u32());
+    points.reserve(static_cast<int>(count));
+
+    qint64 x = 0, y = 0;
+    for (quint64 i = 0; i < count; ++i) {
+        x += in.signedVarint();
+        y += in.signedVarint();
+
+        StrokePoint p;
+        p.pos = QPointF(x / positionScale, y / positionScale);
+        p.pressure = in.byte() / 255.0f;
+        p.opacity = in.byte() / 255.0f;
+        p.thickness = in.varint() / thicknessScale;
+        p.r = color.r;
+        p.g = color.g;
+        p.b = color.b;
+        if (in.failed) return false;
+        points.append(p);
+    }
+    return true;
+}
+
+QByteArray encode(const SyncOp& op) {
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << protocolVersion << static_cast<quint8>(op.type) << op.clientId << op.seq << op.relaySeq
+           << op.strokeId << op.layerId << op.brushId << op.sentMs;
+    if (op.carriesStroke()) {
+        stream << op.entryKind << op.symmetryMode << op.symmetryOrder << op.symmetryCx << op.symmetryCy << op.symmetryAngle;
+    }
+    if (op.type == SyncOpType::Hello) {
+        stream << op.session;
+    }
+    if (op.type == SyncOpType::Transform) {
+        for (double value : op.matrix) stream << value;
+        stream << op.targets;
+    }
+    // Whole strokes go the way StrokeManager stores them, so every canvas ends up with the
+    // same points (dab jitter is seeded from them). Live ones are only a preview.
+    if (!op.points.isEmpty()) {
+        stream << (op.carriesStroke() ? StrokeCodec::encode(op.points) : encodePoints(op.points));
+    }
+
+    QByteArray frame;
+    QDataStream header(&frame, QIODevice::WriteOnly);
+    header << static_cast<quint32>(payload.size());
+    frame += payload;
+    return frame;
+}
+
+bool decodeNext(QByteArray& buffer, SyncOp& op, bool& error) {
+    error = false;
+    if (buffer.size() < 4) return false;
+
+    quint32 length = (static_cast<quint8>(buffer[0]) << 24) | (static_cast<quint8>(buffer[1]) << 16)
+                   | (static_cast<quint8>(buffer[2]) << 8) | static_cast<quint8>(buffer[3]);
+    if (length > maxFrameBytes) {
+        error = true;
+        return false;
+    }
+    if (static_cast<quint32>(buffer.size()) < 4 + length) return false;
+
+    QByteArray payload = buffer.mid(4, length);
+    buffer.remove(0, 4 + length);
+
+    QDataStream stream(payload);
+    quint8 version = 0, type = 0;
+    stream >> version >> type >> op.clientId >> op.seq >> op.relaySeq
+           >> op.strokeId >> op.layerId >> op.brushId >> op.sentMs;
+    if (stream.status() != QDataStream::Ok || version != protocolVersion || type > static_cast<quint8>(SyncOpType::Transform)) {
+        error = true;
+        return false;
+    }
+    op.type = static_cast<SyncOpType>(type);
+
+    op.entryKind = static_cast<quint8>(EntryKind::Stroke);
+    op.symmetryMode = 0;
+    if (op.carriesStroke()) {
+        stream >> op.entryKind >> op.symmetryMode >> op.symmetryOrder >> op.symmetryCx >> op.symmetryCy >> op.symmetryAngle;
+        if (stream.status() != QDataStream::Ok || op.entryKind > static_cast<quint8>(EntryKind::Fill)) {
+            error = true;
+            return false;
+        }
+    }
+
+    op.session = 0;
+    if (op.type == SyncOpType::Hello) {
+        stream >> op.session;
+        if (stream.status() != QDataStream::Ok) {
+            error = true;
+            return false;
+        }
+    }
+
+    op.targets.clear();
+    if (op.type == SyncOpType::Transform) {
+        for (double& value : op.matrix) stream >> value;
+        stream >> op.targets;
+        if (stream.status() != QDataStream::Ok) {
+            error = true;
+            return false;
+        }
+    }
+
+    op.points.clear();
+    if (!stream.atEnd()) {
+        QByteArray encoded;
+        stream >> encoded;
+        const bool decoded = op.carriesStroke() ? StrokeCodec::decode(encoded, op.points) : decodePoints(encoded, op.points);
+        if (stream.status() != QDataStream::Ok || !decoded) {
+            error = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace SyncProtocol
@@ -0,0 +1,77 @@
+#ifndef SYNCPROTOCOL_H
+#define SYNCPROTOCOL_H
+
+#include <QByteArray>
+#include <QVector>
+#include "../data/StrokePoint.h"
+#include "../data/EntryKind.h"
+
+// Wire format for shared canvases. Every document change is an op, identified by
+// (clientId, seq) so replays and duplicates can be dropped, and ordered by the relay
+// (relaySeq). Live strokes stream as LivePoints chunks holding only the new points.
+// Finished strokes (AddStroke, Redo) carry their points StrokeCodec packed.
+enum class SyncOpType : quint8 {
+    Hello = 0,   // relay -> client, carries the client's id
+    AddStroke,
+    Undo,        // removes strokeId
+    Redo,        // re-adds strokeId with its points
+    Clear,
+    LivePoints,  // points appended to a stroke still being drawn
+    LiveEnd,     // that stroke is finished or was dropped
+    Transform    // a selection transform, strokeId is the entry, targets the strokes it moved. Also its redo.
+};
+
+struct SyncOp {
+    SyncOpType type = SyncOpType::Hello;
+    quint32 clientId = 0;  // who made the op
+    quint32 seq = 0;       // per client
+    quint64 relaySeq = 0;  // global order, set by the relay
+    quint64 strokeId = 0;
+    qint32 layerId = -1;
+    qint32 brushId = 0;
+    qint64 sentMs = 0;     // wall clock when the (first) point was captured
+    // AddStroke and Redo: a stroke or a fill (EntryKind), and the stroke's Symmetry as plain
+    // fields, the relay has no QtGui. Filters and flattens are never synced, rasters aren't shared
+    quint8 entryKind = static_cast<quint8>(EntryKind::Stroke);
+    quint8 symmetryMode = 0;
+    quint8 symmetryOrder = 2;
+    float symmetryCx = 0.0f, symmetryCy = 0.0f, symmetryAngle = 0.0f;
+    QVector<StrokePoint> points;
+    // Transform, the matrix as plain doubles (m11 m12 m21 m22 dx dy) so every canvas bakes the same points
+    double matrix[6] = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+    QVector<quint64> targets;
+    quint32 session = 0;   // Hello, the relay run. A restarted relay hands out ids and seqs again.
+
+    // A whole stroke or fill, with its kind, symmetry and points
+    bool carriesStroke() const { return type == SyncOpType::AddStroke || type == SyncOpType::Redo; }
+
+    quint64 key() const { return (static_cast<quint64>(clientId) << 32) | seq; }
+
+    // Ops that make up the document and go into the relay's log
+    bool isPersistent() const {
+        return type == SyncOpType::AddStroke || type == SyncOpType::Undo
+            || type == SyncOpType::Redo || type == SyncOpType::Clear || type == SyncOpType::Transform;
+    }
+};
+
+namespace SyncProtocol {
+
+    constexpr quint16 defaultPort = 47600;
+    constexpr quint32 maxFrameBytes = 16 * 1024 * 1024;
+
+    // Length prefixed frame
+    QByteArray encode(const SyncOp& op);
+
+    // Takes one complete frame off the front of buffer. Returns false when more data is
+    // needed, or with error set when the stream is garbage and the connection should go.
+    bool decodeNext(QByteArray& buffer, SyncOp& op, bool& error);
+
+    // LivePoints: 1/8 px deltas in zigzag varints, 8 bit pressure and opacity, one color per batch.
+    // A typical point is 5-6 bytes instead of the ~44 of StrokePoint. Good enough for a preview,
+    // the finished stroke replaces it.
+    QByteArray encodePoints(const QVector<StrokePoint>& points);
+    bool decodePoints(const QByteArray& data, QVector<StrokePoint>& points);
+
+} // namespace SyncProtocol
+
+#endif // SYNCPROTOCOL_H
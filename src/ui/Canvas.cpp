@@ -1,8 +1,24 @@
 #pragma comment(lib, "opengl32.lib")
 #include "Canvas.h"
 #include <QShortcut>
-#include <iostream>
 #include <QTimer>
+#include <QScreen>
+#include <algorithm>
+#include "core/StartupTrace.h"
+#include "core/StrokeRasterizer.h"
+#include "core/StrokeSnapshot.h"
+#include <QSaveFile>
+#include <QFileInfo>
+
+static bool isFilterTool(Tool tool) {
+    return tool == Tool::Blur || tool == Tool::Smudge || tool == Tool::Sharpen;
+}
+
+static FilterType filterFor(Tool tool) {
+    if (tool == Tool::Smudge) return FilterType::Smudge;
+    if (tool == Tool::Sharpen) return FilterType::Sharpen;
+    return FilterType::Blur;
+}
 
 Canvas::Canvas(QWidget* parent) : QOpenGLWidget(parent), vboUpdateFlag(false)
 {
@@ -14,13 +30,60 @@ Canvas::Canvas(QWidget* parent) : QOpenGLWidget(parent), vboUpdateFlag(false)
     connect(r, &QShortcut::activated, this, &Canvas::redo);
     setAttribute(Qt::WA_TabletTracking);
     setMouseTracking(true);
+    setUpdateBehavior(QOpenGLWidget::PartialUpdate); // keep last frame, we redraw dirty rects only
+
+    // Prediction error / latency numbers get logged at the end of every stroke
+    if (qEnvironmentVariableIsSet("LANCER_MEASURE_LATENCY")) {
+        controller->setLatencyMeasurement(true);
+    }
+
+    // Soft memory limits in MB, past them caches get compacted and evicted
+    const qint64 mb = 1024 * 1024;
+    bool ok = false;
+    qint64 cpuLimit = qEnvironmentVariableIntValue("LANCER_CPU_LIMIT_MB", &ok);
+    if (!ok) cpuLimit = 2048;
+    qint64 gpuLimit = qEnvironmentVariableIntValue("LANCER_GPU_LIMIT_MB", &ok);
+    if (!ok) gpuLimit = 1024;
+    memoryTracker.setSoftLimits(cpuLimit * mb, gpuLimit * mb);
+
+    // Strokes kept uncompressed, older ones are packed in memory (negative keeps everything as is)
+    const int hotStrokes = qEnvironmentVariableIntValue("LANCER_HOT_STROKES", &ok);
+    if (ok) controller->getManager().setHotStrokeCount(hotStrokes);
+
+    // Frame budget in ms, by default one refresh interval (see initializeGL)
+    if (qEnvironmentVariableIsSet("LANCER_FIXED_QUALITY")) {
+        quality.setEnabled(false);
+    }
+    // Repaints are coalesced and paced to the display, see FrameScheduler
+    connect(this, &QOpenGLWidget::frameSwapped, &scheduler, &FrameScheduler::frameSwapped);
+
+    qualityIdle.setSingleShot(true);
+    qualityIdle.setInterval(500);
+    connect(&qualityIdle, &QTimer::timeout, this, &Canvas::restoreQuality);
+
+    // Frames skip the refresh when nothing on screen changed (or never come if GL broke),
+    // edits that only touch memory still show up within a second
+    memoryRefresh.setInterval(1000);
+    connect(&memoryRefresh, &QTimer::timeout, this, [this]() {
+        if (!memoryDirty) return;
+        memoryDirty = false;
+        updateMemoryUsage();
+    });
+    memoryRefresh.start();
+
+    // Tessellation runs on its own thread, results come back through the event loop
+    connect(&tessellator, &TessellationWorker::resultsReady, this, &Canvas::collectTessellation, Qt::QueuedConnection);
 
+    // Reference images bigger than this on a side are scaled down while they load
+    const int referenceSide = qEnvironmentVariableIntValue("LANCER_REFERENCE_MAX_SIDE", &ok);
+    if (ok && referenceSide > 0) referenceLoader.setMaxSide(referenceSide);
+    connect(&referenceLoader, &ReferenceLoader::loaded, this, &Canvas::referenceLoaded);
 }
 
 Canvas::~Canvas()
 {
-    makeCurrent();  // Ensure OpenGL context is current
-    vBuffer.destroy();
+    renderThread.reset(); // its context shares with ours, it goes first
+    makeCurrent();  // the renderer's GL objects go with our context
 }
 
 void Canvas::initializeGL()
@@ -35,26 +98,56 @@ void Canvas::initializeGL()
     qDebug() << "OpenGL Renderer:" << glRenderer;
 #endif
     glClearColor(1.0f, 1.0f, 1.0f, 1.0f);  // Background color
-    glEnable(GL_LINE_SMOOTH);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glLineWidth(3.0f);
-
-    // Create Canvas's resources
-    vBuffer.create();
+    StartupTrace::mark("GL context initialized");
 
-    // Initialize renderer with Canvas resources
-    controller->initializeRenderer(&vBuffer);
+    bool budgetSet = false;
+    const int budget = qEnvironmentVariableIntValue("LANCER_FRAME_BUDGET_MS", &budgetSet);
+    const qreal hz = screen() ? screen()->refreshRate() : 60.0;
+    scheduler.setRefreshRate(hz);
+    quality.setBudget(budgetSet && budget > 0 ? budget : (hz > 0.0 ? 1000.0 / hz : 16.0));
 
-    if (!vBuffer.isCreated()) {
-        vBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-        vBuffer.create(); 
+    // Frames from a render thread of their own, so the rest of the UI can't hold them up
+    if (qEnvironmentVariableIsSet("LANCER_RENDER_THREAD")) {
+        startRenderThread();
+    }
+    else {
+        renderer.initialize();
+        brushesSupported = renderer.brushesSupported();
+        StartupTrace::mark("brush shaders ready");
     }
 
     GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (status != GL_FRAMEBUFFER_COMPLETE) {
         qWarning() << "Initial framebuffer incomplete! Status:" << status;
     }
+
+    // New context means new (undefined) framebuffer contents, and no raster or reference textures yet
+    for (auto it = rasters.cbegin(); it != rasters.cend(); ++it) {
+        uploadRaster(it.key(), it.value().rect());
+    }
+    for (ReferenceLayer& reference : references) {
+        reference.shownLevel = reference.streamLevel = -1;
+        reference.pending.clear();
+    }
+    markFullRedraw();
+}
+
+void Canvas::startRenderThread() {
+    renderThread.reset(); // a new widget context, the old thread shared with the dead one
+    renderThread = std::make_unique<CanvasRenderThread>(context());
+
+    // No point finishing frames faster than the display shows them
+    const qreal hz = screen() ? screen()->refreshRate() : 60.0;
+    renderThread->setFrameInterval(hz > 0.0 ? qRound(1000.0 / hz) : 16);
+
+    connect(renderThread.get(), &CanvasRenderThread::initialized, this, [this]() {
+        brushesSupported = renderThread->brushesSupported();
+        rebuildDabs(); // for anything drawn before we knew
+        StartupTrace::mark("brush shaders ready");
+        scheduler.requestFrame();
+    }, Qt::QueuedConnection);
+    connect(renderThread.get(), &CanvasRenderThread::frameReady, this, [this]() { scheduler.requestFrame(); }, Qt::QueuedConnection);
+    renderThread->start();
 }
 
 void Canvas::paintGL()
@@ -68,31 +161,14 @@ void Canvas::paintGL()
     if (renderBroken) return;
 
     try {
-        makeCurrent();
-
 #ifdef QT_DEBUG
         qDebug() << "paintGL() starting...";
 #endif
 
-        // Clear screen
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Update VBO if needed
-        if (vboUpdateFlag) {
-            updateVertexBuffer();
-            vboUpdateFlag = false;
-        }
-
-        // Render buffered strokes
-        if (!vertices.isEmpty()) {
-            renderVertexBuffer();
-        }
-
-        // Render live stroke
-        const auto& stroke = controller->getCurrentStroke();
-        if (!stroke.isEmpty() && stroke.size() > 1) {
-            renderCurrentStroke();
-        }
+        // QOpenGLWidget made the context current already
+        scheduler.beginFrame();
+        drawFrame();
+        scheduler.endFrame();
 
 #ifdef QT_DEBUG
         GLenum err;
@@ -115,47 +191,266 @@ void Canvas::paintGL()
     }
 }
 
+void Canvas::drawFrame() {
+    QElapsedTimer frameTimer;
+    frameTimer.start();
 
-void Canvas::renderCurrentStroke() {
-    if (!controller) return;
+    FrameState state;
+    const bool changed = takeFrameState(state);
+    bool shown = true;
 
-    const auto& stroke = controller->getCurrentStroke();
-    if (stroke.isEmpty() || stroke.size() < 2) return;
+    if (renderThread) {
+        // The frame is made over there, here we only show the newest finished one
+        if (changed) renderThread->submit(std::move(state));
+        shown = presentFrame();
+        frameStats = renderThread->getStats();
+        if (frameStats.frames > qualityFrames) {
+            qualityFrames = frameStats.frames;
+            reportFrameTime(frameStats.renderMs);
+        }
+    }
+    else {
+        // Nothing changed, the preserved frame is still correct
+        if (!changed) return;
+        renderer.render(state, defaultFramebufferObject());
+        frameStats = renderer.getStats();
+        reportFrameTime(frameTimer.nsecsElapsed() / 1.0e6);
+    }
 
-    auto& renderer = controller->getRenderer();
-    auto& processor = controller->getProcessor();
+    if (memoryDirty) {
+        memoryDirty = false;
+        updateMemoryUsage();
+    }
 
-    QVector<StrokePoint> coloredStroke = stroke;
-    QColor color = controller->getCurrentColor();
+    if (!firstFrameDone && shown) {
+        firstFrameDone = true;
+        StartupTrace::markReady();
+        emit firstFrameShown();
+    }
+}
 
-    for (auto& pt : coloredStroke) {
-        pt.r = color.redF();
-        pt.g = color.greenF();
-        pt.b = color.blueF();
+void Canvas::reportFrameTime(double ms) {
+    const qreal scale = quality.settings().renderScale;
+    if (quality.frameFinished(ms)) {
+#ifdef QT_DEBUG
+        qDebug() << "[Quality] level" << quality.level() << "at" << quality.getStats().averageMs << "ms per frame";
+#endif
+        if (quality.settings().renderScale != scale) {
+            markFullRedraw(); // the caches get redone at the new size
+            scheduler.requestFrame();
+        }
+    }
+    qualityIdle.start(); // restarts
+}
+
+void Canvas::restoreQuality() {
+    const qreal scale = quality.settings().renderScale;
+    if (!quality.restore()) return;
+    if (scale != quality.settings().renderScale) {
+        markFullRedraw();
     }
+    markSelectionDirty(); // outlines get their smoothing back
+    scheduler.requestFrame();
+}
 
-    QVector<Vertex> verts = processor.generateVertices(coloredStroke);
+bool Canvas::takeFrameState(FrameState& state) {
+    streamReferences();
+    const QRectF clip = fullRedraw ? QRectF(rect()) : dirtyRect;
+    const QRect scissor = takeDirtyDeviceRect();
+    if (scissor.isEmpty() && cacheOps.isEmpty() && !vboUpdateFlag && !releaseLiveBuffers) return false;
 
-    if (!verts.isEmpty()) {
-        // Use a separate temporary buffer for the current stroke
-        static QOpenGLBuffer tempBuffer(QOpenGLBuffer::VertexBuffer);
-        if (!tempBuffer.isCreated()) {
-            tempBuffer.create();
+    auto& manager = controller->getManager();
+    auto& selection = controller->getSelection();
+
+    state.size = size();
+    state.dpr = devicePixelRatioF();
+    state.clip = scissor.isEmpty() ? QRectF() : clip;
+    state.cacheOps = std::move(cacheOps);
+    cacheOps.clear();
+    state.releaseLiveBuffers = releaseLiveBuffers;
+    releaseLiveBuffers = false;
+    state.renderScale = quality.settings().renderScale;
+    state.lineSmoothing = quality.settings().lineSmoothing;
+
+    // The live mesh stays up until its stroke is committed, also after the pen lifted
+    state.liveLayer = liveMeshId != 0 ? manager.getActiveLayer() : -1;
+
+    // Empty layers have nothing to composite, unless we are drawing on them right now
+    for (const Layer& layer : manager.getLayers()) {
+        if (manager.layerStrokeCount(layer.id) > 0 || layer.id == state.liveLayer || rasters.contains(layer.id)
+            || references.contains(layer.id)) {
+            state.layers.append(layer);
         }
+    }
+
+    // Shared, not copied, until we next edit our side
+    if (vboUpdateFlag) vectorStarts = BrushEngine::vectorStarts(manager.getStrokeRecords());
+    state.documentChanged = vboUpdateFlag;
+    vboUpdateFlag = false;
+    state.vertices = vertices;
+    state.strokes = manager.getStrokeRecords();
+    state.dabs = dabs;
+    state.dabCounts = dabCounts;
+    state.vectorStarts = vectorStarts;
+
+    state.liveSymmetry = controller->getSymmetry();
+    state.liveVertices = liveVertices;
+    state.liveDabs = liveMeshDabs;
+    if (remoteDirty) rebuildRemoteMesh();
+    state.remoteVertices = remoteVertices;
+    state.remoteCounts = remoteCounts;
 
-        if (tempBuffer.bind()) {
-            tempBuffer.allocate(verts.constData(), verts.size() * sizeof(Vertex));
-            QVector<int> oneCount = { static_cast<int>(verts.size()) };
-            renderer.renderVertexBuffer(verts, oneCount, tempBuffer);
-            tempBuffer.release();
+    state.dragging = selection.isDragging();
+    state.selectionLayer = selection.getSelectionLayer();
+    state.selectionMask = selection.getSelectionMask();
+    state.selectionTransform = selection.getTransform();
+    state.selecting = selection.isSelecting();
+    if (state.selecting) state.selectionPath = selection.getPathOutline();
+    state.hasSelection = selection.hasSelection();
+    if (state.hasSelection) state.selectionBounds = selection.getSelectionBounds();
+    return true;
+}
+
+bool Canvas::presentFrame() {
+    QSize deviceSize;
+    const GLuint texture = renderThread->lockFrame(&deviceSize);
+
+    glDisable(GL_SCISSOR_TEST);
+    if (texture == 0) {
+        // Nothing finished yet, plain background
+        glClear(GL_COLOR_BUFFER_BIT);
+        renderThread->unlockFrame();
+        return false;
+    }
+
+    const float w = width();
+    const float h = height();
+
+    // The frame has GL orientation, widget top maps to texture top (v = 1)
+    const GLfloat positions[] = { 0, 0,  w, 0,  0, h,  w, h };
+    const GLfloat texCoords[] = { 0, 1,  1, 1,  0, 0,  1, 0 };
+
+    glDisable(GL_BLEND); // opaque, replaces the whole target
+    glBindBuffer(GL_ARRAY_BUFFER, 0); // client side arrays
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, positions);
+    glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_BLEND);
+
+    // Done sampling before the render thread may write the texture again
+    glFinish();
+    renderThread->unlockFrame();
+    return true;
+}
+
+void Canvas::invalidateCache(int layerId, const QRectF& rect) {
+    CacheOp op;
+    op.type = CacheOp::Type::Invalidate;
+    op.layerId = layerId;
+    op.rect = rect;
+    cacheOps.append(op);
+}
+
+void Canvas::queueLiveSamples() {
+    const auto& stroke = controller->getCurrentStroke();
+    if (liveStrokeId == 0 || stroke.isEmpty()) return;
+
+    const BrushSettings& brush = BrushEngine::preset(controller->getCurrentBrush());
+    TessellationJob job;
+    job.type = TessellationJob::Type::LiveSamples;
+    job.strokeId = liveStrokeId;
+    // Into a buffer the worker handed back, after the first few samples this doesn't allocate
+    job.points = tessellator.takeSampleBuffer();
+    for (int i = queuedPoints; i < stroke.size(); ++i) job.points.append(stroke[i]);
+    if (quality.settings().prediction) job.tail = controller->getPredictedTail();
+    job.segments = quality.settings().interpolationSegments;
+    job.color = controller->getStrokeColor();
+    job.brushId = controller->getCurrentBrush();
+    job.dabs = brush.textured && brushesSupported;
+
+    // If the queue is full the points just ride along with the next sample
+    if (tessellator.submit(std::move(job))) {
+        queuedPoints = stroke.size();
+    }
+}
+
+void Canvas::collectTessellation() {
+    tessellated.clear(); // keeps capacity
+    if (tessellator.takeResults(tessellated) == 0) return;
+
+    for (TessellationResult& result : tessellated) {
+        if (result.type == TessellationResult::Type::StrokeMesh) {
+            commitTessellatedStroke(result);
+            continue;
         }
+
+        // Meshes of a stroke that was lifted or dropped meanwhile are stale
+        if (result.strokeId != liveStrokeId) continue;
+
+        // Whatever the tail covered last time has to go too
+        const QRectF bounds = controller->getSymmetry().map(result.bounds);
+        markDirty(liveStrokeBounds);
+        markDirty(bounds);
+        liveStrokeBounds = bounds;
+        liveMeshId = result.strokeId;
+        liveVertices = std::move(result.vertices);
+        liveMeshDabs = std::move(result.dabs);
     }
+
+    scheduler.requestFrame();
 }
 
+void Canvas::commitTessellatedStroke(TessellationResult& result) {
+    auto& manager = controller->getManager();
+    manager.addTessellatedStroke(result.points, result.vertices, result.bounds, vertices,
+                                 result.brushId, result.strokeId, result.layerId, result.symmetry);
+    dabs += result.dabs;
+    dabCounts.append(result.dabs.size());
+    memoryDirty = true;
+    const StrokeRecord& stroke = manager.getStrokeRecords().last();
+    invalidateCache(stroke.layerId, stroke.bounds); // with the copies
+    markDirty(stroke.bounds);
 
-void Canvas::resizeGL(int width, int height) {
-    glViewport(0, 0, width, height); // Set viewport
+    vboUpdateFlag = true;
+    if (liveMeshId == result.strokeId) {
+        clearLiveMesh(); // predicted tail is gone now
+    }
+
+    if (sync) {
+        sync->sendStroke(result.strokeId, manager.getStrokeRecords().last().layerId, result.brushId,
+                         manager.getStroke(manager.strokeCount() - 1), result.symmetry);
+        sync->endLiveStroke(result.strokeId);
+    }
+}
+
+void Canvas::clearLiveMesh() {
+    markDirty(liveStrokeBounds);
+    liveStrokeBounds = QRectF();
+    liveMeshId = 0;
+    liveVertices.clear();
+    liveMeshDabs.clear();
+}
 
+void Canvas::finishTessellation() {
+    tessellator.waitForIdle();
+    collectTessellation();
+}
+
+void Canvas::resizeGL(int width, int height) {
+    // The renderer picks the new size up from the next FrameState, this projection
+    // is for presenting the render thread's frames
     glMatrixMode(GL_PROJECTION); // Switch to projection matrix stack
     glLoadIdentity(); // Reset Current Matrix to Identity matrix 
     glOrtho(0, width, height, 0, -1, 1); // Sets up Orthographic projection, Y is flipped because we are converting gl coords to Qt coords
@@ -163,75 +458,1147 @@ void Canvas::resizeGL(int width, int height) {
     glMatrixMode(GL_MODELVIEW); // Matrix Ops affect model-voew matrix
     glLoadIdentity(); // Resert Current Matrix
 
+    markFullRedraw(); // framebuffer was reallocated
+    memoryDirty = true;
+}
+
+void Canvas::markDirty(const QRectF& rect) {
+    if (rect.isEmpty()) return;
+    dirtyRect = dirtyRect.isEmpty() ? rect : dirtyRect.united(rect);
+}
+
+void Canvas::markFullRedraw() {
+    fullRedraw = true;
+}
+
+QRect Canvas::takeDirtyDeviceRect() {
+    const qreal dpr = devicePixelRatioF();
+    const QSize fb(qRound(width() * dpr), qRound(height() * dpr));
+
+    QRect device;
+    if (fullRedraw) {
+        device = QRect(QPoint(0, 0), fb);
+    }
+    else if (!dirtyRect.isEmpty()) {
+        device = LayerCompositor::toScissorRect(dirtyRect, dpr, fb);
+    }
+
+    dirtyRect = QRectF();
+    fullRedraw = false;
+    return device;
 }
 
 // Fixed addStrokeToVertexBuffer
 void Canvas::addStrokeToVertexBuffer(const QVector<StrokePoint>& stroke)
 {
-    int oldSize = vertices.size();
-    controller->getManager().addStroke(stroke, controller->getProcessor(), vertices);
-
-    if (vertices.size() > oldSize) {
-        for (int i = oldSize; i < vertices.size(); ++i) {
-            const Vertex& v = vertices[i];
-            if (!std::isfinite(v.x) || !std::isfinite(v.y) ||
-                std::abs(v.x) > 10000 || std::abs(v.y) > 10000) {
-                std::cout << "INVALID VERTEX [" << i << "]: x=" << v.x << ", y=" << v.y << std::endl;
-            }
+    const int brushId = controller->getCurrentBrush();
+    controller->getManager().addStroke(stroke, controller->getProcessor(), vertices, brushId);
+    appendStrokeDabs(stroke, brushId);
+    memoryDirty = true;
+    const QRectF& bounds = controller->getManager().getStrokeRecords().last().bounds;
+    invalidateCache(controller->getManager().getActiveLayer(), bounds);
+    markDirty(bounds);
+
+    scheduler.requestFrame();
+}
+
+void Canvas::updateVertexBuffer() {
+    vboUpdateFlag = true; // uploaded with the next frame
+    scheduler.requestFrame();
+}
+
+void Canvas::appendStrokeDabs(const QVector<StrokePoint>& stroke, int brushId) {
+    const BrushSettings& brush = BrushEngine::preset(brushId);
+    if (!brush.textured || !brushesSupported) {
+        dabCounts.append(0);
+        return;
+    }
+
+    dabCounts.append(controller->getBrushEngine().appendDabs(stroke, brush, dabs)); // no per-stroke vector
+}
+
+void Canvas::rebuildDabs() {
+    auto& manager = controller->getManager();
+
+    dabs.clear();
+    dabCounts.clear();
+    for (int i = 0; i < manager.strokeCount(); ++i) {
+        const StrokeRecord& stroke = manager.strokeAt(i);
+        if (stroke.kind != EntryKind::Stroke) {
+            dabCounts.append(0); // fills and the rest have no brush
+            continue;
         }
+        appendStrokeDabs(manager.getStroke(i), stroke.brushId); // one at a time, cold ones stay compressed
+    }
+    vboUpdateFlag = true;
+}
+
+void Canvas::markSelectionDirty() {
+    auto& selection = controller->getSelection();
+
+    QRectF bounds = selection.getSelectionBounds();
+    if (selection.isSelecting()) {
+        QRectF path = selection.getPathBounds();
+        bounds = bounds.isEmpty() ? path : bounds.united(path);
+    }
+    if (!bounds.isEmpty()) {
+        bounds.adjust(-4, -4, 4, 4); // outline width and scaled stroke thickness
     }
 
-    update();
+    // Where the outline and the moved strokes were last frame has to go too
+    markDirty(selectionOverlayBounds);
+    markDirty(bounds);
+    selectionOverlayBounds = bounds;
 }
 
-void Canvas::updateVertexBuffer() {
-    if (!vBuffer.isCreated()) {
-        qWarning() << "VBuffer not created!";
+void Canvas::clearSelection() {
+    if (!controller->getSelection().hasSelection() && !controller->getSelection().isSelecting()) return;
+    controller->getSelection().clear();
+    markSelectionDirty();
+    scheduler.requestFrame();
+}
+
+void Canvas::setTool(Tool tool) {
+    controller->setTool(tool);
+    if (tool != Tool::Lasso && tool != Tool::RectSelect) {
+        clearSelection();
+    }
+}
+
+void Canvas::selectionPress(QMouseEvent* event) {
+    if (event->button() != Qt::LeftButton) return;
+    finishTessellation(); // the stroke just lifted should be selectable
+
+    auto& selection = controller->getSelection();
+    QPointF pos = event->position();
+
+    if (selection.hitsSelection(pos)) {
+        TransformMode mode = TransformMode::Move;
+        if (event->modifiers() & Qt::ShiftModifier) mode = TransformMode::Scale;
+        else if (event->modifiers() & Qt::ControlModifier) mode = TransformMode::Rotate;
+
+        // Take the selected strokes out of their layer cache for the duration of the drag
+        invalidateCache(selection.getSelectionLayer(), selection.getSelectionBounds());
+        selection.beginDrag(pos, mode);
+    }
+    else {
+        // Starting a new path drops the old selection
+        selection.clear();
+        SelectionShape shape = controller->getTool() == Tool::RectSelect ? SelectionShape::Rectangle : SelectionShape::Lasso;
+        selection.beginPath(pos, shape);
+    }
+
+    markSelectionDirty();
+    scheduler.requestFrame();
+}
+
+void Canvas::selectionMove(QMouseEvent* event) {
+    auto& selection = controller->getSelection();
+    if (selection.isDragging()) {
+        selection.updateDrag(event->position());
+    }
+    else if (selection.isSelecting()) {
+        selection.extendPath(event->position());
+    }
+    else {
+        return;
+    }
+
+    markSelectionDirty();
+    scheduler.requestFrame();
+}
+
+void Canvas::selectionRelease(QMouseEvent* event) {
+    if (event->button() != Qt::LeftButton) return;
+
+    auto& selection = controller->getSelection();
+    auto& manager = controller->getManager();
+
+    if (selection.isDragging()) {
+        QRectF before = selection.getSelectionBounds();
+        QTransform transform = selection.getTransform();
+
+        // Bake the drag into the points once, instead of on every move. It's one undo step.
+        QVector<quint64> ids;
+        for (int index : selection.getSelectedStrokes()) ids.append(manager.strokeAt(index).id);
+        const quint64 entryId = manager.transformStrokes(ids, transform, controller->getProcessor(), vertices);
+        if (entryId != 0) {
+            manager.setChangeSinceLastUndo(true);
+            manager.clearRedoStack();
+            rebuildDabs();
+            vboUpdateFlag = true;
+            memoryDirty = true;
+            if (sync) sync->sendTransform(entryId, ids, transform);
+        }
+        selection.endDrag();
+
+        // Selected strokes go back into their layer cache at the new position
+        invalidateCache(selection.getSelectionLayer(), before.united(selection.getSelectionBounds()));
+    }
+    else if (selection.isSelecting()) {
+        selection.finishPath(manager, manager.getActiveLayer());
+    }
+
+    markSelectionDirty();
+    scheduler.requestFrame();
+}
+
+QImage Canvas::renderVisibleLayers() {
+    const auto& manager = controller->getManager();
+    QImage image(size(), QImage::Format_RGB32);
+    StrokeRasterizer::render(image, 1.0, manager.getLayers(), rasters, manager.snapshot());
+    return image;
+}
+
+void Canvas::bucketFill(const QPointF& pos) {
+    finishTessellation(); // fill what's actually down
+
+    QElapsedTimer rasterTimer;
+    rasterTimer.start();
+    const QImage image = renderVisibleLayers();
+    const double rasterMs = rasterTimer.nsecsElapsed() / 1.0e6;
+
+    const QVector<QRect> rects = floodFill.fill(image, pos.toPoint(), fillSettings);
+    floodFill.getStats().rasterMs = rasterMs;
+    if (rects.isEmpty()) return;
+
+#ifdef QT_DEBUG
+    const FloodFillStats& fillStats = floodFill.getStats();
+    qDebug() << "Filled" << fillStats.pixels << "px as" << fillStats.rects << "quads, render" << fillStats.rasterMs
+             << "ms, fill" << fillStats.fillMs << "ms";
+#endif
+
+    auto& manager = controller->getManager();
+    const QVector<StrokePoint> points = FloodFill::toStroke(rects, controller->getStrokeColor(), QTime::currentTime());
+    const quint64 strokeId = manager.newStrokeId();
+    manager.setChangeSinceLastUndo(true);
+    manager.clearRedoStack();
+    manager.addFill(points, controller->getProcessor(), vertices, strokeId);
+    dabCounts.append(0); // no brush, no dabs
+
+    const StrokeRecord& stroke = manager.getStrokeRecords().last();
+    invalidateCache(stroke.layerId, stroke.bounds);
+    markDirty(stroke.bounds);
+    vboUpdateFlag = true;
+    memoryDirty = true;
+
+    if (sync) {
+        sync->sendStroke(strokeId, stroke.layerId, 0, manager.getStroke(manager.strokeCount() - 1), Symmetry(), EntryKind::Fill);
+    }
+    scheduler.requestFrame();
+}
+
+void Canvas::uploadRaster(int layerId, const QRect& rect) {
+    const QImage raster = rasters.value(layerId);
+    if (raster.isNull() || rect.isEmpty()) return;
+
+    // A copy of just the changed pixels, so the next edit doesn't detach the whole raster
+    CacheOp op;
+    op.type = CacheOp::Type::UploadRaster;
+    op.layerId = layerId;
+    op.rect = rect;
+    op.pixels = rect == raster.rect() ? raster : raster.copy(rect);
+    cacheOps.append(op);
+
+    invalidateCache(layerId, rect);
+    markDirty(rect);
+    memoryDirty = true;
+    scheduler.requestFrame();
+}
+
+// Draws the layer's strokes into its raster and ends them with a flatten entry. They stay in
+// the document (vector export, sync) but aren't drawn again, undoing the entry puts the raster
+// back and draws them as vectors again.
+void Canvas::rasterizeLayer(int id) {
+    auto& manager = controller->getManager();
+    if (!manager.findLayer(id)) return;
+    finishTessellation();
+
+    QImage& raster = rasters[id];
+    const bool created = raster.isNull();
+    if (created) raster = StrokeRasterizer::newLayerImage(size());
+
+    // The ones before an earlier flatten are in the raster already
+    const QVector<StrokeRecord>& strokes = manager.getStrokeRecords();
+    QVector<int> indices;
+    for (int i = BrushEngine::vectorStarts(strokes).value(id, 0); i < strokes.size(); ++i) {
+        if (strokes[i].layerId == id && strokes[i].draws()) {
+            indices.append(i);
+        }
+    }
+    if (indices.isEmpty()) {
+        if (created) uploadRaster(id, raster.rect());
         return;
     }
-    controller->getRenderer().updateVertexBuffer(vBuffer, vertices);
+
+    clearSelection(); // they stop being selectable
+    const QImage before = raster; // shared, the painter detaches the raster from it
+    {
+        QPainter painter(&raster);
+        for (int i : indices) {
+            StrokeRasterizer::drawStroke(painter, manager.getStroke(i), strokes[i].kind, strokes[i].symmetry);
+        }
+    }
+
+    // Undoing it redraws the whole layer
+    controller->getManager().addFlatten(QRectF(raster.rect()), 0, id);
+    commitRasterEdit(id, before, raster.rect());
+
+#ifdef QT_DEBUG
+    qDebug() << "Rasterized" << indices.size() << "strokes of layer" << id;
+#endif
+    uploadRaster(id, raster.rect());
 }
 
-void Canvas::renderVertexBuffer() {
-    controller->getRenderer().renderVertexBuffer(vertices, controller->getManager().getStrokeVertexCounts(), vBuffer);
+void Canvas::filterLayer(int id, FilterType filter, float radius, float strength) {
+    if (!controller->getManager().findLayer(id)) return;
+    clearSelection();
+    rasterizeLayer(id);
+
+    // Radius and strength ride in the point
+    QImage& raster = rasters[id];
+    const QImage before = raster;
+    StrokePoint point{};
+    point.thickness = radius;
+    point.pressure = strength;
+    point.strokeTime = QTime::currentTime();
+    const QVector<StrokePoint> points(1, point);
+
+    const QRect changed = rasterFilter.applyStroke(raster, points, filter);
+#ifdef QT_DEBUG
+    const RasterFilterStats& stats = rasterFilter.getStats();
+    qDebug() << "Filtered" << stats.pixels << "px in" << stats.tiles << "tiles on" << stats.threads << "threads," << stats.ms << "ms";
+#endif
+    if (changed.isEmpty()) return;
+    controller->getManager().addFilter(filter, points, QRectF(changed), 0, id);
+    commitRasterEdit(id, before, changed);
+    uploadRaster(id, changed);
+}
+
+void Canvas::commitRasterEdit(int layerId, const QImage& before, const QRect& rect) {
+    auto& manager = controller->getManager();
+    const quint64 strokeId = manager.getStrokeRecords().last().id;
+    manager.setChangeSinceLastUndo(true);
+    manager.clearRedoStack();
+    dabCounts.append(0); // keeps dabCounts parallel
+    vboUpdateFlag = true; // a flatten changes which strokes draw
+
+    // Edits of strokes that are gone for good (the redo list was just emptied) can go
+    for (auto it = rasterEdits.begin(); it != rasterEdits.end();) {
+        if (manager.indexOfStroke(it.key()) < 0) it = rasterEdits.erase(it);
+        else ++it;
+    }
+    RasterEdit edit;
+    edit.layerId = layerId;
+    edit.rect = rect;
+    edit.before = before.copy(rect);
+    edit.after = rasters.value(layerId).copy(rect);
+    rasterEdits.insert(strokeId, edit);
+    memoryDirty = true;
+}
+
+void Canvas::restoreRasterEdit(quint64 strokeId, bool undone) {
+    const RasterEdit edit = rasterEdits.value(strokeId);
+    if (edit.layerId < 0 || !rasters.contains(edit.layerId)) return;
+
+    QPainter painter(&rasters[edit.layerId]);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(edit.rect.topLeft(), undone ? edit.before : edit.after);
+    painter.end();
+    uploadRaster(edit.layerId, edit.rect);
+}
+
+qint64 Canvas::rasterBytes() const {
+    qint64 bytes = filterBefore.sizeInBytes();
+    for (const QImage& raster : rasters) bytes += raster.sizeInBytes();
+    for (const RasterEdit& edit : rasterEdits) bytes += edit.before.sizeInBytes() + edit.after.sizeInBytes();
+    return bytes;
+}
+
+void Canvas::appendFilterPoint(const QPointF& pos) {
+    StrokePoint point{};
+    point.pos = pos;
+    point.thickness = filterBrush.radius;
+    point.pressure = filterBrush.strength;
+    point.strokeTime = QTime::currentTime();
+    filterPoints.append(point);
+
+    const QRect changed = rasterFilter.addPoints(rasters[filterStrokeLayer], filterPoints, filterPoints.size() - 1);
+    if (changed.isEmpty()) return;
+    filterDirty |= changed;
+    uploadRaster(filterStrokeLayer, changed);
+}
+
+void Canvas::filterPress(QMouseEvent* event) {
+    if (event->button() != Qt::LeftButton) return;
+
+    // Filters work on pixels, the strokes of the layer get flattened first
+    const int layerId = controller->getManager().getActiveLayer();
+    rasterizeLayer(layerId);
+    if (!rasters.contains(layerId)) return;
+
+    filterStrokeLayer = layerId;
+    filterBefore = rasters[layerId]; // shared, the first dab detaches the raster from it
+    filterDirty = QRect();
+    filterPoints.clear();
+    rasterFilter.beginStroke(filterFor(controller->getTool()));
+    appendFilterPoint(event->position());
+}
+
+void Canvas::filterMove(QMouseEvent* event) {
+    if (filterStrokeLayer < 0 || !(event->buttons() & Qt::LeftButton)) return;
+    appendFilterPoint(event->position());
+}
+
+void Canvas::filterRelease(QMouseEvent* event) {
+    if (filterStrokeLayer < 0 || event->button() != Qt::LeftButton) return;
+
+    if (!filterDirty.isEmpty()) {
+        controller->getManager().addFilter(filterFor(controller->getTool()), filterPoints, QRectF(filterDirty), 0, filterStrokeLayer);
+        commitRasterEdit(filterStrokeLayer, filterBefore, filterDirty);
+    }
+#ifdef QT_DEBUG
+    const RasterFilterStats& stats = rasterFilter.getStats();
+    qDebug() << "Filter stroke," << stats.dabs << "dabs in" << stats.dabMs << "ms";
+#endif
+
+    filterStrokeLayer = -1;
+    filterBefore = QImage();
+    filterPoints.clear();
+    memoryDirty = true;
+}
+
+int Canvas::importReference(const QString& path) {
+    auto& manager = controller->getManager();
+    const int id = manager.addLayer(QFileInfo(path).fileName());
+
+    // At the bottom, to trace over
+    const QVector<Layer>& layers = manager.getLayers();
+    for (int i = 0; i < layers.size(); ++i) {
+        if (layers[i].id == id) manager.moveLayer(id, -i);
+    }
+    references.insert(id, ReferenceLayer());
+    referenceLoader.load(id, path);
+    emit layersChanged();
+    return id;
+}
+
+void Canvas::referenceLoaded(int layerId, std::shared_ptr<const ReferenceImage> image, const QString& error) {
+    auto it = references.find(layerId);
+    if (it == references.end()) return; // the layer went while it was loading
+
+    if (!image) {
+        qWarning() << "Could not load reference image:" << error;
+        references.erase(it);
+        if (controller->getManager().layerStrokeCount(layerId) == 0) removeLayer(layerId);
+        emit referenceImported(layerId, false, error);
+        return;
+    }
+
+    // Fitted into the canvas and centered, never scaled up
+    QSizeF shown = image->size();
+    if (shown.width() > width() || shown.height() > height()) shown.scale(size(), Qt::KeepAspectRatio);
+    it->placement = QRectF(QPointF((width() - shown.width()) / 2.0, (height() - shown.height()) / 2.0), shown);
+    it->image = image;
+
+    const ReferenceImageStats& stats = image->getStats();
+    emit referenceImported(layerId, true, QString("%1 x %2, %3 levels, decoded in %4 ms")
+                           .arg(stats.sourceSize.width()).arg(stats.sourceSize.height())
+                           .arg(image->levelCount()).arg(qRound(stats.decodeMs + stats.mipMs)));
+    memoryDirty = true;
+    scheduler.requestFrame();
+}
+
+void Canvas::streamReferences() {
+    if (references.isEmpty()) return;
+
+    // Device pixels the images take up, the cache resolution counts too
+    const qreal deviceScale = devicePixelRatioF() * quality.settings().renderScale;
+    int budget = referenceTilesPerFrame;
+    bool more = false;
+
+    for (auto it = references.begin(); it != references.end(); ++it) {
+        ReferenceLayer& reference = it.value();
+        if (!reference.image) continue;
+        const ReferenceImage& image = *reference.image;
+        const int coarsest = image.levelCount() - 1; // stays up once it is there, the stand-in for the others
+
+        auto drop = [&](int level) {
+            CacheOp op;
+            op.type = CacheOp::Type::DropReference;
+            op.layerId = it.key();
+            op.level = level;
+            cacheOps.append(op);
+            invalidateCache(it.key(), reference.placement);
+            markDirty(reference.placement);
+        };
+
+        const int target = reference.shownLevel < 0 ? coarsest : image.levelFor(reference.placement.size() * deviceScale);
+        if (target != reference.streamLevel) {
+            // A level that only got half way up is no use now
+            if (reference.streamLevel != reference.shownLevel && reference.streamLevel != coarsest) drop(reference.streamLevel);
+            reference.streamLevel = target;
+            const bool onGpu = reference.shownLevel >= 0 && (target == coarsest || target == reference.shownLevel);
+            reference.pending = onGpu ? QVector<QRect>() : image.tiles(target);
+        }
+
+        const QImage& level = image.level(reference.streamLevel);
+        const qreal sx = reference.placement.width() / level.width();
+        const qreal sy = reference.placement.height() / level.height();
+        while (budget > 0 && !reference.pending.isEmpty()) {
+            const QRect tile = reference.pending.takeFirst();
+            CacheOp op;
+            op.type = CacheOp::Type::UploadReferenceTile;
+            op.layerId = it.key();
+            op.level = reference.streamLevel;
+            op.rect = QRectF(reference.placement.x() + tile.x() * sx, reference.placement.y() + tile.y() * sy,
+                             tile.width() * sx, tile.height() * sy);
+            op.pixels = level.copy(tile);
+            cacheOps.append(op);
+            invalidateCache(it.key(), op.rect);
+            markDirty(op.rect);
+            --budget;
+        }
+
+        if (reference.pending.isEmpty() && reference.shownLevel != reference.streamLevel) {
+            if (reference.shownLevel >= 0 && reference.shownLevel != coarsest) drop(reference.shownLevel);
+            reference.shownLevel = reference.streamLevel;
+            memoryDirty = true;
+#ifdef QT_DEBUG
+            qDebug() << "Reference on layer" << it.key() << "showing level" << reference.shownLevel << level.size();
+#endif
+        }
+        more = more || !reference.pending.isEmpty();
+    }
+
+    // The rest next frame, input gets its turn in between
+    if (more) scheduler.requestFrame();
+}
+
+void Canvas::dropReferences(int layerId) {
+    if (references.remove(layerId) == 0) return;
+    CacheOp op;
+    op.type = CacheOp::Type::DropReference;
+    op.layerId = layerId;
+    cacheOps.append(op);
+    memoryDirty = true;
 }
 
 void Canvas::rebuildVertexBuffer() {
     vertices.clear();
-    for (const QVector<StrokePoint>& stroke : controller->getManager().getStrokes()) {
-        addStrokeToVertexBuffer(stroke);
+    const auto& manager = controller->getManager();
+    for (int i = 0; i < manager.strokeCount(); ++i) {
+        addStrokeToVertexBuffer(manager.getStroke(i));
     }
 }
 
 void Canvas::clearCanvas() {
+    finishTessellation();
+    if (sync) sync->sendClear();
     controller->clearCurrentStroke();
+    clearDocument();
+}
+
+void Canvas::clearDocument() {
+    for (auto it = rasters.cbegin(); it != rasters.cend(); ++it) {
+        CacheOp drop;
+        drop.type = CacheOp::Type::DropRaster;
+        drop.layerId = it.key();
+        cacheOps.append(drop);
+    }
+    rasters.clear();
+    rasterEdits.clear();
+    for (int id : references.keys()) dropReferences(id);
+    filterStrokeLayer = -1;
+    filterBefore = QImage();
+    clearStrokes();
+}
+
+void Canvas::clearStrokes() {
+    controller->getSelection().clear();
+    selectionOverlayBounds = QRectF();
     controller->getManager().clear();
+    remoteStrokes.clear();
     vertices.clear();
-    controller->getManager().clearStrokeVertexCounts();
-
-    makeCurrent();
-    glClear(GL_COLOR_BUFFER_BIT);
+    dabs.clear();
+    dabCounts.clear();
 
-    // Clear the VBO
-    controller->getRenderer().clearBuffer(vBuffer);
+    vboUpdateFlag = true; // empties the VBOs
 
-    update();
+    liveStrokeBounds = QRectF();
+    CacheOp invalidate;
+    invalidate.type = CacheOp::Type::InvalidateAll;
+    cacheOps.append(invalidate);
+    markFullRedraw();
+    memoryDirty = true;
+    scheduler.requestFrame();
 }
 
 void Canvas::setColor(const QColor& color) {
     controller->setCurrentColor(color);
 }
 
+void Canvas::setBrush(int presetId) {
+    controller->setCurrentBrush(presetId);
+}
+
+// Only new points read the dynamics, strokes already down keep what they were drawn with
+void Canvas::setBrushOptions(float min, float max, float s) {
+    controller->getDynamics().setThicknessRange(min, max);
+    controller->getDynamics().setSpeedSensitivity(s);
+}
+
+void Canvas::setBrushDynamics(const DynamicsSettings& settings) {
+    controller->getDynamics().setSettings(settings);
+}
+
+// Around the middle of the canvas, mirror axis vertical. Strokes already down keep theirs.
+void Canvas::setSymmetry(SymmetryMode mode, int order) {
+    Symmetry symmetry;
+    symmetry.mode = mode;
+    symmetry.order = static_cast<quint8>(qBound(1, order, Symmetry::maxOrder));
+    symmetry.cx = width() / 2.0f;
+    symmetry.cy = height() / 2.0f;
+    controller->setSymmetry(symmetry);
+}
+
+void Canvas::setPredictionEnabled(bool enabled) {
+    controller->setPredictionEnabled(enabled);
+    // The worker keeps the last tail until told otherwise. No new points, just the current
+    // tail (none when off), its mesh then marks the old area dirty too.
+    queueLiveSamples();
+    scheduler.requestFrame();
+}
+
+int Canvas::addLayer() {
+    auto& manager = controller->getManager();
+    int id = manager.addLayer(QString("Layer %1").arg(manager.getLayers().size() + 1));
+    manager.setActiveLayer(id);
+    emit layersChanged();
+    return id;
+}
+
+void Canvas::removeLayer(int id) {
+    finishTessellation();
+    clearSelection();
+    if (controller->getManager().removeLayer(id, controller->getProcessor(), vertices)) {
+        CacheOp remove;
+        remove.type = CacheOp::Type::RemoveLayer; // the renderer frees the layer's FBO
+        remove.layerId = id;
+        cacheOps.append(remove);
+        if (rasters.remove(id) > 0) {
+            remove.type = CacheOp::Type::DropRaster;
+            cacheOps.append(remove);
+        }
+        if (filterStrokeLayer == id) filterStrokeLayer = -1;
+        dropReferences(id);
+        rebuildDabs();
+        memoryDirty = true;
+        vboUpdateFlag = true;
+        markFullRedraw();
+        scheduler.requestFrame();
+        emit layersChanged();
+    }
+}
+
+void Canvas::moveLayer(int id, int delta) {
+    if (controller->getManager().moveLayer(id, delta)) {
+        markFullRedraw(); // caches are fine, only the composite order changed
+        scheduler.requestFrame();
+        emit layersChanged();
+    }
+}
+
+void Canvas::setActiveLayer(int id) {
+    // No layersChanged here, the panel is where the selection came from
+    controller->getManager().setActiveLayer(id);
+}
+
+void Canvas::setLayerVisible(int id, bool visible) {
+    if (Layer* layer = controller->getManager().findLayer(id)) {
+        layer->visible = visible;
+        markFullRedraw();
+        scheduler.requestFrame();
+    }
+}
+
+void Canvas::setLayerOpacity(int id, float opacity) {
+    if (Layer* layer = controller->getManager().findLayer(id)) {
+        layer->opacity = std::clamp(opacity, 0.0f, 1.0f);
+        markFullRedraw();
+        scheduler.requestFrame();
+    }
+}
+
+void Canvas::setLayerBlendMode(int id, BlendMode mode) {
+    if (Layer* layer = controller->getManager().findLayer(id)) {
+        layer->blendMode = mode;
+        markFullRedraw();
+        scheduler.requestFrame();
+    }
+}
+
+QVector<Layer> Canvas::getLayers() const {
+    return controller->getManager().getLayers();
+}
+
+int Canvas::getActiveLayer() const {
+    return controller->getManager().getActiveLayer();
+}
+
+TimelapseDocument Canvas::getTimelapseDocument() {
+    finishTessellation();
+    const auto& manager = controller->getManager();
+    return { size(), manager.getLayers(), manager.snapshot() };
+}
+
+Document Canvas::getDocument() {
+    finishTessellation();
+    const auto& manager = controller->getManager();
+    Document document;
+    document.size = size();
+    document.layers = manager.getLayers();
+    document.strokes = manager.getStrokeRecords(); // packed ones are saved as they are
+    document.rasters = rasters;
+    return document;
+}
+
+bool Canvas::exportVector(const QString& path, VectorExportStats& stats) {
+    VectorFormat format;
+    if (!VectorExporter::formatForPath(path, format)) {
+        qWarning() << "Unknown export format:" << path;
+        return false;
+    }
+
+    finishTessellation(); // the last stroke may still be on the worker
+
+    // Written to a temp file and renamed at the end, a failed export leaves the old file alone
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Export failed:" << file.errorString();
+        return false;
+    }
+
+    const auto& manager = controller->getManager();
+    VectorExporter exporter(format);
+    if (!exporter.write(&file, size(), manager.getLayers(), manager.snapshot())) {
+        qWarning() << "Export failed:" << exporter.errorString();
+        file.cancelWriting();
+        return false;
+    }
+    stats = exporter.getStats();
+
+#ifdef QT_DEBUG
+    qDebug() << "Exported" << stats.strokes << "strokes," << stats.segments << "curves from" << stats.inputPoints
+             << "outline points," << stats.bytes << "bytes in" << stats.elapsedMs << "ms";
+#endif
+    return file.commit();
+}
+
+bool Canvas::exportRaster(const Document& document, const QString& path, qreal scale, TiledCanvasStats& stats,
+                          const std::atomic<bool>* cancel, const std::function<void(int, int)>& progress, QString* error) {
+    TileStoreOptions options;
+    bool ok = false;
+    const int cacheMB = qEnvironmentVariableIntValue("LANCER_TILE_CACHE_MB", &ok);
+    if (ok && cacheMB > 0) options.workingSetBytes = cacheMB * 1024ll * 1024;
+
+    auto fail = [error](const QString& message) {
+        qWarning() << "Export failed:" << message;
+        if (error) *error = message;
+        return false;
+    };
+
+    TiledCanvas tiled(options);
+    if (!tiled.create(document.size, scale, document.layers)) return fail(tiled.errorString());
+    for (auto it = document.rasters.cbegin(); it != document.rasters.cend(); ++it) {
+        tiled.setLayerRaster(it.key(), it.value());
+    }
+    // Packed strokes are decoded one at a time, the snapshot shares the document's records
+    const StrokeSnapshot strokes(document.strokes);
+    const QHash<int, int> starts = BrushEngine::vectorStarts(document.strokes);
+    QVector<StrokePoint> scratch;
+    for (int i = 0; i < document.strokes.size(); ++i) {
+        const StrokeRecord& record = document.strokes[i];
+        if (!record.draws()) continue; // filters are in the rasters, transforms in the points
+        if (i < starts.value(record.layerId, 0)) continue; // so are flattened strokes
+        tiled.addStroke(strokes.pointsOf(i, scratch), record.layerId, record.kind, record.symmetry);
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return fail(file.errorString());
+    if (!tiled.writeTiff(&file, cancel, progress)) {
+        file.cancelWriting();
+        return fail(tiled.errorString());
+    }
+    stats = tiled.getStats();
+
+#ifdef QT_DEBUG
+    qDebug() << "Exported" << tiled.pixelSize() << "in" << tiled.columns() * tiled.rows() << "tiles," << stats.rasterized
+             << "drawn in" << stats.rasterMs << "ms," << stats.tiles.evictions << "evictions," << stats.tiles.fileBytes / (1024 * 1024) << "MB paged";
+#endif
+    if (!file.commit()) return fail(file.errorString());
+    return true;
+}
+
+void Canvas::setMemoryLimits(qint64 cpuBytes, qint64 gpuBytes) {
+    memoryTracker.setSoftLimits(cpuBytes, gpuBytes);
+    memoryDirty = true;
+    scheduler.requestFrame();
+}
+
+void Canvas::updateMemoryUsage() {
+    auto& manager = controller->getManager();
+    const qint64 vertexBytes = vertices.size() * static_cast<qint64>(sizeof(Vertex));
+    const qint64 dabBytes = dabs.size() * static_cast<qint64>(sizeof(Dab));
+
+    // The VBOs are allocated to exactly the uploaded size, the CPU side keeps its spare capacity
+    memoryTracker.setUsage(MemoryCategory::Strokes, manager.strokeBytes() + dabCounts.capacity() * static_cast<qint64>(sizeof(int)));
+    memoryTracker.setUsage(MemoryCategory::RedoHistory, manager.redoBytes());
+    memoryTracker.setUsage(MemoryCategory::Vertices, vertices.capacity() * static_cast<qint64>(sizeof(Vertex)));
+    memoryTracker.setUsage(MemoryCategory::Dabs, dabs.capacity() * static_cast<qint64>(sizeof(Dab)));
+    memoryTracker.setUsage(MemoryCategory::VertexBuffer, 0, vertexBytes + dabBytes);
+    memoryTracker.setUsage(MemoryCategory::LiveStrokeBuffer, 0, frameStats.liveBufferBytes);
+    memoryTracker.setUsage(MemoryCategory::LayerCaches, 0, frameStats.cacheBytes);
+    memoryTracker.setUsage(MemoryCategory::Rasters, rasterBytes(), frameStats.rasterBytes);
+    qint64 referenceBytes = 0;
+    for (const ReferenceLayer& reference : references) {
+        if (reference.image) referenceBytes += reference.image->bytes();
+    }
+    memoryTracker.setUsage(MemoryCategory::References, referenceBytes, frameStats.referenceBytes);
+
+    if (memoryTracker.isOverCpuLimit() || memoryTracker.isOverGpuLimit()) {
+        enforceMemoryLimits();
+    }
+
+    emit memoryUsageChanged();
+}
+
+void Canvas::enforceMemoryLimits() {
+    auto& manager = controller->getManager();
+
+    if (memoryTracker.isOverCpuLimit()) {
+        // Spare capacity first, that costs nothing but a copy. Then every committed stroke
+        // gets compressed, not just the old ones
+        manager.compact();
+        manager.compressCold(0);
+        vertices.squeeze();
+        dabs.squeeze();
+        dabCounts.squeeze();
+        memoryTracker.setUsage(MemoryCategory::Strokes, manager.strokeBytes() + dabCounts.capacity() * static_cast<qint64>(sizeof(int)));
+        memoryTracker.setUsage(MemoryCategory::RedoHistory, manager.redoBytes());
+        memoryTracker.setUsage(MemoryCategory::Vertices, vertices.capacity() * static_cast<qint64>(sizeof(Vertex)));
+        memoryTracker.setUsage(MemoryCategory::Dabs, dabs.capacity() * static_cast<qint64>(sizeof(Dab)));
+
+        // Then the redo history, the only thing we can drop without losing the drawing
+        if (memoryTracker.isOverCpuLimit() && manager.redoBytes() > 0) {
+            qWarning() << "Over the CPU memory limit, dropping redo history";
+            manager.clearRedoStack();
+            memoryTracker.setUsage(MemoryCategory::RedoHistory, manager.redoBytes());
+        }
+    }
+
+    if (memoryTracker.isOverGpuLimit()) {
+        // Only layers that are composited need a cache, hidden and empty ones can go
+        QVector<int> keep;
+        for (const Layer& layer : manager.getLayers()) {
+            if (layer.visible && (manager.layerStrokeCount(layer.id) > 0 || rasters.contains(layer.id) || references.contains(layer.id))) {
+                keep.append(layer.id);
+            }
+        }
+        CacheOp evict;
+        evict.type = CacheOp::Type::Evict; // done by the renderer before its next frame
+        evict.keep = keep;
+        cacheOps.append(evict);
+
+        // Live buffers are recreated on the next stroke
+        if (!controller->isDrawing()) {
+            releaseLiveBuffers = true;
+        }
+#ifdef QT_DEBUG
+        qDebug() << "Over the GPU memory limit, evicting the caches of" << manager.getLayers().size() - keep.size() << "layers";
+#endif
+    }
+}
+
+void Canvas::setSyncClient(SyncClient* client) {
+    if (sync) disconnect(sync, nullptr, this, nullptr);
+    sync = client;
+    if (!sync) return;
+
+    connect(sync, &SyncClient::opReceived, this, &Canvas::applyRemoteOp);
+    connect(sync, &SyncClient::connectedToRelay, this, [this](quint32 id) {
+        controller->getManager().setClientId(id); // new strokes get ids nobody else hands out
+        publishHistory();
+    });
+    connect(sync, &SyncClient::disconnectedFromRelay, this, [this]() {
+        for (const RemoteLiveStroke& live : remoteLive) markDirty(live.bounds);
+        remoteLive.clear();
+        remoteDirty = true;
+        scheduler.requestFrame();
+    });
+}
+
+// Everything we drew before connecting, or while the relay was away, goes out in document
+// order. Peers drop ids they already have, so entries a relay has seen before do no harm.
+// Filters and flattens stay local. Our transforms go out as ops of their own, so the strokes
+// they moved go out the way they were before them: walking back from the newest undoes each
+// on a copy of its targets.
+void Canvas::publishHistory() {
+    finishTessellation();
+    auto& manager = controller->getManager();
+    const QVector<StrokeRecord>& entries = manager.getStrokeRecords();
+
+    QHash<quint64, QVector<StrokePoint>> unmoved;
+    for (int i = entries.size() - 1; i >= 0; --i) {
+        const StrokeRecord& entry = entries[i];
+        if (entry.kind != EntryKind::Transform || remoteStrokes.contains(entry.id)) continue;
+        const QTransform inverse = entry.transform.inverted();
+        for (quint64 id : entry.targets) {
+            auto it = unmoved.find(id);
+            if (it == unmoved.end()) {
+                const int index = manager.indexOfStroke(id);
+                if (index < 0) continue;
+                it = unmoved.insert(id, manager.getStroke(index));
+            }
+            StrokeManager::transformPoints(*it, inverse);
+        }
+    }
+
+    for (int i = 0; i < entries.size(); ++i) {
+        const StrokeRecord& entry = entries[i];
+        if (remoteStrokes.contains(entry.id)) continue; // theirs to send
+        if (entry.kind == EntryKind::Transform) {
+            sync->sendTransform(entry.id, entry.targets, entry.transform);
+        }
+        else if (entry.draws()) {
+            const QVector<StrokePoint> points = unmoved.value(entry.id, manager.getStroke(i));
+            sync->sendStroke(entry.id, entry.layerId, entry.brushId, points, entry.symmetry, entry.kind);
+        }
+    }
+}
+
+void Canvas::streamLiveStroke() {
+    if (!sync || !sync->isConnected() || !controller->isDrawing()) return;
+
+    const auto& stroke = controller->getCurrentStroke();
+    for (; streamedPoints < stroke.size(); ++streamedPoints) {
+        sync->streamLivePoint(liveStrokeId, stroke[streamedPoints]);
+    }
+}
+
+void Canvas::applyRemoteOp(const SyncOp& op) {
+    if (op.isPersistent()) finishTessellation(); // our own pending commits go first
+    auto& manager = controller->getManager();
+    auto& processor = controller->getProcessor();
+
+    switch (op.type) {
+    case SyncOpType::AddStroke:
+    case SyncOpType::Redo: {
+        // The finished stroke replaces its live preview
+        if (remoteLive.contains(op.strokeId)) {
+            markDirty(remoteLive.take(op.strokeId).bounds);
+        }
+        if (op.points.size() < 2 || manager.indexOfStroke(op.strokeId) >= 0) break; // already have it
+
+        // Layers aren't shared, unknown ids land on the active layer
+        if (EntryKind(op.entryKind) == EntryKind::Fill) {
+            manager.addFill(op.points, processor, vertices, op.strokeId, op.layerId);
+            dabCounts.append(0);
+        }
+        else {
+            manager.addStroke(op.points, processor, vertices, op.brushId, op.strokeId, op.layerId, SyncClient::symmetryOf(op));
+            appendStrokeDabs(op.points, op.brushId);
+        }
+        remoteStrokes.insert(op.strokeId);
+
+        // Relay order: strokes of ours it hasn't echoed yet come after this one on every
+        // other canvas, so they go on top of it here too
+        int index = manager.strokeCount() - 1;
+        for (quint64 id : sync->unconfirmedStrokes()) {
+            const int own = manager.indexOfStroke(id);
+            if (own >= 0) index = std::min(index, own);
+        }
+        if (index < manager.strokeCount() - 1) {
+            clearSelection(); // indices shift
+            manager.moveStroke(manager.strokeCount() - 1, index, vertices);
+            rebuildDabs();
+        }
+
+        const StrokeRecord& stroke = manager.strokeAt(index);
+        invalidateCache(stroke.layerId, stroke.bounds);
+        markDirty(stroke.bounds);
+        vboUpdateFlag = true;
+        memoryDirty = true;
+        break;
+    }
+    case SyncOpType::Transform: {
+        if (manager.indexOfStroke(op.strokeId) >= 0) break; // already have it
+
+        clearSelection(); // the strokes move under it
+        if (manager.transformStrokes(op.targets, SyncClient::transformOf(op), processor, vertices, op.strokeId) == 0) break;
+        remoteStrokes.insert(op.strokeId);
+        rebuildDabs();
+
+        const StrokeRecord& entry = manager.getStrokeRecords().last();
+        invalidateCache(entry.layerId, entry.bounds);
+        markDirty(entry.bounds);
+        vboUpdateFlag = true;
+        memoryDirty = true;
+        break;
+    }
+    case SyncOpType::Undo: {
+        int index = manager.indexOfStroke(op.strokeId);
+        if (index < 0) break;
+
+        clearSelection(); // indices shift
+        const StrokeRecord& stroke = manager.strokeAt(index);
+        invalidateCache(stroke.layerId, stroke.bounds);
+        markDirty(stroke.bounds);
+        manager.removeStroke(index, processor, vertices); // a transform moves its strokes back
+        remoteStrokes.remove(op.strokeId);
+        rebuildDabs();
+        vboUpdateFlag = true;
+        memoryDirty = true;
+        break;
+    }
+    case SyncOpType::Clear: {
+        // Only what is shared goes. Rasters and references are ours, so are the filters and
+        // flattens that made the rasters, and what we sent after the clear isn't cleared anywhere else.
+        const QVector<quint64>& unconfirmed = sync->unconfirmedStrokes();
+        QVector<StrokeRecord> kept;
+        for (int i = 0; i < manager.strokeCount(); ++i) {
+            const StrokeRecord& entry = manager.strokeAt(i);
+            if (!entry.editsRaster() && !unconfirmed.contains(entry.id)) continue;
+            kept.append(entry);
+            kept.last().points = manager.getStroke(i);
+        }
+        clearStrokes();
+        for (const StrokeRecord& entry : kept) {
+            switch (entry.kind) {
+            case EntryKind::Stroke:
+                manager.addStroke(entry.points, processor, vertices, entry.brushId, entry.id, entry.layerId, entry.symmetry);
+                appendStrokeDabs(entry.points, entry.brushId);
+                break;
+            case EntryKind::Fill:
+                manager.addFill(entry.points, processor, vertices, entry.id, entry.layerId);
+                dabCounts.append(0);
+                break;
+            case EntryKind::Filter:
+                manager.addFilter(entry.filter, entry.points, entry.bounds, entry.id, entry.layerId);
+                dabCounts.append(0);
+                break;
+            case EntryKind::Flatten:
+                manager.addFlatten(entry.bounds, entry.id, entry.layerId);
+                dabCounts.append(0);
+                break;
+            case EntryKind::Transform:
+                break; // never unconfirmed, and not ours alone
+            }
+        }
+        break;
+    }
+    case SyncOpType::LivePoints: {
+        RemoteLiveStroke& live = remoteLive[op.strokeId];
+        // Bounds of the new points plus the segment joining them to what we had
+        int first = live.points.isEmpty() ? 0 : live.points.size() - 1;
+        live.points += op.points;
+        QRectF bounds = processor.strokeBounds(live.points, first);
+        live.bounds = live.bounds.isEmpty() ? bounds : live.bounds.united(bounds);
+        markDirty(bounds);
+        break;
+    }
+    case SyncOpType::LiveEnd:
+        if (remoteLive.contains(op.strokeId)) {
+            markDirty(remoteLive.take(op.strokeId).bounds);
+        }
+        break;
+    case SyncOpType::Hello:
+        break;
+    }
+
+    remoteDirty = true;
+    scheduler.requestFrame();
+}
+
+void Canvas::rebuildRemoteMesh() {
+    remoteDirty = false;
+    remoteVertices.clear();
+    remoteCounts.clear();
+
+    auto& processor = controller->getProcessor();
+    for (const RemoteLiveStroke& live : remoteLive) {
+        remoteCounts.append(processor.generateVertices(live.points, remoteVertices));
+    }
+}
+
 void Canvas::undo() {
-    controller->getManager().undo(controller->getProcessor(), vertices);
+    finishTessellation(); // a stroke still being tessellated is the one to undo
+    clearSelection(); // stroke indices are about to shift
+    auto& manager = controller->getManager();
+
+    // Our own newest stroke, a peer's may be on top of it and is theirs to undo
+    int index = manager.strokeCount() - 1;
+    while (index >= 0 && remoteStrokes.contains(manager.strokeAt(index).id)) --index;
+    if (index < 0) return;
+
+    const StrokeRecord& undone = manager.strokeAt(index);
+    const quint64 undoneId = undone.id;
+    const bool undoneRaster = undone.editsRaster();
+    const bool moved = undone.kind == EntryKind::Transform; // its strokes go back, dabs and all
+    const bool newest = index == manager.strokeCount() - 1;
+    // the stroke about to disappear
+    invalidateCache(undone.layerId, undone.bounds);
+    markDirty(undone.bounds);
+
+    int before = manager.strokeCount();
+    manager.undo(controller->getProcessor(), vertices, index);
+    if (manager.strokeCount() < before && (!newest || moved)) {
+        rebuildDabs();
+    }
+    else if (manager.strokeCount() < before && !dabCounts.isEmpty()) {
+        dabs.resize(dabs.size() - dabCounts.takeLast()); // always the newest stroke
+        vboUpdateFlag = true;
+    }
+    if (undoneRaster && manager.strokeCount() < before) {
+        vboUpdateFlag = true; // may have been a flatten
+        restoreRasterEdit(undoneId, true); // never synced, so nothing to send
+    }
+    else if (sync && manager.strokeCount() < before) {
+        sync->sendUndo(undoneId);
+    }
+    memoryDirty = true;
     updateVertexBuffer();
-    update();
+    scheduler.requestFrame();
 }
 
 void Canvas::redo() {
-    controller->getManager().redo(controller->getProcessor(), vertices);
+    finishTessellation();
+    clearSelection();
+    auto& manager = controller->getManager();
+    int before = manager.strokeCount();
+    manager.redo(controller->getProcessor(), vertices);
+    if (manager.strokeCount() > before) {
+        const StrokeRecord& redone = manager.getStrokeRecords().last();
+        const QVector<StrokePoint> points = manager.getStroke(manager.strokeCount() - 1);
+        vboUpdateFlag = true;
+        memoryDirty = true;
+        if (redone.kind == EntryKind::Transform) {
+            rebuildDabs(); // its strokes moved again
+            if (sync) sync->sendTransform(redone.id, redone.targets, redone.transform);
+        }
+        else if (redone.editsRaster()) {
+            dabCounts.append(0); // keeps dabCounts parallel
+            restoreRasterEdit(redone.id, false); // never synced
+        }
+        else {
+            appendStrokeDabs(points, redone.brushId);
+            if (sync) sync->sendRedo(redone.id, redone.layerId, redone.brushId, points, redone.symmetry, redone.kind);
+        }
+        invalidateCache(redone.layerId, redone.bounds);
+        markDirty(redone.bounds);
+    }
     updateVertexBuffer();
-    update();
+    scheduler.requestFrame();
 }
 
 void Canvas::mousePressEvent(QMouseEvent* event)
@@ -239,11 +1606,29 @@ void Canvas::mousePressEvent(QMouseEvent* event)
 #ifdef QT_DEBUG
     qDebug() << "Mouse Pressed";
 #endif
+    if (controller->getTool() == Tool::Fill) {
+        if (event->button() == Qt::LeftButton) bucketFill(event->position());
+        return;
+    }
+    if (isFilterTool(controller->getTool())) {
+        filterPress(event);
+        return;
+    }
+    if (controller->getTool() != Tool::Brush) {
+        selectionPress(event);
+        return;
+    }
+
     controller->getManager().setChangeSinceLastUndo(true);
     controller->getManager().clearRedoStack();
     controller->onMousePress(event);
+    liveStrokeId = controller->getManager().newStrokeId();
+    queuedPoints = 0;
+    streamedPoints = 0;
+    queueLiveSamples();
+    streamLiveStroke();
     timer.restart();
-    update();
+    scheduler.requestFrame();
 }
 
 void Canvas::tabletEvent(QTabletEvent* event)
@@ -256,57 +1641,67 @@ void Canvas::tabletEvent(QTabletEvent* event)
         controller->getManager().setChangeSinceLastUndo(true);
         controller->getManager().clearRedoStack();
         timer.restart();
-        update();
+        queueLiveSamples();
+        streamLiveStroke();
+        scheduler.requestFrame();
     }
 }
 
 
 void Canvas::mouseMoveEvent(QMouseEvent* event)
 {
+    if (controller->getTool() == Tool::Fill) return;
+    if (isFilterTool(controller->getTool())) {
+        filterMove(event);
+        return;
+    }
+    if (controller->getTool() != Tool::Brush) {
+        selectionMove(event);
+        return;
+    }
+
     controller->onMouseMove(event);
-    update();
+    if (controller->isDrawing()) {
+        queueLiveSamples();
+        streamLiveStroke();
+        scheduler.requestFrame();
+    }
 }
 
 void Canvas::mouseReleaseEvent(QMouseEvent* event)
 {
+    if (controller->getTool() == Tool::Fill) return;
+    if (isFilterTool(controller->getTool())) {
+        filterRelease(event);
+        return;
+    }
+    if (controller->getTool() != Tool::Brush) {
+        selectionRelease(event);
+        return;
+    }
+
     if ((Qt::LeftButton == event->button()) && controller->isDrawing()) {
         controller->onMouseLift(event);
         if (controller->getCurrentStroke().size() > 1) {
-            const auto& currentStroke = controller->getCurrentStroke();
-
-            int maxPoints = (currentStroke.size() > 3) ? 3 : currentStroke.size();
-            for (int i = 0; i < maxPoints; ++i) {
-                const auto& pt = currentStroke[i];
-            }
-
-
-            // Check if any vertices are invalid
-            for (int i = vertices.size() - 10; i < vertices.size(); ++i) {
-                if (i >= 0) {
-                    const auto& v = vertices[i];
-                    if (!std::isfinite(v.x) || !std::isfinite(v.y) ||
-                        std::abs(v.x) > 5000 || std::abs(v.y) > 5000) {
-                        std::cout << "PROBLEMATIC VERTEX [" << i << "]: x=" << v.x << ", y=" << v.y << std::endl;
-                    }
-                }
-            }
-
-            addStrokeToVertexBuffer(controller->getCurrentStroke());
-
-            // Check if any vertices are invalid
-            for (int i = vertices.size() - 10; i < vertices.size(); ++i) {
-                if (i >= 0) {
-                    const auto& v = vertices[i];
-                    if (!std::isfinite(v.x) || !std::isfinite(v.y) ||
-                        std::abs(v.x) > 5000 || std::abs(v.y) > 5000) {
-                        std::cout << "PROBLEMATIC VERTEX [" << i << "]: x=" << v.x << ", y=" << v.y << std::endl;
-                    }
-                }
-            }
-
-            vboUpdateFlag=true;
+            // Tessellated on the worker, lands in commitTessellatedStroke. The live mesh stays up until then.
+            const int brushId = controller->getCurrentBrush();
+            const BrushSettings& brush = BrushEngine::preset(brushId);
+            TessellationJob job;
+            job.type = TessellationJob::Type::Commit;
+            job.strokeId = liveStrokeId;
+            job.points = controller->getCurrentStroke();
+            job.brushId = brushId;
+            job.layerId = controller->getManager().getActiveLayer();
+            job.dabs = brush.textured && brushesSupported;
+            job.symmetry = controller->getSymmetry();
+            tessellator.submitBlocking(std::move(job));
+        }
+        else {
+            clearLiveMesh();
+            if (sync) sync->endLiveStroke(liveStrokeId);
         }
+        liveStrokeId = 0;
         controller->clearCurrentStroke();
-        update();
+        scheduler.requestFrame();
     }
 }
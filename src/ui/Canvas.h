@@ -9,6 +9,24 @@
 #include "../data/StrokePoint.h"
 #include "core/CanvasController.h"
 #include "data/Vertex.h"
+#include "data/Layer.h"
+#include "rendering/CanvasRenderer.h"
+#include "rendering/CanvasRenderThread.h"
+#include "rendering/FrameScheduler.h"
+#include "core/MemoryTracker.h"
+#include "sync/SyncClient.h"
+#include "core/TessellationWorker.h"
+#include "core/VectorExporter.h"
+#include "core/Timelapse.h"
+#include "core/QualityController.h"
+#include "core/TiledCanvas.h"
+#include "core/FloodFill.h"
+#include "core/RasterFilter.h"
+#include "core/ReferenceImage.h"
+#include "core/DocumentFile.h"
+#include <QTimer>
+#include <QHash>
+#include <QSet>
 
 class Canvas : public QOpenGLWidget, protected QOpenGLFunctions  
 {  
@@ -20,13 +38,156 @@ private:
     QElapsedTimer timer; // timer
 
     // VBO Stuff
-    QOpenGLBuffer vBuffer;
-    QVector<Vertex> vertices; // List of Vertex structs, append points to upload to vertexBuffer
+    QVector<Vertex> vertices; // List of Vertex structs, uploaded by the renderer
     bool vboUpdateFlag; // Check if vertex data has changed
 
-    void renderVertexBuffer();
+    // Textured brushes. Every stroke still has its solid strip in vertices, strokes drawn
+    // with a textured preset additionally get dabs here, which are drawn instead when supported.
+    QVector<Dab> dabs;
+    QVector<int> dabCounts; // parallel to strokes, 0 for solid strokes
+    bool brushesSupported = false; // the renderer can draw dabs
+    void appendStrokeDabs(const QVector<StrokePoint>& stroke, int brushId);
+    void rebuildDabs();
+
+    // Rendering. All GL work lives in a CanvasRenderer, fed FrameState snapshots: in paintGL,
+    // or on a CanvasRenderThread (LANCER_RENDER_THREAD) while paintGL only draws its last frame.
+    CanvasRenderer renderer;
+    std::unique_ptr<CanvasRenderThread> renderThread;
+    QVector<CacheOp> cacheOps;  // layer cache changes for the next frame
+    bool releaseLiveBuffers = false;
+    FrameStats frameStats;      // GPU side numbers as of the last frame
+    FrameScheduler scheduler{ this }; // everything that needs a repaint asks it, not update()
+    void drawFrame();
+    bool takeFrameState(FrameState& state); // false when nothing changed
+    void invalidateCache(int layerId, const QRectF& rect);
+    void startRenderThread();
+    bool presentFrame(); // threaded mode, draws the render thread's last frame, false if there is none yet
+
+    // Adaptive quality. Frame times go to the controller, which trades live stroke density,
+    // cache resolution and overlay smoothing for speed. Quiet for a moment and it's back to full.
+    QualityController quality;
+    QTimer qualityIdle;
+    quint64 qualityFrames = 0; // render thread frames already reported
+    void reportFrameTime(double ms);
+    void restoreQuality();
+
+    // Memory accounting, refreshed after anything that changes the document or the buffers
+    MemoryTracker memoryTracker;
+    bool memoryDirty = true;
+    QTimer memoryRefresh; // picks up memoryDirty between frames
+    bool firstFrameDone = false;
+    void updateMemoryUsage();
+    void enforceMemoryLimits(); // compacts, then evicts, when over the soft limits
+
+    // Shared canvas. Local changes go out as ops, remote ones come in through applyRemoteOp.
+    // Strokes other people are still drawing are kept apart and drawn on top of everything.
+    SyncClient* sync = nullptr;
+    quint64 liveStrokeId = 0;   // id the stroke being drawn will get
+    int streamedPoints = 0;     // how much of it went out already
+    struct RemoteLiveStroke {
+        QVector<StrokePoint> points;
+        QRectF bounds;
+    };
+    QHash<quint64, RemoteLiveStroke> remoteLive;
+    QVector<Vertex> remoteVertices; // remoteLive tessellated, rebuilt when it changes
+    QVector<int> remoteCounts;
+    bool remoteDirty = false;
+    QSet<quint64> remoteStrokes; // finished strokes that came from peers, undo skips them
+    void streamLiveStroke();
+    void applyRemoteOp(const SyncOp& op);
+    void rebuildRemoteMesh();
+    void publishHistory(); // our entries, for a relay that hasn't seen them
+    void clearDocument(); // clearCanvas without telling anyone
+    void clearStrokes();  // the history only, rasters and references stay
+
+    // Tessellation happens on the worker. Input queues samples and commits, the results
+    // come back as a live mesh to draw or a finished stroke to append to the document.
+    TessellationWorker tessellator;
+    QVector<TessellationResult> tessellated; // reused by collectTessellation
+    int queuedPoints = 0;      // how much of the live stroke went to the worker
+    quint64 liveMeshId = 0;    // stroke the live mesh belongs to, 0 if none is up
+    QVector<Vertex> liveVertices;
+    QVector<Dab> liveMeshDabs;
+    void queueLiveSamples();
+    void collectTessellation();
+    void commitTessellatedStroke(TessellationResult& result);
+    void clearLiveMesh();
+    void finishTessellation(); // waits for outstanding commits, before anything that edits the stroke list
+
     void rebuildVertexBuffer();
-    void renderCurrentStroke();
+
+    // Damage tracking. The widget keeps its framebuffer between frames (PartialUpdate),
+    // so paintGL only clears and redraws the union of what changed since the last frame.
+    QRectF dirtyRect;            // widget coords
+    bool fullRedraw = true;
+    QRectF liveStrokeBounds;     // live stroke tip + predicted tail as drawn last frame
+    void markDirty(const QRectF& rect);
+    void markFullRedraw();
+    QRect takeDirtyDeviceRect(); // in framebuffer pixels, resets the accumulated damage
+
+    // Selection. While a transform is dragged the selected strokes are left out of their
+    // layer cache and drawn with the drag matrix on the GL matrix stack, nothing is re-tessellated
+    // until the drag is released.
+    QRectF selectionOverlayBounds; // outline + selected strokes as drawn last frame
+    void selectionPress(QMouseEvent* event);
+    void selectionMove(QMouseEvent* event);
+    void selectionRelease(QMouseEvent* event);
+    void markSelectionDirty();
+    void clearSelection();
+
+    // Paint bucket. The visible layers are rendered on the CPU, filled from the click, and
+    // the result goes into the document as a fill entry (StrokeManager::addFill) on the
+    // active layer. Undo, sync and export know fills, they draw as filled quads.
+    FloodFill floodFill;
+    FloodFillSettings fillSettings;
+    void bucketFill(const QPointF& pos);
+    QImage renderVisibleLayers(); // widget sized, opaque
+
+    // Layer rasters. A layer can have pixels under its strokes, rasterizeLayer flattens the strokes
+    // into them (a Flatten entry). Filter brushes and whole-layer filters change those pixels and go
+    // into the history as Filter entries with no mesh; the pixels each one replaced are kept by entry
+    // id for undo and redo. Rasters are local, like layers, so neither kind is sent.
+    QHash<int, QImage> rasters; // layer id -> ARGB32 premultiplied, widget sized when made
+    struct RasterEdit {
+        int layerId = -1;
+        QRect rect;
+        QImage before;
+        QImage after;
+    };
+    QHash<quint64, RasterEdit> rasterEdits; // stroke id -> its pixels
+    RasterFilter rasterFilter;
+    FilterBrushSettings filterBrush;
+    QVector<StrokePoint> filterPoints; // the filter stroke being drawn
+    QImage filterBefore;  // its layer's raster as it started
+    QRect filterDirty;
+    QHash<int, int> vectorStarts; // BrushEngine::vectorStarts, updated with the VBOs
+    int filterStrokeLayer = -1; // -1 when no filter stroke is going on
+    void filterPress(QMouseEvent* event);
+    void filterMove(QMouseEvent* event);
+    void filterRelease(QMouseEvent* event);
+    void appendFilterPoint(const QPointF& pos);
+    void commitRasterEdit(int layerId, const QImage& before, const QRect& rect); // for the Filter or Flatten entry just added
+    void restoreRasterEdit(quint64 strokeId, bool undone);
+    void uploadRaster(int layerId, const QRect& rect); // texture, cache and damage
+    qint64 rasterBytes() const;
+
+    // Reference images, each on a layer of its own under that layer's strokes. The loader decodes
+    // and builds the mips off the GUI thread. Only the level matching the size the image is shown at
+    // goes to the GPU, a few tiles a frame, with the smallest level standing in until it is all there.
+    // Display only: fills, filters and exports don't see them, and they aren't synced.
+    struct ReferenceLayer {
+        std::shared_ptr<const ReferenceImage> image; // null while it is decoding
+        QRectF placement;     // widget coords
+        int shownLevel = -1;  // on the GPU in full
+        int streamLevel = -1; // going up
+        QVector<QRect> pending; // tiles of streamLevel still to upload
+    };
+    QHash<int, ReferenceLayer> references;
+    ReferenceLoader referenceLoader;
+    int referenceTilesPerFrame = 4;
+    void referenceLoaded(int layerId, std::shared_ptr<const ReferenceImage> image, const QString& error);
+    void streamReferences(); // picks the levels and queues this frame's tiles
+    void dropReferences(int layerId);
 
 public:  
     Canvas(QWidget* parent = nullptr); // Canvas class  
@@ -37,7 +198,64 @@ public:
     void undo();
     void redo();
     void setColor(const QColor& color); // Sets pen color 
-    void setBrushOptions(float min, float max, float s);
+    void setBrushOptions(float min, float max, float s); // thickness range, speed sensitivity 0-1
+    void setBrushDynamics(const DynamicsSettings& settings); // curves, see BrushDynamics::presets()
+    void setPredictionEnabled(bool enabled); // extrapolate a short tail ahead of the pen
+    void setSymmetry(SymmetryMode mode, int order = 2); // new strokes repeat, see Symmetry
+    void setTool(Tool tool);
+    void setBrush(int presetId); // see BrushEngine::presets()
+    void setFillSettings(const FloodFillSettings& settings) { fillSettings = settings; }
+    void setFilterBrush(const FilterBrushSettings& settings) { filterBrush = settings; }
+
+    // Layers
+    int addLayer();
+    void removeLayer(int id);
+    void moveLayer(int id, int delta);
+    void setActiveLayer(int id);
+    void setLayerVisible(int id, bool visible);
+    void setLayerOpacity(int id, float opacity);
+    void setLayerBlendMode(int id, BlendMode mode);
+    QVector<Layer> getLayers() const;
+    int getActiveLayer() const;
+    // Flattens the layer's strokes into its raster, one undoable step. The strokes stay in the document.
+    void rasterizeLayer(int id);
+    // FilterType::LayerGaussian, LayerBox or LayerSharpen over the layer's raster, rasterizing it first.
+    // strength is 0-1, for sharpen the amount / 4
+    void filterLayer(int id, FilterType filter, float radius, float strength);
+    // New layer showing the image, fitted to the canvas once decoded. Returns the layer id,
+    // referenceImported tells how loading went
+    int importReference(const QString& path);
+
+    // Export, format by suffix (.svg, .pdf)
+    Document getDocument(); // for DocumentFile and lancer-cli
+    bool exportVector(const QString& path, VectorExportStats& stats);
+    // Tiled TIFF at scale output pixels per canvas pixel, rendered out of core so any size fits.
+    // Works on a getDocument() copy only, so it can run on a worker thread; cancel and
+    // progress go to TiledCanvas::writeTiff
+    static bool exportRaster(const Document& document, const QString& path, qreal scale, TiledCanvasStats& stats,
+                             const std::atomic<bool>* cancel = nullptr,
+                             const std::function<void(int, int)>& progress = nullptr, QString* error = nullptr);
+    TimelapseDocument getTimelapseDocument(); // a copy to replay, the canvas stays editable
+
+    // Memory
+    const MemoryTracker& getMemoryTracker() const { return memoryTracker; }
+    void setMemoryLimits(qint64 cpuBytes, qint64 gpuBytes); // soft limits, 0 disables
+
+    // Sync, the client is owned by the caller
+    void setSyncClient(SyncClient* client);
+
+    bool isRenderThreaded() const { return renderThread != nullptr; }
+    FrameStats getFrameStats() const { return frameStats; }
+    const QualityController& getQuality() const { return quality; }
+    const FrameSchedulerStats& getSchedulerStats() const { return scheduler.getStats(); }
+    const FloodFillStats& getFillStats() { return floodFill.getStats(); }
+    const RasterFilterStats& getFilterStats() const { return rasterFilter.getStats(); }
+
+signals:
+    void layersChanged();
+    void memoryUsageChanged();
+    void firstFrameShown(); // once, after the first paint, deferred startup work hangs off it
+    void referenceImported(int layerId, bool ok, const QString& message);
 
 protected:  
     void initializeGL() override;
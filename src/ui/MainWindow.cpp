@@ -7,8 +7,22 @@
 #include <QPushButton>
 #include <QColorDialog>
 #include <iostream>
+#include <memory>
 #include <QLabel>
 #include <QTimer>
+#include <QButtonGroup>
+#include <QStatusBar>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QInputDialog>
+#include <QProgressDialog>
+#include <QSpinBox>
+#include <QApplication>
+#include <QFileInfo>
+#include <QMenu>
+#include "../core/StartupTrace.h"
+#include "../sync/SyncClient.h"
+#include "tools/TimelapsePlayer.h"
 
 MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
 {
@@ -31,10 +45,47 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
     });
 
 
-    QString lancerVersion = loadVersion();
-    setWindowTitle("Lancer: v" + lancerVersion);
+    // Version goes into the title once the canvas is up, see setupDeferredUI
+    setWindowTitle("Lancer");
     setMinimumSize(800, 800);
     setupUI();
+
+    // Queued so the first frame is on screen before anything else gets built
+    connect(canvas, &Canvas::firstFrameShown, this, &MainWindow::setupDeferredUI, Qt::QueuedConnection);
+    // The first frame never comes if GL fails to start, the panels still have to
+    QTimer::singleShot(2000, this, &MainWindow::setupDeferredUI);
+
+    exportPoll.setInterval(200);
+}
+
+MainWindow::~MainWindow()
+{
+    // A running export stops at its next tile, the partial file is thrown away
+    if (exportThread) {
+        exportCancel = true;
+        exportThread->wait();
+        delete exportThread;
+    }
+}
+
+void MainWindow::setupDeferredUI()
+{
+    if (layersPanel) return; // the fallback timer and the first frame both get here
+    setWindowTitle("Lancer: v" + loadVersion());
+
+    // Tabs that aren't visible at startup
+    layersPanel = new LayersPanel();
+    sidebarTabs->addTab(layersPanel, "Layers");
+
+    brushPanel = new BrushPanel();
+    sidebarTabs->addTab(brushPanel, "Brushes");
+
+    // You can add more tabs here in the future TODO
+
+    connectLayersPanel();
+
+    StartupTrace::mark("deferred UI built");
+    StartupTrace::report();
 }
 
 QString MainWindow::loadVersion()
@@ -97,11 +148,74 @@ void MainWindow::setupUI()
     QPushButton* clearButton = new QPushButton("Clear Canvas");
     QPushButton* undoButton = new QPushButton("Undo");
     QPushButton* redoButton = new QPushButton("Redo");
+    QPushButton* predictButton = new QPushButton("Prediction");
+    predictButton->setCheckable(true);
+    QPushButton* exportButton = new QPushButton("Export");
+    QPushButton* timelapseButton = new QPushButton("Timelapse");
+    QPushButton* referenceButton = new QPushButton("Reference");
+    referenceButton->setToolTip("Import an image to trace over, on a layer of its own");
+
+    // Tools, only one active at a time
+    QPushButton* brushButton = new QPushButton("Brush");
+    QPushButton* lassoButton = new QPushButton("Lasso");
+    QPushButton* rectSelectButton = new QPushButton("Select");
+    QPushButton* fillButton = new QPushButton("Fill");
+    QSpinBox* fillGapBox = new QSpinBox();
+    fillGapBox->setRange(0, 20);
+    fillGapBox->setSuffix(" px");
+    fillGapBox->setToolTip("Fill gap closing: gaps in the lines up to about twice this don't let the fill through");
+    QPushButton* blurButton = new QPushButton("Blur");
+    QPushButton* smudgeButton = new QPushButton("Smudge");
+    QPushButton* sharpenButton = new QPushButton("Sharpen");
+    QSpinBox* filterRadiusBox = new QSpinBox();
+    filterRadiusBox->setRange(2, 200);
+    filterRadiusBox->setValue(30);
+    filterRadiusBox->setSuffix(" px");
+    filterRadiusBox->setToolTip("Blur, smudge and sharpen brush radius. They work on pixels, the layer's strokes get rasterized first");
+    QPushButton* filterButton = new QPushButton("Filter");
+    QMenu* filterMenu = new QMenu(filterButton);
+    QAction* gaussianAction = filterMenu->addAction("Gaussian Blur...");
+    QAction* boxAction = filterMenu->addAction("Box Blur...");
+    QAction* sharpenAction = filterMenu->addAction("Sharpen...");
+    filterButton->setMenu(filterMenu);
+    QPushButton* symmetryButton = new QPushButton("Symmetry");
+    symmetryButton->setToolTip("New strokes repeat around the middle of the canvas");
+    QMenu* symmetryMenu = new QMenu(symmetryButton);
+    QAction* symmetryOffAction = symmetryMenu->addAction("Off");
+    QAction* mirrorAction = symmetryMenu->addAction("Mirror");
+    QAction* fourWayAction = symmetryMenu->addAction("4-Way Mirror");
+    QAction* radialAction = symmetryMenu->addAction("Radial...");
+    QAction* kaleidoscopeAction = symmetryMenu->addAction("Kaleidoscope...");
+    symmetryButton->setMenu(symmetryMenu);
+    lassoButton->setToolTip("Drag inside the selection to move, Shift+drag to scale, Ctrl+drag to rotate");
+    rectSelectButton->setToolTip(lassoButton->toolTip());
+    QButtonGroup* toolGroup = new QButtonGroup(this);
+    for (QPushButton* button : { brushButton, lassoButton, rectSelectButton, fillButton, blurButton, smudgeButton, sharpenButton }) {
+        button->setCheckable(true);
+        toolGroup->addButton(button);
+    }
+    brushButton->setChecked(true);
 
     toolLayout->addWidget(clearButton);
     toolLayout->addWidget(undoButton);
     toolLayout->addWidget(redoButton);
+    toolLayout->addWidget(predictButton);
+    toolLayout->addSpacing(12);
+    toolLayout->addWidget(brushButton);
+    toolLayout->addWidget(lassoButton);
+    toolLayout->addWidget(rectSelectButton);
+    toolLayout->addWidget(fillButton);
+    toolLayout->addWidget(fillGapBox);
+    toolLayout->addWidget(blurButton);
+    toolLayout->addWidget(smudgeButton);
+    toolLayout->addWidget(sharpenButton);
+    toolLayout->addWidget(filterRadiusBox);
+    toolLayout->addWidget(filterButton);
+    toolLayout->addWidget(symmetryButton);
     toolLayout->addStretch(); // Push buttons to left
+    toolLayout->addWidget(referenceButton);
+    toolLayout->addWidget(timelapseButton);
+    toolLayout->addWidget(exportButton);
 
     // Create canvas
     canvas = new Canvas(this);
@@ -110,6 +224,9 @@ void MainWindow::setupUI()
     mainLayout->addLayout(toolLayout);
     mainLayout->addWidget(canvas, 1); // Give canvas stretch factor of 1
 
+    setupStatusBar();
+    setupSync();
+
     mainSplitter->addWidget(leftSidebar);
     mainSplitter->addWidget(mainContent);
 
@@ -137,6 +254,173 @@ void MainWindow::setupUI()
     connect(redoButton, &QPushButton::clicked, [this]() {
         canvas->redo();
     });
+    connect(predictButton, &QPushButton::toggled, [this](bool checked) {
+        canvas->setPredictionEnabled(checked);
+    });
+    connect(brushButton, &QPushButton::clicked, [this]() { canvas->setTool(Tool::Brush); });
+    connect(lassoButton, &QPushButton::clicked, [this]() { canvas->setTool(Tool::Lasso); });
+    connect(rectSelectButton, &QPushButton::clicked, [this]() { canvas->setTool(Tool::RectSelect); });
+    connect(fillButton, &QPushButton::clicked, [this]() { canvas->setTool(Tool::Fill); });
+    connect(fillGapBox, QOverload<int>::of(&QSpinBox::valueChanged), [this](int gap) {
+        FloodFillSettings settings;
+        settings.gapClosing = gap;
+        canvas->setFillSettings(settings);
+    });
+    connect(blurButton, &QPushButton::clicked, [this]() { canvas->setTool(Tool::Blur); });
+    connect(smudgeButton, &QPushButton::clicked, [this]() { canvas->setTool(Tool::Smudge); });
+    connect(sharpenButton, &QPushButton::clicked, [this]() { canvas->setTool(Tool::Sharpen); });
+    connect(filterRadiusBox, QOverload<int>::of(&QSpinBox::valueChanged), [this](int radius) {
+        FilterBrushSettings settings;
+        settings.radius = radius;
+        canvas->setFilterBrush(settings);
+    });
+    connect(gaussianAction, &QAction::triggered, [this]() { filterActiveLayer(FilterType::LayerGaussian); });
+    connect(boxAction, &QAction::triggered, [this]() { filterActiveLayer(FilterType::LayerBox); });
+    connect(sharpenAction, &QAction::triggered, [this]() { filterActiveLayer(FilterType::LayerSharpen); });
+    connect(symmetryOffAction, &QAction::triggered, [this, symmetryButton]() {
+        canvas->setSymmetry(SymmetryMode::None);
+        symmetryButton->setText("Symmetry");
+    });
+    connect(mirrorAction, &QAction::triggered, [this, symmetryButton]() {
+        canvas->setSymmetry(SymmetryMode::Mirror);
+        symmetryButton->setText("Mirror");
+    });
+    connect(fourWayAction, &QAction::triggered, [this, symmetryButton]() {
+        canvas->setSymmetry(SymmetryMode::Kaleidoscope, 2);
+        symmetryButton->setText("4-Way");
+    });
+    for (QAction* action : { radialAction, kaleidoscopeAction }) {
+        const bool mirrored = action == kaleidoscopeAction;
+        connect(action, &QAction::triggered, [this, symmetryButton, mirrored]() {
+            bool ok = false;
+            const int order = QInputDialog::getInt(this, mirrored ? "Kaleidoscope" : "Radial Symmetry", "Spokes:",
+                                                   6, 2, Symmetry::maxOrder, 1, &ok);
+            if (!ok) return;
+            canvas->setSymmetry(mirrored ? SymmetryMode::Kaleidoscope : SymmetryMode::Radial, order);
+            symmetryButton->setText((mirrored ? "Kaleidoscope " : "Radial ") + QString::number(order));
+        });
+    }
+    connect(exportButton, &QPushButton::clicked, this, &MainWindow::exportDocument);
+    connect(referenceButton, &QPushButton::clicked, [this]() {
+        const QString path = QFileDialog::getOpenFileName(this, "Import Reference", QString(),
+                                                          "Images (*.png *.jpg *.jpeg *.bmp *.tif *.tiff *.webp)");
+        if (path.isEmpty()) return;
+        canvas->importReference(path);
+        statusBar()->showMessage("Loading " + QFileInfo(path).fileName() + "...");
+    });
+    connect(canvas, &Canvas::referenceImported, [this](int, bool ok, const QString& message) {
+        statusBar()->showMessage((ok ? "Reference loaded, " : "Could not load reference: ") + message, 5000);
+    });
+    connect(timelapseButton, &QPushButton::clicked, [this]() {
+        // Plays a snapshot, drawing can go on while it is open
+        TimelapsePlayer* player = new TimelapsePlayer(canvas->getTimelapseDocument(), this);
+        player->setAttribute(Qt::WA_DeleteOnClose);
+        player->show();
+    });
+}
+
+void MainWindow::filterActiveLayer(FilterType filter)
+{
+    bool ok = false;
+    const double radius = QInputDialog::getDouble(this, "Filter", "Radius (px):", 8.0, 0.5, 250.0, 1, &ok);
+    if (!ok) return;
+    double strength = 1.0;
+    if (filter == FilterType::LayerSharpen) {
+        strength = QInputDialog::getDouble(this, "Filter", "Amount:", 1.0, 0.0, 4.0, 2, &ok) / 4.0;
+        if (!ok) return;
+    }
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    canvas->filterLayer(canvas->getActiveLayer(), filter, radius, strength);
+    QApplication::restoreOverrideCursor();
+    const RasterFilterStats& stats = canvas->getFilterStats();
+    statusBar()->showMessage(QString("Filtered %1 tiles on %2 threads in %3 ms")
+                             .arg(stats.tiles).arg(stats.threads).arg(qRound(stats.ms)), 5000);
+}
+
+void MainWindow::exportDocument()
+{
+    QString path = QFileDialog::getSaveFileName(this, "Export", QString(), "SVG (*.svg);;PDF (*.pdf);;TIFF (*.tif *.tiff);;Lancer document (*.lancer)");
+    if (path.isEmpty()) return;
+
+    const QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == DocumentFile::suffix) {
+        QString error;
+        if (!DocumentFile::save(path, canvas->getDocument(), &error)) {
+            QMessageBox::warning(this, "Export", "Could not save " + path + ": " + error);
+            return;
+        }
+        statusBar()->showMessage("Saved " + QFileInfo(path).fileName() + ", render it with lancer-cli", 5000);
+        return;
+    }
+    if (suffix == "tif" || suffix == "tiff") {
+        bool ok = false;
+        const double scale = QInputDialog::getDouble(this, "Export", "Pixels per canvas pixel:", 4.0, 0.1, 1000.0, 1, &ok);
+        if (!ok) return;
+
+        exportRaster(path, scale);
+        return;
+    }
+
+    VectorExportStats stats;
+    if (!canvas->exportVector(path, stats)) {
+        QMessageBox::warning(this, "Export", "Could not export to " + path);
+        return;
+    }
+    statusBar()->showMessage(QString("Exported %1 strokes, %2 KB in %3 ms")
+                             .arg(stats.strokes).arg(stats.bytes / 1024).arg(stats.elapsedMs), 5000);
+}
+
+void MainWindow::exportRaster(const QString& path, qreal scale)
+{
+    if (exportThread) {
+        QMessageBox::information(this, "Export", "A TIFF export is still running");
+        return;
+    }
+
+    exportCancel = false;
+    exportDone = 0;
+    exportTotal = 0;
+
+    // The canvas stays editable, the thread renders its own copy. Results go through the
+    // shared pointers, read once the thread has finished
+    const Document document = canvas->getDocument();
+    auto stats = std::make_shared<TiledCanvasStats>();
+    auto error = std::make_shared<QString>();
+    exportThread = QThread::create([this, document, path, scale, stats, error]() {
+        Canvas::exportRaster(document, path, scale, *stats, &exportCancel, [this](int done, int total) {
+            exportDone = done;
+            exportTotal = total;
+        }, error.get());
+    });
+
+    QProgressDialog* progress = new QProgressDialog("Exporting " + QFileInfo(path).fileName() + "...", "Cancel", 0, 100, this);
+    progress->setWindowModality(Qt::WindowModal);
+    progress->setMinimumDuration(500);
+    progress->setAutoClose(false);
+    progress->setAutoReset(false);
+    connect(progress, &QProgressDialog::canceled, this, [this]() { exportCancel = true; });
+
+    connect(&exportPoll, &QTimer::timeout, progress, [this, progress]() {
+        const int total = exportTotal.load();
+        if (total > 0) progress->setValue(static_cast<int>(100ll * exportDone.load() / total));
+    });
+
+    connect(exportThread, &QThread::finished, this, [this, path, progress, stats, error]() {
+        exportPoll.stop();
+        progress->deleteLater();
+        exportThread->deleteLater();
+        exportThread = nullptr;
+        if (!error->isEmpty()) {
+            if (!exportCancel) QMessageBox::warning(this, "Export", "Could not export to " + path + ": " + *error);
+            return;
+        }
+        statusBar()->showMessage(QString("Exported %1 tiles, %2 drawn in %3 ms")
+                                 .arg(stats->tiles.tiles).arg(stats->rasterized).arg(qRound(stats->rasterMs)), 5000);
+    });
+
+    exportPoll.start();
+    exportThread->start();
 }
 
 void MainWindow::setupLeftSidebar()
@@ -206,16 +490,86 @@ void MainWindow::setupLeftSidebar()
                                         ).arg(color.name()));
     });
 
-    // Add color tab to tab widget
+    // Add color tab to tab widget, the other tabs are added in setupDeferredUI
     sidebarTabs->addTab(colorTab, "Colors");
 
-    // You can add more tabs here in the future TODO
-    // sidebarTabs->addTab(brushTab, "Brushes");
-    // sidebarTabs->addTab(layersTab, "Layers");
-
     sidebarLayout->addWidget(sidebarTabs);
 }
 
+void MainWindow::connectLayersPanel()
+{
+    connect(layersPanel, &LayersPanel::addRequested, [this]() { canvas->addLayer(); });
+    connect(layersPanel, &LayersPanel::removeRequested, canvas, &Canvas::removeLayer);
+    connect(layersPanel, &LayersPanel::moveRequested, canvas, &Canvas::moveLayer);
+    connect(layersPanel, &LayersPanel::activeLayerChanged, canvas, &Canvas::setActiveLayer);
+    connect(layersPanel, &LayersPanel::visibilityChanged, canvas, &Canvas::setLayerVisible);
+    connect(layersPanel, &LayersPanel::opacityChanged, canvas, &Canvas::setLayerOpacity);
+    connect(layersPanel, &LayersPanel::blendModeChanged, canvas, &Canvas::setLayerBlendMode);
+
+    connect(canvas, &Canvas::layersChanged, [this]() {
+        layersPanel->setLayers(canvas->getLayers(), canvas->getActiveLayer());
+    });
+    layersPanel->setLayers(canvas->getLayers(), canvas->getActiveLayer());
+
+    connect(brushPanel, &BrushPanel::brushChanged, canvas, &Canvas::setBrush);
+    connect(brushPanel, &BrushPanel::dynamicsChanged, canvas, &Canvas::setBrushDynamics);
+    connect(brushPanel, &BrushPanel::brushOptionsChanged, canvas, &Canvas::setBrushOptions);
+}
+
+void MainWindow::setupStatusBar()
+{
+    // Memory use per subsystem, the tooltip has the breakdown
+    memoryLabel = new QLabel();
+    statusBar()->addPermanentWidget(memoryLabel);
+
+    connect(canvas, &Canvas::memoryUsageChanged, [this]() {
+        const MemoryTracker& tracker = canvas->getMemoryTracker();
+        memoryLabel->setText(tracker.summary());
+        memoryLabel->setToolTip(tracker.details());
+    });
+}
+
+void MainWindow::setupSync()
+{
+    // LANCER_RELAY=host:port joins a shared canvas, see lancer-relay
+    const QString relay = qEnvironmentVariable("LANCER_RELAY");
+    if (relay.isEmpty()) return;
+
+    const int colon = relay.lastIndexOf(':');
+    const QString host = colon > 0 ? relay.left(colon) : relay;
+    bool ok = false;
+    const quint16 port = colon > 0 ? relay.mid(colon + 1).toUShort(&ok) : 0;
+    if (!ok) {
+        qWarning() << "LANCER_RELAY should be host:port, got" << relay;
+        return;
+    }
+
+    syncClient = new SyncClient(this);
+    canvas->setSyncClient(syncClient);
+
+    syncLabel = new QLabel(tr("Sync: connecting"));
+    statusBar()->addPermanentWidget(syncLabel);
+
+    connect(syncClient, &SyncClient::connectedToRelay, this, [this](quint32 id) {
+        syncLabel->setText(tr("Sync: client %1").arg(id));
+    });
+    connect(syncClient, &SyncClient::disconnectedFromRelay, this, [this]() {
+        syncLabel->setText(tr("Sync: offline"));
+    });
+    connect(syncClient, &SyncClient::statsChanged, this, [this]() {
+        const SyncStats& stats = syncClient->getStats();
+        syncLabel->setText(tr("Sync: %1 B/stroke, ink %2 ms")
+                           .arg(stats.bytesPerStroke(), 0, 'f', 0)
+                           .arg(stats.meanInkLatencyMs, 0, 'f', 1));
+        syncLabel->setToolTip(tr("Sent %1 B in %2 ops, received %3 B in %4 ops, worst ink latency %5 ms")
+                              .arg(stats.bytesSent).arg(stats.opsSent)
+                              .arg(stats.bytesReceived).arg(stats.opsReceived)
+                              .arg(stats.maxInkLatencyMs));
+    });
+
+    syncClient->connectToRelay(host, port);
+}
+
 void MainWindow::onColorChanged(const QColor& color)
 {
     canvas->setColor(color);
@@ -3,9 +3,17 @@
 
 #include <QMainWindow>
 #include <QSplitter>
+#include <QLabel>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
 #include "tools/HSVColorPicker.h"
+#include "tools/LayersPanel.h"
+#include "tools/BrushPanel.h"
+#include "../data/EntryKind.h"
 
 class Canvas;
+class SyncClient;
 
 class MainWindow : public QMainWindow
 {
@@ -13,6 +21,7 @@ class MainWindow : public QMainWindow
 
 public:
     explicit MainWindow(QWidget* parent = nullptr);
+    ~MainWindow();
 
 private slots:
     void onColorChanged(const QColor& color);
@@ -20,13 +29,32 @@ private slots:
 private:
     Canvas* canvas;
     HSVColorPicker* colorPicker;
+    LayersPanel* layersPanel = nullptr; // created after the first frame
+    BrushPanel* brushPanel = nullptr;
     QWidget* leftSidebar;
     QTabWidget* sidebarTabs;
     QSplitter* mainSplitter;
+    QLabel* memoryLabel;
+    QLabel* syncLabel = nullptr;
+    SyncClient* syncClient = nullptr; // only with LANCER_RELAY set
+
+    // TIFF export, runs on its own thread over a copy of the document
+    QThread* exportThread = nullptr;
+    std::atomic<bool> exportCancel{ false };
+    std::atomic<int> exportDone{ 0 };
+    std::atomic<int> exportTotal{ 0 };
+    QTimer exportPoll;
 
     QString loadVersion();
     void setupUI();
     void setupLeftSidebar();
+    void connectLayersPanel();
+    void setupStatusBar();
+    void setupSync();
+    void setupDeferredUI();
+    void exportDocument();
+    void exportRaster(const QString& path, qreal scale);
+    void filterActiveLayer(FilterType filter); // the whole-layer ones, asks for the settings
 };
 
 #endif // MAINWINDOW_H
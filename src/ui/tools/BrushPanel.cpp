@@ -0,0 +1,123 @@
+#include "BrushPanel.h"
+#include "../../core/BrushEngine.h"
+#include <QVBoxLayout>
+#include <QFormLayout>
+#include <QLabel>
+
+namespace {
+constexpr float sliderScale = 10.0f; // size sliders in 0.1 px steps
+}
+
+BrushPanel::BrushPanel(QWidget* parent)
+    : QWidget(parent)
+{
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(5, 5, 5, 5);
+
+    QLabel* title = new QLabel("Brushes");
+    title->setStyleSheet("QLabel { font-weight: bold; font-size: 14px; color: #333; }");
+    title->setAlignment(Qt::AlignCenter);
+    layout->addWidget(title);
+
+    brushList = new QListWidget();
+    for (const BrushSettings& brush : BrushEngine::presets()) {
+        brushList->addItem(brush.name);
+    }
+    brushList->setCurrentRow(0);
+    layout->addWidget(brushList, 1);
+
+    connect(brushList, &QListWidget::currentRowChanged, [this](int row) {
+        if (row >= 0) emit brushChanged(row);
+    });
+
+    // Dynamics
+    QLabel* dynamicsTitle = new QLabel("Dynamics");
+    dynamicsTitle->setStyleSheet(title->styleSheet());
+    dynamicsTitle->setAlignment(Qt::AlignCenter);
+    layout->addWidget(dynamicsTitle);
+
+    dynamics = BrushDynamics::presets().first();
+
+    dynamicsPresets = new QComboBox();
+    for (const DynamicsSettings& preset : BrushDynamics::presets()) {
+        dynamicsPresets->addItem(preset.name);
+    }
+    layout->addWidget(dynamicsPresets);
+
+    curveSelect = new QComboBox();
+    curveSelect->addItems({ "Pressure → Size", "Pressure → Opacity", "Speed → Size" });
+    layout->addWidget(curveSelect);
+
+    curveEditor = new CurveEditor();
+    layout->addWidget(curveEditor);
+
+    auto makeSlider = [](int min, int max, int value) {
+        QSlider* slider = new QSlider(Qt::Horizontal);
+        slider->setRange(min, max);
+        slider->setValue(value);
+        return slider;
+    };
+    minSizeSlider = makeSlider(1, 100, qRound(dynamics.minThickness * sliderScale));
+    maxSizeSlider = makeSlider(1, 100, qRound(dynamics.maxThickness * sliderScale));
+    speedSlider = makeSlider(0, 100, qRound(dynamics.speedSensitivity * 100.0f));
+
+    QFormLayout* sliders = new QFormLayout();
+    sliders->addRow("Min size", minSizeSlider);
+    sliders->addRow("Max size", maxSizeSlider);
+    sliders->addRow("Speed", speedSlider);
+    layout->addLayout(sliders);
+
+    showSelectedCurve();
+
+    connect(dynamicsPresets, &QComboBox::currentIndexChanged, [this](int index) {
+        if (index < 0) return;
+        // The size range is the user's, presets only bring curves and speed sensitivity
+        const float minThickness = dynamics.minThickness;
+        const float maxThickness = dynamics.maxThickness;
+        dynamics = BrushDynamics::presets()[index];
+        dynamics.minThickness = minThickness;
+        dynamics.maxThickness = maxThickness;
+
+        speedSlider->blockSignals(true);
+        speedSlider->setValue(qRound(dynamics.speedSensitivity * 100.0f));
+        speedSlider->blockSignals(false);
+        showSelectedCurve();
+        emit dynamicsChanged(dynamics);
+    });
+    connect(curveSelect, &QComboBox::currentIndexChanged, [this](int) { showSelectedCurve(); });
+    connect(curveEditor, &CurveEditor::curveChanged, [this](const DynamicsCurve& curve) {
+        *selectedCurve() = curve;
+        emit dynamicsChanged(dynamics); // rebakes the tables, cheap enough to do per drag step
+    });
+
+    connect(minSizeSlider, &QSlider::valueChanged, [this](int value) {
+        if (maxSizeSlider->value() < value) maxSizeSlider->setValue(value);
+        emitBrushOptions();
+    });
+    connect(maxSizeSlider, &QSlider::valueChanged, [this](int value) {
+        if (minSizeSlider->value() > value) minSizeSlider->setValue(value);
+        emitBrushOptions();
+    });
+    connect(speedSlider, &QSlider::valueChanged, [this](int) { emitBrushOptions(); });
+}
+
+DynamicsCurve* BrushPanel::selectedCurve() {
+    switch (curveSelect->currentIndex()) {
+    case 1: return &dynamics.pressureOpacity;
+    case 2: return &dynamics.speedSize;
+    default: return &dynamics.pressureSize;
+    }
+}
+
+void BrushPanel::showSelectedCurve() {
+    curveEditor->setCurve(*selectedCurve());
+    curveEditor->setAxisLabels(curveSelect->currentIndex() == 2 ? "speed" : "pressure",
+                               curveSelect->currentIndex() == 1 ? "opacity" : "size");
+}
+
+void BrushPanel::emitBrushOptions() {
+    dynamics.minThickness = minSizeSlider->value() / sliderScale;
+    dynamics.maxThickness = maxSizeSlider->value() / sliderScale;
+    dynamics.speedSensitivity = speedSlider->value() / 100.0f;
+    emit brushOptionsChanged(dynamics.minThickness, dynamics.maxThickness, dynamics.speedSensitivity);
+}
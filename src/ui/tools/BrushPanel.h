@@ -0,0 +1,42 @@
+#ifndef BRUSHPANEL_H
+#define BRUSHPANEL_H
+
+#include <QWidget>
+#include <QListWidget>
+#include <QComboBox>
+#include <QSlider>
+#include "CurveEditor.h"
+#include "../../core/BrushDynamics.h"
+
+// Lists the brush presets, the selected row index is the preset id.
+// Below it the dynamics: a curve preset, one editor for the curve picked in the combo box,
+// and the size range / speed sliders.
+class BrushPanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit BrushPanel(QWidget* parent = nullptr);
+
+signals:
+    void brushChanged(int presetId);
+    void dynamicsChanged(const DynamicsSettings& settings);
+    void brushOptionsChanged(float minThickness, float maxThickness, float speedSensitivity);
+
+private:
+    QListWidget* brushList;
+    QComboBox* dynamicsPresets;
+    QComboBox* curveSelect;
+    CurveEditor* curveEditor;
+    QSlider* minSizeSlider;
+    QSlider* maxSizeSlider;
+    QSlider* speedSlider;
+
+    DynamicsSettings dynamics;
+
+    DynamicsCurve* selectedCurve();
+    void showSelectedCurve();
+    void emitBrushOptions();
+};
+
+#endif // BRUSHPANEL_H
@@ -0,0 +1,156 @@
+#include "CurveEditor.h"
+#include <QPainter>
+#include <QPainterPath>
+#include <algorithm>
+
+namespace {
+constexpr qreal margin = 8.0;
+constexpr qreal handleRadius = 4.0;
+constexpr qreal minGap = 0.02; // keeps neighbouring points from sharing an x
+}
+
+CurveEditor::CurveEditor(QWidget* parent)
+    : QWidget(parent)
+{
+    curve = DynamicsCurve::linear();
+    setMinimumSize(120, 100);
+}
+
+void CurveEditor::setCurve(const DynamicsCurve& value) {
+    curve = value;
+    dragIndex = -1;
+    update();
+}
+
+void CurveEditor::setAxisLabels(const QString& x, const QString& y) {
+    xLabel = x;
+    yLabel = y;
+    update();
+}
+
+QRectF CurveEditor::plotRect() const {
+    return QRectF(rect()).adjusted(margin, margin, -margin, -margin);
+}
+
+QPointF CurveEditor::toWidget(const QPointF& point) const {
+    QRectF r = plotRect();
+    return QPointF(r.left() + point.x() * r.width(), r.bottom() - point.y() * r.height());
+}
+
+QPointF CurveEditor::toCurve(const QPointF& pos) const {
+    QRectF r = plotRect();
+    return QPointF(std::clamp((pos.x() - r.left()) / r.width(), 0.0, 1.0),
+                   std::clamp((r.bottom() - pos.y()) / r.height(), 0.0, 1.0));
+}
+
+int CurveEditor::pointAt(const QPointF& pos) const {
+    for (int i = 0; i < curve.points.size(); ++i) {
+        QPointF d = toWidget(curve.points[i]) - pos;
+        if (QPointF::dotProduct(d, d) <= (handleRadius + 3) * (handleRadius + 3)) return i;
+    }
+    return -1;
+}
+
+void CurveEditor::movePoint(int index, const QPointF& pos) {
+    QPointF p = toCurve(pos);
+    const int last = curve.points.size() - 1;
+    if (index == 0) {
+        p.setX(0.0);
+    }
+    else if (index == last) {
+        p.setX(1.0);
+    }
+    else {
+        // Stay between the neighbours so the points remain sorted
+        p.setX(std::clamp(p.x(), curve.points[index - 1].x() + minGap, curve.points[index + 1].x() - minGap));
+    }
+    curve.points[index] = p;
+}
+
+void CurveEditor::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    painter.setRenderHint(QPainter::Antialiasing);
+
+    const QRectF r = plotRect();
+    painter.fillRect(rect(), QColor(250, 250, 250));
+    painter.setPen(QColor(225, 225, 225));
+    for (int i = 1; i < 4; ++i) {
+        qreal x = r.left() + r.width() * i / 4;
+        qreal y = r.top() + r.height() * i / 4;
+        painter.drawLine(QPointF(x, r.top()), QPointF(x, r.bottom()));
+        painter.drawLine(QPointF(r.left(), y), QPointF(r.right(), y));
+    }
+    painter.setPen(QColor(180, 180, 180));
+    painter.drawRect(r);
+
+    painter.setPen(QColor(140, 140, 140));
+    QFont font = painter.font();
+    font.setPointSizeF(font.pointSizeF() * 0.85);
+    painter.setFont(font);
+    painter.drawText(r.adjusted(4, 0, -4, -2), Qt::AlignRight | Qt::AlignBottom, xLabel);
+    painter.drawText(r.adjusted(4, 2, -4, 0), Qt::AlignLeft | Qt::AlignTop, yLabel);
+
+    // Sampled once per pixel column, same evaluation the lookup tables are baked from
+    QPainterPath path;
+    const int steps = std::max(2, static_cast<int>(r.width()));
+    for (int i = 0; i <= steps; ++i) {
+        float x = static_cast<float>(i) / steps;
+        QPointF p = toWidget(QPointF(x, curve.evaluate(x)));
+        if (i == 0) path.moveTo(p);
+        else path.lineTo(p);
+    }
+    painter.setPen(QPen(QColor(40, 110, 200), 2.0));
+    painter.drawPath(path);
+
+    painter.setPen(QPen(QColor(40, 110, 200), 1.5));
+    for (int i = 0; i < curve.points.size(); ++i) {
+        painter.setBrush(i == dragIndex ? QColor(40, 110, 200) : QColor(Qt::white));
+        painter.drawEllipse(toWidget(curve.points[i]), handleRadius, handleRadius);
+    }
+}
+
+void CurveEditor::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton) return;
+
+    const QPointF pos = event->position();
+    dragIndex = pointAt(pos);
+    if (dragIndex < 0) {
+        // New point, between the two it falls between
+        QPointF p = toCurve(pos);
+        auto it = std::upper_bound(curve.points.begin(), curve.points.end(), p.x(),
+                                   [](double x, const QPointF& point) { return x < point.x(); });
+        int index = static_cast<int>(it - curve.points.begin());
+        if (index == 0 || index == curve.points.size()) return; // left of the first / right of the last
+        curve.points.insert(index, p);
+        dragIndex = index;
+        movePoint(dragIndex, pos);
+        emit curveChanged(curve);
+    }
+    update();
+}
+
+void CurveEditor::mouseMoveEvent(QMouseEvent* event)
+{
+    if (dragIndex < 0) return;
+    movePoint(dragIndex, event->position());
+    emit curveChanged(curve);
+    update();
+}
+
+void CurveEditor::mouseReleaseEvent(QMouseEvent*)
+{
+    dragIndex = -1;
+    update();
+}
+
+void CurveEditor::mouseDoubleClickEvent(QMouseEvent* event)
+{
+    int index = pointAt(event->position());
+    if (index <= 0 || index >= curve.points.size() - 1) return; // the ends stay
+    curve.points.removeAt(index);
+    dragIndex = -1;
+    emit curveChanged(curve);
+    update();
+}
@@ -0,0 +1,47 @@
+#ifndef CURVEEDITOR_H
+#define CURVEEDITOR_H
+
+#include <QWidget>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include "../../core/BrushDynamics.h"
+
+// Edits one dynamics curve. Drag points to move them, click empty space to add one,
+// double click a point to remove it. The end points only move up and down.
+class CurveEditor : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit CurveEditor(QWidget* parent = nullptr);
+
+    void setCurve(const DynamicsCurve& curve);
+    const DynamicsCurve& getCurve() const { return curve; }
+    void setAxisLabels(const QString& x, const QString& y);
+
+    QSize sizeHint() const override { return QSize(180, 140); }
+
+signals:
+    void curveChanged(const DynamicsCurve& curve);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+    void mouseDoubleClickEvent(QMouseEvent* event) override;
+
+private:
+    DynamicsCurve curve;
+    int dragIndex = -1;
+    QString xLabel;
+    QString yLabel;
+
+    QRectF plotRect() const;
+    QPointF toWidget(const QPointF& point) const;
+    QPointF toCurve(const QPointF& pos) const; // clamped to 0..1
+    int pointAt(const QPointF& pos) const;     // -1 if none is close
+    void movePoint(int index, const QPointF& pos);
+};
+
+#endif // CURVEEDITOR_H
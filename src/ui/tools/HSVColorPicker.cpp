@@ -1,8 +1,12 @@
 #include "HSVColorPicker.h"
+#include "../../core/math/ColorSpaceQt.h"
 #include <QResizeEvent>
 #include <QPainterPath>
 #include <QtMath>
 #include <algorithm>
+#include <limits>
+#include <vector>
+
 
 HSVColorPicker::HSVColorPicker(QWidget* parent)
     : QWidget(parent)
@@ -25,6 +29,12 @@ void HSVColorPicker::setCurrentColor(const QColor& color) {
     update();
 }
 
+void HSVColorPicker::invalidateCaches() {
+    wheelCache = QImage();
+    triangleCache = QImage();
+    triangleCacheHue = -1.0f;
+}
+
 void HSVColorPicker::calculateGeometry() {
     int size = std::min(width(), height());
     center = QPointF(0.5f * width(), 0.5f * height());
@@ -59,18 +69,44 @@ void HSVColorPicker::paintEvent(QPaintEvent* event)
 
 void HSVColorPicker::drawColorWheel(QPainter& painter)
 {
-    // Draw color wheel
-    for (int i = 0; i < 360; ++i) {
-        float angle = qDegreesToRadians(i - 90);
-        QColor wheelColor = hsvToRgb(i, 1.0f, 1.0f);
+    if (wheelCache.isNull() || wheelCache.devicePixelRatio() != devicePixelRatioF()) {
+        rebuildWheelCache();
+    }
+    painter.drawImage(QPointF(0, 0), wheelCache);
+}
+
+void HSVColorPicker::rebuildWheelCache()
+{
+    const qreal dpr = devicePixelRatioF();
+    wheelCache = QImage(size() * dpr, QImage::Format_ARGB32_Premultiplied);
+    wheelCache.setDevicePixelRatio(dpr);
+    wheelCache.fill(Qt::transparent);
+
+    // Only the ring's bounding box has anything in it
+    const int first = std::max(0, static_cast<int>((center.y() - outerRadius) * dpr) - 1);
+    const int last = std::min(wheelCache.height(), static_cast<int>((center.y() + outerRadius) * dpr) + 2);
+
+    // Per row hue and coverage go into arrays, the conversion runs as one batch
+    const int width = wheelCache.width();
+    std::vector<float> hues(width), coverage(width), ones(width, 1.0f);
+
+    for (int py = first; py < last; ++py) {
+        const float y = (py + 0.5f) / dpr - center.y();
 
-        QPen pen(wheelColor, 2.0f);
-        painter.setPen(pen);
+        for (int px = 0; px < width; ++px) {
+            const float x = (px + 0.5f) / dpr - center.x();
+            const float d = std::sqrt(x * x + y * y);
 
-        QPointF innerPoint = center + QPointF(innerRadius * cos(angle), innerRadius * sin(angle));
-        QPointF outerPoint = center + QPointF(outerRadius * cos(angle), outerRadius * sin(angle));
+            // One device pixel of antialiasing on both edges of the ring
+            coverage[px] = std::clamp(std::min(d - innerRadius, outerRadius - d) * dpr + 0.5f, 0.0f, 1.0f);
 
-        painter.drawLine(innerPoint, outerPoint);
+            // Same orientation as getAngleFromPoint, red at the top going clockwise
+            float hue = qRadiansToDegrees(std::atan2(y, x)) + 90.0f;
+            hues[px] = hue < 0.0f ? hue + 360.0f : hue;
+        }
+
+        QRgb* row = reinterpret_cast<QRgb*>(wheelCache.scanLine(py));
+        ColorSpace::hsvToPremultipliedRGBA8(hues.data(), ones.data(), ones.data(), coverage.data(), row, width);
     }
 }
 
@@ -84,65 +120,124 @@ float HSVColorPicker::getAngleFromPoint(const QPointF& point)
 }
 
 QColor HSVColorPicker::hsvToRgb(float h, float s, float v){
-    QColor color;
-    color.setHsvF(h / 360.0f, s, v);
-    return color;
+    RGBf rgb = ColorSpace::hsvToRgb(h, s, v);
+    return QColor::fromRgbF(rgb.r, rgb.g, rgb.b);
 }
 
 void HSVColorPicker::rgbToHsv(const QColor& rgb, float& h, float& s, float& v)
 {
-    h = rgb.hsvHueF() * 360.0f;
-    s = rgb.hsvSaturationF();
-    v = rgb.valueF();
-    if (h < 0) h = 0; // Handle undefined hue
+    HSVf hsv = ColorSpace::rgbToHsv(ColorSpace::fromQColor(rgb)); // hue is 0 when undefined
+    h = hsv.h;
+    s = hsv.s;
+    v = hsv.v;
 }
 
 void HSVColorPicker::drawHSVTriangle(QPainter& painter)
 {
-    // Create triangle path for clipping
+    // Create triangle path for the outline
     QPainterPath trianglePath;
     trianglePath.moveTo(triangleVertices[0]);
     trianglePath.lineTo(triangleVertices[1]);
     trianglePath.lineTo(triangleVertices[2]);
     trianglePath.closeSubpath();
 
-    // Create a QImage for pixel-perfect rendering with proper alpha support
-    QRect triangleBounds = trianglePath.boundingRect().toRect();
-    triangleBounds = triangleBounds.intersected(rect()); // Clip to widget bounds
-
-    if (triangleBounds.isEmpty()) return;
+    // Only rebuilt when the hue or the size changed
+    if (triangleCache.isNull() || triangleCacheHue != currentHue || triangleCache.devicePixelRatio() != devicePixelRatioF()) {
+        rebuildTriangleCache();
+    }
+    if (!triangleCache.isNull()) {
+        painter.drawImage(triangleCacheRect.topLeft(), triangleCache);
+    }
 
-    // Use Format_ARGB32 for proper alpha channel support
-    QImage triangleImage(triangleBounds.size(), QImage::Format_ARGB32);
-    triangleImage.fill(Qt::transparent); // Fill with transparent background
+    // Draw triangle outline
+    painter.setPen(QPen(Qt::black, 2));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawPath(trianglePath);
+}
 
-    // Fill the image pixel by pixel
-    for (int y = 0; y < triangleImage.height(); ++y) {
-        for (int x = 0; x < triangleImage.width(); ++x) {
-            QPointF pixelPoint = triangleBounds.topLeft() + QPointF(x, y);
+void HSVColorPicker::rebuildTriangleCache()
+{
+    triangleCacheHue = currentHue;
 
-            if (isPointInTriangle(pixelPoint)) {
-                // Get saturation and value from triangle coordinates
-                auto [saturation, value] = getSVFromTrianglePoint(pixelPoint);
+    QPolygonF triangle;
+    triangle << triangleVertices[0] << triangleVertices[1] << triangleVertices[2];
+    triangleCacheRect = triangle.boundingRect().toAlignedRect().intersected(rect()); // Clip to widget bounds
 
-                // Clamp values to valid range
-                saturation = std::clamp(saturation, 0.0f, 1.0f);
-                value = std::clamp(value, 0.0f, 1.0f);
+    if (triangleCacheRect.isEmpty()) {
+        triangleCache = QImage();
+        return;
+    }
 
-                QColor pixelColor = QColor::fromHsvF(currentHue / 360.0f, saturation, value);
-                triangleImage.setPixelColor(x, y, pixelColor);
-            }
-            // Pixels outside triangle remain transparent (no need to set them)
+    const qreal dpr = devicePixelRatioF();
+    triangleCache = QImage(triangleCacheRect.size() * dpr, QImage::Format_ARGB32_Premultiplied);
+    triangleCache.setDevicePixelRatio(dpr);
+    triangleCache.fill(Qt::transparent);
+
+    // Barycentric weights are linear in the pixel position (same math as getSVFromTrianglePoint),
+    // so along a scanline they are just a start value plus a constant step
+    const QPointF white = triangleVertices[0];
+    const QPointF v0 = triangleVertices[2] - white; // pure - white
+    const QPointF v1 = triangleVertices[1] - white; // black - white
+    const float dot00 = QPointF::dotProduct(v0, v0);
+    const float dot01 = QPointF::dotProduct(v0, v1);
+    const float dot11 = QPointF::dotProduct(v1, v1);
+    const float invDenom = 1.0f / (dot00 * dot11 - dot01 * dot01);
+    const QPointF pureAxis = (dot11 * v0 - dot01 * v1) * invDenom;  // u = pureAxis . (p - white)
+    const QPointF blackAxis = (dot00 * v1 - dot01 * v0) * invDenom; // v = blackAxis . (p - white)
+
+    const float step = 1.0f / dpr;
+    std::vector<float> hues(triangleCache.width(), currentHue), saturations(triangleCache.width()), values(triangleCache.width());
+    const float duStep = pureAxis.x() * step;
+    const float dvStep = blackAxis.x() * step;
+
+    for (int py = 0; py < triangleCache.height(); ++py) {
+        const float y = triangleCacheRect.top() + (py + 0.5f) / dpr;
+
+        // Where this scanline enters and leaves the triangle
+        float xMin = std::numeric_limits<float>::max();
+        float xMax = std::numeric_limits<float>::lowest();
+        for (int e = 0; e < 3; ++e) {
+            const QPointF& a = triangleVertices[e];
+            const QPointF& b = triangleVertices[(e + 1) % 3];
+            if ((y < a.y() && y < b.y()) || (y > a.y() && y > b.y()) || a.y() == b.y()) continue;
+            float x = a.x() + (y - a.y()) * (b.x() - a.x()) / (b.y() - a.y());
+            xMin = std::min(xMin, x);
+            xMax = std::max(xMax, x);
         }
+        if (xMin > xMax) continue;
+
+        const int first = std::max(0, static_cast<int>(std::ceil((xMin - triangleCacheRect.left()) * dpr - 0.5f)));
+        const int last = std::min(triangleCache.width() - 1, static_cast<int>(std::floor((xMax - triangleCacheRect.left()) * dpr - 0.5f)));
+        if (first > last) continue;
+
+        const QPointF start = QPointF(triangleCacheRect.left() + (first + 0.5f) / dpr, y) - white;
+        float u = QPointF::dotProduct(pureAxis, start);
+        float v = QPointF::dotProduct(blackAxis, start);
+
+        const int count = last - first + 1;
+        for (int i = 0; i < count; ++i) {
+            saturations[i] = std::clamp(u, 0.0f, 1.0f);
+            values[i] = std::clamp(1.0f - v, 0.0f, 1.0f); // white + pure hue weights
+            u += duStep;
+            v += dvStep;
+        }
+
+        QRgb* row = reinterpret_cast<QRgb*>(triangleCache.scanLine(py));
+        ColorSpace::hsvToPremultipliedRGBA8(hues.data(), saturations.data(), values.data(), nullptr, row + first, count);
     }
+}
 
-    // Draw the image
-    painter.drawImage(triangleBounds.topLeft(), triangleImage);
+QRect HSVColorPicker::indicatorsRect()
+{
+    // Matches drawIndicators: 6px and 5px circles with a 3px pen
+    float hueAngle = qDegreesToRadians(currentHue - 90.0f);
+    QPointF huePoint = center + QPointF((innerRadius + outerRadius) * 0.5f * cos(hueAngle),
+        (innerRadius + outerRadius) * 0.5f * sin(hueAngle));
+    QPointF svPoint = getSVPointInTriangle(currentSaturation, currentValue);
 
-    // Draw triangle outline
-    painter.setPen(QPen(Qt::black, 2));
-    painter.setBrush(Qt::NoBrush);
-    painter.drawPath(trianglePath);
+    QRectF hueRect(huePoint - QPointF(9, 9), QSizeF(18, 18));
+    QRectF svRect(svPoint - QPointF(8, 8), QSizeF(16, 16));
+    return hueRect.united(svRect).toAlignedRect();
 }
 
 void HSVColorPicker::drawIndicators(QPainter& painter)
@@ -245,26 +340,33 @@ QPair<float, float> HSVColorPicker::getSVFromTrianglePoint(const QPointF& point)
 void HSVColorPicker::resizeEvent(QResizeEvent* event)
 {
     calculateGeometry();
+    invalidateCaches();
     QWidget::resizeEvent(event);
 }
 
 void HSVColorPicker::updateColorFromWheel(const QPointF& point)
 {
+    QRect before = indicatorsRect();
     currentHue = getAngleFromPoint(point);
     // Triangle stays static - no need to update vertices
     currentColor = hsvToRgb(currentHue, currentSaturation, currentValue);
     emit colorChanged(currentColor);
-    update();
+
+    // New hue means a new triangle fill, the wheel itself is unchanged
+    update(before.united(indicatorsRect()).united(triangleCacheRect.adjusted(-2, -2, 2, 2)));
 }
 
 void HSVColorPicker::updateColorFromTriangle(const QPointF& point)
 {
+    QRect before = indicatorsRect();
     auto [s, v] = getSVFromTrianglePoint(point);
     currentSaturation = std::clamp(s, 0.0f, 1.0f);
     currentValue = std::clamp(v, 0.0f, 1.0f);
     currentColor = hsvToRgb(currentHue, currentSaturation, currentValue);
     emit colorChanged(currentColor);
-    update();
+
+    // Only the SV indicator moved, the cached layers are blitted back underneath it
+    update(before.united(indicatorsRect()));
 }
 
 bool HSVColorPicker::isPointInWheel(const QPointF& point)
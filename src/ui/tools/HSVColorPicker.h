@@ -6,6 +6,7 @@
 #include <QMouseEvent>
 #include <QColor>
 #include <QPainter>
+#include <QImage>
 #include <QPointF>
 #include <cmath>
 
@@ -47,12 +48,23 @@ private:
     bool draggingWheel;
     bool draggingTriangle;
 
+    // Cached layers, painted at device resolution. The wheel only depends on the size,
+    // the triangle on size and hue, so moving an indicator just blits them again.
+    QImage wheelCache;
+    QImage triangleCache;
+    QRect triangleCacheRect; // widget coords
+    float triangleCacheHue = -1.0f;
+
     // Helper methods
     void calculateGeometry();
     void calculateTriangleVertcies();
     void drawColorWheel(QPainter& painter);
     void drawHSVTriangle(QPainter& painter);
     void drawIndicators(QPainter& painter);
+    void rebuildWheelCache();
+    void rebuildTriangleCache();
+    void invalidateCaches();
+    QRect indicatorsRect(); // both indicators, for partial repaints
 
     float getAngleFromPoint(const QPointF& point);
     QPointF getPointOnWheel(float angle);
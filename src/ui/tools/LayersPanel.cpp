@@ -0,0 +1,142 @@
+#include "LayersPanel.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QLabel>
+#include <QSignalBlocker>
+
+LayersPanel::LayersPanel(QWidget* parent)
+    : QWidget(parent)
+{
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(5, 5, 5, 5);
+
+    QLabel* title = new QLabel("Layers");
+    title->setStyleSheet("QLabel { font-weight: bold; font-size: 14px; color: #333; }");
+    title->setAlignment(Qt::AlignCenter);
+    layout->addWidget(title);
+
+    layerList = new QListWidget();
+    layout->addWidget(layerList, 1);
+
+    QHBoxLayout* buttonLayout = new QHBoxLayout();
+    QPushButton* addButton = new QPushButton("Add");
+    QPushButton* removeButton = new QPushButton("Delete");
+    QPushButton* upButton = new QPushButton("Up");
+    QPushButton* downButton = new QPushButton("Down");
+    buttonLayout->addWidget(addButton);
+    buttonLayout->addWidget(removeButton);
+    buttonLayout->addWidget(upButton);
+    buttonLayout->addWidget(downButton);
+    layout->addLayout(buttonLayout);
+
+    QLabel* opacityLabel = new QLabel("Opacity:");
+    opacityLabel->setStyleSheet("QLabel { font-weight: bold; color: #333; }");
+    layout->addWidget(opacityLabel);
+
+    opacitySlider = new QSlider(Qt::Horizontal);
+    opacitySlider->setRange(0, 100);
+    opacitySlider->setValue(100);
+    layout->addWidget(opacitySlider);
+
+    QLabel* blendLabel = new QLabel("Blend Mode:");
+    blendLabel->setStyleSheet("QLabel { font-weight: bold; color: #333; }");
+    layout->addWidget(blendLabel);
+
+    blendCombo = new QComboBox();
+    blendCombo->addItem("Normal", static_cast<int>(BlendMode::Normal));
+    blendCombo->addItem("Multiply", static_cast<int>(BlendMode::Multiply));
+    blendCombo->addItem("Screen", static_cast<int>(BlendMode::Screen));
+    blendCombo->addItem("Add", static_cast<int>(BlendMode::Add));
+    layout->addWidget(blendCombo);
+
+    connect(addButton, &QPushButton::clicked, this, &LayersPanel::addRequested);
+    connect(removeButton, &QPushButton::clicked, [this]() {
+        int id = selectedLayerId();
+        if (id >= 0) emit removeRequested(id);
+    });
+    connect(upButton, &QPushButton::clicked, [this]() {
+        int id = selectedLayerId();
+        if (id >= 0) emit moveRequested(id, 1);
+    });
+    connect(downButton, &QPushButton::clicked, [this]() {
+        int id = selectedLayerId();
+        if (id >= 0) emit moveRequested(id, -1);
+    });
+
+    connect(layerList, &QListWidget::currentItemChanged, [this](QListWidgetItem* current) {
+        if (!current) return;
+        syncControls();
+        emit activeLayerChanged(current->data(Qt::UserRole).toInt());
+    });
+    connect(layerList, &QListWidget::itemChanged, [this](QListWidgetItem* item) {
+        int id = item->data(Qt::UserRole).toInt();
+        if (Layer* layer = findLayer(id)) {
+            layer->visible = item->checkState() == Qt::Checked;
+            emit visibilityChanged(id, layer->visible);
+        }
+    });
+    connect(opacitySlider, &QSlider::valueChanged, [this](int value) {
+        int id = selectedLayerId();
+        if (Layer* layer = findLayer(id)) {
+            layer->opacity = value / 100.0f;
+            emit opacityChanged(id, layer->opacity);
+        }
+    });
+    connect(blendCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+        int id = selectedLayerId();
+        if (Layer* layer = findLayer(id)) {
+            layer->blendMode = static_cast<BlendMode>(blendCombo->itemData(index).toInt());
+            emit blendModeChanged(id, layer->blendMode);
+        }
+    });
+}
+
+void LayersPanel::setLayers(const QVector<Layer>& layers, int activeId)
+{
+    QSignalBlocker blocker(layerList);
+    currentLayers = layers;
+    layerList->clear();
+
+    for (int i = layers.size() - 1; i >= 0; --i) {
+        const Layer& layer = layers[i];
+        QListWidgetItem* item = new QListWidgetItem(layer.name, layerList);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(layer.visible ? Qt::Checked : Qt::Unchecked);
+        item->setData(Qt::UserRole, layer.id);
+        if (layer.id == activeId) {
+            layerList->setCurrentItem(item);
+        }
+    }
+
+    syncControls();
+}
+
+int LayersPanel::selectedLayerId() const
+{
+    QListWidgetItem* item = layerList->currentItem();
+    return item ? item->data(Qt::UserRole).toInt() : -1;
+}
+
+Layer* LayersPanel::findLayer(int id)
+{
+    for (Layer& layer : currentLayers) {
+        if (layer.id == id) return &layer;
+    }
+    return nullptr;
+}
+
+void LayersPanel::syncControls()
+{
+    // Show the selected layer's settings without echoing them back as changes
+    int id = selectedLayerId();
+    for (const Layer& layer : currentLayers) {
+        if (layer.id != id) continue;
+
+        QSignalBlocker opacityBlocker(opacitySlider);
+        QSignalBlocker blendBlocker(blendCombo);
+        opacitySlider->setValue(qRound(layer.opacity * 100.0f));
+        blendCombo->setCurrentIndex(blendCombo->findData(static_cast<int>(layer.blendMode)));
+        break;
+    }
+}
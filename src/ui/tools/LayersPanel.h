@@ -0,0 +1,41 @@
+#ifndef LAYERSPANEL_H
+#define LAYERSPANEL_H
+
+#include <QWidget>
+#include <QListWidget>
+#include <QSlider>
+#include <QComboBox>
+#include <QVector>
+#include "../../data/Layer.h"
+
+class LayersPanel : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit LayersPanel(QWidget* parent = nullptr);
+
+    // Rebuilds the list, top layer first like every other paint program
+    void setLayers(const QVector<Layer>& layers, int activeId);
+
+signals:
+    void addRequested();
+    void removeRequested(int id);
+    void moveRequested(int id, int delta);
+    void activeLayerChanged(int id);
+    void visibilityChanged(int id, bool visible);
+    void opacityChanged(int id, float opacity);
+    void blendModeChanged(int id, BlendMode mode);
+
+private:
+    QListWidget* layerList;
+    QSlider* opacitySlider;
+    QComboBox* blendCombo;
+    QVector<Layer> currentLayers;
+
+    int selectedLayerId() const;
+    Layer* findLayer(int id);
+    void syncControls();
+};
+
+#endif // LAYERSPANEL_H
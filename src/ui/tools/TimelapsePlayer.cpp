@@ -0,0 +1,185 @@
+#include "TimelapsePlayer.h"
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QResizeEvent>
+#include <QPixmap>
+#include <QDebug>
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+namespace {
+
+QString formatTime(qint64 ms) {
+    qint64 s = ms / 1000;
+    return s >= 3600
+        ? QString("%1:%2:%3").arg(s / 3600).arg(s / 60 % 60, 2, 10, QChar('0')).arg(s % 60, 2, 10, QChar('0'))
+        : QString("%1:%2").arg(s / 60).arg(s % 60, 2, 10, QChar('0'));
+}
+
+constexpr int tickMs = 33;
+
+} // namespace
+
+TimelapsePlayer::TimelapsePlayer(const TimelapseDocument& snapshot, QWidget* parent)
+    : QDialog(parent)
+    , document(snapshot)
+{
+    setWindowTitle("Timelapse");
+    resize(900, 600);
+
+    timelapse.setDocument(document);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+
+    view = new QLabel();
+    view->setAlignment(Qt::AlignCenter);
+    view->setMinimumSize(320, 200);
+    view->setSizePolicy(QSizePolicy::Ignored, QSizePolicy::Ignored);
+    layout->addWidget(view, 1);
+
+    seekSlider = new QSlider(Qt::Horizontal);
+    seekSlider->setRange(0, static_cast<int>(std::min<qint64>(timelapse.duration(), std::numeric_limits<int>::max())));
+    layout->addWidget(seekSlider);
+
+    QHBoxLayout* controls = new QHBoxLayout();
+    playButton = new QPushButton("Play");
+    speedSelect = new QComboBox();
+    for (int speed : { 1, 4, 16, 60, 240 }) {
+        speedSelect->addItem(QString("%1x").arg(speed), speed);
+    }
+    speedSelect->setCurrentIndex(2);
+    timeLabel = new QLabel();
+    exportButton = new QPushButton("Export frames...");
+
+    controls->addWidget(playButton);
+    controls->addWidget(speedSelect);
+    controls->addWidget(timeLabel);
+    controls->addStretch();
+    controls->addWidget(exportButton);
+    layout->addLayout(controls);
+
+    playTimer.setInterval(tickMs);
+    connect(&playTimer, &QTimer::timeout, this, &TimelapsePlayer::tick);
+    connect(playButton, &QPushButton::clicked, [this]() {
+        if (playTimer.isActive()) {
+            playTimer.stop();
+        }
+        else {
+            if (position >= timelapse.duration()) seek(0);
+            playTimer.start();
+        }
+        playButton->setText(playTimer.isActive() ? "Pause" : "Play");
+    });
+    connect(seekSlider, &QSlider::sliderMoved, [this](int value) { seek(value); });
+    connect(exportButton, &QPushButton::clicked, this, &TimelapsePlayer::startExport);
+
+    exportPoll.setInterval(200);
+    connect(&exportPoll, &QTimer::timeout, [this]() {
+        int total = exportTotal.load();
+        if (total > 0) {
+            exportButton->setText(QString("Cancel export (%1%)").arg(100ll * exportDone.load() / total));
+        }
+    });
+
+    seek(timelapse.duration()); // open on the finished picture, fills the checkpoints on the way
+}
+
+TimelapsePlayer::~TimelapsePlayer() {
+    if (exportThread) {
+        exportCancel = true;
+        exportThread->wait();
+        delete exportThread;
+    }
+}
+
+double TimelapsePlayer::speed() const {
+    return speedSelect->currentData().toDouble();
+}
+
+void TimelapsePlayer::seek(qint64 ms) {
+    position = std::clamp<qint64>(ms, 0, timelapse.duration());
+    showFrame();
+}
+
+void TimelapsePlayer::tick() {
+    position += static_cast<qint64>(tickMs * speed());
+    if (position >= timelapse.duration()) {
+        position = timelapse.duration();
+        playTimer.stop();
+        playButton->setText("Play");
+    }
+    showFrame();
+}
+
+void TimelapsePlayer::showFrame() {
+    shown = timelapse.frameAt(position);
+    view->setPixmap(QPixmap::fromImage(shown).scaled(view->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+
+    seekSlider->blockSignals(true);
+    seekSlider->setValue(static_cast<int>(position));
+    seekSlider->blockSignals(false);
+    timeLabel->setText(formatTime(position) + " / " + formatTime(timelapse.duration()));
+
+#ifdef QT_DEBUG
+    const TimelapseStats& stats = timelapse.getStats();
+    if (stats.lastSeekStrokes > 100) {
+        qDebug() << "[Timelapse] seek replayed" << stats.lastSeekStrokes << "strokes in" << stats.lastFrameMs << "ms,"
+                 << stats.checkpoints << "checkpoints," << stats.checkpointBytes / (1024 * 1024) << "MB";
+    }
+#endif
+}
+
+void TimelapsePlayer::resizeEvent(QResizeEvent* event) {
+    QDialog::resizeEvent(event);
+    if (!shown.isNull()) {
+        view->setPixmap(QPixmap::fromImage(shown).scaled(view->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    }
+}
+
+void TimelapsePlayer::startExport() {
+    if (exportThread) {
+        exportCancel = true; // the button is Cancel while an export runs
+        return;
+    }
+
+    QString dir = QFileDialog::getExistingDirectory(this, "Export frames to");
+    if (dir.isEmpty()) return;
+
+    TimelapseExportOptions options;
+    options.speed = speed();
+    exportCancel = false;
+    exportDone = 0;
+    exportTotal = 0;
+
+    // Results go through the shared pointer, read once the thread has finished
+    auto result = std::make_shared<QString>();
+    exportThread = QThread::create([this, dir, options, result]() {
+        Timelapse exporter;
+        exporter.setDocument(document);
+        bool ok = exporter.exportFrames(dir, options, &exportCancel, [this](int done, int total) {
+            exportDone = done;
+            exportTotal = total;
+        });
+        if (!ok) *result = exporter.errorString();
+    });
+
+    connect(exportThread, &QThread::finished, this, [this, dir, result]() {
+        exportPoll.stop();
+        exportThread->deleteLater();
+        exportThread = nullptr;
+        exportButton->setText("Export frames...");
+        if (!result->isEmpty() && !exportCancel) {
+            QMessageBox::warning(this, "Timelapse", *result);
+        }
+        else if (result->isEmpty()) {
+            QMessageBox::information(this, "Timelapse", QString("Wrote %1 frames to %2").arg(exportTotal.load()).arg(dir));
+        }
+    });
+
+    exportButton->setText("Cancel export");
+    exportPoll.start();
+    exportThread->start();
+}
@@ -0,0 +1,55 @@
+#ifndef TIMELAPSEPLAYER_H
+#define TIMELAPSEPLAYER_H
+
+#include <QDialog>
+#include <QLabel>
+#include <QSlider>
+#include <QComboBox>
+#include <QPushButton>
+#include <QTimer>
+#include <QThread>
+#include <atomic>
+#include "../../core/Timelapse.h"
+
+// Plays back a snapshot of the document and exports it as an image sequence.
+// The export replays its own copy on a worker thread, playback keeps working meanwhile.
+class TimelapsePlayer : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit TimelapsePlayer(const TimelapseDocument& document, QWidget* parent = nullptr);
+    ~TimelapsePlayer();
+
+protected:
+    void resizeEvent(QResizeEvent* event) override;
+
+private:
+    TimelapseDocument document;
+    Timelapse timelapse;
+    qint64 position = 0; // timeline ms
+
+    QLabel* view;
+    QLabel* timeLabel;
+    QSlider* seekSlider;
+    QComboBox* speedSelect;
+    QPushButton* playButton;
+    QPushButton* exportButton;
+    QTimer playTimer;
+    QImage shown;
+
+    // Export
+    QThread* exportThread = nullptr;
+    std::atomic<bool> exportCancel{ false };
+    std::atomic<int> exportDone{ 0 };
+    std::atomic<int> exportTotal{ 0 };
+    QTimer exportPoll;
+
+    void seek(qint64 ms);
+    void tick();
+    void showFrame();
+    void startExport();
+    double speed() const;
+};
+
+#endif // TIMELAPSEPLAYER_H
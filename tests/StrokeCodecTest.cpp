@@ -0,0 +1,94 @@
+// Round trips through StrokeCodec and StrokeSnapshot. Exits non-zero on the first
+// mismatch, run by ctest.
+#include <QVector>
+#include <QTime>
+#include <cmath>
+#include <cstdio>
+#include "core/StrokeCodec.h"
+#include "core/StrokeSnapshot.h"
+
+namespace {
+
+int failures = 0;
+constexpr float epsilon = 1e-4f; // float rounding of the input on top of the quantization, an ulp is 6e-5 near 1000
+
+void check(bool ok, const char* what, int index = -1) {
+    if (ok) return;
+    failures++;
+    if (index >= 0) std::fprintf(stderr, "FAIL %s (point %d)\n", what, index);
+    else std::fprintf(stderr, "FAIL %s\n", what);
+}
+
+// A wobbly pen stroke, deterministic
+QVector<StrokePoint> makeStroke(int count, bool timed, bool uniformColor, int startMs = 12 * 3600 * 1000) {
+    QVector<StrokePoint> points;
+    for (int i = 0; i < count; ++i) {
+        StrokePoint p;
+        p.pos = QPointF(100.0 + i * 1.37 + std::sin(i * 0.3) * 4.1, 50.0 - i * 0.71 + std::cos(i * 0.17) * 7.3);
+        p.pressure = 0.5f + 0.5f * static_cast<float>(std::sin(i * 0.05));
+        p.thickness = 2.0f + 6.0f * p.pressure;
+        p.opacity = 0.25f + 0.75f * p.pressure;
+        p.strokeTime = timed ? QTime::fromMSecsSinceStartOfDay((startMs + i * 7) % (24 * 3600 * 1000)) : QTime();
+        p.r = uniformColor ? 0.2f : i / float(count);
+        p.g = 0.4f;
+        p.b = uniformColor ? 0.6f : 1.0f - i / float(count);
+        points.append(p);
+    }
+    return points;
+}
+
+// What the codec promises: positions within 1/32 px, the rest within half a step, colors
+// and times exact
+void compare(const QVector<StrokePoint>& in, const QVector<StrokePoint>& out, const char* what) {
+    check(in.size() == out.size(), what);
+    if (in.size() != out.size()) return;
+    for (int i = 0; i < in.size(); ++i) {
+        const StrokePoint& a = in[i];
+        const StrokePoint& b = out[i];
+        check(std::abs(a.pos.x() - b.pos.x()) <= 1.0 / 32 + epsilon && std::abs(a.pos.y() - b.pos.y()) <= 1.0 / 32 + epsilon, what, i);
+        check(std::abs(a.thickness - b.thickness) <= 0.5f / 64 + epsilon, what, i);
+        check(std::abs(a.pressure - b.pressure) <= 0.5f / 4095 + epsilon, what, i);
+        check(std::abs(a.opacity - b.opacity) <= 0.5f / 255 + epsilon, what, i);
+        check(a.r == b.r && a.g == b.g && a.b == b.b, what, i);
+        check(a.strokeTime == b.strokeTime, what, i);
+    }
+}
+
+void roundTrip(const QVector<StrokePoint>& points, const char* what) {
+    QVector<StrokePoint> decoded;
+    check(StrokeCodec::decode(StrokeCodec::encode(points), decoded), what);
+    compare(points, decoded, what);
+    check(StrokeCodec::pointCount(StrokeCodec::encode(points)) == points.size(), what);
+}
+
+} // namespace
+
+int main() {
+    roundTrip({}, "empty stroke");
+    roundTrip(makeStroke(1, true, true), "single point");
+    roundTrip(makeStroke(2000, true, true), "timed, one color");
+    roundTrip(makeStroke(500, false, false), "untimed, color per point");
+    roundTrip(makeStroke(300, true, true, 24 * 3600 * 1000 - 1000), "past midnight");
+
+    // Garbage and truncated data are refused, not read past the end
+    QVector<StrokePoint> decoded;
+    const QByteArray packed = StrokeCodec::encode(makeStroke(100, true, true));
+    check(!StrokeCodec::decode(packed.left(packed.size() / 2), decoded), "truncated stroke");
+    check(!StrokeCodec::decode(QByteArray("\xff\xff\xff\xff\xff\xff", 6), decoded), "garbage count");
+
+    // A snapshot hands out hot strokes as they are and decodes packed ones into the scratch
+    const QVector<StrokePoint> hot = makeStroke(50, true, true);
+    const QVector<StrokePoint> cold = makeStroke(80, true, false);
+    StrokeRecord hotRecord, coldRecord;
+    hotRecord.points = hot;
+    coldRecord.packed = StrokeCodec::encode(cold);
+    const StrokeSnapshot snapshot({ hotRecord, coldRecord });
+    QVector<StrokePoint> scratch;
+    check(snapshot.size() == 2, "snapshot size");
+    check(&snapshot.pointsOf(0, scratch) != &scratch && scratch.isEmpty(), "hot stroke not decoded");
+    check(&snapshot.pointsOf(1, scratch) == &scratch, "cold stroke decoded into the scratch");
+    compare(cold, scratch, "snapshot cold stroke");
+
+    if (failures == 0) std::printf("StrokeCodec: all round trips passed\n");
+    return failures == 0 ? 0 : 1;
+}